@@ -1,5 +1,8 @@
 #include "address.h"
+#include "config.h"
+#include "dns.h"
 #include "endian.h"
+#include "iomanager.h"
 #include <sstream>
 #include <netdb.h>
 #include <ifaddrs.h>
@@ -10,6 +13,43 @@ namespace server{
 
 static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
 
+static server::ConfigVar<bool>::ptr g_dns_async =
+    server::Config::AddData("dns.async", true, "resolve host by DnsResolver in IOManager");
+
+//在IOManager中用DnsResolver解析，getaddrinfo会阻塞整个线程
+//fallback为true表示不是DNS的问题（服务名无法转换成端口），交给getaddrinfo处理
+static bool AsyncLookup(std::vector<Address::ptr> &result, const std::string &node, const char *service, int family, bool &fallback){
+    uint16_t port = 0;
+    if (service && *service){
+        char *end = nullptr;
+        long v = strtol(service, &end, 10);
+        if (*end == '\0' && v >= 0 && v <= 65535){
+            port = (uint16_t)v;
+        }
+        else{
+            servent *ent = getservbyname(service, NULL);
+            if (!ent){
+                fallback = true;
+                return false;
+            }
+            port = byteswapOnLittleEndian((uint16_t)ent->s_port);
+        }
+    }
+    std::vector<IPAddress::ptr> addrs;
+    //服务器没有应答时resolve内部已经退回过getaddrinfo，失败表示域名不存在，不需要再阻塞查询一次
+    if (!DnsResolverMgr::GetInstance()->resolve(node, addrs, family)){
+        LOG_WARN(g_logger) << "Address::Lookup resolve(" << node << ", " << family << ") fail";
+        return false;
+    }
+    for (auto& i : addrs){
+        //缓存中的地址是共享的，复制一份再设置端口
+        IPAddress::ptr addr = std::dynamic_pointer_cast<IPAddress>(Address::Create(i->getAddr(), i->getAddrLen()));
+        addr->setPort(port);
+        result.push_back(addr);
+    }
+    return true;
+}
+
 template<class T>
 static T createMask(uint32_t prefix){
     return (1 << (sizeof(T) * 8 - prefix) - 1);
@@ -66,6 +106,17 @@ bool Address::Lookup(std::vector<Address::ptr> &result, const std::string &host,
     if (node.empty()){
         node = host;
     }
+    //没有配置DNS服务器时用getaddrinfo，nsswitch中的其他来源也能生效
+    if (g_dns_async->getVal() && IOManager::GetThis()
+        && !DnsResolverMgr::GetInstance()->getServers().empty()){
+        bool fallback = false;
+        if (AsyncLookup(result, node, service, family, fallback)){
+            return true;
+        }
+        if (!fallback){
+            return false;
+        }
+    }
     int error = getaddrinfo(node.c_str(), service, &hints, &results);
     if (error){
         LOG_ERROR(g_logger) << "Address::Lookup getaddress(" << host << ", "
@@ -0,0 +1,451 @@
+#include "dns.h"
+#include "config.h"
+#include "log.h"
+#include "socket.h"
+#include "util.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <netdb.h>
+#include <sstream>
+#include <string.h>
+
+namespace server{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+static server::ConfigVar<std::vector<std::string>>::ptr g_dns_servers =
+    server::Config::AddData("dns.servers", std::vector<std::string>(), "dns servers, empty for /etc/resolv.conf");
+
+static server::ConfigVar<std::string>::ptr g_dns_hosts_file =
+    server::Config::AddData("dns.hosts_file", std::string("/etc/hosts"), "dns hosts file");
+
+static server::ConfigVar<uint32_t>::ptr g_dns_timeout =
+    server::Config::AddData("dns.timeout", (uint32_t)2000, "dns query timeout(ms) per server");
+
+static server::ConfigVar<uint32_t>::ptr g_dns_attempts =
+    server::Config::AddData("dns.attempts", (uint32_t)2, "dns query attempts");
+
+static server::ConfigVar<uint32_t>::ptr g_dns_max_ttl =
+    server::Config::AddData("dns.max_ttl", (uint32_t)300, "dns cache max ttl(s)");
+
+static server::ConfigVar<uint32_t>::ptr g_dns_negative_ttl =
+    server::Config::AddData("dns.negative_ttl", (uint32_t)5, "dns negative cache ttl(s)");
+
+static server::ConfigVar<uint32_t>::ptr g_dns_cache_size =
+    server::Config::AddData("dns.cache_size", (uint32_t)4096, "dns max cached names");
+
+enum DnsType{
+    DNS_TYPE_A = 1,
+    DNS_TYPE_AAAA = 28,
+};
+
+static std::atomic<uint16_t> s_dns_id = {0};
+
+static std::string NormalizeName(const std::string &name){
+    std::string ret = name;
+    while (!ret.empty() && ret.back() == '.'){
+        ret.pop_back();
+    }
+    std::transform(ret.begin(), ret.end(), ret.begin(), ::tolower);
+    return ret;
+}
+
+static bool FamilyMatch(const IPAddress::ptr &addr, int family){
+    return family == AF_UNSPEC || addr->getFamily() == family;
+}
+
+DnsResolver::DnsResolver(){
+    loadServers();
+    loadHosts(g_dns_hosts_file->getVal());
+    g_dns_servers->addListen(0x646e7331, [this](const std::vector<std::string> &old_value, const std::vector<std::string> &new_value){
+        loadServers();
+    });
+    g_dns_hosts_file->addListen(0x646e7332, [this](const std::string &old_value, const std::string &new_value){
+        loadHosts(new_value);
+    });
+}
+
+void DnsResolver::loadServers(){
+    std::vector<std::string> names = g_dns_servers->getVal();
+    if (names.empty()){
+        std::ifstream ifs("/etc/resolv.conf");
+        std::string line;
+        while (std::getline(ifs, line)){
+            std::stringstream ss(line);
+            std::string key, val;
+            ss >> key >> val;
+            if (key == "nameserver" && !val.empty()){
+                names.push_back(val);
+            }
+        }
+    }
+    std::vector<Address::ptr> servers;
+    for (auto& i : names){
+        //支持ip和ip:port两种写法
+        std::string ip = i;
+        uint16_t port = 53;
+        size_t pos = i.rfind(':');
+        if (pos != std::string::npos && i.find(':') == pos){
+            ip = i.substr(0, pos);
+            port = atoi(i.c_str() + pos + 1);
+        }
+        IPAddress::ptr addr = IPAddress::Create(ip.c_str(), port);
+        if (!addr){
+            LOG_WARN(g_logger) << "invalid dns server: " << i;
+            continue;
+        }
+        servers.push_back(addr);
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    m_servers.swap(servers);
+}
+
+void DnsResolver::setServers(const std::vector<Address::ptr> &servers){
+    if (servers.empty()){
+        loadServers();
+        return;
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    m_servers = servers;
+}
+
+std::vector<Address::ptr> DnsResolver::getServers(){
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_servers;
+}
+
+bool DnsResolver::loadHosts(const std::string &path){
+    std::ifstream ifs(path);
+    if (!ifs){
+        LOG_WARN(g_logger) << "load hosts file fail: " << path;
+        return false;
+    }
+    std::unordered_map<std::string, std::vector<IPAddress::ptr>> hosts;
+    std::string line;
+    while (std::getline(ifs, line)){
+        size_t pos = line.find('#');
+        if (pos != std::string::npos){
+            line.resize(pos);
+        }
+        std::stringstream ss(line);
+        std::string ip, name;
+        if (!(ss >> ip)){
+            continue;
+        }
+        IPAddress::ptr addr = IPAddress::Create(ip.c_str());
+        if (!addr){
+            continue;
+        }
+        while (ss >> name){
+            hosts[NormalizeName(name)].push_back(addr);
+        }
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    m_hosts.swap(hosts);
+    return true;
+}
+
+void DnsResolver::clearCache(){
+    RWMutexType::WriteLock lock(m_mutex);
+    m_cache.clear();
+}
+
+size_t DnsResolver::getCacheSize(){
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_cache.size();
+}
+
+bool DnsResolver::lookupHosts(const std::string &name, std::vector<IPAddress::ptr> &result, int family){
+    RWMutexType::ReadLock lock(m_mutex);
+    auto it = m_hosts.find(name);
+    if (it == m_hosts.end()){
+        return false;
+    }
+    for (auto& i : it->second){
+        if (FamilyMatch(i, family)){
+            result.push_back(i);
+        }
+    }
+    return !result.empty();
+}
+
+//查询报文：header + QNAME + QTYPE + QCLASS
+static bool BuildQuery(std::string &buf, uint16_t id, const std::string &name, uint16_t qtype){
+    buf.clear();
+    uint8_t header[12] = {0};
+    header[0] = id >> 8;
+    header[1] = id & 0xFF;
+    //RD，需要递归查询
+    header[2] = 0x01;
+    //QDCOUNT = 1
+    header[5] = 1;
+    buf.append((char *)header, sizeof(header));
+    size_t pos = 0;
+    while (pos < name.size()){
+        size_t end = name.find('.', pos);
+        if (end == std::string::npos){
+            end = name.size();
+        }
+        size_t len = end - pos;
+        if (len == 0 || len > 63){
+            return false;
+        }
+        buf.push_back((char)len);
+        buf.append(name, pos, len);
+        pos = end + 1;
+    }
+    buf.push_back('\0');
+    if (buf.size() - sizeof(header) > 255){
+        return false;
+    }
+    buf.push_back((char)(qtype >> 8));
+    buf.push_back((char)(qtype & 0xFF));
+    //QCLASS = IN
+    buf.push_back('\0');
+    buf.push_back('\1');
+    return true;
+}
+
+//跳过一个可能带压缩指针的域名
+static bool SkipName(const uint8_t *data, size_t len, size_t &pos){
+    while (pos < len){
+        uint8_t l = data[pos];
+        if (l == 0){
+            ++pos;
+            return true;
+        }
+        if ((l & 0xC0) == 0xC0){
+            pos += 2;
+            return pos <= len;
+        }
+        pos += l + 1;
+    }
+    return false;
+}
+
+static uint16_t ReadUint16(const uint8_t *p){
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t ReadUint32(const uint8_t *p){
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+//返回-1表示报文无效，0表示应答有效
+static int ParseResponse(const uint8_t *data, size_t len, uint16_t id, uint16_t qtype
+                         , std::vector<IPAddress::ptr> &result, uint32_t &ttl, bool &nxdomain){
+    if (len < 12 || ReadUint16(data) != id || !(data[2] & 0x80)){
+        return -1;
+    }
+    uint8_t rcode = data[3] & 0x0F;
+    if (rcode == 3){
+        nxdomain = true;
+        return 0;
+    }
+    if (rcode != 0){
+        return -1;
+    }
+    uint16_t qdcount = ReadUint16(data + 4);
+    uint16_t ancount = ReadUint16(data + 6);
+    size_t pos = 12;
+    for (uint16_t i = 0; i < qdcount; ++i){
+        if (!SkipName(data, len, pos) || pos + 4 > len){
+            return -1;
+        }
+        pos += 4;
+    }
+    ttl = UINT32_MAX;
+    for (uint16_t i = 0; i < ancount; ++i){
+        if (!SkipName(data, len, pos) || pos + 10 > len){
+            return -1;
+        }
+        uint16_t type = ReadUint16(data + pos);
+        uint16_t cls = ReadUint16(data + pos + 2);
+        uint32_t rttl = ReadUint32(data + pos + 4);
+        uint16_t rdlen = ReadUint16(data + pos + 8);
+        pos += 10;
+        if (pos + rdlen > len){
+            return -1;
+        }
+        //CNAME等其他记录跳过，递归服务器会把最终的A/AAAA记录一起返回
+        if (cls == 1 && type == qtype){
+            if (type == DNS_TYPE_A && rdlen == 4){
+                sockaddr_in addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin_family = AF_INET;
+                memcpy(&addr.sin_addr, data + pos, 4);
+                result.push_back(std::make_shared<IPv4Address>(addr));
+                ttl = std::min(ttl, rttl);
+            }
+            else if (type == DNS_TYPE_AAAA && rdlen == 16){
+                sockaddr_in6 addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin6_family = AF_INET6;
+                memcpy(&addr.sin6_addr, data + pos, 16);
+                result.push_back(std::make_shared<IPv6Address>(addr));
+                ttl = std::min(ttl, rttl);
+            }
+        }
+        pos += rdlen;
+    }
+    if (result.empty()){
+        ttl = 0;
+    }
+    return 0;
+}
+
+bool DnsResolver::query(const std::string &name, uint16_t qtype, std::vector<IPAddress::ptr> &result
+                        , uint32_t &ttl, bool &nxdomain){
+    std::vector<Address::ptr> servers = getServers();
+    if (servers.empty()){
+        LOG_WARN(g_logger) << "DnsResolver no dns server";
+        return false;
+    }
+    uint16_t id = (uint16_t)(++s_dns_id ^ server::GetCurrentUS());
+    std::string packet;
+    if (!BuildQuery(packet, id, name, qtype)){
+        LOG_WARN(g_logger) << "DnsResolver invalid name: " << name;
+        nxdomain = true;
+        return true;
+    }
+    uint8_t buf[4096];
+    uint32_t attempts = g_dns_attempts->getVal();
+    for (uint32_t n = 0; n < attempts; ++n){
+        for (auto& server : servers){
+            //connect之后只会收到这个服务器的应答
+            Socket::ptr sock = Socket::CreateUDP(server);
+            if (!sock->connect(server)){
+                continue;
+            }
+            sock->setRecvTimeout(g_dns_timeout->getVal());
+            if (sock->send(packet.c_str(), packet.size()) != (int)packet.size()){
+                continue;
+            }
+            while (true){
+                int rt = sock->recv(buf, sizeof(buf));
+                if (rt <= 0){
+                    LOG_DEBUG(g_logger) << "DnsResolver query " << name << " from " << server->toString()
+                                        << " fail rt=" << rt << " errno=" << errno;
+                    break;
+                }
+                //id不匹配的报文丢掉继续等
+                if (ParseResponse(buf, rt, id, qtype, result, ttl, nxdomain) == 0){
+                    return true;
+                }
+                result.clear();
+            }
+        }
+    }
+    return false;
+}
+
+bool DnsResolver::SystemLookup(const std::string &name, std::vector<IPAddress::ptr> &result, int family){
+    addrinfo hints, *results;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    //只取一种socktype，否则每个地址会重复出现
+    hints.ai_socktype = SOCK_STREAM;
+    int error = getaddrinfo(name.c_str(), NULL, &hints, &results);
+    if (error){
+        LOG_WARN(g_logger) << "DnsResolver getaddrinfo(" << name << ", " << family << ") err=" << error
+                           << " errstr=" << gai_strerror(error);
+        return false;
+    }
+    for (addrinfo *next = results; next; next = next->ai_next){
+        IPAddress::ptr addr = std::dynamic_pointer_cast<IPAddress>(Address::Create(next->ai_addr, (socklen_t)next->ai_addrlen));
+        if (addr){
+            result.push_back(addr);
+        }
+    }
+    freeaddrinfo(results);
+    return !result.empty();
+}
+
+void DnsResolver::prune(uint64_t now){
+    //先删除所有过期的，还是满的话删除最快过期的一个
+    auto oldest = m_cache.end();
+    for (auto it = m_cache.begin(); it != m_cache.end();){
+        if (it->second.expire <= now){
+            it = m_cache.erase(it);
+            continue;
+        }
+        if (oldest == m_cache.end() || it->second.expire < oldest->second.expire){
+            oldest = it;
+        }
+        ++it;
+    }
+    if (m_cache.size() >= g_dns_cache_size->getVal() && oldest != m_cache.end()){
+        m_cache.erase(oldest);
+    }
+}
+
+bool DnsResolver::resolve(const std::string &host, std::vector<IPAddress::ptr> &result, int family){
+    //数字地址不需要查询
+    IPAddress::ptr numeric = IPAddress::Create(host.c_str());
+    if (numeric){
+        if (!FamilyMatch(numeric, family)){
+            return false;
+        }
+        result.push_back(numeric);
+        return true;
+    }
+    std::string name = NormalizeName(host);
+    if (name.empty()){
+        return false;
+    }
+    if (lookupHosts(name, result, family)){
+        return true;
+    }
+
+    std::string key = name + "/" + std::to_string(family);
+    uint64_t now = server::GetCurrentMS();
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        auto it = m_cache.find(key);
+        if (it != m_cache.end() && it->second.expire > now){
+            result.insert(result.end(), it->second.addrs.begin(), it->second.addrs.end());
+            return !it->second.addrs.empty();
+        }
+    }
+
+    std::vector<IPAddress::ptr> addrs;
+    uint32_t ttl = 0;
+    bool nxdomain = false;
+    bool ok = false;
+    if (family != AF_INET6){
+        ok = query(name, DNS_TYPE_A, addrs, ttl, nxdomain);
+    }
+    if (family != AF_INET && addrs.empty() && !nxdomain){
+        ok = query(name, DNS_TYPE_AAAA, addrs, ttl, nxdomain) || ok;
+    }
+
+    Entry entry;
+    if (!addrs.empty()){
+        ttl = std::min(ttl, g_dns_max_ttl->getVal());
+        entry.expire = now + ttl * 1000;
+    }
+    else{
+        //服务器都没有应答时退回到getaddrinfo，结果没有TTL，和负缓存一样只缓存一小段时间
+        //不存在或者没有记录时不再退回，一段时间内也不再查询
+        if (!ok){
+            SystemLookup(name, addrs, family);
+        }
+        entry.expire = now + g_dns_negative_ttl->getVal() * 1000;
+        if (addrs.empty()){
+            LOG_WARN(g_logger) << "DnsResolver resolve " << name << " fail nxdomain=" << nxdomain << " answered=" << ok;
+        }
+    }
+    entry.addrs = addrs;
+    if (entry.expire > now){
+        RWMutexType::WriteLock lock(m_mutex);
+        if (m_cache.size() >= g_dns_cache_size->getVal() && m_cache.find(key) == m_cache.end()){
+            prune(now);
+        }
+        m_cache[key] = entry;
+    }
+    result.insert(result.end(), addrs.begin(), addrs.end());
+    return !addrs.empty();
+}
+
+}
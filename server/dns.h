@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "address.h"
+#include "mutex.h"
+#include "singleton.h"
+
+namespace server{
+
+//协程版的DNS解析，通过hook后的UDP socket查询，等待应答时只挂起当前协程
+//解析顺序：数字地址 -> hosts文件 -> 缓存 -> DNS服务器，服务器都没有应答时退回到getaddrinfo
+//结果按应答中的TTL缓存，NXDOMAIN和退回getaddrinfo的结果按dns.negative_ttl缓存，最多缓存dns.cache_size个域名
+class DnsResolver{
+public:
+    typedef std::shared_ptr<DnsResolver> ptr;
+    typedef RWMutex RWMutexType;
+
+    DnsResolver();
+
+    //解析域名，result中地址的端口为0，family为AF_INET、AF_INET6或AF_UNSPEC
+    //返回false表示域名不存在或者没有对应的记录，命中负缓存时不会再查询，也不会阻塞在getaddrinfo上
+    bool resolve(const std::string &name, std::vector<IPAddress::ptr> &result, int family = AF_UNSPEC);
+
+    //为空时使用dns.servers，再为空时读取/etc/resolv.conf
+    void setServers(const std::vector<Address::ptr> &servers);
+    std::vector<Address::ptr> getServers();
+    bool loadHosts(const std::string &path);
+    void clearCache();
+    size_t getCacheSize();
+
+private:
+    struct Entry{
+        //为空表示负缓存
+        std::vector<IPAddress::ptr> addrs;
+        uint64_t expire;
+    };
+
+    //向DNS服务器查询一种记录，nxdomain为true表示域名不存在
+    bool query(const std::string &name, uint16_t qtype, std::vector<IPAddress::ptr> &result
+               , uint32_t &ttl, bool &nxdomain);
+    bool lookupHosts(const std::string &name, std::vector<IPAddress::ptr> &result, int family);
+    //DNS服务器都没有应答时用getaddrinfo，会阻塞当前线程，nsswitch中的其他来源也能生效
+    static bool SystemLookup(const std::string &name, std::vector<IPAddress::ptr> &result, int family);
+    void loadServers();
+    //缓存满时删除过期的entry，调用前需要加写锁
+    void prune(uint64_t now);
+
+    RWMutexType m_mutex;
+    std::vector<Address::ptr> m_servers;
+    std::unordered_map<std::string, std::vector<IPAddress::ptr>> m_hosts;
+    std::unordered_map<std::string, Entry> m_cache;
+};
+
+typedef server::Singletion<DnsResolver> DnsResolverMgr;
+
+}
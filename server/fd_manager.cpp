@@ -84,11 +84,14 @@ void FdManager::resizeFds(size_t len){
 }
 
 FdCtx::ptr FdManager::add(int fd){
-    if (fd > m_fds.size()){
-        resizeFds(fd * 1.5);
+    if (fd < 0){
+        return nullptr;
     }
-
+    //扩容和写入要在同一把锁里，否则并发时会写到越界的位置
     RWMutexType::WriteLock lock(m_mutex);
+    if ((size_t)fd >= m_fds.size()){
+        m_fds.resize(fd * 1.5 + 1);
+    }
     FdCtx::ptr ctx(new FdCtx(fd));
     m_fds[fd] = ctx;
     return ctx;
@@ -100,12 +103,15 @@ FdCtx::ptr FdManager::get(int fd, bool auto_create){
     }
     
     RWMutexType::ReadLock lock(m_mutex);
+    if (fd < 0 || (size_t)fd >= m_fds.size()){
+        return nullptr;
+    }
     return m_fds[fd];
 }
 
 void FdManager::del(int fd){
     RWMutexType::WriteLock lock(m_mutex);
-    if (m_fds.size() < fd){
+    if (fd < 0 || (size_t)fd >= m_fds.size()){
         return;
     }
     m_fds[fd].reset();
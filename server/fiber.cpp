@@ -143,7 +143,8 @@ Fiber::ptr Fiber::GetRootFiber(){
 
 void Fiber::YieldToHold(){
     Fiber::ptr cur = GetThis();
-    cur->m_state = HOLD;
+    //保持EXEC直到上下文保存完，由调度器切回后再置为HOLD
+    //否则其他线程可能在swapOut完成前就把它调度起来
     cur->swapOut();
 }
 
@@ -159,6 +160,10 @@ void Fiber::YieldToHoldBack(){
     cur->back();
 }
 
+uint64_t Fiber::TotalFibers(){
+    return s_fiber_count;
+}
+
 uint64_t Fiber::GetFiberId(){
     if (t_fiber){
         return t_fiber->getId();
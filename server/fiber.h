@@ -51,6 +51,8 @@ public:
     static void YieldToReadyBack();
     static void YieldToHoldBack();
     static uint64_t GetFiberId();
+    //当前存在的协程数
+    static uint64_t TotalFibers();
 
     static void MainFunc();
     static void CallMainFunc();
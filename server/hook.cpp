@@ -5,6 +5,7 @@
 #include "config.h"
 
 #include <dlfcn.h>
+#include <signal.h>
 #include <iostream>
 
 static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
@@ -29,6 +30,8 @@ static uint64_t s_connect_timeout = -1;
 struct _HookIniter{
     _HookIniter(){
         hook_init();
+        //对端关闭后继续写会收到SIGPIPE，默认行为是结束进程，写操作返回EPIPE就够了
+        signal(SIGPIPE, SIG_IGN);
         s_connect_timeout = g_tcp_connect_timeout->getVal();
 
         g_tcp_connect_timeout->addListen(66666, [](const int &old_value, const int &new_value)
@@ -53,6 +56,7 @@ struct _HookIniter{
         send_f = (send_fun)dlsym(RTLD_NEXT, "send");
         sendto_f = (sendto_fun)dlsym(RTLD_NEXT, "sendto");
         sendmsg_f = (sendmsg_fun)dlsym(RTLD_NEXT, "sendmsg");
+        sendfile_f = (sendfile_fun)dlsym(RTLD_NEXT, "sendfile");
         close_f = (close_fun)dlsym(RTLD_NEXT, "close");
         fcntl_f = (fcntl_fun)dlsym(RTLD_NEXT, "fcntl");
         ioctl_f = (ioctl_fun)dlsym(RTLD_NEXT, "ioctl");
@@ -174,6 +178,7 @@ writev_fun writev_f = nullptr;
 send_fun send_f = nullptr;
 sendto_fun sendto_f = nullptr;
 sendmsg_fun sendmsg_f = nullptr;
+sendfile_fun sendfile_f = nullptr;
 
 close_fun close_f = nullptr;
 fcntl_fun fcntl_f = nullptr;
@@ -371,6 +376,10 @@ ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags){
     return do_io(sockfd, sendmsg_f, "sendmsg", server::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count){
+    return do_io(out_fd, sendfile_f, "sendfile", server::IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
 int close(int fd){
     if (!server::is_hook_enable()){
         return close_f(fd);
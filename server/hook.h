@@ -69,6 +69,10 @@ extern sendto_fun sendto_f;
 typedef ssize_t (*sendmsg_fun)(int sockfd, const struct msghdr *msg, int flags);
 extern sendmsg_fun sendmsg_f;
 
+//零拷贝发送文件，out_fd为socket时按写事件挂起协程
+typedef ssize_t (*sendfile_fun)(int out_fd, int in_fd, off_t *offset, size_t count);
+extern sendfile_fun sendfile_f;
+
 //操作相关
 typedef int (*close_fun)(int fd);
 extern close_fun close_f;
@@ -0,0 +1,244 @@
+#include "cache_servlet.h"
+#include "../config.h"
+#include "../log.h"
+#include "../util.h"
+#include <strings.h>
+
+namespace server{
+namespace http{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+static server::ConfigVar<uint64_t>::ptr g_cache_max_size =
+    server::Config::AddData("http.cache.max_size", (uint64_t)(64 * 1024 * 1024), "http response cache max bytes");
+
+CacheServlet::CacheServlet(Servlet::ptr servlet, uint64_t ttl, const std::vector<std::string> &vary)
+:Servlet("CacheServlet")
+,m_servlet(servlet)
+,m_ttl(ttl)
+,m_vary(vary)
+,m_bytes(0){
+
+}
+
+size_t CacheServlet::getCacheCount(){
+    MutexType::Lock lock(m_mutex);
+    return m_entries.size();
+}
+
+uint64_t CacheServlet::getCacheBytes(){
+    MutexType::Lock lock(m_mutex);
+    return m_bytes;
+}
+
+void CacheServlet::clear(){
+    MutexType::Lock lock(m_mutex);
+    m_lru.clear();
+    m_entries.clear();
+    m_expires.clear();
+    m_bytes = 0;
+}
+
+std::string CacheServlet::makeKey(const http::HttpRequest::ptr &request) const{
+    std::string key = request->getPath();
+    key.push_back('?');
+    key.append(request->getQuery());
+    std::string val;
+    for (auto& i : m_vary){
+        key.push_back('\n');
+        if (request->hasHeader(i, &val)){
+            key.append(val);
+        }
+    }
+    return key;
+}
+
+bool CacheServlet::isCacheable(const http::HttpResponse::ptr &response) const{
+    if (response->isStream() || response->getRaw() || response->getStatus() != HttpStatus::OK){
+        return false;
+    }
+    std::string val;
+    if (response->hasHeader("Set-Cookie", &val)){
+        return false;
+    }
+    if (response->hasHeader("Cache-Control", &val)
+        && (strcasestr(val.c_str(), "no-store") || strcasestr(val.c_str(), "private"))){
+        return false;
+    }
+    return true;
+}
+
+void CacheServlet::erase(std::unordered_map<std::string, std::list<Entry::ptr>::iterator>::iterator it){
+    const Entry::ptr &entry = *it->second;
+    m_bytes -= entry->key.size();
+    if (entry->response){
+        m_bytes -= entry->response->getBody().size();
+    }
+    for (auto& i : entry->raw){
+        if (i){
+            m_bytes -= i->data.size();
+        }
+    }
+    m_lru.erase(it->second);
+    m_entries.erase(it);
+}
+
+void CacheServlet::eraseExpired(uint64_t now){
+    while (!m_expires.empty()){
+        Entry::ptr entry = m_expires.front().lock();
+        if (entry && entry->expire > now){
+            break;
+        }
+        m_expires.pop_front();
+        //已经被淘汰或者替换的entry不用处理
+        if (entry){
+            auto it = m_entries.find(entry->key);
+            if (it != m_entries.end() && *it->second == entry){
+                erase(it);
+            }
+        }
+    }
+}
+
+void CacheServlet::insert(Entry::ptr entry){
+    uint64_t size = entry->key.size() + entry->raw[(int)ContentEncoding::IDENTITY]->data.size();
+    if (entry->response){
+        size += entry->response->getBody().size();
+    }
+    uint64_t max_size = g_cache_max_size->getVal();
+    if (size > max_size){
+        return;
+    }
+    auto it = m_entries.find(entry->key);
+    if (it != m_entries.end()){
+        erase(it);
+    }
+    //从最久没有使用的开始淘汰
+    while (m_bytes + size > max_size && !m_lru.empty()){
+        erase(m_entries.find(m_lru.back()->key));
+    }
+    m_lru.push_front(entry);
+    m_entries[entry->key] = m_lru.begin();
+    m_expires.push_back(entry);
+    m_bytes += size;
+}
+
+HttpRawResponse::ptr CacheServlet::getRaw(const Entry::ptr &entry, ContentEncoding encoding){
+    //raw[IDENTITY]在entry放进缓存之前就设置好了，之后不会修改
+    if (encoding == ContentEncoding::IDENTITY || !entry->compressible){
+        return entry->raw[(int)ContentEncoding::IDENTITY];
+    }
+    {
+        MutexType::Lock lock(m_mutex);
+        if (entry->raw[(int)encoding]){
+            return entry->raw[(int)encoding];
+        }
+    }
+    //在锁外压缩，并发的请求可能各自压缩一次，只保存第一份
+    HttpResponse::ptr rsp(new HttpResponse(*entry->response));
+    if (!CompressResponse(rsp, encoding)){
+        return entry->raw[(int)ContentEncoding::IDENTITY];
+    }
+    HttpRawResponse::ptr raw = rsp->serializeRaw();
+    MutexType::Lock lock(m_mutex);
+    if (!entry->raw[(int)encoding]){
+        entry->raw[(int)encoding] = raw;
+        //已经被淘汰的entry不计入缓存大小
+        auto it = m_entries.find(entry->key);
+        if (it != m_entries.end() && *it->second == entry){
+            m_bytes += raw->data.size();
+            uint64_t max_size = g_cache_max_size->getVal();
+            while (m_bytes > max_size && m_lru.back() != entry){
+                erase(m_entries.find(m_lru.back()->key));
+            }
+        }
+    }
+    return entry->raw[(int)encoding];
+}
+
+int32_t CacheServlet::handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session){
+    if (request->getMethod() != HttpMethod::GET){
+        return m_servlet->handle(request, response, session);
+    }
+
+    std::string key = makeKey(request);
+    ContentEncoding encoding = session->getAcceptEncoding();
+    Loading::ptr loading;
+    {
+        uint64_t now = server::GetCurrentMS();
+        MutexType::Lock lock(m_mutex);
+        eraseExpired(now);
+        auto it = m_entries.find(key);
+        if (it != m_entries.end()){
+            if ((*it->second)->expire > now){
+                //命中，移动到LRU头部
+                m_lru.splice(m_lru.begin(), m_lru, it->second);
+                Entry::ptr entry = *it->second;
+                lock.unlock();
+                response->setRaw(getRaw(entry, encoding));
+                return 0;
+            }
+            erase(it);
+        }
+
+        Scheduler *scheduler = Scheduler::GetThis();
+        auto lit = m_loading.find(key);
+        if (lit != m_loading.end() && scheduler){
+            //已经有请求在计算，挂起等它完成
+            loading = lit->second;
+            loading->waiters.push_back(std::make_pair(scheduler, Fiber::GetThis()));
+            lock.unlock();
+            Fiber::YieldToHold();
+            if (loading->entry){
+                response->setRaw(getRaw(loading->entry, encoding));
+                return 0;
+            }
+            //结果不能缓存，自己计算
+            return m_servlet->handle(request, response, session);
+        }
+        if (lit == m_loading.end()){
+            loading.reset(new Loading);
+            m_loading[key] = loading;
+        }
+    }
+
+    int32_t rt = m_servlet->handle(request, response, session);
+
+    std::vector<std::pair<Scheduler *, Fiber::ptr>> waiters;
+    Entry::ptr entry;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (loading){
+            if (isCacheable(response)){
+                entry.reset(new Entry);
+                entry->key = key;
+                entry->compressible = IsCacheCompressedVariants()
+                                      && IsCompressible(response, response->getBody().size());
+                if (entry->compressible){
+                    //不压缩的版本也要带上vary，中间的缓存才能区分
+                    AddVaryAcceptEncoding(response);
+                    entry->response.reset(new HttpResponse(*response));
+                }
+                entry->raw[(int)ContentEncoding::IDENTITY] = response->serializeRaw();
+                entry->expire = server::GetCurrentMS() + m_ttl;
+                loading->entry = entry;
+                insert(entry);
+            }
+            waiters.swap(loading->waiters);
+            m_loading.erase(key);
+        }
+    }
+    for (auto& i : waiters){
+        i.first->scheduler(i.second);
+    }
+    //自己的响应也使用缓存的压缩版本
+    if (entry && entry->compressible && encoding != ContentEncoding::IDENTITY){
+        response->setRaw(getRaw(entry, encoding));
+    }
+    return rt;
+}
+
+}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "servlet.h"
+#include "compress.h"
+#include "../fiber.h"
+#include "../mutex.h"
+#include "../scheduler.h"
+#include <deque>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace server{
+namespace http{
+
+//给幂等的GET接口加一层内存缓存，缓存序列化好的响应，命中时由HttpSession直接发送
+//key由path、query和指定的header组成，同一个key的并发请求只计算一次
+//可压缩的响应按Accept-Encoding发送压缩后的版本，每种编码只在第一次用到时压缩一次
+class CacheServlet : public Servlet{
+public:
+    typedef std::shared_ptr<CacheServlet> ptr;
+    typedef Mutex MutexType;
+    //ttl为缓存时间(ms)，vary为参与key计算的header，如Accept-Encoding
+    CacheServlet(Servlet::ptr servlet, uint64_t ttl, const std::vector<std::string> &vary = {});
+
+    virtual int32_t handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session) override;
+
+    Servlet::ptr getServlet() const { return m_servlet; }
+    size_t getCacheCount();
+    uint64_t getCacheBytes();
+    void clear();
+
+private:
+    struct Entry{
+        typedef std::shared_ptr<Entry> ptr;
+        std::string key;
+        //原始的响应，用来生成压缩的版本
+        HttpResponse::ptr response;
+        //按ContentEncoding保存序列化好的响应，raw[IDENTITY]一定存在
+        HttpRawResponse::ptr raw[(int)ContentEncoding::COUNT];
+        bool compressible;
+        uint64_t expire;
+    };
+
+    //正在计算中的key，其他请求挂起在waiters上等待结果
+    struct Loading{
+        typedef std::shared_ptr<Loading> ptr;
+        std::vector<std::pair<Scheduler *, Fiber::ptr>> waiters;
+        //计算结果不能缓存时为nullptr，等待者自己调用servlet
+        Entry::ptr entry;
+    };
+
+    std::string makeKey(const http::HttpRequest::ptr &request) const;
+    //响应是否可以缓存
+    bool isCacheable(const http::HttpResponse::ptr &response) const;
+    //调用前需要加锁
+    void insert(Entry::ptr entry);
+    //返回entry对应编码的响应，不存在时压缩后保存
+    HttpRawResponse::ptr getRaw(const Entry::ptr &entry, ContentEncoding encoding);
+    void erase(std::unordered_map<std::string, std::list<Entry::ptr>::iterator>::iterator it);
+    //删除已经过期的entry，调用前需要加锁
+    void eraseExpired(uint64_t now);
+
+    Servlet::ptr m_servlet;
+    uint64_t m_ttl;
+    std::vector<std::string> m_vary;
+
+    MutexType m_mutex;
+    //越靠前越是最近使用的
+    std::list<Entry::ptr> m_lru;
+    std::unordered_map<std::string, std::list<Entry::ptr>::iterator> m_entries;
+    //ttl固定，按插入顺序就是按过期时间排序，不再被访问的entry也能及时删除
+    std::deque<std::weak_ptr<Entry>> m_expires;
+    std::unordered_map<std::string, Loading::ptr> m_loading;
+    uint64_t m_bytes;
+};
+
+}
+}
@@ -0,0 +1,262 @@
+#include "compress.h"
+#include "../config.h"
+#include "../log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+namespace server{
+namespace http{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+static server::ConfigVar<bool>::ptr g_gzip_enable =
+    server::Config::AddData("http.gzip.enable", true, "compress responses by Accept-Encoding");
+
+static server::ConfigVar<uint32_t>::ptr g_gzip_min_size =
+    server::Config::AddData("http.gzip.min_size", (uint32_t)1024, "responses smaller than this are sent uncompressed");
+
+static server::ConfigVar<int>::ptr g_gzip_level =
+    server::Config::AddData("http.gzip.level", (int)6, "zlib compression level 1-9");
+
+static server::ConfigVar<std::vector<std::string>>::ptr g_gzip_types =
+    server::Config::AddData("http.gzip.types", std::vector<std::string>{"text/html", "text/css", "text/plain", "text/xml"
+                            , "text/javascript", "application/javascript", "application/json", "application/xml"
+                            , "image/svg+xml"}, "content types that are compressed");
+
+static server::ConfigVar<bool>::ptr g_gzip_cache_variants =
+    server::Config::AddData("http.gzip.cache_variants", true, "cache compressed variants of static files and cached responses");
+
+static server::ConfigVar<uint64_t>::ptr g_gzip_file_max_size =
+    server::Config::AddData("http.gzip.file_max_size", (uint64_t)(4 * 1024 * 1024), "larger static files are sent uncompressed with sendfile");
+
+static int GetLevel(){
+    int level = g_gzip_level->getVal();
+    return level < 1 || level > 9 ? Z_DEFAULT_COMPRESSION : level;
+}
+
+const char *ContentEncodingToString(ContentEncoding v){
+    switch (v){
+    case ContentEncoding::GZIP:
+        return "gzip";
+    case ContentEncoding::DEFLATE:
+        return "deflate";
+    default:
+        return "identity";
+    }
+}
+
+ContentEncoding NegotiateEncoding(const std::string &accept){
+    if (!g_gzip_enable->getVal()){
+        return ContentEncoding::IDENTITY;
+    }
+    double gzip_q = -1;
+    double deflate_q = -1;
+    double any_q = -1;
+    size_t pos = 0;
+    while (pos < accept.size()){
+        size_t end = accept.find(',', pos);
+        if (end == std::string::npos){
+            end = accept.size();
+        }
+        size_t b = pos;
+        while (b < end && (accept[b] == ' ' || accept[b] == '\t')){
+            ++b;
+        }
+        size_t e = b;
+        while (e < end && accept[e] != ';' && accept[e] != ' ' && accept[e] != '\t'){
+            ++e;
+        }
+        double q = 1;
+        size_t qpos = accept.find("q=", e);
+        if (qpos < end){
+            q = atof(accept.c_str() + qpos + 2);
+        }
+        const char *name = accept.c_str() + b;
+        size_t len = e - b;
+        if ((len == 4 && strncasecmp(name, "gzip", 4) == 0) || (len == 6 && strncasecmp(name, "x-gzip", 6) == 0)){
+            gzip_q = q;
+        }
+        else if (len == 7 && strncasecmp(name, "deflate", 7) == 0){
+            deflate_q = q;
+        }
+        else if (len == 1 && *name == '*'){
+            any_q = q;
+        }
+        pos = end + 1;
+    }
+    //没有单独列出的编码使用*的q值
+    if (gzip_q < 0){
+        gzip_q = any_q;
+    }
+    if (deflate_q < 0){
+        deflate_q = any_q;
+    }
+    if (gzip_q <= 0 && deflate_q <= 0){
+        return ContentEncoding::IDENTITY;
+    }
+    return gzip_q >= deflate_q ? ContentEncoding::GZIP : ContentEncoding::DEFLATE;
+}
+
+bool IsCompressibleType(const std::string &type){
+    //去掉; charset=utf-8之类的参数
+    size_t len = type.find(';');
+    if (len == std::string::npos){
+        len = type.size();
+    }
+    while (len > 0 && type[len - 1] == ' '){
+        --len;
+    }
+    for (auto& i : g_gzip_types->getVal()){
+        if (i.size() == len && strncasecmp(i.c_str(), type.c_str(), len) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsCacheCompressedVariants(){
+    return g_gzip_cache_variants->getVal();
+}
+
+uint64_t GetCompressFileMaxSize(){
+    return g_gzip_file_max_size->getVal();
+}
+
+bool IsCompressible(const HttpResponse::ptr &rsp, int64_t length){
+    if (length >= 0 && length < (int64_t)g_gzip_min_size->getVal()){
+        return false;
+    }
+    HttpStatus status = rsp->getStatus();
+    //206的区间是按原始内容计算的
+    if (!rsp->hasContentLength() || status == HttpStatus::PARTIAL_CONTENT){
+        return false;
+    }
+    const HttpResponse::MapType &headers = rsp->getHeaders();
+    if (headers.find("content-encoding") != headers.end()){
+        return false;
+    }
+    auto it = headers.find("cache-control");
+    if (it != headers.end() && strcasestr(it->second.c_str(), "no-transform")){
+        return false;
+    }
+    it = headers.find("content-type");
+    return it != headers.end() && IsCompressibleType(it->second);
+}
+
+void SetContentEncoding(const HttpResponse::ptr &rsp, ContentEncoding encoding){
+    rsp->setHeader("Content-Encoding", ContentEncodingToString(encoding));
+    AddVaryAcceptEncoding(rsp);
+}
+
+void AddVaryAcceptEncoding(const HttpResponse::ptr &rsp){
+    auto it = rsp->getHeaders().find("vary");
+    if (it == rsp->getHeaders().end()){
+        rsp->setHeader("Vary", "Accept-Encoding");
+    }
+    else if (!strcasestr(it->second.c_str(), "accept-encoding") && it->second != "*"){
+        rsp->setHeader("Vary", it->second + ", Accept-Encoding");
+    }
+}
+
+bool CompressResponse(const HttpResponse::ptr &rsp, ContentEncoding encoding){
+    if (encoding == ContentEncoding::IDENTITY){
+        return false;
+    }
+    std::string out;
+    if (!Compress(encoding, rsp->getBody().c_str(), rsp->getBody().size(), out)){
+        return false;
+    }
+    rsp->setBody(out);
+    SetContentEncoding(rsp, encoding);
+    return true;
+}
+
+bool Compress(ContentEncoding encoding, const void *data, size_t len, std::string &out){
+    if (encoding == ContentEncoding::IDENTITY){
+        return false;
+    }
+    //deflateInit要申请几百K的内存，每个线程每种编码只初始化一次，之后deflateReset复用
+    static thread_local Compressor::ptr s_compressors[(int)ContentEncoding::COUNT];
+    Compressor::ptr &compressor = s_compressors[(int)encoding];
+    if (!compressor){
+        compressor = Compressor::Create(encoding);
+        if (!compressor){
+            return false;
+        }
+    }
+    else{
+        compressor->reset();
+    }
+    out.reserve(out.size() + deflateBound(nullptr, len) + 18);
+    return compressor->write(data, len, out, false) && compressor->finish(out);
+}
+
+Compressor::ptr Compressor::Create(ContentEncoding encoding){
+    if (encoding == ContentEncoding::IDENTITY){
+        return nullptr;
+    }
+    Compressor::ptr compressor(new Compressor(encoding));
+    return compressor->m_inited ? compressor : nullptr;
+}
+
+Compressor::Compressor(ContentEncoding encoding)
+:m_encoding(encoding)
+,m_inited(false){
+    memset(&m_zs, 0, sizeof(m_zs));
+    //windowBits加16输出gzip的头和尾
+    int window_bits = encoding == ContentEncoding::GZIP ? 15 + 16 : 15;
+    int rt = deflateInit2(&m_zs, GetLevel(), Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+    if (rt != Z_OK){
+        LOG_ERROR(g_logger) << "deflateInit2 fail rt=" << rt;
+        return;
+    }
+    m_inited = true;
+}
+
+Compressor::~Compressor(){
+    if (m_inited){
+        deflateEnd(&m_zs);
+    }
+}
+
+void Compressor::reset(){
+    deflateReset(&m_zs);
+}
+
+bool Compressor::deflate(const void *data, size_t len, std::string &out, int flush){
+    m_zs.next_in = (Bytef *)data;
+    m_zs.avail_in = len;
+    do{
+        //直接输出到out的空闲空间
+        size_t offset = out.size();
+        size_t avail = out.capacity() > offset + 64 ? out.capacity() - offset : 4096;
+        out.resize(offset + avail);
+        m_zs.next_out = (Bytef *)&out[offset];
+        m_zs.avail_out = avail;
+        int rt = ::deflate(&m_zs, flush);
+        out.resize(offset + avail - m_zs.avail_out);
+        if (rt == Z_STREAM_END){
+            return true;
+        }
+        if (rt != Z_OK && rt != Z_BUF_ERROR){
+            LOG_ERROR(g_logger) << "deflate fail rt=" << rt;
+            return false;
+        }
+        //输出空间没有用完说明这一轮的输入已经处理完
+        if (m_zs.avail_out != 0 && m_zs.avail_in == 0){
+            return flush != Z_FINISH || rt == Z_STREAM_END;
+        }
+    } while (true);
+}
+
+bool Compressor::write(const void *data, size_t len, std::string &out, bool flush){
+    return deflate(data, len, out, flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+}
+
+bool Compressor::finish(std::string &out){
+    return deflate(nullptr, 0, out, Z_FINISH);
+}
+
+}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "http.h"
+#include <memory>
+#include <string>
+#include <zlib.h>
+
+namespace server{
+namespace http{
+
+enum class ContentEncoding
+{
+    IDENTITY = 0,
+    GZIP = 1,
+    //HTTP中的deflate是zlib格式
+    DEFLATE = 2,
+    COUNT = 3,
+};
+
+const char *ContentEncodingToString(ContentEncoding v);
+
+//按Accept-Encoding中的q值选择编码，相同时gzip优先，都不接受或者http.gzip.enable关闭时返回IDENTITY
+ContentEncoding NegotiateEncoding(const std::string &accept);
+
+//content-type是否在http.gzip.types中，忽略;之后的参数
+bool IsCompressibleType(const std::string &type);
+
+//响应是否需要压缩：没有content-encoding，状态码和content-type允许
+//length为body长度，小于http.gzip.min_size时不压缩，-1表示长度未知（流式响应）
+bool IsCompressible(const HttpResponse::ptr &rsp, int64_t length);
+
+//是否缓存静态文件和CacheServlet响应压缩后的版本（http.gzip.cache_variants）
+bool IsCacheCompressedVariants();
+//缓存压缩版本的静态文件的最大长度
+uint64_t GetCompressFileMaxSize();
+
+//在vary中加上Accept-Encoding，已经有时不重复添加
+void AddVaryAcceptEncoding(const HttpResponse::ptr &rsp);
+
+//设置content-encoding，并在vary中加上Accept-Encoding
+void SetContentEncoding(const HttpResponse::ptr &rsp, ContentEncoding encoding);
+
+//压缩rsp的body，设置content-encoding和vary，失败时rsp不变
+bool CompressResponse(const HttpResponse::ptr &rsp, ContentEncoding encoding);
+
+//一次性压缩，使用线程内复用的z_stream，不需要每次申请压缩的内存
+bool Compress(ContentEncoding encoding, const void *data, size_t len, std::string &out);
+
+//流式压缩，用于分块发送的响应，每次write的结果追加到out
+class Compressor{
+public:
+    typedef std::shared_ptr<Compressor> ptr;
+    //encoding为IDENTITY或者初始化失败时返回nullptr
+    static Compressor::ptr Create(ContentEncoding encoding);
+    ~Compressor();
+
+    //flush为true时把已经写入的数据全部输出（Z_SYNC_FLUSH），对端可以立即解压
+    bool write(const void *data, size_t len, std::string &out, bool flush);
+    //结束压缩流，输出剩余数据和尾部
+    bool finish(std::string &out);
+    //重新开始一个新的压缩流
+    void reset();
+
+    ContentEncoding getEncoding() const { return m_encoding; }
+
+private:
+    Compressor(ContentEncoding encoding);
+    bool deflate(const void *data, size_t len, std::string &out, int flush);
+
+    ContentEncoding m_encoding;
+    z_stream m_zs;
+    bool m_inited;
+};
+
+}
+}
@@ -0,0 +1,451 @@
+#include "file_servlet.h"
+#include "../config.h"
+#include "../log.h"
+#include "../util.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace server{
+namespace http{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+static server::ConfigVar<uint32_t>::ptr g_file_check_interval =
+    server::Config::AddData("http.file.check_interval", (uint32_t)1000, "file servlet stat check interval(ms)");
+
+static server::ConfigVar<uint32_t>::ptr g_file_cache_size =
+    server::Config::AddData("http.file.cache_size", (uint32_t)1024, "file servlet max cached files");
+
+static const char *s_mime_types[][2] = {
+    {"html", "text/html"},
+    {"htm", "text/html"},
+    {"css", "text/css"},
+    {"js", "application/javascript"},
+    {"json", "application/json"},
+    {"txt", "text/plain"},
+    {"xml", "text/xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"svg", "image/svg+xml"},
+    {"ico", "image/x-icon"},
+    {"webp", "image/webp"},
+    {"pdf", "application/pdf"},
+    {"wasm", "application/wasm"},
+    {"mp4", "video/mp4"},
+    {"woff2", "font/woff2"},
+};
+
+static const char *GetMimeType(const std::string &path){
+    size_t pos = path.rfind('.');
+    if (pos == std::string::npos || path.find('/', pos) != std::string::npos){
+        return "application/octet-stream";
+    }
+    const char *ext = path.c_str() + pos + 1;
+    for (auto& i : s_mime_types){
+        if (strcasecmp(i[0], ext) == 0){
+            return i[1];
+        }
+    }
+    return "application/octet-stream";
+}
+
+static int HexValue(char c){
+    if (c >= '0' && c <= '9'){
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f'){
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F'){
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+//%XX解码，解码出\0时返回false
+static bool UrlDecode(const std::string &str, std::string &out){
+    out.clear();
+    out.reserve(str.size());
+    for (size_t i = 0; i < str.size(); ++i){
+        if (str[i] == '%' && i + 2 < str.size() && HexValue(str[i + 1]) >= 0 && HexValue(str[i + 2]) >= 0){
+            char c = (char)(HexValue(str[i + 1]) * 16 + HexValue(str[i + 2]));
+            if (c == '\0'){
+                return false;
+            }
+            out.push_back(c);
+            i += 2;
+        }
+        else{
+            out.push_back(str[i]);
+        }
+    }
+    return true;
+}
+
+//If-None-Match中任意一个etag匹配（弱比较）即返回true
+static bool MatchETag(const std::string &header, const std::string &etag){
+    size_t pos = 0;
+    while (pos < header.size()){
+        size_t end = header.find(',', pos);
+        if (end == std::string::npos){
+            end = header.size();
+        }
+        size_t b = pos;
+        size_t e = end;
+        while (b < e && (header[b] == ' ' || header[b] == '\t')){
+            ++b;
+        }
+        while (e > b && (header[e - 1] == ' ' || header[e - 1] == '\t')){
+            --e;
+        }
+        if (e - b == 1 && header[b] == '*'){
+            return true;
+        }
+        if (e - b > 2 && header[b] == 'W' && header[b + 1] == '/'){
+            b += 2;
+        }
+        if (header.compare(b, e - b, etag) == 0){
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+static bool ParseUint(const char *&p, uint64_t &v){
+    if (*p < '0' || *p > '9'){
+        return false;
+    }
+    v = 0;
+    while (*p >= '0' && *p <= '9'){
+        if (v > (UINT64_MAX - 9) / 10){
+            return false;
+        }
+        v = v * 10 + (*p - '0');
+        ++p;
+    }
+    return true;
+}
+
+//只支持单个区间bytes=a-b、bytes=a-、bytes=-n
+//返回1表示区间有效，0表示无法满足(416)，-1表示格式不支持，按完整文件返回
+static int ParseRange(const std::string &range, uint64_t size, uint64_t &start, uint64_t &end){
+    if (range.compare(0, 6, "bytes=") != 0 || range.find(',') != std::string::npos){
+        return -1;
+    }
+    const char *p = range.c_str() + 6;
+    while (*p == ' '){
+        ++p;
+    }
+    if (*p == '-'){
+        ++p;
+        uint64_t n = 0;
+        if (!ParseUint(p, n) || *p){
+            return -1;
+        }
+        if (n == 0 || size == 0){
+            return 0;
+        }
+        start = n >= size ? 0 : size - n;
+        end = size - 1;
+        return 1;
+    }
+    if (!ParseUint(p, start) || *p != '-'){
+        return -1;
+    }
+    ++p;
+    if (*p){
+        if (!ParseUint(p, end) || *p || end < start){
+            return -1;
+        }
+    }
+    else{
+        end = UINT64_MAX;
+    }
+    if (start >= size){
+        return 0;
+    }
+    if (end >= size){
+        end = size - 1;
+    }
+    return 1;
+}
+
+FileServlet::FileInfo::FileInfo()
+:fd(-1)
+,size(0)
+,mtime(0)
+,mtimeNsec(0)
+,mime(nullptr)
+,checkTime(0)
+,accessTime(0){
+
+}
+
+FileServlet::FileInfo::~FileInfo(){
+    if (fd >= 0){
+        ::close(fd);
+    }
+}
+
+FileServlet::FileServlet(const std::string &root, const std::string &prefix)
+:Servlet("FileServlet")
+,m_root(root)
+,m_prefix(prefix){
+    while (m_root.size() > 1 && m_root.back() == '/'){
+        m_root.pop_back();
+    }
+}
+
+size_t FileServlet::getCacheSize(){
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_files.size();
+}
+
+bool FileServlet::getPath(const std::string &uri, std::string &path){
+    if (uri.compare(0, m_prefix.size(), m_prefix) != 0){
+        return false;
+    }
+    std::string rel;
+    if (!UrlDecode(uri.substr(m_prefix.size()), rel)){
+        return false;
+    }
+    //逐段检查，拒绝..，防止访问root之外的文件
+    size_t pos = 0;
+    while (pos <= rel.size()){
+        size_t end = rel.find('/', pos);
+        if (end == std::string::npos){
+            end = rel.size();
+        }
+        if (end - pos == 2 && rel[pos] == '.' && rel[pos + 1] == '.'){
+            return false;
+        }
+        pos = end + 1;
+    }
+    path = m_root;
+    if (rel.empty() || rel[0] != '/'){
+        path.push_back('/');
+    }
+    path.append(rel);
+    if (path.back() == '/'){
+        path.append("index.html");
+    }
+    return true;
+}
+
+FileServlet::FileInfo::ptr FileServlet::getFile(const std::string &path){
+    uint64_t now = server::GetCurrentMS();
+    FileInfo::ptr info;
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        auto it = m_files.find(path);
+        if (it != m_files.end()){
+            info = it->second;
+            info->accessTime = now;
+            if (now - info->checkTime < g_file_check_interval->getVal()){
+                return info;
+            }
+        }
+    }
+
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)){
+        if (info){
+            RWMutexType::WriteLock lock(m_mutex);
+            m_files.erase(path);
+        }
+        return nullptr;
+    }
+    if (info && info->size == (uint64_t)st.st_size
+        && info->mtime == st.st_mtim.tv_sec && info->mtimeNsec == st.st_mtim.tv_nsec){
+        RWMutexType::WriteLock lock(m_mutex);
+        info->checkTime = now;
+        return info;
+    }
+
+    //文件不存在于缓存或者已经被修改，重新打开
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0){
+        LOG_WARN(g_logger) << "FileServlet open " << path << " errno=" << errno
+                           << " errstr=" << strerror(errno);
+        return nullptr;
+    }
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)){
+        ::close(fd);
+        return nullptr;
+    }
+    info.reset(new FileInfo);
+    info->fd = fd;
+    info->size = st.st_size;
+    info->mtime = st.st_mtim.tv_sec;
+    info->mtimeNsec = st.st_mtim.tv_nsec;
+    info->mime = GetMimeType(path);
+    info->checkTime = now;
+    info->accessTime = now;
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\"%lx-%lx\"", (unsigned long)info->mtime, (unsigned long)info->size);
+    info->etag = buf;
+
+    RWMutexType::WriteLock lock(m_mutex);
+    //缓存满时淘汰最久没有访问的文件，只在打开新文件时遍历一次
+    if (m_files.size() >= g_file_cache_size->getVal() && m_files.find(path) == m_files.end()){
+        auto oldest = m_files.begin();
+        for (auto it = m_files.begin(); it != m_files.end(); ++it){
+            if (it->second->accessTime < oldest->second->accessTime){
+                oldest = it;
+            }
+        }
+        if (oldest != m_files.end()){
+            m_files.erase(oldest);
+        }
+    }
+    m_files[path] = info;
+    return info;
+}
+
+bool FileServlet::getEncoded(const FileInfo::ptr &info, ContentEncoding encoding, std::string &body){
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        if (!info->encoded[(int)encoding].empty()){
+            body = info->encoded[(int)encoding];
+            return true;
+        }
+    }
+    //并发的第一次请求可能各自压缩一次，结果相同，只保存一份
+    std::string data(info->size, '\0');
+    size_t offset = 0;
+    while (offset < data.size()){
+        ssize_t rt = ::pread(info->fd, &data[offset], data.size() - offset, offset);
+        if (rt <= 0){
+            return false;
+        }
+        offset += rt;
+    }
+    if (!Compress(encoding, data.c_str(), data.size(), body)){
+        return false;
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    if (info->encoded[(int)encoding].empty()){
+        info->encoded[(int)encoding] = body;
+    }
+    return true;
+}
+
+bool FileServlet::hasEncoded(const FileInfo::ptr &info, ContentEncoding encoding, uint64_t &size){
+    RWMutexType::ReadLock lock(m_mutex);
+    size = info->encoded[(int)encoding].size();
+    return size > 0;
+}
+
+int32_t FileServlet::handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session){
+    HttpMethod method = request->getMethod();
+    if (method != HttpMethod::GET && method != HttpMethod::HEAD){
+        return Servlet::handle(request, response, session);
+    }
+
+    std::string path;
+    FileInfo::ptr info;
+    if (getPath(request->getPath(), path)){
+        info = getFile(path);
+    }
+    if (!info){
+        static const std::string& RSP_BODY = "<html><head><title>404 Not Found"
+            "</title></head><body><center><h1>404 Not Found</h1></center>"
+            "<hr><center>sewing Server/1.0.0</center></body></html>";
+        response->setStatus(http::HttpStatus::NOT_FOUND);
+        response->setHeader("Content-Type", "text/html");
+        response->setBody(RSP_BODY);
+        return 0;
+    }
+
+    response->setHeader("Accept-Ranges", "bytes");
+    response->setHeader("Content-Type", info->mime);
+
+    //带Range的请求按原始内容计算区间，不压缩
+    std::string val;
+    ContentEncoding encoding = ContentEncoding::IDENTITY;
+    if (IsCacheCompressedVariants() && IsCompressible(response, info->size) && info->size <= GetCompressFileMaxSize()){
+        AddVaryAcceptEncoding(response);
+        if (!request->hasHeader("Range", &val)){
+            encoding = session->getAcceptEncoding();
+        }
+    }
+    //HEAD不为了计算长度去压缩整个文件，没有缓存的压缩版本时按原始内容回复
+    uint64_t encoded_size = 0;
+    if (method == HttpMethod::HEAD && encoding != ContentEncoding::IDENTITY
+        && !hasEncoded(info, encoding, encoded_size)){
+        encoding = ContentEncoding::IDENTITY;
+    }
+    //压缩的版本使用不同的etag
+    std::string etag = info->etag;
+    if (encoding != ContentEncoding::IDENTITY){
+        etag.insert(etag.size() - 1, std::string("-") + ContentEncodingToString(encoding));
+    }
+    response->setHeader("ETag", etag);
+
+    if (request->hasHeader("If-None-Match", &val) && MatchETag(val, etag)){
+        response->setStatus(http::HttpStatus::NOT_MODIFIED);
+        return 0;
+    }
+
+    if (method == HttpMethod::HEAD && encoding != ContentEncoding::IDENTITY){
+        SetContentEncoding(response, encoding);
+        response->setStream(true);
+        response->setContentLength(encoded_size);
+        session->sendResponse(response, true);
+        return 0;
+    }
+    std::string body;
+    if (encoding != ContentEncoding::IDENTITY && getEncoded(info, encoding, body)){
+        SetContentEncoding(response, encoding);
+        response->setBody(body);
+        return 0;
+    }
+
+    uint64_t start = 0;
+    uint64_t length = info->size;
+    if (request->hasHeader("Range", &val)){
+        uint64_t end = 0;
+        int rt = ParseRange(val, info->size, start, end);
+        if (rt == 0){
+            response->setStatus(http::HttpStatus::RANGE_NOT_SATISFIABLE);
+            response->setHeader("Content-Range", "bytes */" + std::to_string(info->size));
+            return 0;
+        }
+        if (rt > 0){
+            length = end - start + 1;
+            response->setStatus(http::HttpStatus::PARTIAL_CONTENT);
+            response->setHeader("Content-Range", "bytes " + std::to_string(start) + "-"
+                                + std::to_string(end) + "/" + std::to_string(info->size));
+        }
+        else{
+            start = 0;
+        }
+    }
+
+    if (method == HttpMethod::HEAD){
+        //HEAD只发送header，content-length为完整body的长度
+        response->setStream(true);
+        response->setContentLength(length);
+        session->sendResponse(response, true);
+        return 0;
+    }
+    if (session->sendFile(response, info->fd, start, length) != (int64_t)length){
+        LOG_WARN(g_logger) << "FileServlet sendfile " << path << " failed errno=" << errno
+                           << " errstr=" << strerror(errno);
+        response->setClose(true);
+    }
+    return 0;
+}
+
+}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "servlet.h"
+#include "compress.h"
+#include "../mutex.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <time.h>
+
+namespace server{
+namespace http{
+
+//静态文件servlet，body通过sendfile零拷贝发送
+//支持Range（206/416）和ETag/If-None-Match（304），打开的fd和stat结果会被缓存
+//http.gzip.cache_variants打开时，可压缩的文件按客户端的Accept-Encoding发送缓存的压缩版本
+class FileServlet : public Servlet{
+public:
+    typedef std::shared_ptr<FileServlet> ptr;
+    typedef RWMutex RWMutexType;
+    //root为本地目录，请求路径去掉prefix后拼到root后面，如/static/a.css -> root/a.css
+    FileServlet(const std::string &root, const std::string &prefix = "");
+
+    virtual int32_t handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session) override;
+
+    size_t getCacheSize();
+
+private:
+    struct FileInfo{
+        typedef std::shared_ptr<FileInfo> ptr;
+        FileInfo();
+        //发送中的请求持有shared_ptr，缓存淘汰后fd在最后一个请求结束时关闭
+        ~FileInfo();
+
+        int fd;
+        uint64_t size;
+        time_t mtime;
+        long mtimeNsec;
+        std::string etag;
+        const char *mime;
+        //上次stat检查的时间(ms)
+        uint64_t checkTime;
+        //上次访问的时间(ms)，缓存满时淘汰最久没有访问的文件，命中时只持有读锁，所以用atomic
+        std::atomic<uint64_t> accessTime;
+        //压缩后的内容，第一次请求时生成，读写需要加m_mutex
+        std::string encoded[(int)ContentEncoding::COUNT];
+    };
+
+    //把请求路径转换成本地路径，包含..等非法路径时返回false
+    bool getPath(const std::string &uri, std::string &path);
+    //从缓存获取文件，超过检查间隔时重新stat，文件变化时重新打开
+    FileInfo::ptr getFile(const std::string &path);
+    //获取压缩后的文件内容，失败时返回false
+    bool getEncoded(const FileInfo::ptr &info, ContentEncoding encoding, std::string &body);
+    //压缩版本已经缓存时返回true，size为压缩后的长度，不会触发压缩
+    bool hasEncoded(const FileInfo::ptr &info, ContentEncoding encoding, uint64_t &size);
+
+    std::string m_root;
+    std::string m_prefix;
+    RWMutexType m_mutex;
+    std::unordered_map<std::string, FileInfo::ptr> m_files;
+};
+
+}
+}
@@ -0,0 +1,569 @@
+#include "hpack.h"
+#include <string.h>
+#include <unordered_map>
+
+namespace server{
+namespace http{
+
+//RFC 7541 附录A
+static const HPackHeader s_static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+static const uint32_t STATIC_COUNT = sizeof(s_static_table) / sizeof(s_static_table[0]);
+
+//静态表中每个name第一次出现的index
+static std::unordered_map<std::string, uint32_t> MakeStaticIndex(){
+    std::unordered_map<std::string, uint32_t> m;
+    for (uint32_t i = 0; i < STATIC_COUNT; ++i){
+        m.insert(std::make_pair(s_static_table[i].name, i + 1));
+    }
+    return m;
+}
+
+static const std::unordered_map<std::string, uint32_t> s_static_index = MakeStaticIndex();
+
+struct HuffmanCode{
+    uint32_t code;
+    uint8_t bits;
+};
+
+//RFC 7541 附录B，下标为符号，256为EOS
+static const HuffmanCode s_huffman_codes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+};
+
+//按4bit查表解码：状态为huffman树的内部节点，每个状态、每个半字节对应下一个状态和输出的符号
+//码长最短为5bit，一个半字节最多输出一个符号
+struct HuffmanDecodeEntry{
+    uint16_t next;
+    int16_t sym;
+    //经过了EOS，解码失败
+    bool fail;
+};
+
+struct HuffmanDecodeTable{
+    //内部节点最多256个
+    HuffmanDecodeEntry entries[256][16];
+    //在这个状态结束是否合法：从根开始全是1并且不超过7bit
+    bool accept[256];
+};
+
+static HuffmanDecodeTable *MakeDecodeTable(){
+    //先建树，节点0为根，children为-1表示没有，叶子的sym>=0
+    struct Node{
+        int children[2];
+        int sym;
+        int depth;
+        bool ones;
+    };
+    std::vector<Node> nodes(1, Node{{-1, -1}, -1, 0, true});
+    for (int s = 0; s < 257; ++s){
+        const HuffmanCode &c = s_huffman_codes[s];
+        int n = 0;
+        for (int i = c.bits - 1; i >= 0; --i){
+            int bit = (c.code >> i) & 1;
+            if (nodes[n].children[bit] < 0){
+                nodes[n].children[bit] = nodes.size();
+                nodes.push_back(Node{{-1, -1}, -1, nodes[n].depth + 1, nodes[n].ones && bit == 1});
+            }
+            n = nodes[n].children[bit];
+        }
+        nodes[n].sym = s;
+    }
+    //内部节点编号为状态
+    std::vector<int> state(nodes.size(), -1);
+    std::vector<int> internal;
+    for (size_t i = 0; i < nodes.size(); ++i){
+        if (nodes[i].sym < 0){
+            state[i] = internal.size();
+            internal.push_back(i);
+        }
+    }
+    HuffmanDecodeTable *table = new HuffmanDecodeTable;
+    memset(table, 0, sizeof(*table));
+    for (size_t s = 0; s < internal.size(); ++s){
+        const Node &node = nodes[internal[s]];
+        table->accept[s] = s == 0 || (node.ones && node.depth <= 7);
+        for (int nibble = 0; nibble < 16; ++nibble){
+            HuffmanDecodeEntry &e = table->entries[s][nibble];
+            e.sym = -1;
+            int n = internal[s];
+            for (int i = 3; i >= 0; --i){
+                n = nodes[n].children[(nibble >> i) & 1];
+                if (nodes[n].sym == 256){
+                    e.fail = true;
+                    break;
+                }
+                if (nodes[n].sym >= 0){
+                    e.sym = nodes[n].sym;
+                    n = 0;
+                }
+            }
+            e.next = state[n];
+        }
+    }
+    return table;
+}
+
+static const HuffmanDecodeTable *s_decode_table = MakeDecodeTable();
+
+bool HuffmanDecode(const char *data, size_t len, std::string &out){
+    const HuffmanDecodeTable &t = *s_decode_table;
+    uint16_t state = 0;
+    for (size_t i = 0; i < len; ++i){
+        uint8_t c = data[i];
+        const HuffmanDecodeEntry &hi = t.entries[state][c >> 4];
+        if (hi.fail){
+            return false;
+        }
+        if (hi.sym >= 0){
+            out.push_back((char)hi.sym);
+        }
+        const HuffmanDecodeEntry &lo = t.entries[hi.next][c & 0x0F];
+        if (lo.fail){
+            return false;
+        }
+        if (lo.sym >= 0){
+            out.push_back((char)lo.sym);
+        }
+        state = lo.next;
+    }
+    return t.accept[state];
+}
+
+size_t HuffmanEncodedLength(const char *data, size_t len){
+    uint64_t bits = 0;
+    for (size_t i = 0; i < len; ++i){
+        bits += s_huffman_codes[(uint8_t)data[i]].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+void HuffmanEncode(const char *data, size_t len, std::string &out){
+    uint64_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; ++i){
+        const HuffmanCode &c = s_huffman_codes[(uint8_t)data[i]];
+        acc = (acc << c.bits) | c.code;
+        bits += c.bits;
+        while (bits >= 8){
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    //用EOS的高位（全1）填充
+    if (bits > 0){
+        out.push_back((char)((acc << (8 - bits)) | (0xFF >> bits)));
+    }
+}
+
+//整数编码，prefix为前缀的bit数，first为第一个字节中前缀以外的高位
+static void EncodeInteger(uint32_t v, int prefix, uint8_t first, std::string &out){
+    uint32_t max = (1u << prefix) - 1;
+    if (v < max){
+        out.push_back((char)(first | v));
+        return;
+    }
+    out.push_back((char)(first | max));
+    v -= max;
+    while (v >= 128){
+        out.push_back((char)((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+static bool DecodeInteger(const uint8_t *&p, const uint8_t *end, int prefix, uint32_t &v){
+    if (p == end){
+        return false;
+    }
+    uint32_t max = (1u << prefix) - 1;
+    v = *p++ & max;
+    if (v < max){
+        return true;
+    }
+    //最多5个字节，超过uint32的范围视为错误
+    for (int shift = 0; shift <= 28; shift += 7){
+        if (p == end){
+            return false;
+        }
+        uint8_t b = *p++;
+        uint64_t add = (uint64_t)(b & 0x7F) << shift;
+        if (v + add > 0xFFFFFFFFull){
+            return false;
+        }
+        v += add;
+        if (!(b & 0x80)){
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool DecodeString(const uint8_t *&p, const uint8_t *end, std::string &out){
+    if (p == end){
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint32_t len = 0;
+    if (!DecodeInteger(p, end, 7, len) || len > (size_t)(end - p)){
+        return false;
+    }
+    out.clear();
+    if (huffman){
+        out.reserve(len + len / 2);
+        if (!HuffmanDecode((const char *)p, len, out)){
+            return false;
+        }
+    }
+    else{
+        out.assign((const char *)p, len);
+    }
+    p += len;
+    return true;
+}
+
+static void EncodeString(const std::string &v, std::string &out){
+    //huffman编码更短时才使用
+    size_t hlen = v.size() > 4 ? HuffmanEncodedLength(v.c_str(), v.size()) : v.size();
+    if (hlen < v.size()){
+        EncodeInteger(hlen, 7, 0x80, out);
+        HuffmanEncode(v.c_str(), v.size(), out);
+    }
+    else{
+        EncodeInteger(v.size(), 7, 0, out);
+        out.append(v);
+    }
+}
+
+HPackTable::HPackTable(uint32_t maxSize)
+:m_size(0)
+,m_maxSize(maxSize){
+
+}
+
+const HPackHeader *HPackTable::get(uint32_t index) const{
+    if (index == 0){
+        return nullptr;
+    }
+    if (index <= STATIC_COUNT){
+        return &s_static_table[index - 1];
+    }
+    index -= STATIC_COUNT + 1;
+    return index < m_entries.size() ? &m_entries[index] : nullptr;
+}
+
+void HPackTable::evict(uint32_t size){
+    while (!m_entries.empty() && m_size + size > m_maxSize){
+        const HPackHeader &h = m_entries.back();
+        m_size -= h.name.size() + h.value.size() + 32;
+        m_entries.pop_back();
+    }
+}
+
+void HPackTable::add(const std::string &name, const std::string &value){
+    uint32_t size = name.size() + value.size() + 32;
+    evict(size);
+    if (size > m_maxSize){
+        return;
+    }
+    m_entries.push_front(HPackHeader{name, value});
+    m_size += size;
+}
+
+void HPackTable::setMaxSize(uint32_t v){
+    m_maxSize = v;
+    evict(0);
+}
+
+uint32_t HPackTable::find(const std::string &name, const std::string &value, uint32_t &nameIndex) const{
+    nameIndex = 0;
+    auto it = s_static_index.find(name);
+    if (it != s_static_index.end()){
+        nameIndex = it->second;
+        //同名的条目在静态表中是连续的
+        for (uint32_t i = it->second; i <= STATIC_COUNT && s_static_table[i - 1].name == name; ++i){
+            if (s_static_table[i - 1].value == value){
+                return i;
+            }
+        }
+    }
+    for (size_t i = 0; i < m_entries.size(); ++i){
+        const HPackHeader &h = m_entries[i];
+        if (h.name == name){
+            if (h.value == value){
+                return STATIC_COUNT + 1 + i;
+            }
+            if (!nameIndex){
+                nameIndex = STATIC_COUNT + 1 + i;
+            }
+        }
+    }
+    return 0;
+}
+
+HPackDecoder::HPackDecoder(uint32_t maxTableSize)
+:m_table(maxTableSize)
+,m_maxTableSize(maxTableSize)
+,m_tooLarge(false){
+
+}
+
+void HPackDecoder::setMaxTableSize(uint32_t v){
+    m_maxTableSize = v;
+    if (m_table.getMaxSize() > v){
+        m_table.setMaxSize(v);
+    }
+}
+
+bool HPackDecoder::decode(const char *data, size_t len, std::vector<HPackHeader> &headers, size_t maxListSize){
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + len;
+    bool first = true;
+    //按RFC 7540 SETTINGS_MAX_HEADER_LIST_SIZE的算法，每个header为name+value+32
+    size_t total = 0;
+    m_tooLarge = false;
+    while (p < end){
+        uint8_t b = *p;
+        uint32_t index = 0;
+        if (b & 0x80){
+            //Indexed Header Field
+            if (!DecodeInteger(p, end, 7, index)){
+                return false;
+            }
+            const HPackHeader *h = m_table.get(index);
+            if (!h){
+                return false;
+            }
+            first = false;
+            total += h->name.size() + h->value.size() + 32;
+            if (maxListSize && total > maxListSize){
+                m_tooLarge = true;
+                continue;
+            }
+            headers.push_back(*h);
+            continue;
+        }
+        if ((b & 0xE0) == 0x20){
+            //动态表大小更新只能出现在header块的开头
+            uint32_t size = 0;
+            if (!first || !DecodeInteger(p, end, 5, size) || size > m_maxTableSize){
+                return false;
+            }
+            m_table.setMaxSize(size);
+            continue;
+        }
+        first = false;
+        //01：加入动态表，0000：不加入，0001：永不加入
+        bool indexing = (b & 0xC0) == 0x40;
+        if (!DecodeInteger(p, end, indexing ? 6 : 4, index)){
+            return false;
+        }
+        headers.push_back(HPackHeader());
+        HPackHeader &h = headers.back();
+        if (index){
+            const HPackHeader *name = m_table.get(index);
+            if (!name){
+                return false;
+            }
+            h.name = name->name;
+        }
+        else if (!DecodeString(p, end, h.name)){
+            return false;
+        }
+        if (!DecodeString(p, end, h.value)){
+            return false;
+        }
+        if (indexing){
+            m_table.add(h.name, h.value);
+        }
+        total += h.name.size() + h.value.size() + 32;
+        if (maxListSize && total > maxListSize){
+            m_tooLarge = true;
+            headers.pop_back();
+        }
+    }
+    return true;
+}
+
+HPackEncoder::HPackEncoder(uint32_t maxTableSize)
+:m_table(maxTableSize)
+,m_pendingSize(maxTableSize)
+,m_sizeUpdate(false){
+
+}
+
+void HPackEncoder::setMaxTableSize(uint32_t v){
+    //只用默认的4096，对端允许更大时不扩大
+    v = v < 4096 ? v : 4096;
+    if (v != m_table.getMaxSize()){
+        m_table.setMaxSize(v);
+        m_pendingSize = v;
+        m_sizeUpdate = true;
+    }
+}
+
+void HPackEncoder::begin(std::string &out){
+    if (m_sizeUpdate){
+        EncodeInteger(m_pendingSize, 5, 0x20, out);
+        m_sizeUpdate = false;
+    }
+}
+
+//每次都不一样或者敏感的header，不放进动态表
+static bool IsNoIndex(const std::string &name){
+    return name == "content-length" || name == "date" || name == "etag" || name == "last-modified"
+        || name == "set-cookie" || name == "authorization" || name == "location" || name == "content-range";
+}
+
+void HPackEncoder::encode(const std::string &name, const std::string &value, std::string &out){
+    uint32_t name_index = 0;
+    uint32_t index = m_table.find(name, value, name_index);
+    if (index){
+        EncodeInteger(index, 7, 0x80, out);
+        return;
+    }
+    if (IsNoIndex(name)){
+        //set-cookie和authorization使用永不索引，中间的代理也不能压缩
+        bool never = name == "set-cookie" || name == "authorization";
+        EncodeInteger(name_index, 4, never ? 0x10 : 0, out);
+    }
+    else{
+        EncodeInteger(name_index, 6, 0x40, out);
+    }
+    if (!name_index){
+        EncodeString(name, out);
+    }
+    EncodeString(value, out);
+    if (!IsNoIndex(name)){
+        m_table.add(name, value);
+    }
+}
+
+}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace server{
+namespace http{
+
+//HPACK（RFC 7541）中的一个header，name都是小写
+struct HPackHeader{
+    std::string name;
+    std::string value;
+};
+
+//静态表+动态表，index从1开始，1~61为静态表，之后是动态表（最新加入的在前）
+class HPackTable{
+public:
+    HPackTable(uint32_t maxSize = 4096);
+
+    //index不存在时返回nullptr
+    const HPackHeader *get(uint32_t index) const;
+    //超过maxSize时从最旧的开始淘汰，单个条目比maxSize大时清空动态表
+    void add(const std::string &name, const std::string &value);
+    //返回name和value都相同的index，没有时返回0，nameIndex为只有name相同的index
+    uint32_t find(const std::string &name, const std::string &value, uint32_t &nameIndex) const;
+
+    void setMaxSize(uint32_t v);
+    uint32_t getMaxSize() const { return m_maxSize; }
+    //按RFC每个条目为name+value+32
+    uint32_t getSize() const { return m_size; }
+    size_t getCount() const { return m_entries.size(); }
+
+private:
+    void evict(uint32_t size);
+
+    std::deque<HPackHeader> m_entries;
+    uint32_t m_size;
+    uint32_t m_maxSize;
+};
+
+//解码一个完整的header块（HEADERS+CONTINUATION），动态表跨header块保留
+class HPackDecoder{
+public:
+    HPackDecoder(uint32_t maxTableSize = 4096);
+
+    //失败表示压缩错误，动态表已经不可靠，连接要以COMPRESSION_ERROR关闭
+    //解码后的总大小超过maxListSize（0不限制）时仍然解码完整个块以保持动态表同步，但之后的header被丢弃，isTooLarge返回true
+    bool decode(const char *data, size_t len, std::vector<HPackHeader> &headers, size_t maxListSize = 0);
+    bool isTooLarge() const { return m_tooLarge; }
+    //本端SETTINGS_HEADER_TABLE_SIZE，对端的动态表大小更新不能超过它
+    void setMaxTableSize(uint32_t v);
+    const HPackTable &getTable() const { return m_table; }
+
+private:
+    HPackTable m_table;
+    uint32_t m_maxTableSize;
+    bool m_tooLarge;
+};
+
+//编码header块，值较长时用huffman编码，set-cookie等敏感的header不进入动态表
+class HPackEncoder{
+public:
+    HPackEncoder(uint32_t maxTableSize = 4096);
+
+    //每个header块开始时调用，动态表大小变化后要先写大小更新
+    void begin(std::string &out);
+    void encode(const std::string &name, const std::string &value, std::string &out);
+    //对端SETTINGS_HEADER_TABLE_SIZE，本端使用的动态表不超过它
+    void setMaxTableSize(uint32_t v);
+    const HPackTable &getTable() const { return m_table; }
+
+private:
+    HPackTable m_table;
+    uint32_t m_pendingSize;
+    bool m_sizeUpdate;
+};
+
+//huffman解码，遇到EOS或者不合法的填充返回false
+bool HuffmanDecode(const char *data, size_t len, std::string &out);
+//huffman编码后的字节数
+size_t HuffmanEncodedLength(const char *data, size_t len);
+void HuffmanEncode(const char *data, size_t len, std::string &out);
+
+}
+}
@@ -1,7 +1,9 @@
 #include "http.h"
 
 #include "../log.h"
+#include "../config.h"
 #include <string.h>
+#include <time.h>
 #include <sstream>
 
 namespace server{
@@ -20,28 +22,279 @@ static const char *HttpStatusList[] = {
 #undef XX
 };
 
+//把[begin, end)中最多8个字节按内存中的顺序拼成整数，和运行时memcpy读到的值相同
+constexpr uint64_t PackWord(const char *s, size_t begin, size_t end, size_t i = 0){
+    return i >= 8 || begin + i >= end ? 0
+         : ((uint64_t)(uint8_t)s[begin + i] << (8 * (
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            i
+#else
+            7 - i
+#endif
+         ))) | PackWord(s, begin, end, i + 1);
+}
+
+static inline uint64_t LoadWord(const char *at, size_t length){
+    uint64_t word = 0;
+    memcpy(&word, at, length < 8 ? length : 8);
+    return word;
+}
+
+//方法名按长度和两个8字节整数比较，表在编译期由HTTP_METHOD_MAP生成，下标就是HttpMethod的值
+struct MethodWord{
+    uint64_t head;
+    uint64_t tail;
+    uint8_t len;
+};
+
+#define METHOD_WORD(string) \
+    {PackWord(#string, 0, sizeof(#string) - 1), PackWord(#string, 8, sizeof(#string) - 1), sizeof(#string) - 1}
+
+static constexpr MethodWord s_method_words[] = {
+#define XX(num, method, string) METHOD_WORD(string),
+    HTTP_METHOD_MAP(XX)
+#undef XX
+};
+
+#undef METHOD_WORD
+
+#define XX(num, method, string) \
+    static_assert(num < sizeof(s_method_words) / sizeof(s_method_words[0]) \
+                  && s_method_words[num].len == sizeof(#string) - 1 && sizeof(#string) - 1 <= 16, \
+                  "HTTP_METHOD_MAP must be numbered from 0 and names must fit in 16 bytes");
+HTTP_METHOD_MAP(XX)
+#undef XX
+
+static constexpr uint64_t s_http10_word = PackWord("HTTP/1.0", 0, 8);
+static constexpr uint64_t s_http11_word = PackWord("HTTP/1.1", 0, 8);
+
+static server::ConfigVar<std::string>::ptr g_http_server_name =
+    server::Config::AddData("http.server.name", std::string("sewing-server/1.0.0"), "value of the Server response header, empty to disable");
+
+//编译期生成完整的状态行，序列化时直接memcpy
+struct StatusLine{
+    const char *data;
+    size_t len;
+};
+
+enum HttpStatusIndex
+{
+#define XX(num, status, string) STATUS_INDEX_##status,
+    HTTP_STATUS_MAP(XX)
+#undef XX
+    STATUS_INDEX_COUNT
+};
+
+#define STATUS_LINE(version, num, string) \
+    {"HTTP/" version " " #num " " #string "\r\n", sizeof("HTTP/" version " " #num " " #string "\r\n") - 1}
+
+static const StatusLine HttpStatusLine10[] = {
+#define XX(num, status, string) STATUS_LINE("1.0", num, string),
+    HTTP_STATUS_MAP(XX)
+#undef XX
+};
+
+static const StatusLine HttpStatusLine11[] = {
+#define XX(num, status, string) STATUS_LINE("1.1", num, string),
+    HTTP_STATUS_MAP(XX)
+#undef XX
+};
+
+#undef STATUS_LINE
+
+static int HttpStatustoIndex(HttpStatus val){
+    switch (val)
+    {
+    #define XX(num, status, string)     \
+        case HttpStatus::status:        \
+        return STATUS_INDEX_##status;
+
+    HTTP_STATUS_MAP(XX);
+    #undef XX
+    default:
+        return -1;
+    }
+}
+
+static const StatusLine *GetStatusLine(HttpStatus status, uint8_t version){
+    int idx = HttpStatustoIndex(status);
+    if (idx < 0){
+        return nullptr;
+    }
+    if (version == 0x11){
+        return &HttpStatusLine11[idx];
+    }
+    if (version == 0x10){
+        return &HttpStatusLine10[idx];
+    }
+    return nullptr;
+}
+
+//空闲链表按16字节分级，更大的直接用operator new
+static const size_t NODE_POOL_GRANULE = 16;
+static const size_t NODE_POOL_MAX_SIZE = 256;
+//每一级最多缓存的节点数，超过的直接释放
+static const uint32_t NODE_POOL_MAX_FREE = 1024;
+//复用的请求和响应最多保留这么大的body容量，避免空闲连接占着大块内存
+static const size_t RECYCLE_MAX_BODY = 16 * 1024;
+
+//没有析构函数，线程退出时缓存的节点不归还（IOManager的线程和进程同生命周期）
+struct NodePool{
+    struct Node{
+        Node *next;
+    };
+    Node *heads[NODE_POOL_MAX_SIZE / NODE_POOL_GRANULE];
+    uint32_t counts[NODE_POOL_MAX_SIZE / NODE_POOL_GRANULE];
+};
+
+static thread_local NodePool t_node_pool = {{nullptr}, {0}};
+
+void *NodePoolAllocate(size_t size){
+    if (size == 0 || size > NODE_POOL_MAX_SIZE){
+        return ::operator new(size);
+    }
+    size_t idx = (size - 1) / NODE_POOL_GRANULE;
+    NodePool &pool = t_node_pool;
+    NodePool::Node *node = pool.heads[idx];
+    if (node){
+        pool.heads[idx] = node->next;
+        --pool.counts[idx];
+        return node;
+    }
+    return ::operator new((idx + 1) * NODE_POOL_GRANULE);
+}
+
+void NodePoolDeallocate(void *ptr, size_t size){
+    if (size == 0 || size > NODE_POOL_MAX_SIZE){
+        ::operator delete(ptr);
+        return;
+    }
+    size_t idx = (size - 1) / NODE_POOL_GRANULE;
+    NodePool &pool = t_node_pool;
+    if (pool.counts[idx] >= NODE_POOL_MAX_FREE){
+        ::operator delete(ptr);
+        return;
+    }
+    NodePool::Node *node = static_cast<NodePool::Node *>(ptr);
+    node->next = pool.heads[idx];
+    pool.heads[idx] = node;
+    ++pool.counts[idx];
+}
+
+static void ClearBody(std::string &body){
+    if (body.capacity() > RECYCLE_MAX_BODY){
+        std::string().swap(body);
+    }
+    else{
+        body.clear();
+    }
+}
+
+//Date和Server头部每个线程缓存一份，每秒最多重新生成一次
+struct HeaderCache{
+    time_t sec = 0;
+    char date[64];
+    size_t dateLen = 0;
+    std::string server;
+};
+
+static thread_local HeaderCache t_header_cache;
+
+static const HeaderCache &GetHeaderCache(){
+    time_t now = time(0);
+    HeaderCache &cache = t_header_cache;
+    if (now != cache.sec){
+        cache.sec = now;
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        cache.dateLen = strftime(cache.date, sizeof(cache.date), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        std::string name = g_http_server_name->getVal();
+        cache.server = name.empty() ? "" : "Server: " + name + "\r\n";
+    }
+    return cache;
+}
+
+StringView HttpDateValue(){
+    //去掉"Date: "和结尾的CRLF
+    const HeaderCache &cache = GetHeaderCache();
+    return StringView(cache.date + 6, cache.dateLen - 8);
+}
+
+StringView HttpServerValue(){
+    const HeaderCache &cache = GetHeaderCache();
+    if (cache.server.empty()){
+        return StringView();
+    }
+    return StringView(cache.server.c_str() + 8, cache.server.size() - 10);
+}
+
+bool HasToken(const std::string &v, const char *token){
+    size_t len = strlen(token);
+    size_t pos = 0;
+    while (pos < v.size()){
+        size_t end = v.find(',', pos);
+        if (end == std::string::npos){
+            end = v.size();
+        }
+        size_t b = pos;
+        size_t e = end;
+        while (b < e && (v[b] == ' ' || v[b] == '\t')){
+            ++b;
+        }
+        while (e > b && (v[e - 1] == ' ' || v[e - 1] == '\t')){
+            --e;
+        }
+        if (e - b == len && strncasecmp(v.c_str() + b, token, len) == 0){
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
 HttpMethod StringtoHttpMethod(const std::string &val){
-#define XX(num, method, string)            \
-    if (strcmp(#string, val.c_str()) == 0) \
-    {                                      \
-        return HttpMethod::method;         \
+    return ParseHttpMethod(val.c_str(), val.size());
+}
+
+HttpMethod CharstoHttpMethod(const char *val){
+    //前缀匹配，长度已经记录在表中，不需要每次strlen
+    for (size_t i = 0; i < sizeof(s_method_words) / sizeof(s_method_words[0]); ++i){
+        if (strncmp(HttpMethodList[i], val, s_method_words[i].len) == 0){
+            return (HttpMethod)i;
+        }
     }
-    HTTP_METHOD_MAP(XX);
-#undef XX
     return HttpMethod::INVALID_METHOD;
 }
 
-HttpMethod CharstoHttpMethod(const char *val){
-#define XX(num, method, string)                      \
-    if (strncmp(#string, val, strlen(#string)) == 0) \
-    {                                                \
-        return HttpMethod::method;                   \
+HttpMethod ParseHttpMethod(const char *at, size_t length){
+    if (length == 0 || length > 16){
+        return HttpMethod::INVALID_METHOD;
+    }
+    uint64_t head = LoadWord(at, length);
+    uint64_t tail = length > 8 ? LoadWord(at + 8, length - 8) : 0;
+    for (size_t i = 0; i < sizeof(s_method_words) / sizeof(s_method_words[0]); ++i){
+        const MethodWord &w = s_method_words[i];
+        if (w.len == length && w.head == head && w.tail == tail){
+            return (HttpMethod)i;
+        }
     }
-    HTTP_METHOD_MAP(XX);
-#undef XX
     return HttpMethod::INVALID_METHOD;
 }
 
+uint8_t ParseHttpVersion(const char *at, size_t length){
+    if (length != 8){
+        return 0;
+    }
+    uint64_t word = LoadWord(at, 8);
+    if (word == s_http11_word){
+        return 0x11;
+    }
+    if (word == s_http10_word){
+        return 0x10;
+    }
+    return 0;
+}
+
 const char* HttpMethodtoString(const HttpMethod &val){
     uint32_t idx = (uint32_t)val;
     if (idx >= sizeof(HttpMethodList) / sizeof(HttpMethodList[0])){
@@ -68,17 +321,273 @@ bool CaseInsenitiveLess::operator()(const std::string &lhs, const std::string &r
     return strcasecmp(lhs.c_str(), rhs.c_str()) < 0;
 }
 
+bool ParseContentLength(const char *data, size_t len, int64_t &val){
+    if (len == 0){
+        return false;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < len; ++i){
+        unsigned d = (unsigned char)data[i] - '0';
+        if (d > 9 || v > ((uint64_t)std::numeric_limits<int64_t>::max() - d) / 10){
+            return false;
+        }
+        v = v * 10 + d;
+    }
+    val = (int64_t)v;
+    return true;
+}
+
+//connection和content-length在设置header时解析一次并缓存，之后每次判断长连接和读取body时不用再查map和转换
+static ConnectionHeader ParseConnectionHeader(const std::string &val){
+    if (strcasecmp(val.c_str(), "keep-alive") == 0){
+        return ConnectionHeader::KEEP_ALIVE;
+    }
+    if (strcasecmp(val.c_str(), "close") == 0){
+        return ConnectionHeader::CLOSE;
+    }
+    return ConnectionHeader::OTHER;
+}
+
+//val为nullptr表示删除了这个header
+static void UpdateHotHeader(const std::string &key, const std::string *val, ConnectionHeader &conn, int64_t &length){
+    if (key.size() == 10 && strcasecmp(key.c_str(), "connection") == 0){
+        conn = val ? ParseConnectionHeader(*val) : ConnectionHeader::NONE;
+    }
+    else if (key.size() == 14 && strcasecmp(key.c_str(), "content-length") == 0){
+        if (!val || !ParseContentLength(val->c_str(), val->size(), length)){
+            length = -1;
+        }
+    }
+}
+
+static void InitHotHeaders(const HttpRequest::MapType &headers, ConnectionHeader &conn, int64_t &length){
+    conn = ConnectionHeader::NONE;
+    length = -1;
+    auto it = headers.find("connection");
+    if (it != headers.end()){
+        UpdateHotHeader(it->first, &it->second, conn, length);
+    }
+    it = headers.find("content-length");
+    if (it != headers.end()){
+        UpdateHotHeader(it->first, &it->second, conn, length);
+    }
+}
+
 HttpRequest::HttpRequest(uint8_t version, bool close)
 :m_method(HttpMethod::GET)
 ,m_version(version)
 ,m_close(close)
+,m_parsed(0)
+,m_connection(ConnectionHeader::NONE)
+,m_headerContentLength(-1)
 ,m_path("/")
 {
 
 }
 
+void HttpRequest::reset(uint8_t version, bool close){
+    m_method = HttpMethod::GET;
+    m_version = version;
+    m_close = close;
+    m_parsed = 0;
+    m_connection = ConnectionHeader::NONE;
+    m_headerContentLength = -1;
+    m_path = "/";
+    m_query.clear();
+    m_fragment.clear();
+    ClearBody(m_body);
+    //头部留作备用，下一个请求的同名头复用value的容量
+    m_spareHeaders.clear();
+    m_spareHeaders.swap(m_headers);
+    m_parames.clear();
+    m_cookies.clear();
+    m_paramPos.clear();
+    m_cookiePos.clear();
+    m_allParames.clear();
+    m_allCookies.clear();
+}
+
+static int FromHex(char c){
+    if (c >= '0' && c <= '9'){
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f'){
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F'){
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+std::string UrlDecode(const char *data, size_t len, bool plus){
+    std::string out;
+    out.reserve(len);
+    for (size_t i = 0; i < len; ++i){
+        char c = data[i];
+        if (c == '+' && plus){
+            c = ' ';
+        }
+        else if (c == '%' && i + 2 < len && FromHex(data[i + 1]) >= 0 && FromHex(data[i + 2]) >= 0){
+            c = (char)(FromHex(data[i + 1]) << 4 | FromHex(data[i + 2]));
+            i += 2;
+        }
+        out.push_back(c);
+    }
+    return out;
+}
+
+//没有需要解码的字符时直接使用原始数据
+static bool NeedDecode(const char *data, size_t len, bool plus){
+    return memchr(data, '%', len) || (plus && memchr(data, '+', len));
+}
+
+static std::string DecodeView(const char *data, size_t len, bool plus){
+    return NeedDecode(data, len, plus) ? UrlDecode(data, len, plus) : std::string(data, len);
+}
+
+//按sep切分key=value，cookie需要去掉两边的空格和值两边的引号
+static void SplitParams(const std::string &data, char sep, bool cookie, uint8_t source, std::vector<HttpParamPos> &out){
+    size_t pos = 0;
+    while (pos < data.size()){
+        size_t end = data.find(sep, pos);
+        if (end == std::string::npos){
+            end = data.size();
+        }
+        size_t b = pos;
+        size_t e = end;
+        if (cookie){
+            while (b < e && data[b] == ' '){
+                ++b;
+            }
+            while (e > b && data[e - 1] == ' '){
+                --e;
+            }
+        }
+        pos = end + 1;
+        if (b == e){
+            continue;
+        }
+        size_t eq = data.find('=', b);
+        HttpParamPos p;
+        p.key = b;
+        p.source = source;
+        if (eq == std::string::npos || eq >= e){
+            p.keyLen = e - b;
+            p.value = e;
+            p.valueLen = 0;
+        }
+        else{
+            p.keyLen = eq - b;
+            p.value = eq + 1;
+            p.valueLen = e - eq - 1;
+            if (cookie && p.valueLen >= 2 && data[p.value] == '"' && data[e - 1] == '"'){
+                ++p.value;
+                p.valueLen -= 2;
+            }
+        }
+        out.push_back(p);
+    }
+}
+
+//key中有编码时先解码再比较，和MapType一样不区分大小写
+static bool KeyEquals(const std::string &data, const HttpParamPos &p, const std::string &key, bool plus){
+    const char *raw = data.c_str() + p.key;
+    if (!NeedDecode(raw, p.keyLen, plus)){
+        return p.keyLen == key.size() && strncasecmp(raw, key.c_str(), key.size()) == 0;
+    }
+    return strcasecmp(UrlDecode(raw, p.keyLen, plus).c_str(), key.c_str()) == 0;
+}
+
+void HttpRequest::initParam() const{
+    if (m_parsed & PARSED_PARAM){
+        return;
+    }
+    m_parsed |= PARSED_PARAM;
+    m_paramPos.clear();
+    SplitParams(m_query, '&', false, 0, m_paramPos);
+    auto it = m_headers.find("content-type");
+    static const char FORM[] = "application/x-www-form-urlencoded";
+    if (!m_body.empty() && it != m_headers.end()
+            && strncasecmp(it->second.c_str(), FORM, sizeof(FORM) - 1) == 0){
+        SplitParams(m_body, '&', false, 1, m_paramPos);
+    }
+}
+
+const std::string *HttpRequest::getCookieHeader() const{
+    auto it = m_headers.find("cookie");
+    return it == m_headers.end() ? nullptr : &it->second;
+}
+
+void HttpRequest::initCookie() const{
+    if (m_parsed & PARSED_COOKIE){
+        return;
+    }
+    m_parsed |= PARSED_COOKIE;
+    m_cookiePos.clear();
+    const std::string *cookie = getCookieHeader();
+    if (cookie){
+        SplitParams(*cookie, ';', true, 0, m_cookiePos);
+    }
+}
+
+const HttpRequest::MapType &HttpRequest::getParames() const{
+    initParam();
+    if (m_paramPos.empty()){
+        return m_parames;
+    }
+    m_allParames = m_parames;
+    for (auto& i : m_paramPos){
+        const std::string &data = i.source ? m_body : m_query;
+        m_allParames.insert(std::make_pair(DecodeView(data.c_str() + i.key, i.keyLen, true)
+                                         , DecodeView(data.c_str() + i.value, i.valueLen, true)));
+    }
+    return m_allParames;
+}
+
+const HttpRequest::MapType &HttpRequest::getCookies() const{
+    initCookie();
+    if (m_cookiePos.empty()){
+        return m_cookies;
+    }
+    const std::string &data = *getCookieHeader();
+    m_allCookies = m_cookies;
+    for (auto& i : m_cookiePos){
+        m_allCookies.insert(std::make_pair(DecodeView(data.c_str() + i.key, i.keyLen, false)
+                                         , DecodeView(data.c_str() + i.value, i.valueLen, false)));
+    }
+    return m_allCookies;
+}
+
 void HttpRequest::setHeader(const std::string &key, const std::string &val){
     m_headers[key] = val;
+    UpdateHotHeader(key, &val, m_connection, m_headerContentLength);
+    //content-type和cookie会影响参数的解析结果
+    resetParam();
+    resetCookie();
+}
+
+void HttpRequest::setHeader(const char *key, size_t klen, const char *val, size_t vlen){
+    //key直接移动到节点中，已经存在时覆盖value
+    auto it = m_headers.emplace(std::string(key, klen), std::string()).first;
+    if (!m_spareHeaders.empty()){
+        auto spare = m_spareHeaders.find(it->first);
+        if (spare != m_spareHeaders.end()){
+            it->second.swap(spare->second);
+            m_spareHeaders.erase(spare);
+        }
+    }
+    it->second.assign(val, vlen);
+    UpdateHotHeader(it->first, &it->second, m_connection, m_headerContentLength);
+    resetParam();
+    resetCookie();
+}
+
+void HttpRequest::setHeaders(const MapType &v){
+    m_headers = v;
+    InitHotHeaders(m_headers, m_connection, m_headerContentLength);
+    resetParam();
+    resetCookie();
 }
 
 void HttpRequest::setParam(const std::string &key, const std::string &val){
@@ -91,14 +600,36 @@ void HttpRequest::setCookie(const std::string &key, const std::string &val){
 
 void HttpRequest::delHeader(const std::string &key){
     m_headers.erase(key);
+    UpdateHotHeader(key, nullptr, m_connection, m_headerContentLength);
+    resetParam();
+    resetCookie();
 }
 
 void HttpRequest::delParam(const std::string &key){
     m_parames.erase(key);
+    initParam();
+    for (auto it = m_paramPos.begin(); it != m_paramPos.end();){
+        if (KeyEquals(it->source ? m_body : m_query, *it, key, true)){
+            it = m_paramPos.erase(it);
+        }
+        else{
+            ++it;
+        }
+    }
 }
 
 void HttpRequest::delCookie(const std::string &key){
     m_cookies.erase(key);
+    initCookie();
+    const std::string *cookie = getCookieHeader();
+    for (auto it = m_cookiePos.begin(); cookie && it != m_cookiePos.end();){
+        if (KeyEquals(*cookie, *it, key, false)){
+            it = m_cookiePos.erase(it);
+        }
+        else{
+            ++it;
+        }
+    }
 }
 
 bool HttpRequest::hasHeader(const std::string &key, std::string* val){
@@ -114,27 +645,60 @@ bool HttpRequest::hasHeader(const std::string &key, std::string* val){
 
 bool HttpRequest::hasParam(const std::string &key, std::string* val){
     auto it = m_parames.find(key);
-    if (it == m_parames.end()){
-        return false;
+    if (it != m_parames.end()){
+        if (val){
+            *val = it->second;
+        }
+        return true;
     }
-    if (val){
-        *val = it->second;
+    initParam();
+    for (auto& i : m_paramPos){
+        const std::string &data = i.source ? m_body : m_query;
+        if (KeyEquals(data, i, key, true)){
+            if (val){
+                *val = DecodeView(data.c_str() + i.value, i.valueLen, true);
+            }
+            return true;
+        }
     }
-    return true;
+    return false;
 }
 
 bool HttpRequest::hasCookie(const std::string &key, std::string* val){
     auto it = m_cookies.find(key);
-    if (it == m_cookies.end()){
-        return false;
+    if (it != m_cookies.end()){
+        if (val){
+            *val = it->second;
+        }
+        return true;
     }
-    if (val){
-        *val = it->second;
+    initCookie();
+    const std::string *cookie = getCookieHeader();
+    for (auto& i : m_cookiePos){
+        if (KeyEquals(*cookie, i, key, false)){
+            if (val){
+                *val = DecodeView(cookie->c_str() + i.value, i.valueLen, false);
+            }
+            return true;
+        }
     }
-    return true;
+    return false;
+}
+
+void HttpRequest::init(){
+    if (m_connection == ConnectionHeader::KEEP_ALIVE){
+        m_close = false;
+        return;
+    }
+    if (m_connection == ConnectionHeader::CLOSE){
+        m_close = true;
+        return;
+    }
+    //HTTP/1.1默认长连接，HTTP/1.0默认短连接
+    m_close = m_version < 0x11;
 }
 
-std::ostream& HttpRequest::dump(std::ostream &os){
+std::ostream& HttpRequest::dump(std::ostream &os) const{
     //GET /uri HTTP/1.1 \r\n
     //Host: www.baidu.com
 
@@ -149,7 +713,7 @@ std::ostream& HttpRequest::dump(std::ostream &os){
        << "."
        << ((uint32_t)(m_version & 0x0F))
        << "\r\n"
-       << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
+       << "connection: " << (m_headers.count("upgrade") ? "Upgrade" : (m_close ? "close" : "keep-alive")) << "\r\n";
 
     for (auto& i : m_headers){
         if (strcasecmp(i.first.c_str(), "connection") == 0){
@@ -162,12 +726,12 @@ std::ostream& HttpRequest::dump(std::ostream &os){
         os << "Content-Length: " << m_body.size() << "\r\n\r\n" << m_body;
     }
     else{
-        os << "\r\n\r\n";
+        os << "\r\n";
     }
     return os;
 }
 
-std::string HttpRequest::toString(){
+std::string HttpRequest::toString() const{
     std::stringstream ss;
     dump(ss);
     return ss.str();
@@ -177,16 +741,41 @@ HttpResponse::HttpResponse(uint8_t version, bool close)
 :m_status(HttpStatus::OK)
 ,m_version(version)
 ,m_close(close)
+,m_stream(false)
+,m_contentLength(-1)
+,m_connection(ConnectionHeader::NONE)
+,m_headerContentLength(-1)
 {
 
 }
 
+void HttpResponse::reset(uint8_t version, bool close){
+    m_status = HttpStatus::OK;
+    m_version = version;
+    m_close = close;
+    m_stream = false;
+    m_contentLength = -1;
+    m_connection = ConnectionHeader::NONE;
+    m_headerContentLength = -1;
+    m_raw.reset();
+    ClearBody(m_body);
+    m_reason.clear();
+    m_headers.clear();
+}
+
 void HttpResponse::setHeader(const std::string &key, const std::string &val){
     m_headers[key] = val;
+    UpdateHotHeader(key, &val, m_connection, m_headerContentLength);
+}
+
+void HttpResponse::setHeaders(const MapType &v){
+    m_headers = v;
+    InitHotHeaders(m_headers, m_connection, m_headerContentLength);
 }
 
 void HttpResponse::delHeader(const std::string &key){
     m_headers.erase(key);
+    UpdateHotHeader(key, nullptr, m_connection, m_headerContentLength);
 }
 
 bool HttpResponse::hasHeader(const std::string &key, std::string* val){
@@ -200,50 +789,135 @@ bool HttpResponse::hasHeader(const std::string &key, std::string* val){
     return true;
 }
 
-std::ostream& HttpResponse::dump(std::ostream &os){
+static void AppendUint(std::string &buf, uint64_t v){
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *p = end;
+    do{
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    buf.append(p, end - p);
+}
+
+void HttpResponse::serializeHeader(std::string &buf) const{
+    appendHeader(buf, true);
+}
+
+HttpRawResponse::ptr HttpResponse::serializeRaw() const{
+    std::shared_ptr<HttpRawResponse> raw(new HttpRawResponse);
+    raw->connOffset = appendHeader(raw->data, false);
+    raw->data.append(m_body);
+    return raw;
+}
+
+size_t HttpResponse::appendHeader(std::string &buf, bool conn) const{
     //HTTP/1.0 200 OK
     //Pragma: no-cache
     //Content-Type: text/html
     //Content-Length: 14988
     //Connection: close
-    os << "HTTP/"
-       << ((uint32_t)(m_version >> 4))
-       << "."
-       << ((uint32_t)(m_version & 0x0F))
-       << " "
-       << (uint32_t)m_status
-       << " "
-       << (m_reason.empty() ? HttpStatustoString(m_status) : m_reason)
-       <<  "\r\n";
-    
+    const StatusLine *line = m_reason.empty() ? GetStatusLine(m_status, m_version) : nullptr;
+    if (line){
+        buf.append(line->data, line->len);
+    }
+    else{
+        buf.append("HTTP/");
+        buf.push_back((char)('0' + (m_version >> 4)));
+        buf.push_back('.');
+        buf.push_back((char)('0' + (m_version & 0x0F)));
+        buf.push_back(' ');
+        AppendUint(buf, (uint32_t)m_status);
+        buf.push_back(' ');
+        buf.append(m_reason.empty() ? HttpStatustoString(m_status) : m_reason.c_str());
+        buf.append("\r\n");
+    }
+
+    bool has_date = false;
+    bool has_server = false;
     for (auto& i : m_headers){
         if (strcasecmp(i.first.c_str(), "connection") == 0){
             continue;
         }
-        os << i.first << ": " << i.second << "\r\n";
+        if (!has_date && strcasecmp(i.first.c_str(), "date") == 0){
+            has_date = true;
+            //缓存的响应发送时再生成Date
+            if (!conn){
+                continue;
+            }
+        }
+        else if (!has_server && strcasecmp(i.first.c_str(), "server") == 0){
+            has_server = true;
+        }
+        buf.append(i.first);
+        buf.append(": ");
+        buf.append(i.second);
+        buf.append("\r\n");
+    }
+    const HeaderCache &cache = GetHeaderCache();
+    if (!has_date && conn){
+        buf.append(cache.date, cache.dateLen);
+    }
+    if (!has_server){
+        buf.append(cache.server);
+    }
+    size_t conn_offset = buf.size();
+    if (conn && m_status == HttpStatus::SWITCHING_PROTOCOLS){
+        buf.append("connection: Upgrade\r\n");
+    }
+    else if (conn){
+        buf.append(m_close ? "connection: close\r\n" : "connection: keep-alive\r\n");
     }
-    os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
 
-    if (!m_body.empty()){
-        os << "content-length: " << m_body.size() << "\r\n\r\n" << m_body;
+    if (m_stream && m_contentLength >= 0){
+        if (hasContentLength()){
+            buf.append("content-length: ");
+            AppendUint(buf, (uint64_t)m_contentLength);
+            buf.append("\r\n");
+        }
+        buf.append("\r\n");
+    }
+    else if (m_stream){
+        //HTTP/1.0不支持chunked，只能靠关闭连接来结束body
+        buf.append(m_version >= 0x11 ? "transfer-encoding: chunked\r\n\r\n" : "\r\n");
+    }
+    else if (!m_body.empty()){
+        buf.append("content-length: ");
+        AppendUint(buf, m_body.size());
+        buf.append("\r\n\r\n");
+    }
+    else if (hasContentLength()){
+        //空body也要写明长度，否则长连接和pipeline下对端无法确定响应的结束位置
+        buf.append("content-length: 0\r\n\r\n");
     }
     else{
-        os << "\r\n\r\n";
+        buf.append("\r\n");
     }
-    return os;
+    return conn_offset;
+}
+
+std::ostream& HttpResponse::dump(std::ostream &os) const{
+    std::string buf;
+    serializeHeader(buf);
+    return os << buf << m_body;
+}
+
+bool HttpResponse::hasContentLength() const{
+    uint32_t status = (uint32_t)m_status;
+    return status >= 200 && status != 204 && status != 304;
 }
 
-std::string HttpResponse::toString(){
+std::string HttpResponse::toString() const{
     std::stringstream ss;
     dump(ss);
     return ss.str();
 }
 
-std::ostream& operator<<(std::ostream& os, HttpRequest req){
+std::ostream& operator<<(std::ostream& os, const HttpRequest &req){
     return req.dump(os);
 }
 
-std::ostream& operator<<(std::ostream& os, HttpResponse rsp){
+std::ostream& operator<<(std::ostream& os, const HttpResponse &rsp){
     return rsp.dump(os);
 }
 
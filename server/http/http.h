@@ -2,11 +2,20 @@
 
 #include <memory>
 #include <map>
+#include <vector>
+#include <limits>
+#include <type_traits>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <boost/lexical_cast.hpp>
+#include <boost/utility/string_view.hpp>
 
 namespace server{
 namespace http{
 
+typedef boost::string_view StringView;
+
 /* Request Methods */
 //接受一个参数XX
 #define HTTP_METHOD_MAP(XX)         \
@@ -134,21 +143,147 @@ struct CaseInsenitiveLess{
     bool operator()(const std::string &lhs, const std::string &rhs) const;
 };
 
+//小块内存（map节点等）的线程内空闲链表，释放的节点留给本线程之后的请求，长连接上不用每个请求都malloc
+//协程换了线程时释放到当前线程的链表中
+void *NodePoolAllocate(size_t size);
+void NodePoolDeallocate(void *ptr, size_t size);
+
+template<class T>
+class NodePoolAllocator{
+public:
+    typedef T value_type;
+
+    NodePoolAllocator() {}
+    template<class U>
+    NodePoolAllocator(const NodePoolAllocator<U> &) {}
+
+    template<class U>
+    struct rebind{
+        typedef NodePoolAllocator<U> other;
+    };
+
+    T *allocate(size_t n){
+        return static_cast<T *>(NodePoolAllocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n){
+        NodePoolDeallocate(p, n * sizeof(T));
+    }
+};
+
+template<class T, class U>
+bool operator==(const NodePoolAllocator<T> &, const NodePoolAllocator<U> &) { return true; }
+
+template<class T, class U>
+bool operator!=(const NodePoolAllocator<T> &, const NodePoolAllocator<U> &) { return false; }
+
 HttpMethod StringtoHttpMethod(const std::string &val);
 HttpMethod CharstoHttpMethod(const char *val);
+//解析器使用，先比较长度再按8字节整数比较，不产生std::string
+HttpMethod ParseHttpMethod(const char *at, size_t length);
+//HTTP/1.0返回0x10，HTTP/1.1返回0x11，其他返回0
+uint8_t ParseHttpVersion(const char *at, size_t length);
 const char* HttpMethodtoString(const HttpMethod &val);
 const char* HttpStatustoString(const HttpStatus &val);
-
-//查找MapType是否存在key对应的val，返回true和false并赋值给val，如果不存在使用def的值。
-template<class MapType, class T>
-bool checkGetAs(const MapType& m, const std::string& key, T& val, const T& def = T()){
-    auto it = m.find(key);
-    if (it == m.end()){
-        val = def;
+//响应中Date和Server头的值（不含头名），每个线程缓存，http.server.name为空时Server为空
+StringView HttpDateValue();
+StringView HttpServerValue();
+//Connection、Upgrade等逗号分隔的列表中是否有token（不区分大小写）
+bool HasToken(const std::string &v, const char *token);
+
+//不抛异常的整数解析（类似std::from_chars），整个字符串必须是十进制数字，可以带+/-，溢出时返回false
+template<class T>
+bool ParseInteger(const char *data, size_t len, T &val){
+    typedef typename std::make_unsigned<T>::type U;
+    if (len == 0){
         return false;
     }
+    bool neg = false;
+    size_t i = 0;
+    if (data[0] == '+' || data[0] == '-'){
+        neg = data[0] == '-';
+        if (len == 1 || (neg && !std::is_signed<T>::value)){
+            return false;
+        }
+        i = 1;
+    }
+    U limit = (U)std::numeric_limits<T>::max() + (neg ? 1 : 0);
+    U v = 0;
+    for (; i < len; ++i){
+        unsigned d = (unsigned char)data[i] - '0';
+        if (d > 9 || v > (limit - d) / 10){
+            return false;
+        }
+        v = v * 10 + d;
+    }
+    val = neg ? (T)(0 - v) : (T)v;
+    return true;
+}
+
+//Content-Length的值只能是十进制数字（1*DIGIT），不允许符号、空白和空值，溢出时返回false
+bool ParseContentLength(const char *data, size_t len, int64_t &val);
+
+//char类型和lexical_cast一样按字符处理，不按数字解析
+template<class T>
+struct IsParseInteger{
+    static const bool value = std::is_integral<T>::value && !std::is_same<T, bool>::value
+                           && !std::is_same<T, char>::value && !std::is_same<T, signed char>::value
+                           && !std::is_same<T, unsigned char>::value;
+};
+
+//把字符串转换成T，失败时val为def。整数、浮点数、bool和string不抛异常，其他类型使用lexical_cast
+template<class T>
+typename std::enable_if<IsParseInteger<T>::value, bool>::type
+castAs(const std::string &str, T& val, const T& def = T()){
+    if (ParseInteger(str.c_str(), str.size(), val)){
+        return true;
+    }
+    val = def;
+    return false;
+}
+
+template<class T>
+typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+castAs(const std::string &str, T& val, const T& def = T()){
+    const char *begin = str.c_str();
+    char *end = nullptr;
+    //strtod会跳过开头的空白，lexical_cast不允许
+    if (!str.empty() && *begin > ' '){
+        errno = 0;
+        long double v = strtold(begin, &end);
+        if (end == begin + str.size() && errno != ERANGE
+            && v <= std::numeric_limits<T>::max() && v >= -std::numeric_limits<T>::max()){
+            val = (T)v;
+            return true;
+        }
+    }
+    val = def;
+    return false;
+}
+
+inline bool castAs(const std::string &str, bool& val, const bool& def = false){
+    if (str == "1"){
+        val = true;
+        return true;
+    }
+    if (str == "0"){
+        val = false;
+        return true;
+    }
+    val = def;
+    return false;
+}
+
+inline bool castAs(const std::string &str, std::string& val, const std::string& def = ""){
+    val = str;
+    return true;
+}
+
+template<class T>
+typename std::enable_if<!IsParseInteger<T>::value && !std::is_floating_point<T>::value, bool>::type
+castAs(const std::string &str, T& val, const T& def = T()){
     try{
-        val = boost::lexical_cast<T>(it->second);
+        val = boost::lexical_cast<T>(str);
         return true;
     }
     catch(...){
@@ -157,28 +292,57 @@ bool checkGetAs(const MapType& m, const std::string& key, T& val, const T& def =
     return false;
 }
 
-//查找MapType是否存在key对应的val，如果存在返回改值，不存在返回ef的值。
+//connection头的值，setHeader时解析一次
+enum class ConnectionHeader
+{
+    NONE = 0,
+    KEEP_ALIVE = 1,
+    CLOSE = 2,
+    //Upgrade等其他值
+    OTHER = 3,
+};
+
+//查找MapType是否存在key对应的val，返回true和false并赋值给val，如果不存在使用def的值。
 template<class MapType, class T>
-T getAs(const MapType& m, const std::string& key, const T& def = T()){
+bool checkGetAs(const MapType& m, const std::string& key, T& val, const T& def = T()){
     auto it = m.find(key);
     if (it == m.end()){
-        return def;
-    }
-    try{
-        return boost::lexical_cast<T>(it->second);
-    }
-    catch(...){
+        val = def;
+        return false;
     }
-    return def;
-;
+    return castAs(it->second, val, def);
 }
 
+//查找MapType是否存在key对应的val，如果存在返回改值，不存在返回ef的值。
+template<class MapType, class T>
+T getAs(const MapType& m, const std::string& key, const T& def = T()){
+    T val;
+    checkGetAs(m, key, val, def);
+    return val;
+}
+
+//URL解码，plus为true时把+解码成空格（query和表单）
+std::string UrlDecode(const char *data, size_t len, bool plus = true);
+
+//query、表单或者cookie中的一个键值对，只记录在原始数据中的位置，读取时才解码
+struct HttpParamPos{
+    uint32_t key;
+    uint32_t keyLen;
+    uint32_t value;
+    uint32_t valueLen;
+    //0: query 1: body
+    uint8_t source;
+};
+
 class HttpRequest{
 public:
     typedef std::shared_ptr<HttpRequest> ptr;
-    typedef std::map<std::string, std::string, CaseInsenitiveLess> MapType;
+    typedef std::map<std::string, std::string, CaseInsenitiveLess
+                     , NodePoolAllocator<std::pair<const std::string, std::string>>> MapType;
 
     HttpRequest(uint8_t version = 0x11, bool close = true);
+    //恢复到刚构造的状态，字符串和vector保留容量，用于长连接上复用同一个对象
+    void reset(uint8_t version = 0x11, bool close = true);
     const HttpMethod getMethod() const { return m_method; };
     const uint8_t getVersion() const { return m_version; };
     const bool isClose() const { return m_close; };
@@ -187,21 +351,32 @@ public:
     const std::string &getFragment() const { return m_fragment; };
     const std::string &getBody() const { return m_body; };
     const MapType &getHeaders() const { return m_headers; };
-    const MapType &getParames() const { return m_parames; };
-    const MapType &getCookies() const { return m_cookies; };
+    //content-length头的值，没有或者不合法时为-1
+    int64_t getHeaderContentLength() const { return m_headerContentLength; };
+    ConnectionHeader getConnectionHeader() const { return m_connection; };
+    //包含query和表单中的参数，调用时才全部解码到map中
+    const MapType &getParames() const;
+    //包含cookie头中的全部cookie
+    const MapType &getCookies() const;
 
     void setMethod(HttpMethod v) { m_method = v; };
     void setVersion(uint8_t v) { m_version = v; };
     void setClose(bool v) { m_close = v; };
     void setPath(const std::string &v) { m_path = v; };
-    void setQuery(const std::string &v) { m_query = v; };
+    void setQuery(const std::string &v) { m_query = v; resetParam(); };
     void setFragment(const std::string &v) { m_fragment = v; };
-    void setBody(const std::string &v) { m_body = v; };
-    void setHeaders(const MapType &v) { m_headers = v; };
+    //解析器使用，直接拷贝到已有的容量中，不构造临时的std::string
+    void setPath(const char *v, size_t len) { m_path.assign(v, len); };
+    void setQuery(const char *v, size_t len) { m_query.assign(v, len); resetParam(); };
+    void setFragment(const char *v, size_t len) { m_fragment.assign(v, len); };
+    void setBody(const std::string &v) { m_body = v; resetParam(); };
+    void setHeaders(const MapType &v);
     void setParames(const MapType &v) { m_parames = v; };
     void setCookies(const MapType &v) { m_cookies = v; };
 
     void setHeader(const std::string &key, const std::string &val);
+    //解析器使用，value拷贝到节点中，不构造临时的std::string
+    void setHeader(const char *key, size_t klen, const char *val, size_t vlen);
     void setParam(const std::string &key, const std::string &val);
     void setCookie(const std::string &key, const std::string &val);
 
@@ -213,6 +388,9 @@ public:
     bool hasParam(const std::string &key, std::string* val);
     bool hasCookie(const std::string &key, std::string* val);
 
+    //根据版本和Connection头部确定是否为长连接
+    void init();
+
     //检查并获取Http请求的头部参数
     template<class T>
     bool checkGetHeaderAs(const std::string& key, T& val, const T& def = T()){
@@ -224,33 +402,64 @@ public:
         return getAs(m_headers, key, def);
     }
 
+    //setParam设置的参数优先，其次是query，最后是application/x-www-form-urlencoded的body
     template<class T>
     bool checkGetParamAs(const std::string& key, T& val, const T& def = T()){
-        return checkGetAs(m_parames, key, val, def);
+        std::string str;
+        if (!hasParam(key, &str)){
+            val = def;
+            return false;
+        }
+        return castAs(str, val, def);
     }
 
     template<class T>
     T getParamAs(const std::string& key, const T& def = T()){
-        return getAs(m_parames, key, def);
+        T val;
+        checkGetParamAs(key, val, def);
+        return val;
     }
 
     template<class T>
     bool checkGetCookieAs(const std::string& key, T& val, const T& def = T()){
-        return checkGetAs(m_cookies, key, val, def);
+        std::string str;
+        if (!hasCookie(key, &str)){
+            val = def;
+            return false;
+        }
+        return castAs(str, val, def);
     }
 
     template<class T>
     T getCookieAs(const std::string& key, const T& def = T()){
-        return getAs(m_cookies, key, def);
+        T val;
+        checkGetCookieAs(key, val, def);
+        return val;
     }
 
-    std::ostream& dump(std::ostream &os);
-    std::string toString();
+    std::ostream& dump(std::ostream &os) const;
+    std::string toString() const;
 
 private:
+    enum ParseFlag
+    {
+        PARSED_PARAM = 0x1,
+        PARSED_COOKIE = 0x2,
+    };
+
+    //第一次访问时才切分query、表单和cookie，只记录位置，不拷贝也不解码
+    void initParam() const;
+    void initCookie() const;
+    void resetParam() { m_parsed &= ~PARSED_PARAM; m_paramPos.clear(); };
+    void resetCookie() { m_parsed &= ~PARSED_COOKIE; m_cookiePos.clear(); };
+    const std::string *getCookieHeader() const;
+
     HttpMethod m_method;
     uint8_t m_version;
     bool m_close;
+    mutable uint8_t m_parsed;
+    ConnectionHeader m_connection;
+    int64_t m_headerContentLength;
 
     std::string m_path;
     std::string m_query;
@@ -258,34 +467,71 @@ private:
     std::string m_body;
 
     MapType m_headers;
+    //reset前的头部，解析时按名字取回value的容量
+    MapType m_spareHeaders;
+    //setParam、setCookie设置的值
     MapType m_parames;
     MapType m_cookies;
+
+    mutable std::vector<HttpParamPos> m_paramPos;
+    mutable std::vector<HttpParamPos> m_cookiePos;
+    //getParames、getCookies时合并后的结果
+    mutable MapType m_allParames;
+    mutable MapType m_allCookies;
+};
+
+//序列化好的完整响应（不含Date和connection头），可以被不同版本的请求复用
+//发送时状态行的版本换成当前请求的版本，Date和connection头插入到connOffset处
+struct HttpRawResponse{
+    //状态行开头"HTTP/x.y"的长度
+    static const size_t VERSION_LEN = 8;
+    typedef std::shared_ptr<const HttpRawResponse> ptr;
+    std::string data;
+    size_t connOffset;
 };
 
 class HttpResponse{
 public:
     typedef std::shared_ptr<HttpResponse> ptr;
-    typedef std::map<std::string, std::string, CaseInsenitiveLess> MapType;
+    typedef std::map<std::string, std::string, CaseInsenitiveLess
+                     , NodePoolAllocator<std::pair<const std::string, std::string>>> MapType;
 
     HttpResponse(uint8_t version = 0x11, bool close = true);
+    //恢复到刚构造的状态，字符串保留容量，用于长连接上复用同一个对象
+    void reset(uint8_t version = 0x11, bool close = true);
     const HttpStatus getStatus() const { return m_status; };
     const uint8_t getVersion() const { return m_version; };
     const bool isClose() const { return m_close; };
+    const bool isStream() const { return m_stream; };
+    const int64_t getContentLength() const { return m_contentLength; };
+    const HttpRawResponse::ptr &getRaw() const { return m_raw; };
     const std::string &getBody() const { return m_body; };
     const std::string &getReason() const { return m_reason; };
     const MapType &getHeaders() const { return m_headers; };
+    //content-length头的值，没有或者不合法时为-1，和流式响应的getContentLength不同
+    int64_t getHeaderContentLength() const { return m_headerContentLength; };
+    ConnectionHeader getConnectionHeader() const { return m_connection; };
 
     void setStatus(HttpStatus v) { m_status = v; };
     void setVersion(uint8_t v) { m_version = v; };
     void setClose(bool v) { m_close = v; };
+    //流式响应，body通过HttpSession::startStream分块发送，不带content-length
+    void setStream(bool v) { m_stream = v; };
+    //流式响应已知body长度时（如sendfile）写content-length而不是chunked，-1表示未知
+    void setContentLength(int64_t v) { m_contentLength = v; };
+    //设置后HttpSession直接发送raw中的数据，忽略status、header和body
+    void setRaw(HttpRawResponse::ptr v) { m_raw = v; };
     void setBody(const std::string &v) { m_body = v; };
     void setReason(const std::string &v) { m_reason = v; };
-    void setHeaders(const MapType &v) { m_headers = v; };
+    void setHeaders(const MapType &v);
 
     void setHeader(const std::string &key, const std::string &val);
     void delHeader(const std::string &key);
     bool hasHeader(const std::string &key, std::string* val);
 
+    //1xx、204、304的响应不能带content-length
+    bool hasContentLength() const;
+
     template<class T>
     bool checkGetHeaderAs(const std::string& key, T& val, const T& def = T()){
         return checkGetAs(m_headers, key, val, def);
@@ -296,21 +542,34 @@ public:
         return getAs(m_headers, key, def);
     }
 
-    std::ostream& dump(std::ostream &os);
-    std::string toString();
+    //把状态行和header（包括最后的空行）追加到buf，body不拷贝
+    void serializeHeader(std::string &buf) const;
+    //序列化header和body，不写Date和connection头，用于缓存后复用
+    HttpRawResponse::ptr serializeRaw() const;
+
+    std::ostream& dump(std::ostream &os) const;
+    std::string toString() const;
 
 private:
+    //返回connection头的位置，conn为false时不写Date和connection头
+    size_t appendHeader(std::string &buf, bool conn) const;
+
     HttpStatus m_status;
     uint8_t m_version;
     bool m_close;
+    bool m_stream;
+    int64_t m_contentLength;
+    ConnectionHeader m_connection;
+    int64_t m_headerContentLength;
+    HttpRawResponse::ptr m_raw;
 
     std::string m_body;
     std::string m_reason;
     MapType m_headers;
 };
 
-std::ostream& operator<<(std::ostream& os, HttpRequest req);
-std::ostream& operator<<(std::ostream& os, HttpResponse rsp);
+std::ostream& operator<<(std::ostream& os, const HttpRequest &req);
+std::ostream& operator<<(std::ostream& os, const HttpResponse &rsp);
 
 }
 
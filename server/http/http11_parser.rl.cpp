@@ -6624,4 +6624,11 @@ int http_parser_has_error(http_parser *parser) {
 
 int http_parser_is_finished(http_parser *parser) {
   return parser->cs >= http_parser_first_final;
-}
\ No newline at end of file
+}
+
+/* 外部扫描已经解析完整个header时，直接置为完成状态，nread为header的总长度 */
+void http_parser_set_finished(http_parser *parser, size_t nread) {
+  parser->cs = http_parser_first_final;
+  parser->nread = nread;
+  parser->body_start = nread;
+}
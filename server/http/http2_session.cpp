@@ -0,0 +1,1286 @@
+#include "http2_session.h"
+#include "http_parser.h"
+#include "compress.h"
+#include "../config.h"
+#include "../iomanager.h"
+#include "../log.h"
+#include "../util.h"
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+namespace server{
+namespace http{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+static server::ConfigVar<uint32_t>::ptr g_http2_max_concurrent_streams =
+    server::Config::AddData("http.h2.max_concurrent_streams", (uint32_t)100, "max http/2 streams handled at the same time on one connection");
+
+static server::ConfigVar<uint32_t>::ptr g_http2_initial_window_size =
+    server::Config::AddData("http.h2.initial_window_size", (uint32_t)(256 * 1024), "http/2 receive window of each stream, bounds the request body buffered per stream");
+
+static server::ConfigVar<uint32_t>::ptr g_http2_connection_window_size =
+    server::Config::AddData("http.h2.connection_window_size", (uint32_t)(4 * 1024 * 1024), "http/2 receive window of the whole connection");
+
+static server::ConfigVar<uint32_t>::ptr g_http2_max_frame_size =
+    server::Config::AddData("http.h2.max_frame_size", (uint32_t)16384, "largest http/2 frame payload accepted, 16384~16777215");
+
+static server::ConfigVar<uint32_t>::ptr g_http2_max_header_list_size =
+    server::Config::AddData("http.h2.max_header_list_size", (uint32_t)(64 * 1024), "max decoded size of a http/2 request header list");
+
+static server::ConfigVar<uint64_t>::ptr g_http2_idle_timeout =
+    server::Config::AddData("http.h2.idle_timeout", (uint64_t)(60 * 1000), "ms a http/2 connection without active streams may stay idle");
+
+static const char s_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const size_t PREFACE_LEN = sizeof(s_preface) - 1;
+static const size_t FRAME_HEADER_LEN = 9;
+static const uint32_t DEFAULT_WINDOW = 65535;
+static const int64_t MAX_WINDOW = 0x7FFFFFFF;
+//sendData中每攒够这么多数据就先发出去
+static const size_t SEND_BATCH = 64 * 1024;
+
+enum
+{
+    FLAG_END_STREAM = 0x1,
+    FLAG_ACK = 0x1,
+    FLAG_END_HEADERS = 0x4,
+    FLAG_PADDED = 0x8,
+    FLAG_PRIORITY = 0x20,
+};
+
+enum
+{
+    SETTINGS_HEADER_TABLE_SIZE = 1,
+    SETTINGS_ENABLE_PUSH = 2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 4,
+    SETTINGS_MAX_FRAME_SIZE = 5,
+    SETTINGS_MAX_HEADER_LIST_SIZE = 6,
+};
+
+static uint32_t GetUint32(const char *p){
+    const uint8_t *u = (const uint8_t *)p;
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | u[3];
+}
+
+static void PutUint32(char *p, uint32_t v){
+    p[0] = (char)(v >> 24);
+    p[1] = (char)(v >> 16);
+    p[2] = (char)(v >> 8);
+    p[3] = (char)v;
+}
+
+static void AppendSetting(std::string &buf, uint16_t id, uint32_t v){
+    char p[6];
+    p[0] = (char)(id >> 8);
+    p[1] = (char)id;
+    PutUint32(p + 2, v);
+    buf.append(p, 6);
+}
+
+//去掉PADDED的填充，填充长度不合法返回false
+static bool StripPadding(uint8_t flags, const char *&data, size_t &length){
+    if (!(flags & FLAG_PADDED)){
+        return true;
+    }
+    if (length < 1){
+        return false;
+    }
+    size_t pad = (uint8_t)data[0];
+    if (pad >= length){
+        return false;
+    }
+    ++data;
+    length -= pad + 1;
+    return true;
+}
+
+//和HTTP/1.1的连接相关，HTTP/2中不能出现的header
+static bool IsConnectionHeader(const std::string &name){
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+        || name == "transfer-encoding" || name == "upgrade";
+}
+
+//CacheServlet等预先序列化的HTTP/1.1响应，解析回status、header和body
+static HttpResponse::ptr ParseRawResponse(const HttpRawResponse::ptr &raw){
+    std::string data = raw->data;
+    HttpResponseParser parser;
+    size_t offset = parser.execute(&data[0], data.size());
+    if (parser.hasError() || !parser.isFinished()){
+        return nullptr;
+    }
+    HttpResponse::ptr rsp = parser.getData();
+    //execute把header之后的数据移到了开头
+    rsp->setBody(data.substr(0, data.size() - offset));
+    return rsp;
+}
+
+Http2Stream::Http2Stream(std::shared_ptr<Http2Session> session, uint32_t id, HttpRequest::ptr req)
+:HttpSession(session->getSocket(), false)
+,m_session(session)
+,m_id(id)
+,m_request(req)
+,m_recvOffset(0)
+,m_recvWindow(session->m_initialWindow)
+,m_recvConsumed(0)
+,m_recvTotal(0)
+,m_contentLength(-1)
+,m_sendWindow(session->m_peerInitialWindow)
+,m_remoteClosed(false)
+,m_discard(false)
+,m_headersSent(false)
+,m_endSent(false)
+,m_reset(false)
+,m_timeout(false)
+,m_head(req->getMethod() == HttpMethod::HEAD)
+,m_scheduler(nullptr){
+    //stream不直接读socket，不需要接收缓冲区
+    releaseBuffer();
+}
+
+void Http2Stream::init(bool end, int64_t contentLength){
+    m_remoteClosed = end;
+    m_contentLength = contentLength;
+    //getBodyLength和isBodyDone按HTTP/1.1的语义：长度未知时当作chunked
+    m_bodyLeft = contentLength > 0 ? contentLength : 0;
+    m_bodyChunked = contentLength < 0;
+    m_bodyDone = end;
+}
+
+void Http2Stream::wakeup(){
+    if (m_waiter){
+        m_scheduler->scheduler(m_waiter);
+        m_waiter.reset();
+        m_scheduler = nullptr;
+    }
+}
+
+bool Http2Stream::wait(Mutex::Lock &lock){
+    Scheduler *scheduler = Scheduler::GetThis();
+    IOManager *iom = IOManager::GetThis();
+    if (!scheduler || !iom){
+        return false;
+    }
+    Timer::ptr timer;
+    if (m_readTimeout != (uint64_t)-1 && m_readTimeout){
+        std::weak_ptr<Http2Stream> weak(shared_from_this());
+        timer = iom->addConditionTimer(m_readTimeout, [weak](){
+            Http2Stream::ptr stream = weak.lock();
+            if (stream){
+                Mutex::Lock lock(stream->m_session->m_mutex);
+                stream->m_timeout = true;
+                stream->wakeup();
+            }
+        }, weak);
+    }
+    m_scheduler = scheduler;
+    m_waiter = Fiber::GetThis();
+    lock.unlock();
+    Fiber::YieldToHold();
+    if (timer){
+        timer->getManager()->cancel(timer);
+    }
+    lock.lock();
+    bool ok = !m_timeout;
+    m_timeout = false;
+    return ok;
+}
+
+void Http2Stream::consume(size_t length, std::string &frames){
+    m_recvConsumed += length;
+    //归还的窗口攒到一半再发送WINDOW_UPDATE，对端已经发完时不用再归还
+    if (m_remoteClosed || m_reset || m_recvConsumed < m_session->m_initialWindow / 2){
+        return;
+    }
+    char buf[4];
+    PutUint32(buf, m_recvConsumed);
+    m_session->appendFrame(frames, Http2FrameType::WINDOW_UPDATE, 0, m_id, buf, 4);
+    m_recvWindow += m_recvConsumed;
+    m_recvConsumed = 0;
+}
+
+int Http2Stream::readBody(void *buf, size_t length){
+    if (m_bodyDone){
+        return 0;
+    }
+    std::string frames;
+    size_t len = 0;
+    {
+        Mutex::Lock lock(m_session->m_mutex);
+        while (m_recvOffset == m_recvBuffer.size() && !m_remoteClosed && !m_reset && !m_session->m_closed){
+            if (!wait(lock)){
+                errno = ETIMEDOUT;
+                return -1;
+            }
+        }
+        if (m_recvOffset == m_recvBuffer.size()){
+            //被重置或者连接关闭时body不完整
+            if (m_reset || !m_remoteClosed){
+                return -1;
+            }
+            m_bodyDone = true;
+            return 0;
+        }
+        len = std::min(length, m_recvBuffer.size() - m_recvOffset);
+        memcpy(buf, &m_recvBuffer[m_recvOffset], len);
+        m_recvOffset += len;
+        if (m_recvOffset == m_recvBuffer.size()){
+            m_recvBuffer.clear();
+            m_recvOffset = 0;
+        }
+        else if (m_recvOffset >= SEND_BATCH && m_recvOffset * 2 >= m_recvBuffer.size()){
+            m_recvBuffer.erase(0, m_recvOffset);
+            m_recvOffset = 0;
+        }
+        consume(len, frames);
+        if (frames.empty()){
+            return len;
+        }
+        m_session->pushFrames(frames);
+    }
+    m_session->sendQueued();
+    return len;
+}
+
+bool Http2Stream::recvRequestBody(HttpRequest::ptr req){
+    uint64_t max_size = HttpRequestParser::GetHttpRequestMaxBodysize();
+    if (m_contentLength > (int64_t)max_size){
+        return false;
+    }
+    std::string body;
+    size_t size = 0;
+    do{
+        if (body.size() - size < 16 * 1024){
+            body.resize(std::max(size + 16 * 1024, m_contentLength > 0 ? (size_t)m_contentLength : body.size() * 2));
+        }
+        int rt = readBody(&body[size], body.size() - size);
+        if (rt < 0){
+            return false;
+        }
+        if (rt == 0){
+            break;
+        }
+        size += rt;
+        if (size > max_size){
+            return false;
+        }
+    } while (true);
+    body.resize(size);
+    req->setBody(body);
+    return true;
+}
+
+bool Http2Stream::discardBody(){
+    Mutex::Lock lock(m_session->m_mutex);
+    m_discard = true;
+    m_bodyDone = true;
+    std::string().swap(m_recvBuffer);
+    m_recvOffset = 0;
+    return true;
+}
+
+int Http2Stream::read(void *buf, size_t length){
+    return readBody(buf, length);
+}
+
+int Http2Stream::read(ByteArray::ptr ba, size_t length){
+    if (length == 0){
+        return 0;
+    }
+    std::vector<iovec> iovs;
+    ba->getWriteBuffers(iovs, length);
+    int rt = readBody(iovs[0].iov_base, iovs[0].iov_len);
+    if (rt > 0){
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
+int Http2Stream::sendHeaders(const HttpResponse::ptr &rsp, bool end){
+    //header名必须是小写，连接相关的header去掉，content-length按body重新计算
+    std::vector<std::pair<std::string, std::string>> headers;
+    headers.reserve(rsp->getHeaders().size() + 4);
+    headers.push_back(std::make_pair(":status", std::to_string((uint32_t)rsp->getStatus())));
+    bool has_date = false;
+    bool has_server = false;
+    for (auto& i : rsp->getHeaders()){
+        std::string name = i.first;
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (IsConnectionHeader(name) || name == "content-length"){
+            continue;
+        }
+        has_date = has_date || name == "date";
+        has_server = has_server || name == "server";
+        headers.push_back(std::make_pair(name, i.second));
+    }
+    if (!has_date){
+        StringView date = HttpDateValue();
+        headers.push_back(std::make_pair("date", std::string(date.data(), date.size())));
+    }
+    StringView server = HttpServerValue();
+    if (!has_server && !server.empty()){
+        headers.push_back(std::make_pair("server", std::string(server.data(), server.size())));
+    }
+    if (rsp->hasContentLength()){
+        if (!rsp->isStream()){
+            headers.push_back(std::make_pair("content-length", std::to_string(rsp->getBody().size())));
+        }
+        else if (rsp->getContentLength() >= 0){
+            headers.push_back(std::make_pair("content-length", std::to_string(rsp->getContentLength())));
+        }
+    }
+
+    Http2Session *session = m_session.get();
+    int rt = 0;
+    {
+        Mutex::Lock lock(session->m_mutex);
+        if (m_reset || session->m_closed || m_headersSent){
+            return -1;
+        }
+        //编码和放入发送队列在同一个锁里，保证对端按编码的顺序更新动态表
+        std::string block;
+        session->m_encoder.begin(block);
+        for (auto& i : headers){
+            session->m_encoder.encode(i.first, i.second, block);
+        }
+        //超过对端max_frame_size的部分放到CONTINUATION中
+        std::string frames;
+        size_t offset = 0;
+        do{
+            size_t len = std::min(block.size() - offset, (size_t)session->m_peerMaxFrameSize);
+            bool last = offset + len == block.size();
+            uint8_t flags = last ? FLAG_END_HEADERS : 0;
+            if (offset == 0 && end){
+                flags |= FLAG_END_STREAM;
+            }
+            session->appendFrame(frames, offset == 0 ? Http2FrameType::HEADERS : Http2FrameType::CONTINUATION
+                                 , flags, m_id, block.c_str() + offset, len);
+            offset += len;
+        } while (offset < block.size());
+        m_headersSent = true;
+        m_endSent = end;
+        rt = frames.size();
+        session->pushFrames(frames);
+    }
+    return session->sendQueued() < 0 ? -1 : rt;
+}
+
+int Http2Stream::sendData(const iovec *iovs, size_t count, bool end){
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i){
+        total += iovs[i].iov_len;
+    }
+    if (total == 0 && !end){
+        return 0;
+    }
+    Http2Session *session = m_session.get();
+    size_t idx = 0;
+    size_t offset = 0;
+    size_t left = m_head ? 0 : total;
+    bool flush = false;
+    {
+        Mutex::Lock lock(session->m_mutex);
+        if (!m_headersSent || m_endSent){
+            return -1;
+        }
+        std::string frames;
+        do{
+            if (m_reset || session->m_closed){
+                return -1;
+            }
+            int64_t window = std::min(m_sendWindow, session->m_sendWindow);
+            size_t len = (size_t)std::max<int64_t>(0, std::min<int64_t>(std::min<int64_t>(left, window), session->m_peerMaxFrameSize));
+            if (left > 0 && len == 0){
+                //窗口用完，先把攒下的帧发出去，再等对端的WINDOW_UPDATE
+                if (!frames.empty()){
+                    session->pushFrames(frames);
+                    frames.clear();
+                    lock.unlock();
+                    session->sendQueued();
+                    lock.lock();
+                    continue;
+                }
+                if (!wait(lock)){
+                    errno = ETIMEDOUT;
+                    return -1;
+                }
+                continue;
+            }
+            bool last = end && len == left;
+            size_t pos = frames.size();
+            session->appendFrame(frames, Http2FrameType::DATA, last ? FLAG_END_STREAM : 0, m_id, nullptr, len);
+            frames.resize(pos + FRAME_HEADER_LEN + len);
+            char *dst = &frames[pos + FRAME_HEADER_LEN];
+            for (size_t n = len; n > 0;){
+                size_t c = std::min(n, iovs[idx].iov_len - offset);
+                memcpy(dst, (const char *)iovs[idx].iov_base + offset, c);
+                dst += c;
+                n -= c;
+                offset += c;
+                if (offset == iovs[idx].iov_len){
+                    ++idx;
+                    offset = 0;
+                }
+            }
+            m_sendWindow -= len;
+            session->m_sendWindow -= len;
+            left -= len;
+            m_endSent = last;
+            if (frames.size() >= SEND_BATCH && left > 0){
+                session->pushFrames(frames);
+                frames.clear();
+                lock.unlock();
+                if (session->sendQueued() < 0){
+                    return -1;
+                }
+                lock.lock();
+            }
+        } while (left > 0 || (end && !m_endSent));
+        flush = !frames.empty();
+        if (flush){
+            session->pushFrames(frames);
+        }
+    }
+    if (flush && session->sendQueued() < 0){
+        return -1;
+    }
+    return total;
+}
+
+int Http2Stream::sendResponse(HttpResponse::ptr rsp, bool){
+    if (rsp->getRaw()){
+        rsp = ParseRawResponse(rsp->getRaw());
+        if (!rsp){
+            return -1;
+        }
+    }
+    else if (getAcceptEncoding() != ContentEncoding::IDENTITY && !rsp->isStream()
+             && IsCompressible(rsp, rsp->getBody().size())){
+        CompressResponse(rsp, getAcceptEncoding());
+    }
+    //流式响应之后由servlet写body
+    if (rsp->isStream()){
+        return sendHeaders(rsp, false);
+    }
+    const std::string &body = rsp->getBody();
+    bool empty = body.empty() || m_head;
+    int rt = sendHeaders(rsp, empty);
+    if (rt <= 0 || empty){
+        return rt;
+    }
+    iovec iov;
+    iov.iov_base = (void *)body.c_str();
+    iov.iov_len = body.size();
+    int len = sendData(&iov, 1, true);
+    return len < 0 ? -1 : rt + len;
+}
+
+HttpChunkedStream::ptr Http2Stream::startStream(HttpResponse::ptr rsp){
+    rsp->setStream(true);
+    Compressor::ptr compressor;
+    if (getAcceptEncoding() != ContentEncoding::IDENTITY && rsp->getContentLength() < 0 && IsCompressible(rsp, -1)){
+        compressor = Compressor::Create(getAcceptEncoding());
+        if (compressor){
+            SetContentEncoding(rsp, getAcceptEncoding());
+        }
+    }
+    if (sendHeaders(rsp, false) <= 0){
+        return nullptr;
+    }
+    //不分块，每次write作为DATA帧发送
+    m_stream.reset(new HttpChunkedStream(this, false, compressor));
+    return m_stream;
+}
+
+int Http2Stream::finishStream(){
+    HttpSession::finishStream();
+    bool end = false;
+    {
+        Mutex::Lock lock(m_session->m_mutex);
+        end = !m_headersSent || m_endSent || m_reset;
+    }
+    return end ? 0 : sendData(nullptr, 0, true);
+}
+
+int64_t Http2Stream::sendFile(HttpResponse::ptr rsp, int fd, uint64_t offset, uint64_t length){
+    rsp->setStream(true);
+    rsp->setContentLength(length);
+    bool end = length == 0 || m_head;
+    if (sendHeaders(rsp, end) <= 0){
+        return -1;
+    }
+    if (end){
+        return m_head ? length : 0;
+    }
+    std::string buf(std::min(length, (uint64_t)SEND_BATCH), '\0');
+    uint64_t left = length;
+    while (left > 0){
+        size_t len = std::min(left, (uint64_t)buf.size());
+        ssize_t rt = pread(fd, &buf[0], len, offset);
+        if (rt <= 0){
+            close();
+            return -1;
+        }
+        iovec iov;
+        iov.iov_base = &buf[0];
+        iov.iov_len = rt;
+        if (sendData(&iov, 1, (uint64_t)rt == left) < 0){
+            return -1;
+        }
+        offset += rt;
+        left -= rt;
+    }
+    return length;
+}
+
+int Http2Stream::write(const void *buf, size_t length){
+    iovec iov;
+    iov.iov_base = (void *)buf;
+    iov.iov_len = length;
+    return sendData(&iov, 1, false);
+}
+
+int Http2Stream::write(ByteArray::ptr ba, size_t length){
+    std::vector<iovec> iovs;
+    length = ba->getReadBuffers(iovs, length);
+    int rt = iovs.empty() ? 0 : sendData(&iovs[0], iovs.size(), false);
+    if (rt > 0){
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
+int Http2Stream::writevFixSize(iovec *iovs, size_t count){
+    return sendData(iovs, count, false);
+}
+
+void Http2Stream::close(){
+    {
+        Mutex::Lock lock(m_session->m_mutex);
+        if (m_reset || (m_endSent && m_remoteClosed)){
+            return;
+        }
+        m_reset = true;
+        m_session->pushRstStream(m_id, Http2Error::CANCEL);
+    }
+    m_session->sendQueued();
+}
+
+void Http2Stream::finish(){
+    //servlet没有close的流式响应
+    if (m_stream){
+        finishStream();
+    }
+    {
+        Mutex::Lock lock(m_session->m_mutex);
+        if (m_reset){
+            return;
+        }
+        if (m_headersSent && m_endSent && m_remoteClosed){
+            return;
+        }
+        //没有发出响应（读取body失败等），和HTTP/1.1关闭连接一样直接重置
+        //响应已经发完但对端还在发送body时，通知对端不用再发送
+        m_reset = true;
+        m_session->pushRstStream(m_id, !m_headersSent ? Http2Error::INTERNAL_ERROR
+                                       : m_endSent ? Http2Error::NO_ERROR : Http2Error::CANCEL);
+    }
+    m_session->sendQueued();
+}
+
+Http2Session::Http2Session(Socket::ptr sock, const std::string &buffered, StreamHandler handler)
+:m_socket(sock)
+,m_stream(new SocketStream(sock, false))
+,m_rbuf(buffered)
+,m_roffset(0)
+,m_handler(handler)
+,m_continuationStream(0)
+,m_continuationFlags(0)
+,m_lastStreamId(0)
+,m_peerMaxFrameSize(16384)
+,m_peerInitialWindow(DEFAULT_WINDOW)
+,m_maxFrameSize(std::min(std::max(g_http2_max_frame_size->getVal(), (uint32_t)16384), (uint32_t)16777215))
+,m_initialWindow(std::min(g_http2_initial_window_size->getVal(), (uint32_t)MAX_WINDOW))
+,m_maxStreams(g_http2_max_concurrent_streams->getVal())
+,m_maxHeaderListSize(g_http2_max_header_list_size->getVal())
+,m_sendWindow(DEFAULT_WINDOW)
+,m_recvWindow(DEFAULT_WINDOW)
+,m_recvConsumed(0)
+,m_connWindow(std::min(std::max(g_http2_connection_window_size->getVal(), DEFAULT_WINDOW), (uint32_t)MAX_WINDOW))
+,m_sending(false)
+,m_closed(false)
+,m_drainScheduler(nullptr){
+
+}
+
+Http2Session::~Http2Session(){
+
+}
+
+size_t Http2Session::getStreamCount(){
+    MutexType::Lock lock(m_mutex);
+    return m_streams.size();
+}
+
+void Http2Session::appendFrame(std::string &buf, Http2FrameType type, uint8_t flags, uint32_t stream, const char *data, size_t length){
+    char head[FRAME_HEADER_LEN];
+    head[0] = (char)(length >> 16);
+    head[1] = (char)(length >> 8);
+    head[2] = (char)length;
+    head[3] = (char)type;
+    head[4] = (char)flags;
+    PutUint32(head + 5, stream & 0x7FFFFFFF);
+    buf.append(head, FRAME_HEADER_LEN);
+    if (data){
+        buf.append(data, length);
+    }
+}
+
+void Http2Session::pushFrames(std::string &frames){
+    m_queue.push_back(std::move(frames));
+}
+
+void Http2Session::pushRstStream(uint32_t id, Http2Error error){
+    char buf[4];
+    PutUint32(buf, (uint32_t)error);
+    std::string frame;
+    appendFrame(frame, Http2FrameType::RST_STREAM, 0, id, buf, 4);
+    pushFrames(frame);
+}
+
+void Http2Session::resetStream(const Http2Stream::ptr &stream, Http2Error error){
+    stream->m_reset = true;
+    pushRstStream(stream->m_id, error);
+    stream->wakeup();
+}
+
+void Http2Session::wakeupAll(){
+    for (auto& i : m_streams){
+        i.second->wakeup();
+    }
+}
+
+int Http2Session::sendQueued(){
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_closed){
+            return -1;
+        }
+        //其他协程正在发送，会把这些帧一起发出
+        if (m_sending){
+            return 0;
+        }
+        m_sending = true;
+    }
+    std::vector<std::string> sending;
+    std::vector<iovec> iovs;
+    while (true){
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_queue.empty() || m_closed){
+                m_sending = false;
+                return m_closed ? -1 : 0;
+            }
+            sending.clear();
+            while (!m_queue.empty()){
+                sending.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+        }
+        iovs.clear();
+        for (auto& i : sending){
+            iovec iov;
+            iov.iov_base = (void *)i.c_str();
+            iov.iov_len = i.size();
+            iovs.push_back(iov);
+        }
+        int rt = m_stream->writevFixSize(&iovs[0], iovs.size());
+        if (rt <= 0){
+            MutexType::Lock lock(m_mutex);
+            m_closed = true;
+            m_queue.clear();
+            m_sending = false;
+            wakeupAll();
+            return -1;
+        }
+    }
+}
+
+int Http2Session::sendFrame(Http2FrameType type, uint8_t flags, uint32_t stream, const char *data, size_t length){
+    {
+        MutexType::Lock lock(m_mutex);
+        std::string frame;
+        appendFrame(frame, type, flags, stream, data, length);
+        pushFrames(frame);
+    }
+    return sendQueued();
+}
+
+bool Http2Session::goaway(Http2Error error){
+    if (error != Http2Error::NO_ERROR){
+        LOG_DEBUG(g_logger) << "http2 goaway error=" << (uint32_t)error << " " << *m_socket;
+    }
+    char buf[8];
+    PutUint32(buf, m_lastStreamId);
+    PutUint32(buf + 4, (uint32_t)error);
+    sendFrame(Http2FrameType::GOAWAY, 0, 0, buf, 8);
+    return false;
+}
+
+bool Http2Session::fill(size_t length){
+    if (m_rbuf.size() - m_roffset >= length){
+        return true;
+    }
+    //处理过的数据移出缓冲区
+    if (m_roffset){
+        m_rbuf.erase(0, m_roffset);
+        m_roffset = 0;
+    }
+    while (m_rbuf.size() < length){
+        size_t size = m_rbuf.size();
+        m_rbuf.resize(size + std::max(length - size, (size_t)(64 * 1024)));
+        int rt = m_socket->recv(&m_rbuf[size], m_rbuf.size() - size);
+        m_rbuf.resize(size + std::max(rt, 0));
+        if (rt > 0){
+            continue;
+        }
+        //有stream在处理时空闲超时不关闭连接
+        if (rt < 0 && (errno == ETIMEDOUT || errno == EAGAIN) && getStreamCount() > 0){
+            continue;
+        }
+        if (rt < 0 && (errno == ETIMEDOUT || errno == EAGAIN)){
+            goaway(Http2Error::NO_ERROR);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool Http2Session::readFrame(FrameHeader &head, const char *&payload){
+    if (!fill(FRAME_HEADER_LEN)){
+        return false;
+    }
+    const uint8_t *p = (const uint8_t *)&m_rbuf[m_roffset];
+    head.length = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    head.type = p[3];
+    head.flags = p[4];
+    head.stream = GetUint32((const char *)p + 5) & 0x7FFFFFFF;
+    if (head.length > m_maxFrameSize){
+        return goaway(Http2Error::FRAME_SIZE_ERROR);
+    }
+    if (!fill(FRAME_HEADER_LEN + head.length)){
+        return false;
+    }
+    payload = &m_rbuf[m_roffset + FRAME_HEADER_LEN];
+    m_roffset += FRAME_HEADER_LEN + head.length;
+    return true;
+}
+
+bool Http2Session::applySettings(const char *data, size_t length){
+    Http2Error error = Http2Error::NO_ERROR;
+    {
+        MutexType::Lock lock(m_mutex);
+        for (size_t i = 0; i + 6 <= length && error == Http2Error::NO_ERROR; i += 6){
+            uint16_t id = ((uint8_t)data[i] << 8) | (uint8_t)data[i + 1];
+            uint32_t v = GetUint32(data + i + 2);
+            switch (id){
+            case SETTINGS_HEADER_TABLE_SIZE:
+                m_encoder.setMaxTableSize(v);
+                break;
+            case SETTINGS_ENABLE_PUSH:
+                if (v > 1){
+                    error = Http2Error::PROTOCOL_ERROR;
+                }
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE:{
+                if (v > MAX_WINDOW){
+                    error = Http2Error::FLOW_CONTROL_ERROR;
+                    break;
+                }
+                //已经打开的stream按差值调整发送窗口
+                int64_t delta = (int64_t)v - m_peerInitialWindow;
+                for (auto& s : m_streams){
+                    s.second->m_sendWindow += delta;
+                    if (s.second->m_sendWindow > MAX_WINDOW){
+                        error = Http2Error::FLOW_CONTROL_ERROR;
+                    }
+                    s.second->wakeup();
+                }
+                m_peerInitialWindow = v;
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (v < 16384 || v > 16777215){
+                    error = Http2Error::PROTOCOL_ERROR;
+                    break;
+                }
+                m_peerMaxFrameSize = v;
+                break;
+            default:
+                //MAX_CONCURRENT_STREAMS只限制服务端推送，MAX_HEADER_LIST_SIZE只是建议
+                break;
+            }
+        }
+    }
+    return error == Http2Error::NO_ERROR ? true : goaway(error);
+}
+
+bool Http2Session::onSettings(const FrameHeader &head, const char *payload){
+    if (head.stream != 0){
+        return goaway(Http2Error::PROTOCOL_ERROR);
+    }
+    if (head.flags & FLAG_ACK){
+        return head.length == 0 ? true : goaway(Http2Error::FRAME_SIZE_ERROR);
+    }
+    if (head.length % 6){
+        return goaway(Http2Error::FRAME_SIZE_ERROR);
+    }
+    if (!applySettings(payload, head.length)){
+        return false;
+    }
+    return sendFrame(Http2FrameType::SETTINGS, FLAG_ACK, 0, nullptr, 0) >= 0;
+}
+
+bool Http2Session::onWindowUpdate(const FrameHeader &head, const char *payload){
+    if (head.length != 4){
+        return goaway(Http2Error::FRAME_SIZE_ERROR);
+    }
+    uint32_t increment = GetUint32(payload) & 0x7FFFFFFF;
+    Http2Error error = Http2Error::NO_ERROR;
+    bool reset = false;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (head.stream == 0){
+            m_sendWindow += increment;
+            if (increment == 0){
+                error = Http2Error::PROTOCOL_ERROR;
+            }
+            else if (m_sendWindow > MAX_WINDOW){
+                error = Http2Error::FLOW_CONTROL_ERROR;
+            }
+            //等待连接窗口的stream都唤醒，各自重新检查
+            wakeupAll();
+        }
+        else{
+            auto it = m_streams.find(head.stream);
+            if (it != m_streams.end()){
+                Http2Stream::ptr &stream = it->second;
+                stream->m_sendWindow += increment;
+                if (increment == 0){
+                    resetStream(stream, Http2Error::PROTOCOL_ERROR);
+                    reset = true;
+                }
+                else if (stream->m_sendWindow > MAX_WINDOW){
+                    resetStream(stream, Http2Error::FLOW_CONTROL_ERROR);
+                    reset = true;
+                }
+                stream->wakeup();
+            }
+            else if (head.stream > m_lastStreamId){
+                error = Http2Error::PROTOCOL_ERROR;
+            }
+        }
+    }
+    if (error != Http2Error::NO_ERROR){
+        return goaway(error);
+    }
+    return !reset || sendQueued() >= 0;
+}
+
+bool Http2Session::onData(const FrameHeader &head, const char *payload){
+    if (head.stream == 0){
+        return goaway(Http2Error::PROTOCOL_ERROR);
+    }
+    const char *data = payload;
+    size_t length = head.length;
+    if (!StripPadding(head.flags, data, length)){
+        return goaway(Http2Error::PROTOCOL_ERROR);
+    }
+    bool end = head.flags & FLAG_END_STREAM;
+    bool send = false;
+    {
+        MutexType::Lock lock(m_mutex);
+        //整个帧（包括填充）都计入流量控制
+        m_recvWindow -= head.length;
+        if (m_recvWindow < 0){
+            lock.unlock();
+            return goaway(Http2Error::FLOW_CONTROL_ERROR);
+        }
+        //连接级的窗口收到就归还，每个stream缓存的body由stream的窗口限制
+        std::string frames;
+        m_recvConsumed += head.length;
+        if (m_recvConsumed >= m_connWindow / 2){
+            char buf[4];
+            PutUint32(buf, m_recvConsumed);
+            appendFrame(frames, Http2FrameType::WINDOW_UPDATE, 0, 0, buf, 4);
+            m_recvWindow += m_recvConsumed;
+            m_recvConsumed = 0;
+        }
+        auto it = m_streams.find(head.stream);
+        if (it == m_streams.end()){
+            if (head.stream > m_lastStreamId){
+                lock.unlock();
+                return goaway(Http2Error::PROTOCOL_ERROR);
+            }
+            //已经结束的stream，数据直接丢弃
+        }
+        else if (!it->second->m_reset){
+            Http2Stream::ptr &stream = it->second;
+            stream->m_recvWindow -= head.length;
+            stream->m_recvTotal += length;
+            if (stream->m_remoteClosed){
+                resetStream(stream, Http2Error::STREAM_CLOSED);
+            }
+            else if (stream->m_recvWindow < 0){
+                resetStream(stream, Http2Error::FLOW_CONTROL_ERROR);
+            }
+            else if (stream->m_contentLength >= 0 && (stream->m_recvTotal > (uint64_t)stream->m_contentLength
+                     || (end && stream->m_recvTotal != (uint64_t)stream->m_contentLength))){
+                //body的长度和content-length不一致
+                resetStream(stream, Http2Error::PROTOCOL_ERROR);
+            }
+            else{
+                size_t unused = head.length - length;
+                if (stream->m_discard){
+                    unused = head.length;
+                }
+                else{
+                    stream->m_recvBuffer.append(data, length);
+                }
+                stream->m_remoteClosed = end;
+                //填充和丢弃的数据不会被读取，直接归还窗口
+                if (unused){
+                    stream->consume(unused, frames);
+                }
+                stream->wakeup();
+            }
+        }
+        if (!frames.empty()){
+            pushFrames(frames);
+        }
+        send = !m_queue.empty();
+    }
+    return !send || sendQueued() >= 0;
+}
+
+HttpRequest::ptr Http2Session::makeRequest(std::vector<HPackHeader> &headers, int64_t &contentLength){
+    HttpRequest::ptr req(new HttpRequest(0x20, false));
+    contentLength = -1;
+    std::string method;
+    std::string scheme;
+    std::string path;
+    std::string authority;
+    std::string cookie;
+    bool regular = false;
+    for (auto& h : headers){
+        if (h.name.empty()){
+            return nullptr;
+        }
+        if (h.name[0] == ':'){
+            //伪头只能在普通header之前，不能重复
+            std::string *v = h.name == ":method" ? &method : h.name == ":scheme" ? &scheme
+                           : h.name == ":path" ? &path : h.name == ":authority" ? &authority : nullptr;
+            if (regular || !v || !v->empty()){
+                return nullptr;
+            }
+            *v = h.value;
+            continue;
+        }
+        regular = true;
+        for (char c : h.name){
+            if (c >= 'A' && c <= 'Z'){
+                return nullptr;
+            }
+        }
+        if (IsConnectionHeader(h.name) || (h.name == "te" && h.value != "trailers")){
+            return nullptr;
+        }
+        //拆开发送的cookie重新用"; "拼接
+        if (h.name == "cookie"){
+            cookie += cookie.empty() ? h.value : "; " + h.value;
+            continue;
+        }
+        if (h.name == "content-length" && !ParseContentLength(h.value.c_str(), h.value.size(), contentLength)){
+            return nullptr;
+        }
+        std::string old;
+        if (req->hasHeader(h.name, &old)){
+            h.value = old + ", " + h.value;
+        }
+        req->setHeader(h.name, h.value);
+    }
+    HttpMethod m = ParseHttpMethod(method.c_str(), method.size());
+    if (m == HttpMethod::INVALID_METHOD || scheme.empty() || path.empty()){
+        return nullptr;
+    }
+    req->setMethod(m);
+    size_t pos = path.find('?');
+    if (pos != std::string::npos){
+        req->setQuery(path.substr(pos + 1));
+        path.resize(pos);
+    }
+    req->setPath(path);
+    if (!authority.empty() && !req->hasHeader("host", nullptr)){
+        req->setHeader("host", authority);
+    }
+    if (!cookie.empty()){
+        req->setHeader("cookie", cookie);
+    }
+    return req;
+}
+
+bool Http2Session::onHeaders(uint32_t id, uint8_t flags, const char *block, size_t length){
+    //解码器只在读协程中使用，不需要加锁
+    std::vector<HPackHeader> headers;
+    if (!m_decoder.decode(block, length, headers, m_maxHeaderListSize)){
+        return goaway(Http2Error::COMPRESSION_ERROR);
+    }
+    bool end = flags & FLAG_END_STREAM;
+    if (id <= m_lastStreamId){
+        //已有stream上的HEADERS是trailer，必须带END_STREAM，内容忽略
+        MutexType::Lock lock(m_mutex);
+        auto it = m_streams.find(id);
+        if (it == m_streams.end() || it->second->m_reset){
+            return true;
+        }
+        Http2Stream::ptr &stream = it->second;
+        if (!end || stream->m_remoteClosed || (stream->m_contentLength >= 0
+                && stream->m_recvTotal != (uint64_t)stream->m_contentLength)){
+            resetStream(stream, Http2Error::PROTOCOL_ERROR);
+        }
+        else{
+            stream->m_remoteClosed = true;
+            stream->wakeup();
+        }
+        lock.unlock();
+        return sendQueued() >= 0;
+    }
+    m_lastStreamId = id;
+    if (m_decoder.isTooLarge()){
+        return sendRstStream(id, Http2Error::REFUSED_STREAM) >= 0;
+    }
+    int64_t content_length = -1;
+    HttpRequest::ptr req = makeRequest(headers, content_length);
+    if (!req){
+        return sendRstStream(id, Http2Error::PROTOCOL_ERROR) >= 0;
+    }
+    if (getStreamCount() >= m_maxStreams){
+        return sendRstStream(id, Http2Error::REFUSED_STREAM) >= 0;
+    }
+    Http2Stream::ptr stream(new Http2Stream(shared_from_this(), id, req));
+    stream->init(end, content_length);
+    std::string accept;
+    if (req->hasHeader("accept-encoding", &accept)){
+        stream->setAcceptEncoding(NegotiateEncoding(accept));
+    }
+    startStream(stream);
+    return true;
+}
+
+int Http2Session::sendRstStream(uint32_t id, Http2Error error){
+    {
+        MutexType::Lock lock(m_mutex);
+        pushRstStream(id, error);
+    }
+    return sendQueued();
+}
+
+void Http2Session::startStream(const Http2Stream::ptr &stream){
+    {
+        MutexType::Lock lock(m_mutex);
+        m_streams[stream->getId()] = stream;
+    }
+    Http2Session::ptr self = shared_from_this();
+    IOManager::GetThis()->scheduler([self, stream](){
+        self->m_handler(stream);
+        stream->finish();
+        self->removeStream(stream->getId());
+    });
+}
+
+void Http2Session::removeStream(uint32_t id){
+    MutexType::Lock lock(m_mutex);
+    m_streams.erase(id);
+    if (m_streams.empty() && m_drainWaiter){
+        m_drainScheduler->scheduler(m_drainWaiter);
+        m_drainWaiter.reset();
+        m_drainScheduler = nullptr;
+    }
+}
+
+bool Http2Session::onFrame(const FrameHeader &head, const char *payload){
+    //CONTINUATION必须紧跟在同一个stream的HEADERS之后
+    if (m_continuationStream && ((Http2FrameType)head.type != Http2FrameType::CONTINUATION
+                                 || head.stream != m_continuationStream)){
+        return goaway(Http2Error::PROTOCOL_ERROR);
+    }
+    switch ((Http2FrameType)head.type){
+    case Http2FrameType::DATA:
+        return onData(head, payload);
+    case Http2FrameType::HEADERS:{
+        if (head.stream == 0 || !(head.stream & 1)){
+            return goaway(Http2Error::PROTOCOL_ERROR);
+        }
+        const char *data = payload;
+        size_t length = head.length;
+        if (!StripPadding(head.flags, data, length)){
+            return goaway(Http2Error::PROTOCOL_ERROR);
+        }
+        //优先级不处理，所有stream同等对待
+        if (head.flags & FLAG_PRIORITY){
+            if (length < 5){
+                return goaway(Http2Error::FRAME_SIZE_ERROR);
+            }
+            data += 5;
+            length -= 5;
+        }
+        if (head.flags & FLAG_END_HEADERS){
+            return onHeaders(head.stream, head.flags, data, length);
+        }
+        m_continuationStream = head.stream;
+        m_continuationFlags = head.flags;
+        m_headerBlock.assign(data, length);
+        return true;
+    }
+    case Http2FrameType::CONTINUATION:{
+        if (!m_continuationStream){
+            return goaway(Http2Error::PROTOCOL_ERROR);
+        }
+        m_headerBlock.append(payload, head.length);
+        //压缩后的header块不会比解码后的大太多
+        if (m_headerBlock.size() > (size_t)m_maxHeaderListSize * 2){
+            return goaway(Http2Error::ENHANCE_YOUR_CALM);
+        }
+        if (!(head.flags & FLAG_END_HEADERS)){
+            return true;
+        }
+        uint32_t id = m_continuationStream;
+        m_continuationStream = 0;
+        std::string block;
+        block.swap(m_headerBlock);
+        return onHeaders(id, m_continuationFlags, block.c_str(), block.size());
+    }
+    case Http2FrameType::PRIORITY:
+        if (head.stream == 0){
+            return goaway(Http2Error::PROTOCOL_ERROR);
+        }
+        return head.length == 5 || sendRstStream(head.stream, Http2Error::FRAME_SIZE_ERROR) >= 0;
+    case Http2FrameType::RST_STREAM:{
+        if (head.stream == 0 || head.stream > m_lastStreamId){
+            return goaway(Http2Error::PROTOCOL_ERROR);
+        }
+        if (head.length != 4){
+            return goaway(Http2Error::FRAME_SIZE_ERROR);
+        }
+        MutexType::Lock lock(m_mutex);
+        auto it = m_streams.find(head.stream);
+        if (it != m_streams.end()){
+            it->second->m_reset = true;
+            it->second->wakeup();
+        }
+        return true;
+    }
+    case Http2FrameType::SETTINGS:
+        return onSettings(head, payload);
+    case Http2FrameType::PUSH_PROMISE:
+        //客户端不能推送
+        return goaway(Http2Error::PROTOCOL_ERROR);
+    case Http2FrameType::PING:
+        if (head.stream != 0){
+            return goaway(Http2Error::PROTOCOL_ERROR);
+        }
+        if (head.length != 8){
+            return goaway(Http2Error::FRAME_SIZE_ERROR);
+        }
+        return (head.flags & FLAG_ACK) || sendFrame(Http2FrameType::PING, FLAG_ACK, 0, payload, 8) >= 0;
+    case Http2FrameType::GOAWAY:
+        //对端不会再发起新的stream，已有的stream继续处理，读到连接关闭为止
+        return head.stream == 0 ? true : goaway(Http2Error::PROTOCOL_ERROR);
+    case Http2FrameType::WINDOW_UPDATE:
+        return onWindowUpdate(head, payload);
+    default:
+        //未知的帧类型忽略
+        return true;
+    }
+}
+
+void Http2Session::run(HttpRequest::ptr upgrade, const std::string &settings){
+    m_socket->setRecvTimeout(g_http2_idle_timeout->getVal());
+    bool ok = true;
+    if (upgrade){
+        std::string decoded;
+        ok = Base64Decode(settings, decoded) && decoded.size() % 6 == 0
+             && applySettings(decoded.c_str(), decoded.size());
+    }
+
+    //本端的SETTINGS必须是连接上的第一个帧
+    {
+        MutexType::Lock lock(m_mutex);
+        std::string payload;
+        AppendSetting(payload, SETTINGS_MAX_CONCURRENT_STREAMS, m_maxStreams);
+        AppendSetting(payload, SETTINGS_INITIAL_WINDOW_SIZE, m_initialWindow);
+        AppendSetting(payload, SETTINGS_MAX_FRAME_SIZE, m_maxFrameSize);
+        AppendSetting(payload, SETTINGS_MAX_HEADER_LIST_SIZE, m_maxHeaderListSize);
+        AppendSetting(payload, SETTINGS_ENABLE_PUSH, 0);
+        std::string frames;
+        appendFrame(frames, Http2FrameType::SETTINGS, 0, 0, payload.c_str(), payload.size());
+        if (m_connWindow > DEFAULT_WINDOW){
+            char buf[4];
+            PutUint32(buf, m_connWindow - DEFAULT_WINDOW);
+            appendFrame(frames, Http2FrameType::WINDOW_UPDATE, 0, 0, buf, 4);
+            m_recvWindow = m_connWindow;
+        }
+        pushFrames(frames);
+    }
+    ok = ok && sendQueued() >= 0;
+
+    //升级的请求作为已经half-closed的stream 1
+    if (ok && upgrade){
+        m_lastStreamId = 1;
+        Http2Stream::ptr stream(new Http2Stream(shared_from_this(), 1, upgrade));
+        stream->init(true, 0);
+        startStream(stream);
+    }
+
+    //客户端的连接前言，之后第一个帧必须是SETTINGS
+    if (ok && fill(PREFACE_LEN) && memcmp(&m_rbuf[m_roffset], s_preface, PREFACE_LEN) == 0){
+        m_roffset += PREFACE_LEN;
+        FrameHeader head;
+        const char *payload = nullptr;
+        bool first = true;
+        while (readFrame(head, payload)){
+            if (first && (Http2FrameType)head.type != Http2FrameType::SETTINGS){
+                goaway(Http2Error::PROTOCOL_ERROR);
+                break;
+            }
+            first = false;
+            if (!onFrame(head, payload)){
+                break;
+            }
+        }
+    }
+    else if (ok){
+        goaway(Http2Error::PROTOCOL_ERROR);
+    }
+
+    //唤醒等待中的handler，返回前等它们全部结束
+    MutexType::Lock lock(m_mutex);
+    m_closed = true;
+    if (!m_streams.empty()){
+        ::shutdown(m_socket->getSocket(), SHUT_RDWR);
+    }
+    wakeupAll();
+    while (!m_streams.empty() && Scheduler::GetThis()){
+        m_drainScheduler = Scheduler::GetThis();
+        m_drainWaiter = Fiber::GetThis();
+        lock.unlock();
+        Fiber::YieldToHold();
+        lock.lock();
+    }
+}
+
+}
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "http_session.h"
+#include "hpack.h"
+#include "../mutex.h"
+#include "../scheduler.h"
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace server{
+namespace http{
+
+class Http2Session;
+
+//HTTP/2的帧类型（RFC 7540 6）
+enum class Http2FrameType : uint8_t
+{
+    DATA = 0,
+    HEADERS = 1,
+    PRIORITY = 2,
+    RST_STREAM = 3,
+    SETTINGS = 4,
+    PUSH_PROMISE = 5,
+    PING = 6,
+    GOAWAY = 7,
+    WINDOW_UPDATE = 8,
+    CONTINUATION = 9,
+};
+
+//RST_STREAM和GOAWAY的错误码
+enum class Http2Error : uint32_t
+{
+    NO_ERROR = 0,
+    PROTOCOL_ERROR = 1,
+    INTERNAL_ERROR = 2,
+    FLOW_CONTROL_ERROR = 3,
+    SETTINGS_TIMEOUT = 4,
+    STREAM_CLOSED = 5,
+    FRAME_SIZE_ERROR = 6,
+    REFUSED_STREAM = 7,
+    CANCEL = 8,
+    COMPRESSION_ERROR = 9,
+    CONNECT_ERROR = 10,
+    ENHANCE_YOUR_CALM = 11,
+    INADEQUATE_SECURITY = 12,
+    HTTP_1_1_REQUIRED = 13,
+};
+
+//HTTP/2连接上的一个请求，作为HttpSession交给servlet，servlet不需要区分HTTP/1.1和HTTP/2
+//body从DATA帧读取，响应编码成HEADERS和DATA帧，发送时受对端的流量控制窗口限制
+//除了handler所在的协程，其余状态都由连接的读协程修改，统一用Http2Session的锁保护
+class Http2Stream : public HttpSession, public std::enable_shared_from_this<Http2Stream>{
+friend class Http2Session;
+public:
+    typedef std::shared_ptr<Http2Stream> ptr;
+    Http2Stream(std::shared_ptr<Http2Session> session, uint32_t id, HttpRequest::ptr req);
+
+    uint32_t getId() const { return m_id; }
+    const HttpRequest::ptr &getRequest() const { return m_request; }
+
+    virtual bool recvRequestBody(HttpRequest::ptr req) override;
+    //等待DATA帧，读取后向对端归还流量控制窗口
+    virtual int readBody(void *buf, size_t length) override;
+    //之后收到的DATA直接丢弃，响应结束后用RST_STREAM(NO_ERROR)通知对端不用再发送
+    virtual bool discardBody() override;
+    //flush参数无效，响应立即编码成帧发出
+    virtual int sendResponse(HttpResponse::ptr rsp, bool flush = true) override;
+    virtual int flush() override { return 0; }
+    virtual HttpChunkedStream::ptr startStream(HttpResponse::ptr rsp) override;
+    //结束流式响应，发送END_STREAM
+    virtual int finishStream() override;
+    //HTTP/2不能用sendfile，pread之后作为DATA帧发送
+    virtual int64_t sendFile(HttpResponse::ptr rsp, int fd, uint64_t offset, uint64_t length) override;
+    //HTTP/2的stream不能升级成其他协议
+    virtual std::string takeBuffer() override { return ""; }
+
+    virtual int read(void *buf, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+    virtual int write(const void *buf, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+    virtual int writevFixSize(iovec *iovs, size_t count) override;
+    //没有结束时发送RST_STREAM(CANCEL)，不会关闭连接
+    virtual void close() override;
+
+private:
+    //end为HEADERS是否带END_STREAM，contentLength为-1时body长度未知
+    void init(bool end, int64_t contentLength);
+    //以下需要持有Http2Session的锁
+    //挂起当前协程直到wakeup，超过m_readTimeout返回false
+    bool wait(Mutex::Lock &lock);
+    void wakeup();
+    //body被读取或者丢弃后归还接收窗口，需要发送的WINDOW_UPDATE追加到frames
+    void consume(size_t length, std::string &frames);
+
+    //发送HEADERS，end为true时同时结束stream
+    int sendHeaders(const HttpResponse::ptr &rsp, bool end);
+    //按流量控制窗口和对端的max_frame_size拆成DATA帧发送，窗口不够时挂起等待WINDOW_UPDATE
+    int sendData(const iovec *iovs, size_t count, bool end);
+    //handler返回后调用：补发END_STREAM，对端还在发送body时发送RST_STREAM(NO_ERROR)
+    void finish();
+
+    std::shared_ptr<Http2Session> m_session;
+    uint32_t m_id;
+    HttpRequest::ptr m_request;
+
+    //收到还没有被读取的body
+    std::string m_recvBuffer;
+    size_t m_recvOffset;
+    //本端的接收窗口，和已经读取但还没有通过WINDOW_UPDATE归还的字节数
+    int64_t m_recvWindow;
+    uint32_t m_recvConsumed;
+    //收到的body总长度，END_STREAM时和content-length比较
+    uint64_t m_recvTotal;
+    int64_t m_contentLength;
+    //对端的接收窗口
+    int64_t m_sendWindow;
+    //收到了END_STREAM
+    bool m_remoteClosed;
+    bool m_discard;
+    bool m_headersSent;
+    bool m_endSent;
+    //任意一端发送了RST_STREAM，或者连接已经关闭
+    bool m_reset;
+    bool m_timeout;
+    bool m_head;
+
+    //readBody或者sendData中挂起的协程
+    Fiber::ptr m_waiter;
+    Scheduler *m_scheduler;
+};
+
+//一个HTTP/2连接（h2c）：当前协程循环读取帧，每个stream的请求在新的协程中处理
+//写由各个协程把帧放入发送队列，当前没有在发送的调用者依次写出
+class Http2Session : public std::enable_shared_from_this<Http2Session>{
+friend class Http2Stream;
+public:
+    typedef std::shared_ptr<Http2Session> ptr;
+    typedef Mutex MutexType;
+    //在新的协程中调用，返回后stream结束
+    typedef std::function<void(const Http2Stream::ptr &stream)> StreamHandler;
+
+    //buffered为HttpSession中已经读到的数据，从连接前言开始
+    Http2Session(Socket::ptr sock, const std::string &buffered, StreamHandler handler);
+    ~Http2Session();
+
+    //处理连接直到关闭，返回前等待所有stream的handler结束
+    //upgrade不为空时为Upgrade: h2c的请求，作为stream 1处理，settings为HTTP2-Settings头的值
+    void run(HttpRequest::ptr upgrade = nullptr, const std::string &settings = "");
+
+    //正在处理的stream数
+    size_t getStreamCount();
+    Socket::ptr getSocket() const { return m_socket; }
+
+private:
+    struct FrameHeader{
+        uint32_t length;
+        uint8_t type;
+        uint8_t flags;
+        uint32_t stream;
+    };
+
+    //保证读缓冲区中至少有length字节
+    bool fill(size_t length);
+    //payload指向读缓冲区，在下一次readFrame之前有效
+    bool readFrame(FrameHeader &head, const char *&payload);
+    //返回false时连接关闭
+    bool onFrame(const FrameHeader &head, const char *payload);
+    bool onHeaders(uint32_t id, uint8_t flags, const char *block, size_t length);
+    bool onData(const FrameHeader &head, const char *payload);
+    bool onSettings(const FrameHeader &head, const char *payload);
+    bool onWindowUpdate(const FrameHeader &head, const char *payload);
+    bool applySettings(const char *data, size_t length);
+    //把header列表转换成HttpRequest，不合法时返回nullptr
+    HttpRequest::ptr makeRequest(std::vector<HPackHeader> &headers, int64_t &contentLength);
+    void startStream(const Http2Stream::ptr &stream);
+    void removeStream(uint32_t id);
+
+    //以下需要持有m_mutex
+    void appendFrame(std::string &buf, Http2FrameType type, uint8_t flags, uint32_t stream, const char *data, size_t length);
+    void pushFrames(std::string &frames);
+    void pushRstStream(uint32_t id, Http2Error error);
+    void resetStream(const Http2Stream::ptr &stream, Http2Error error);
+    void wakeupAll();
+
+    //把发送队列中的帧写出，其他协程正在发送时直接返回
+    int sendQueued();
+    int sendFrame(Http2FrameType type, uint8_t flags, uint32_t stream, const char *data, size_t length);
+    int sendRstStream(uint32_t id, Http2Error error);
+    //发送GOAWAY，总是返回false，调用者随后关闭连接
+    bool goaway(Http2Error error);
+
+    Socket::ptr m_socket;
+    SocketStream::ptr m_stream;
+    std::string m_rbuf;
+    size_t m_roffset;
+    StreamHandler m_handler;
+    //没有收完的header块，后面跟着CONTINUATION
+    std::string m_headerBlock;
+    uint32_t m_continuationStream;
+    uint8_t m_continuationFlags;
+
+    MutexType m_mutex;
+    std::map<uint32_t, Http2Stream::ptr> m_streams;
+    uint32_t m_lastStreamId;
+    HPackDecoder m_decoder;
+    HPackEncoder m_encoder;
+
+    //对端的设置
+    uint32_t m_peerMaxFrameSize;
+    uint32_t m_peerInitialWindow;
+    //本端的设置
+    uint32_t m_maxFrameSize;
+    uint32_t m_initialWindow;
+    uint32_t m_maxStreams;
+    uint32_t m_maxHeaderListSize;
+
+    //连接级的流量控制窗口
+    int64_t m_sendWindow;
+    int64_t m_recvWindow;
+    uint32_t m_recvConsumed;
+    uint32_t m_connWindow;
+
+    std::deque<std::string> m_queue;
+    bool m_sending;
+    bool m_closed;
+    //run返回前等待所有handler结束
+    Fiber::ptr m_drainWaiter;
+    Scheduler *m_drainScheduler;
+};
+
+}
+}
@@ -1,130 +1,309 @@
 #include "http_connection.h"
 #include "http_parser.h"
+#include "../config.h"
+#include "../hook.h"
 #include "../log.h"
+#include "../util.h"
 
 namespace server{
 namespace http{
 
 static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
 
+static server::ConfigVar<bool>::ptr g_http_client_pool_enable =
+    server::Config::AddData("http.client.pool.enable", true, "http client reuse keep-alive connections");
+
+static server::ConfigVar<uint32_t>::ptr g_http_client_pool_max_size =
+    server::Config::AddData("http.client.pool.max_size", (uint32_t)32, "http client max idle connections per host");
+
+static server::ConfigVar<uint32_t>::ptr g_http_client_pool_idle_timeout =
+    server::Config::AddData("http.client.pool.idle_timeout", (uint32_t)30000, "http client idle connection timeout(ms)");
+
+static server::ConfigVar<uint32_t>::ptr g_http_client_pool_max_request =
+    server::Config::AddData("http.client.pool.max_request", (uint32_t)1000, "http client max requests per connection");
+
 HttpConnection::HttpConnection(Socket::ptr sock, bool owner)
     : SocketStream(sock, owner)
+    , m_createTime(server::GetCurrentMS())
+    , m_lastTime(m_createTime)
+    , m_requestCount(0)
+    , m_length(0)
+    , m_bodyLength(0)
+    , m_bodyLeft(0)
+    , m_bodyChunked(false)
+    , m_bodyToClose(false)
+    , m_chunkStarted(false)
+    , m_bodyDone(true)
 {
 }
 
-HttpResponse::ptr HttpConnection::recvResponse(){
-    HttpResponseParser::ptr parser(new HttpResponseParser);
-    uint64_t buff_size = HttpResponseParser::GetHttpResponseBufferSize();
+std::string HttpConnection::takeBuffer(){
+    if (!m_buffer){
+        return "";
+    }
+    std::string ret(m_buffer.get(), m_length);
+    m_length = 0;
+    return ret;
+}
 
-    std::shared_ptr<char> buffer(
-        new char[buff_size + 1], [](char *ptr)
-        { delete[] ptr; });
-    char *data = buffer.get();
-    int offset = 0;
-    do
-    {
-        int len = read(data + offset, buff_size - offset);
-        if (len <= 0){
-            close();
-            return nullptr;
-        }
-        len += offset;
-        data[len] = '\0';
+bool HttpConnection::isAlive(){
+    if (!isConnected()){
+        return false;
+    }
+    //不能用hook后的recv，否则没有数据时会挂起协程
+    char c;
+    int rt = recv_f(getSocket()->getSocket(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (rt == 0){
+        return false;
+    }
+    if (rt > 0){
+        //空闲连接上不应该有数据
+        return false;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
 
-        size_t nparse = parser->execute(data, len, false);
-        if (parser->hasError()){
-            close();
-            return nullptr;
+//根据版本、connection头和body的长度确定连接能否继续使用
+static void InitResponseClose(HttpResponse::ptr rsp, bool chunked){
+    bool close = rsp->getVersion() < 0x11;
+    if (rsp->getConnectionHeader() == ConnectionHeader::KEEP_ALIVE){
+        close = false;
+    }
+    else if (rsp->getConnectionHeader() == ConnectionHeader::CLOSE){
+        close = true;
+    }
+    //没有content-length也不是chunked，body以关闭连接结束
+    if (!chunked && rsp->hasContentLength() && !rsp->hasHeader("content-length", nullptr)){
+        close = true;
+    }
+    rsp->setClose(close);
+}
+
+HttpResponse::ptr HttpConnection::recvResponse(){
+    HttpResponse::ptr rsp = recvResponseHeader();
+    if (!rsp){
+        return nullptr;
+    }
+    uint64_t max_size = HttpResponseParser::GetHttpResponseMaxBodysize();
+    int64_t length = getBodyLength();
+    if (length > (int64_t)max_size){
+        close();
+        return nullptr;
+    }
+    std::string body;
+    size_t size = 0;
+    //长度已知时一次分配好，chunked时按块扩容
+    body.resize(length > 0 ? length : 0);
+    while (!m_bodyDone){
+        if (body.size() == size){
+            body.resize(size + 4096 > body.size() * 2 ? size + 4096 : body.size() * 2);
         }
-        offset = len - nparse;
-        //未解析
-        if (offset == (int)buff_size){
+        int rt = readBody(&body[size], body.size() - size);
+        if (rt < 0){
             close();
             return nullptr;
         }
-        if (parser->isFinished()){
+        if (rt == 0){
             break;
         }
+        size += rt;
+        if (size > max_size){
+            close();
+            return nullptr;
+        }
+    }
+    body.resize(size);
+    rsp->setBody(body);
+    //多读了下一个响应的数据，连接不能再复用
+    if (m_length > 0){
+        rsp->setClose(true);
+    }
+    return rsp;
+}
 
-    } while (true);
-    auto &client_parser = parser->getParser();
-    std::string body;
-    if (client_parser.chunked){
-        int len = offset;
+HttpResponse::ptr HttpConnection::recvResponseHeader(bool no_body){
+    HttpResponseParser::ptr parser(new HttpResponseParser);
+    uint64_t buff_size = HttpResponseParser::GetHttpResponseBufferSize();
+    if (!m_buffer){
+        m_buffer.reset(new char[buff_size + 1], [](char *ptr)
+                       { delete[] ptr; });
+    }
+    char *data = m_buffer.get();
+    m_length = 0;
+    HttpResponse::ptr rsp;
+    uint32_t status = 0;
+    do{
+        //中间响应之后多读的数据先解析
+        bool need_read = m_length == 0;
+        if (rsp){
+            parser.reset(new HttpResponseParser);
+        }
         do{
-            bool begin = true;
-            do{
-                if (!begin || len == 0){
-                    int rt = read(data + len, buff_size - len);
-                    if (rt <= 0){
-                        close();
-                        return nullptr;
-                    }
-                    len += rt;
-                }
-                data[len] = '\0';
-                size_t nparse = parser->execute(data, len, true);
-                if (parser->hasError()){
-                    close();
-                    return nullptr;
-                }
-                len -= nparse;
-                if (len == (int)buff_size){
+            if (need_read){
+                int len = read(data + m_length, buff_size - m_length);
+                if (len <= 0){
                     close();
                     return nullptr;
                 }
-                begin = false;
-            } while (!parser->isFinished());
-
-            LOG_DEBUG(g_logger) << "content_len=" << client_parser.content_len;
-            if (client_parser.content_len + 2 <= len){
-                body.append(data, client_parser.content_len);
-                memmove(data, data + client_parser.content_len + 2,
-                        len - client_parser.content_len - 2);
-                len -= client_parser.content_len + 2;
+                m_length += len;
             }
-            else{
-                body.append(data, len);
-                int left = client_parser.content_len - len + 2;
-                while (left > 0){
-                    int rt = read(data, left > (int)buff_size ? (int)buff_size : left);
-                    if (rt < 0){
-                        close();
-                        return nullptr;
-                    }
-                    body.append(data, rt);
-                    left -= rt;
-                }
-                body.resize(body.size() - 2);
-                len = 0;
+            need_read = true;
+            data[m_length] = '\0';
+            size_t nparse = parser->execute(data, m_length, false);
+            if (parser->hasError()){
+                close();
+                return nullptr;
+            }
+            //execute会把没有解析的数据移到开头
+            m_length -= nparse;
+            if (m_length == buff_size){
+                close();
+                return nullptr;
             }
-        } while (!client_parser.chunks_done);
-        parser->getData()->setBody(body);
+        } while (!parser->isFinished());
+        rsp = parser->getData();
+        status = (uint32_t)rsp->getStatus();
+    //100 Continue、103 Early Hints等中间响应没有body，跳过；101由调用者处理
+    } while (status >= 100 && status < 200 && status != 101);
+
+    bool chunked = parser->getParser().chunked;
+    std::string val;
+    m_bodyChunked = false;
+    m_bodyToClose = false;
+    m_chunkStarted = false;
+    m_bodyLength = 0;
+    if (no_body || status < 200 || status == 204 || status == 304){
+        chunked = false;
+    }
+    else if (chunked){
+        m_bodyChunked = true;
+    }
+    else if (rsp->hasHeader("content-length", &val)){
+        m_bodyLength = parser->getContentLength();
     }
     else{
-        int64_t length = parser->getContentLength();
-        if(length > 0) {
-            body.resize(length);
-
-            int len = 0;
-            if(length >= offset) {
-                memcpy(&body[0], data, offset);
-                len = offset;
-            } else {
-                memcpy(&body[0], data, length);
-                len = length;
+        m_bodyToClose = true;
+    }
+    m_bodyLeft = m_bodyLength;
+    m_bodyDone = !m_bodyChunked && !m_bodyToClose && m_bodyLength == 0;
+    InitResponseClose(rsp, chunked);
+    if (m_bodyToClose){
+        rsp->setClose(true);
+    }
+    return rsp;
+}
+
+void HttpConnection::consume(size_t len){
+    memmove(m_buffer.get(), m_buffer.get() + len, m_length - len);
+    m_length -= len;
+}
+
+int HttpConnection::readLine(){
+    char *data = m_buffer.get();
+    uint64_t buff_size = HttpResponseParser::GetHttpResponseBufferSize();
+    do{
+        const char *end = (const char *)memchr(data, '\n', m_length);
+        if (end){
+            return end - data + 1;
+        }
+        if (m_length == buff_size){
+            return -1;
+        }
+        int len = read(data + m_length, buff_size - m_length);
+        if (len <= 0){
+            return -1;
+        }
+        m_length += len;
+    } while (true);
+}
+
+bool HttpConnection::readChunkSize(){
+    //上一个chunk的数据后面跟着CRLF
+    if (m_chunkStarted){
+        int n = readLine();
+        if (n < 0){
+            return false;
+        }
+        consume(n);
+    }
+    m_chunkStarted = true;
+
+    int n = readLine();
+    if (n < 0){
+        return false;
+    }
+    char *end = nullptr;
+    uint64_t size = strtoull(m_buffer.get(), &end, 16);
+    if (end == m_buffer.get()){
+        return false;
+    }
+    consume(n);
+    if (size == 0){
+        //跳过trailer直到空行
+        do{
+            n = readLine();
+            if (n < 0){
+                return false;
             }
-            length -= offset;
-            if(length > 0) {
-                if(readFixSize(&body[len], length) <= 0) {
-                    close();
-                    return nullptr;
-                }
+            bool empty = n == 1 || (n == 2 && m_buffer.get()[0] == '\r');
+            consume(n);
+            if (empty){
+                break;
             }
-            parser->getData()->setBody(body);
+        } while (true);
+        m_bodyDone = true;
+    }
+    m_bodyLeft = size;
+    return true;
+}
+
+int HttpConnection::readBody(void *buf, size_t length){
+    if (m_bodyDone){
+        return 0;
+    }
+    if (m_bodyToClose){
+        //body以关闭连接结束
+        int rt = 0;
+        if (m_length > 0){
+            rt = length > m_length ? m_length : length;
+            memcpy(buf, m_buffer.get(), rt);
+            consume(rt);
+            return rt;
+        }
+        rt = read(buf, length);
+        if (rt == 0){
+            m_bodyDone = true;
+        }
+        return rt;
+    }
+    if (m_bodyLeft == 0){
+        if (!m_bodyChunked || !readChunkSize()){
+            close();
+            return -1;
+        }
+        if (m_bodyDone){
+            return 0;
+        }
+    }
+    size_t len = length > m_bodyLeft ? m_bodyLeft : length;
+    int rt = 0;
+    if (m_length > 0){
+        rt = len > m_length ? m_length : len;
+        memcpy(buf, m_buffer.get(), rt);
+        consume(rt);
+    }
+    else{
+        rt = read(buf, len);
+        if (rt <= 0){
+            close();
+            return -1;
         }
     }
-    return parser->getData();
+    m_bodyLeft -= rt;
+    if (m_bodyLeft == 0 && !m_bodyChunked){
+        m_bodyDone = true;
+    }
+    return rt;
 }
 
 int HttpConnection::sendRequest(HttpRequest::ptr req){
@@ -191,12 +370,17 @@ HttpResult::ptr HttpConnection::DoRequest(HttpMethod method
     HttpRequest::ptr req = std::make_shared<HttpRequest>();
     req->setPath(url->getPath());
     req->setMethod(method);
+    //开启连接池时默认使用长连接
+    req->setClose(!g_http_client_pool_enable->getVal());
     bool has_host = false;
     for (auto&i : headers){
         if (strcasecmp(i.first.c_str(), "connection") == 0){
             if (strcasecmp(i.second.c_str(), "keep-alive") == 0){
                 req->setClose(false);
             }
+            else if (strcasecmp(i.second.c_str(), "close") == 0){
+                req->setClose(true);
+            }
             continue;
         }
 
@@ -217,6 +401,11 @@ HttpResult::ptr HttpConnection::DoRequest(HttpMethod method
 HttpResult::ptr HttpConnection::DoRequest(HttpRequest::ptr req
                                 , Uri::ptr url
                                 , uint64_t timeout_ms){
+    //长连接请求通过连接池发送
+    if (!req->isClose() && g_http_client_pool_enable->getVal()){
+        HttpConnectionPool::ptr pool = HttpConnectionPoolMgr::GetInstance()->getPool(url->getHost(), url->getPort());
+        return pool->doRequest(req, timeout_ms);
+    }
     Address::ptr addr = url->createAddress();
     if (!addr){
         return std::make_shared<HttpResult>((int)HttpResult::Error::INVALID_HOST, nullptr, "invalid host: " + url->getHost());
@@ -248,6 +437,152 @@ HttpResult::ptr HttpConnection::DoRequest(HttpRequest::ptr req
     return std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok");
 }
 
+HttpConnectionPool::HttpConnectionPool(const std::string &host, uint16_t port
+                       , uint32_t max_size, uint32_t idle_timeout, uint32_t max_request)
+:m_host(host)
+,m_port(port)
+,m_maxSize(max_size)
+,m_idleTimeout(idle_timeout)
+,m_maxRequest(max_request)
+,m_createCount(0){
+
 }
+
+size_t HttpConnectionPool::getIdleCount(){
+    MutexType::Lock lock(m_mutex);
+    return m_conns.size();
 }
 
+void HttpConnectionPool::expireIdle(uint64_t now){
+    while (!m_conns.empty() && m_conns.front()->getLastTime() + m_idleTimeout <= now){
+        m_conns.front()->close();
+        m_conns.pop_front();
+    }
+}
+
+HttpConnection::ptr HttpConnectionPool::createConnection(uint64_t timeout_ms){
+    IPAddress::ptr addr = Address::LookupAnyIPAddress(m_host);
+    if (!addr){
+        LOG_ERROR(g_logger) << "HttpConnectionPool invalid host: " << m_host;
+        return nullptr;
+    }
+    addr->setPort(m_port);
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    if (!sock){
+        LOG_ERROR(g_logger) << "HttpConnectionPool create socket fail: " << addr->toString();
+        return nullptr;
+    }
+    if (!sock->connect(addr, timeout_ms)){
+        LOG_ERROR(g_logger) << "HttpConnectionPool connect fail: " << addr->toString();
+        return nullptr;
+    }
+    ++m_createCount;
+    return std::make_shared<HttpConnection>(sock);
+}
+
+HttpConnection::ptr HttpConnectionPool::getConnection(uint64_t timeout_ms){
+    uint64_t now = server::GetCurrentMS();
+    std::vector<HttpConnection::ptr> invalid;
+    HttpConnection::ptr conn;
+    {
+        MutexType::Lock lock(m_mutex);
+        expireIdle(now);
+        while (!m_conns.empty()){
+            conn = m_conns.back();
+            m_conns.pop_back();
+            if (conn->isAlive()){
+                break;
+            }
+            invalid.push_back(conn);
+            conn.reset();
+        }
+    }
+    for (auto& i : invalid){
+        i->close();
+    }
+    if (conn){
+        return conn;
+    }
+    return createConnection(timeout_ms);
+}
+
+void HttpConnectionPool::releaseConnection(HttpConnection::ptr conn, bool close){
+    conn->addRequestCount();
+    if (close || !conn->isConnected() || conn->getRequestCount() >= m_maxRequest){
+        conn->close();
+        return;
+    }
+    uint64_t now = server::GetCurrentMS();
+    conn->setLastTime(now);
+    MutexType::Lock lock(m_mutex);
+    expireIdle(now);
+    if (m_conns.size() >= m_maxSize){
+        lock.unlock();
+        conn->close();
+        return;
+    }
+    m_conns.push_back(conn);
+}
+
+HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req, uint64_t timeout_ms){
+    //复用的连接可能刚好被对端关闭，幂等请求换一个新连接重试一次
+    bool idempotent = req->getMethod() == HttpMethod::GET || req->getMethod() == HttpMethod::HEAD;
+    for (int i = 0; i < 2; ++i){
+        HttpConnection::ptr conn = getConnection(timeout_ms);
+        if (!conn){
+            return std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION, nullptr
+                                                , "pool get connection fail: " + m_host + ":" + std::to_string(m_port));
+        }
+        //按连接自己的请求数判断，其他协程并发创建连接不会影响结果
+        bool reused = conn->getRequestCount() > 0;
+        conn->getSocket()->setRecvTimeout(timeout_ms);
+        int rt = conn->sendRequest(req);
+        if (rt <= 0){
+            releaseConnection(conn, true);
+            if (reused){
+                continue;
+            }
+            return std::make_shared<HttpResult>(rt == 0 ? (int)HttpResult::Error::SEND_CLOSE_BY_PEER : (int)HttpResult::Error::SEND_SOCKET_ERROR
+                                                , nullptr, "send request fail errno=" + std::to_string(errno) + " errstr=" + std::string(strerror(errno)));
+        }
+        auto rsp = conn->recvResponse();
+        if (!rsp){
+            releaseConnection(conn, true);
+            if (reused && idempotent && errno != ETIMEDOUT && errno != EAGAIN){
+                continue;
+            }
+            return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT, nullptr, "recv response timeout: " + m_host + ":"
+                                                + std::to_string(m_port) + " timeout_ms:" + std::to_string(timeout_ms));
+        }
+        releaseConnection(conn, rsp->isClose() || req->isClose());
+        return std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok");
+    }
+    return std::make_shared<HttpResult>((int)HttpResult::Error::SEND_CLOSE_BY_PEER, nullptr, "connection closed by peer: " + m_host + ":" + std::to_string(m_port));
+}
+
+HttpConnectionPoolManager::HttpConnectionPoolManager(){
+
+}
+
+HttpConnectionPool::ptr HttpConnectionPoolManager::getPool(const std::string &host, uint16_t port){
+    std::string key = host + ":" + std::to_string(port);
+    MutexType::Lock lock(m_mutex);
+    auto it = m_pools.find(key);
+    if (it != m_pools.end()){
+        return it->second;
+    }
+    HttpConnectionPool::ptr pool(new HttpConnectionPool(host, port
+                                 , g_http_client_pool_max_size->getVal()
+                                 , g_http_client_pool_idle_timeout->getVal()
+                                 , g_http_client_pool_max_request->getVal()));
+    m_pools[key] = pool;
+    return pool;
+}
+
+void HttpConnectionPoolManager::clear(){
+    MutexType::Lock lock(m_mutex);
+    m_pools.clear();
+}
+
+}
+}
@@ -1,9 +1,14 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
+#include <list>
+#include <unordered_map>
 #include "../socket_stream.h"
 #include "http.h"
 #include "../uri.h"
+#include "../mutex.h"
+#include "../singleton.h"
 
 namespace server{
 namespace http{
@@ -20,6 +25,8 @@ struct HttpResult{
         SEND_CLOSE_BY_PEER = 5,
         SEND_SOCKET_ERROR = 6,
         TIMEOUT = 7,
+        POOL_GET_CONNECTION = 8,
+        UPGRADE_FAIL = 9,
     };
     HttpResult(int _result, HttpResponse::ptr _response, const std::string& _error)
         :result(_result), response(_response), error(_error){};
@@ -73,8 +80,110 @@ public:
 
     HttpResponse::ptr recvResponse();
     int sendRequest(HttpRequest::ptr req);
+
+    //只读取响应头，body之后通过readBody边读边处理，no_body为true表示响应没有body(HEAD请求)
+    HttpResponse::ptr recvResponseHeader(bool no_body = false);
+    //读取当前响应的body，chunked会自动解码，返回0表示读完，小于0表示出错
+    int readBody(void *buf, size_t length);
+    //当前响应的body是否已经读完，没有读完的连接不能复用
+    bool isBodyDone() const { return m_bodyDone; }
+    //body的长度，chunked或者以关闭连接结束时为-1
+    int64_t getBodyLength() const { return m_bodyChunked || m_bodyToClose ? -1 : (int64_t)m_bodyLength; }
+
+    //空闲连接检查：对端没有关闭连接，也没有多余的数据
+    bool isAlive();
+    //取出缓冲区中响应头之后多读的数据，协议升级后交给新的协议继续处理
+    std::string takeBuffer();
+
+    uint64_t getCreateTime() const { return m_createTime; }
+    uint64_t getLastTime() const { return m_lastTime; }
+    void setLastTime(uint64_t v) { m_lastTime = v; }
+    uint32_t getRequestCount() const { return m_requestCount; }
+    void addRequestCount() { ++m_requestCount; }
+
 private:
+    //保证缓冲区开头有一整行，返回行的长度（包括\n）
+    int readLine();
+    bool readChunkSize();
+    void consume(size_t len);
+
+    uint64_t m_createTime;
+    //上次放回连接池的时间(ms)
+    uint64_t m_lastTime;
+    //已经在这个连接上发送的请求数
+    uint32_t m_requestCount;
+
+    //recvResponseHeader之后的接收缓冲区，保存多读的body
+    std::shared_ptr<char> m_buffer;
+    size_t m_length;
+    uint64_t m_bodyLength;
+    //body剩余的长度，chunked时为当前chunk剩余的长度
+    uint64_t m_bodyLeft;
+    bool m_bodyChunked;
+    bool m_bodyToClose;
+    bool m_chunkStarted;
+    bool m_bodyDone;
 };
 
+//同一个host:port的长连接池，连接用完后放回池中给下一个请求复用
+class HttpConnectionPool{
+public:
+    typedef std::shared_ptr<HttpConnectionPool> ptr;
+    typedef Mutex MutexType;
+
+    //max_size为最多保留的空闲连接数，idle_timeout为空闲连接的存活时间(ms)
+    //max_request为每个连接最多发送的请求数
+    HttpConnectionPool(const std::string &host, uint16_t port
+                       , uint32_t max_size, uint32_t idle_timeout, uint32_t max_request);
+
+    //优先复用空闲连接，没有时新建连接，失败返回nullptr
+    HttpConnection::ptr getConnection(uint64_t timeout_ms);
+    //响应读完后调用，close为true或者连接不能再使用时直接关闭
+    void releaseConnection(HttpConnection::ptr conn, bool close);
+
+    HttpResult::ptr doRequest(HttpRequest::ptr req, uint64_t timeout_ms);
+
+    const std::string &getHost() const { return m_host; }
+    uint16_t getPort() const { return m_port; }
+    size_t getIdleCount();
+    uint64_t getCreateCount() const { return m_createCount; }
+
+    void setMaxSize(uint32_t v) { m_maxSize = v; }
+    void setIdleTimeout(uint32_t v) { m_idleTimeout = v; }
+    void setMaxRequest(uint32_t v) { m_maxRequest = v; }
+
+private:
+    HttpConnection::ptr createConnection(uint64_t timeout_ms);
+    //调用前需要加锁，关闭超过空闲时间的连接
+    void expireIdle(uint64_t now);
+
+    std::string m_host;
+    uint16_t m_port;
+    uint32_t m_maxSize;
+    uint32_t m_idleTimeout;
+    uint32_t m_maxRequest;
+
+    MutexType m_mutex;
+    //按放回的时间排序，最后放回的在末尾，优先复用
+    std::list<HttpConnection::ptr> m_conns;
+    std::atomic<uint64_t> m_createCount;
+};
+
+//按host:port管理连接池，DoGet/DoPost默认通过这里复用连接
+class HttpConnectionPoolManager{
+public:
+    typedef Mutex MutexType;
+    HttpConnectionPoolManager();
+
+    HttpConnectionPool::ptr getPool(const std::string &host, uint16_t port);
+    void clear();
+
+private:
+    MutexType m_mutex;
+    std::unordered_map<std::string, HttpConnectionPool::ptr> m_pools;
+};
+
+typedef server::Singletion<HttpConnectionPoolManager> HttpConnectionPoolMgr;
+
 }
 }
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "http_fanout.h"
+#include "../iomanager.h"
+#include "../log.h"
+#include "../util.h"
+
+namespace server{
+namespace http{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+HttpFanout::HttpFanout(uint64_t timeout_ms)
+:m_timeout(timeout_ms)
+,m_deadline(timeout_ms ? server::GetCurrentMS() + timeout_ms : ~0ull)
+,m_need(0)
+,m_success(0)
+,m_running(0)
+,m_expired(false)
+,m_finished(false)
+,m_scheduler(nullptr){
+
+}
+
+size_t HttpFanout::add(HttpRequest::ptr req, Uri::ptr url, uint64_t timeout_ms){
+    return launch([req, url](uint64_t timeout){
+        return HttpConnection::DoRequest(req, url, timeout);
+    }, timeout_ms);
+}
+
+size_t HttpFanout::add(HttpMethod method, const std::string &url, uint64_t timeout_ms
+                       , const std::map<std::string, std::string> &headers
+                       , const std::string &body){
+    return launch([method, url, headers, body](uint64_t timeout){
+        return HttpConnection::DoRequest(method, url, timeout, headers, body);
+    }, timeout_ms);
+}
+
+size_t HttpFanout::addGet(const std::string &url, uint64_t timeout_ms
+                          , const std::map<std::string, std::string> &headers){
+    return add(HttpMethod::GET, url, timeout_ms, headers);
+}
+
+size_t HttpFanout::addPost(const std::string &url, uint64_t timeout_ms
+                           , const std::map<std::string, std::string> &headers
+                           , const std::string &body){
+    return add(HttpMethod::POST, url, timeout_ms, headers, body);
+}
+
+size_t HttpFanout::launch(RequestFunc fun, uint64_t timeout_ms){
+    //单个请求的超时不超过整体剩余的时间
+    uint64_t now = server::GetCurrentMS();
+    if (m_deadline != ~0ull){
+        uint64_t left = m_deadline > now ? m_deadline - now : 1;
+        if (timeout_ms == 0 || timeout_ms > left){
+            timeout_ms = left;
+        }
+    }
+
+    IOManager *iom = IOManager::GetThis();
+    size_t index;
+    {
+        MutexType::Lock lock(m_mutex);
+        index = m_results.size();
+        m_results.push_back(nullptr);
+        m_timers.push_back(nullptr);
+        if (iom){
+            std::weak_ptr<HttpFanout> weak(shared_from_this());
+            if (m_deadline != ~0ull && !m_deadlineTimer){
+                m_deadlineTimer = iom->addConditionTimer(m_deadline > now ? m_deadline - now : 1
+                                    , std::bind(&HttpFanout::onDeadline, this), weak);
+            }
+            //请求自己的超时只限制读，连接和排队的时间由定时器限制
+            if (timeout_ms){
+                m_timers[index] = iom->addConditionTimer(timeout_ms
+                                    , std::bind(&HttpFanout::onResult, this, index, nullptr), weak);
+            }
+        }
+    }
+    if (!iom){
+        //不在IOManager中只能依次执行
+        LOG_WARN(g_logger) << "HttpFanout not in IOManager, run request " << index << " serially";
+        run(index, fun, timeout_ms);
+        return index;
+    }
+    iom->scheduler(std::bind(&HttpFanout::run, shared_from_this(), index, fun, timeout_ms));
+    return index;
+}
+
+void HttpFanout::run(size_t index, RequestFunc fun, uint64_t timeout_ms){
+    onResult(index, fun(timeout_ms));
+}
+
+void HttpFanout::onResult(size_t index, HttpResult::ptr result){
+    if (!result){
+        result = std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT, nullptr
+                                              , "fanout request " + std::to_string(index) + " timeout");
+    }
+    Timer::ptr timer;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_finished || m_results[index]){
+            return;
+        }
+        m_results[index] = result;
+        m_completed.push_back(index);
+        if (result->result == (int)HttpResult::Error::OK){
+            ++m_success;
+        }
+        timer.swap(m_timers[index]);
+        //wait要等正在执行的回调结束才返回
+        ++m_running;
+    }
+    if (timer){
+        timer->getManager()->cancel(timer);
+    }
+    if (m_cb){
+        m_cb(index, result);
+    }
+    MutexType::Lock lock(m_mutex);
+    --m_running;
+    if (m_finished ? m_running == 0 : isDone()){
+        wakeup();
+    }
+}
+
+void HttpFanout::onDeadline(){
+    MutexType::Lock lock(m_mutex);
+    m_expired = true;
+    wakeup();
+}
+
+bool HttpFanout::isDone() const{
+    if (m_expired || m_completed.size() == m_results.size()){
+        return true;
+    }
+    if (m_need){
+        //成功的够了，或者剩下的全部成功也不够
+        return m_success >= m_need
+               || m_success + (m_results.size() - m_completed.size()) < m_need;
+    }
+    return false;
+}
+
+void HttpFanout::wakeup(){
+    if (m_waiter){
+        m_scheduler->scheduler(m_waiter);
+        m_waiter.reset();
+        m_scheduler = nullptr;
+    }
+}
+
+size_t HttpFanout::wait(size_t need){
+    std::vector<Timer::ptr> timers;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_finished){
+            return m_success;
+        }
+        m_need = need;
+        Scheduler *scheduler = Scheduler::GetThis();
+        if (!isDone() && scheduler){
+            m_scheduler = scheduler;
+            m_waiter = Fiber::GetThis();
+            lock.unlock();
+            Fiber::YieldToHold();
+            lock.lock();
+        }
+        m_finished = true;
+        //m_finished之后不会再有新的回调，等已经开始的回调执行完
+        while (m_running && scheduler){
+            m_scheduler = scheduler;
+            m_waiter = Fiber::GetThis();
+            lock.unlock();
+            Fiber::YieldToHold();
+            lock.lock();
+        }
+        for (size_t i = 0; i < m_results.size(); ++i){
+            if (!m_results[i]){
+                m_results[i] = std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT, nullptr
+                                                            , "fanout timeout_ms:" + std::to_string(m_timeout));
+            }
+            if (m_timers[i]){
+                timers.push_back(m_timers[i]);
+            }
+        }
+        m_timers.clear();
+        if (m_deadlineTimer){
+            timers.push_back(m_deadlineTimer);
+            m_deadlineTimer.reset();
+        }
+    }
+    for (auto& i : timers){
+        i->getManager()->cancel(i);
+    }
+    return m_success;
+}
+
+size_t HttpFanout::waitAll(){
+    return wait(0);
+}
+
+int HttpFanout::waitAny(){
+    wait(1);
+    for (auto& i : m_completed){
+        if (m_results[i]->result == (int)HttpResult::Error::OK){
+            return i;
+        }
+    }
+    return -1;
+}
+
+size_t HttpFanout::waitQuorum(size_t n){
+    return wait(n);
+}
+
+}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "http_connection.h"
+#include "../fiber.h"
+#include "../mutex.h"
+#include "../scheduler.h"
+#include "../timer.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace server{
+namespace http{
+
+//并发发送多个HTTP请求，每个请求在当前IOManager的一个协程中执行，总耗时取决于最慢的请求而不是总和
+//请求在add时就开始发送，wait只能调用一次，返回后没有完成的请求结果为TIMEOUT，之后完成的结果会被丢弃
+class HttpFanout : public std::enable_shared_from_this<HttpFanout>{
+public:
+    typedef std::shared_ptr<HttpFanout> ptr;
+    typedef Mutex MutexType;
+    //每个请求完成时在执行请求的协程中回调，可能在不同的线程，index为add返回的序号，wait会等正在执行的回调结束，返回后不再回调
+    typedef std::function<void(size_t index, HttpResult::ptr result)> Callback;
+
+    //timeout_ms为整体的超时时间(ms)，从创建时开始计算，0表示只受单个请求的超时限制
+    HttpFanout(uint64_t timeout_ms = 0);
+
+    //timeout_ms为单个请求的超时时间(ms)，返回请求的序号
+    size_t add(HttpRequest::ptr req, Uri::ptr url, uint64_t timeout_ms);
+    size_t add(HttpMethod method, const std::string &url, uint64_t timeout_ms
+               , const std::map<std::string, std::string> &headers = {}
+               , const std::string &body = "");
+    size_t addGet(const std::string &url, uint64_t timeout_ms
+                  , const std::map<std::string, std::string> &headers = {});
+    size_t addPost(const std::string &url, uint64_t timeout_ms
+                   , const std::map<std::string, std::string> &headers = {}
+                   , const std::string &body = "");
+
+    //需要在add之前设置
+    void setCallback(Callback cb) { m_cb = cb; }
+
+    //等待全部完成，返回成功的数量
+    size_t waitAll();
+    //等待任意一个成功，返回它的序号，全部失败或者超时返回-1
+    int waitAny();
+    //等待n个成功，返回成功的数量，小于n表示超时或者失败的太多
+    size_t waitQuorum(size_t n);
+
+    //wait返回后调用
+    HttpResult::ptr getResult(size_t index) const { return m_results[index]; }
+    const std::vector<HttpResult::ptr> &getResults() const { return m_results; }
+    //按完成的先后排列的序号，单个请求超时也算完成，整体超时时没有完成的请求不在其中
+    const std::vector<size_t> &getCompleted() const { return m_completed; }
+    size_t size() const { return m_results.size(); }
+
+private:
+    typedef std::function<HttpResult::ptr(uint64_t timeout_ms)> RequestFunc;
+
+    size_t launch(RequestFunc fun, uint64_t timeout_ms);
+    void run(size_t index, RequestFunc fun, uint64_t timeout_ms);
+    //result为nullptr表示超时
+    void onResult(size_t index, HttpResult::ptr result);
+    void onDeadline();
+    //调用前需要加锁
+    bool isDone() const;
+    //调用前需要加锁，调度等待的协程
+    void wakeup();
+    size_t wait(size_t need);
+
+    uint64_t m_timeout;
+    uint64_t m_deadline;
+    Callback m_cb;
+
+    MutexType m_mutex;
+    std::vector<HttpResult::ptr> m_results;
+    std::vector<size_t> m_completed;
+    std::vector<Timer::ptr> m_timers;
+    Timer::ptr m_deadlineTimer;
+    //需要成功的数量，达到后唤醒等待的协程，0表示等待全部完成
+    size_t m_need;
+    size_t m_success;
+    //正在执行的回调数量
+    size_t m_running;
+    bool m_expired;
+    bool m_finished;
+    Scheduler *m_scheduler;
+    Fiber::ptr m_waiter;
+};
+
+}
+}
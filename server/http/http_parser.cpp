@@ -1,4 +1,5 @@
 #include "http_parser.h"
+#include "http_scanner.h"
 #include "../log.h"
 #include "../config.h"
 
@@ -38,7 +39,7 @@ uint64_t HttpResponseParser::GetHttpResponseMaxBodysize(){
 
 void on_request_method(void *data, const char *at, size_t length){
     HttpRequestParser *parser = static_cast<HttpRequestParser *>(data);
-    HttpMethod m = StringtoHttpMethod(std::string(at, length));
+    HttpMethod m = ParseHttpMethod(at, length);
 
     if (m == HttpMethod::INVALID_METHOD){
         LOG_WARN(g_logger) << "invalid http request method "
@@ -56,29 +57,23 @@ void on_request_uri(void *data, const char *at, size_t length){
 
 void on_request_fragment(void *data, const char *at, size_t length){
     HttpRequestParser *parser = static_cast<HttpRequestParser *>(data);
-    parser->getData()->setFragment(std::string(at, length));
+    parser->getData()->setFragment(at, length);
 }
 
 void on_request_path(void *data, const char *at, size_t length){
     HttpRequestParser *parser = static_cast<HttpRequestParser *>(data);
-    parser->getData()->setPath(std::string(at, length));
+    parser->getData()->setPath(at, length);
 }
 
 void on_request_query(void *data, const char *at, size_t length){
     HttpRequestParser *parser = static_cast<HttpRequestParser *>(data);
-    parser->getData()->setQuery(std::string(at, length));
+    parser->getData()->setQuery(at, length);
 }
 
 void on_request_version(void *data, const char *at, size_t length){
     HttpRequestParser *parser = static_cast<HttpRequestParser *>(data);
-    uint8_t v = 0;
-    if (strncmp(at, "HTTP/1.1", length) == 0){
-        v = 0x11;
-    }
-    else if (strncmp(at, "HTTP/1.0", length) == 0){
-        v = 0x10;
-    }
-    else{
+    uint8_t v = ParseHttpVersion(at, length);
+    if (v == 0){
         LOG_WARN(g_logger) << "invalid http request version: "
                                  << std::string(at, length);
         parser->setError(1001);
@@ -98,7 +93,18 @@ void on_request_http_field(void *data, const char *field, size_t flen, const cha
         parser->setError(1002);
         return;
     }
-    parser->getData()->setHeader(std::string(field, flen), std::string(value, vlen));
+    //重复的Content-Length值不同时无法确定body的长度
+    if (flen == 14 && strncasecmp(field, "content-length", 14) == 0){
+        static const std::string s_content_length = "content-length";
+        const HttpRequest::MapType &headers = parser->getData()->getHeaders();
+        auto it = headers.find(s_content_length);
+        if (it != headers.end() && (it->second.size() != vlen || memcmp(it->second.c_str(), value, vlen) != 0)){
+            LOG_WARN(g_logger) << "conflicting http request content-length";
+            parser->setError(1003);
+            return;
+        }
+    }
+    parser->getData()->setHeader(field, flen, value, vlen);
 }
 
 HttpRequestParser::HttpRequestParser():m_error(0){
@@ -115,14 +121,32 @@ HttpRequestParser::HttpRequestParser():m_error(0){
     m_parser.data = this;
 }
 
+void HttpRequestParser::reset(){
+    //上一个请求已经没有其他地方引用时直接复用
+    if (m_data.use_count() == 1){
+        m_data->reset();
+    }
+    else{
+        m_data.reset(new server::http::HttpRequest);
+    }
+    m_error = 0;
+    //只重置解析状态，回调和data不变
+    http_parser_init(&m_parser);
+}
+
 //data为要解析的字符串，len为长度。
 size_t HttpRequestParser::execute(char *data, size_t len){
-    size_t offset = http_parser_execute(&m_parser, data, len, 0);
+    size_t offset = HttpRequestExecute(&m_parser, data, len, 0);
     //将处理过的部分覆盖，减少内存消耗
     memmove(data, data + offset, (len - offset));
     return offset;
 }
 
+size_t HttpRequestParser::parse(const char *data, size_t len){
+    //ragel记录的mark是相对data的偏移，所以data中已解析的部分必须保持不动
+    return HttpRequestExecute(&m_parser, data, len, m_parser.nread);
+}
+
 bool HttpRequestParser::isFinished(){
     return http_parser_finish(&m_parser);
 }
@@ -132,7 +156,8 @@ bool HttpRequestParser::hasError(){
 }
 
 uint64_t HttpRequestParser::getContentLength(){
-    return m_data->getHeaderAs<uint64_t>("content-length", 0);
+    int64_t len = m_data->getHeaderContentLength();
+    return len < 0 ? 0 : len;
 }
 
 
@@ -155,14 +180,8 @@ void on_response_chunk(void *data, const char *at, size_t length){
 
 void on_response_version(void *data, const char *at, size_t length){
     HttpResponseParser *parser = static_cast<HttpResponseParser *>(data);
-    uint8_t v = 0;
-    if (strncmp(at, "HTTP/1.1", length) == 0){
-        v = 0x11;
-    }
-    else if (strncmp(at, "HTTP/1.0", length) == 0){
-        v = 0x10;
-    }
-    else{
+    uint8_t v = ParseHttpVersion(at, length);
+    if (v == 0){
         LOG_WARN(g_logger) << "invalid http response version: "
                                  << std::string(at, length);
         parser->setError(1001);
@@ -222,7 +241,8 @@ bool HttpResponseParser::hasError(){
 }
 
 uint64_t HttpResponseParser::getContentLength(){
-    return m_data->getHeaderAs<uint64_t>("content-length", 0);
+    int64_t len = m_data->getHeaderContentLength();
+    return len < 0 ? 0 : len;
 }
 
 
@@ -12,8 +12,12 @@ class HttpRequestParser{
 public:
     typedef std::shared_ptr<HttpRequestParser> ptr;
     HttpRequestParser();
+    //准备解析同一个连接上的下一个请求
+    void reset();
 
     size_t execute(char *data, size_t len);
+    //从上次解析结束的位置继续解析，不移动data，返回已解析的header总长度
+    size_t parse(const char *data, size_t len);
     bool isFinished();
     bool hasError();
 
@@ -0,0 +1,338 @@
+#include "http_request_view.h"
+#include "http_scanner.h"
+#include "../log.h"
+#include <string.h>
+#include <stdlib.h>
+
+namespace server{
+namespace http{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+uint32_t HeaderHash(StringView s){
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < s.size(); ++i){
+        h = (h ^ (uint8_t)HeaderLower(s[i])) * 16777619u;
+    }
+    return h;
+}
+
+static const char *KnownHeaderList[] = {
+#define XX(num, name, string) string,
+    HTTP_KNOWN_HEADER_MAP(XX)
+#undef XX
+};
+
+HttpArena::HttpArena(size_t block_size)
+:m_blockSize(block_size)
+,m_cur(0)
+,m_pos(0){
+
+}
+
+HttpArena::~HttpArena(){
+    for (auto& i : m_blocks){
+        delete[] i.data;
+    }
+}
+
+char *HttpArena::alloc(size_t size){
+    //8字节对齐
+    size = (size + 7) & ~(size_t)7;
+    while (m_cur < m_blocks.size()){
+        Block &b = m_blocks[m_cur];
+        if (b.size - m_pos >= size){
+            char *ptr = b.data + m_pos;
+            m_pos += size;
+            return ptr;
+        }
+        ++m_cur;
+        m_pos = 0;
+    }
+    Block b;
+    b.size = size > m_blockSize ? size : m_blockSize;
+    b.data = new char[b.size];
+    m_blocks.push_back(b);
+    m_cur = m_blocks.size() - 1;
+    m_pos = size;
+    return b.data;
+}
+
+StringView HttpArena::copy(const char *data, size_t len){
+    if (len == 0){
+        return StringView();
+    }
+    char *ptr = alloc(len);
+    memcpy(ptr, data, len);
+    return StringView(ptr, len);
+}
+
+void HttpArena::reset(){
+    //超过块大小的大body单独申请，不保留
+    size_t keep = 0;
+    for (size_t i = 0; i < m_blocks.size(); ++i){
+        if (m_blocks[i].size > m_blockSize){
+            delete[] m_blocks[i].data;
+        }
+        else{
+            m_blocks[keep++] = m_blocks[i];
+        }
+    }
+    m_blocks.resize(keep);
+    m_cur = 0;
+    m_pos = 0;
+}
+
+HttpHeaderList::HttpHeaderList(){
+    clear();
+}
+
+void HttpHeaderList::add(StringView name, StringView value){
+    Header h;
+    h.name = name;
+    h.value = value;
+    h.hash = HeaderHash(name);
+
+    int idx = -1;
+    switch (h.hash)
+    {
+    #define XX(num, name, string)               \
+        case HeaderHash(string):                \
+            idx = num;                          \
+            break;
+    HTTP_KNOWN_HEADER_MAP(XX);
+    #undef XX
+    default:
+        break;
+    }
+    if (idx >= 0 && m_known[idx] < 0
+        && name.size() == strlen(KnownHeaderList[idx])
+        && strncasecmp(name.data(), KnownHeaderList[idx], name.size()) == 0){
+        m_known[idx] = (int16_t)m_headers.size();
+    }
+    m_headers.push_back(h);
+}
+
+bool HttpHeaderList::get(StringView name, StringView &val) const{
+    uint32_t hash = HeaderHash(name);
+    for (auto& i : m_headers){
+        if (i.hash == hash && i.name.size() == name.size()
+            && strncasecmp(i.name.data(), name.data(), name.size()) == 0){
+            val = i.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpHeaderList::get(KnownHeader h, StringView &val) const{
+    int16_t idx = m_known[(int)h];
+    if (idx < 0){
+        return false;
+    }
+    val = m_headers[idx].value;
+    return true;
+}
+
+void HttpHeaderList::clear(){
+    m_headers.clear();
+    for (size_t i = 0; i < (size_t)KnownHeader::COUNT; ++i){
+        m_known[i] = -1;
+    }
+}
+
+static StringView Rebase(StringView v, const char *from, const char *to){
+    if (v.empty()){
+        return v;
+    }
+    return StringView(to + (v.data() - from), v.size());
+}
+
+void HttpHeaderList::rebase(const char *from, const char *to){
+    for (auto& i : m_headers){
+        i.name = Rebase(i.name, from, to);
+        i.value = Rebase(i.value, from, to);
+    }
+}
+
+HttpRequestView::HttpRequestView()
+:m_method(HttpMethod::GET)
+,m_version(0x11)
+,m_close(true){
+
+}
+
+int64_t HttpRequestView::getContentLength() const{
+    StringView v;
+    if (!m_headers.get(KnownHeader::CONTENT_LENGTH, v)){
+        return 0;
+    }
+    int64_t len = 0;
+    if (!ParseContentLength(v.data(), v.size(), len)){
+        return -1;
+    }
+    return len;
+}
+
+void HttpRequestView::init(){
+    StringView conn;
+    if (m_headers.get(KnownHeader::CONNECTION, conn)){
+        if (conn.size() == 10 && strncasecmp(conn.data(), "keep-alive", 10) == 0){
+            m_close = false;
+            return;
+        }
+        if (conn.size() == 5 && strncasecmp(conn.data(), "close", 5) == 0){
+            m_close = true;
+            return;
+        }
+    }
+    m_close = m_version < 0x11;
+}
+
+void HttpRequestView::reset(){
+    m_method = HttpMethod::GET;
+    m_version = 0x11;
+    m_close = true;
+    m_path.clear();
+    m_query.clear();
+    m_fragment.clear();
+    m_body.clear();
+    m_headers.clear();
+    m_arena.reset();
+}
+
+void HttpRequestView::rebase(const char *from, const char *to){
+    m_path = Rebase(m_path, from, to);
+    m_query = Rebase(m_query, from, to);
+    m_fragment = Rebase(m_fragment, from, to);
+    m_headers.rebase(from, to);
+}
+
+HttpRequest::ptr HttpRequestView::toRequest() const{
+    HttpRequest::ptr req(new HttpRequest(m_version, m_close));
+    req->setMethod(m_method);
+    req->setPath(m_path.empty() ? "/" : m_path.to_string());
+    req->setQuery(m_query.to_string());
+    req->setFragment(m_fragment.to_string());
+    req->setBody(m_body.to_string());
+    for (auto& i : m_headers){
+        req->setHeader(i.name.to_string(), i.value.to_string());
+    }
+    return req;
+}
+
+static void on_view_method(void *data, const char *at, size_t length){
+    HttpRequestViewParser *parser = static_cast<HttpRequestViewParser *>(data);
+    HttpMethod m = ParseHttpMethod(at, length);
+    if (m == HttpMethod::INVALID_METHOD){
+        LOG_WARN(g_logger) << "invalid http request method "
+                                 << StringView(at, length);
+        parser->setError(1000);
+        return;
+    }
+    parser->getData().setMethod(m);
+}
+
+static void on_view_uri(void *, const char *, size_t){
+
+}
+
+static void on_view_fragment(void *data, const char *at, size_t length){
+    HttpRequestViewParser *parser = static_cast<HttpRequestViewParser *>(data);
+    parser->getData().setFragment(StringView(at, length));
+}
+
+static void on_view_path(void *data, const char *at, size_t length){
+    HttpRequestViewParser *parser = static_cast<HttpRequestViewParser *>(data);
+    parser->getData().setPath(StringView(at, length));
+}
+
+static void on_view_query(void *data, const char *at, size_t length){
+    HttpRequestViewParser *parser = static_cast<HttpRequestViewParser *>(data);
+    parser->getData().setQuery(StringView(at, length));
+}
+
+static void on_view_version(void *data, const char *at, size_t length){
+    HttpRequestViewParser *parser = static_cast<HttpRequestViewParser *>(data);
+    uint8_t v = ParseHttpVersion(at, length);
+    if (v){
+        parser->getData().setVersion(v);
+    }
+    else{
+        LOG_WARN(g_logger) << "invalid http request version: "
+                                 << StringView(at, length);
+        parser->setError(1001);
+    }
+}
+
+static void on_view_header_done(void *, const char *, size_t){
+
+}
+
+static void on_view_http_field(void *data, const char *field, size_t flen, const char *value, size_t vlen){
+    HttpRequestViewParser *parser = static_cast<HttpRequestViewParser *>(data);
+    if (flen == 0){
+        LOG_WARN(g_logger) << "invalid http request field length == 0";
+        parser->setError(1002);
+        return;
+    }
+    //重复的Content-Length值不同时无法确定body的长度，和HttpRequestParser一样拒绝
+    if (flen == 14 && strncasecmp(field, "content-length", 14) == 0){
+        StringView old;
+        if (parser->getData().getHeaders().get(KnownHeader::CONTENT_LENGTH, old)
+            && (old.size() != vlen || memcmp(old.data(), value, vlen) != 0)){
+            LOG_WARN(g_logger) << "conflicting http request content-length";
+            parser->setError(1003);
+            return;
+        }
+    }
+    parser->getData().getHeaders().add(StringView(field, flen), StringView(value, vlen));
+}
+
+HttpRequestViewParser::HttpRequestViewParser(HttpRequestView &data)
+:m_data(data)
+,m_base(nullptr)
+,m_error(0){
+    reset();
+}
+
+void HttpRequestViewParser::reset(){
+    m_error = 0;
+    m_base = nullptr;
+    http_parser_init(&m_parser);
+    m_parser.request_method = on_view_method;
+    m_parser.request_uri = on_view_uri;
+    m_parser.fragment = on_view_fragment;
+    m_parser.request_path = on_view_path;
+    m_parser.query_string = on_view_query;
+    m_parser.http_version = on_view_version;
+    m_parser.header_done = on_view_header_done;
+    m_parser.http_field = on_view_http_field;
+    m_parser.data = this;
+}
+
+size_t HttpRequestViewParser::parse(const char *data, size_t len){
+    m_base = data;
+    return HttpRequestExecute(&m_parser, data, len, m_parser.nread);
+}
+
+bool HttpRequestViewParser::isFinished(){
+    return http_parser_finish(&m_parser);
+}
+
+bool HttpRequestViewParser::hasError(){
+    return m_error || http_parser_has_error(&m_parser);
+}
+
+void HttpRequestViewParser::commit(){
+    if (!m_base){
+        return;
+    }
+    StringView copy = m_data.getArena().copy(m_base, m_parser.nread);
+    m_data.rebase(m_base, copy.data());
+    m_base = copy.data();
+    m_data.init();
+}
+
+}
+}
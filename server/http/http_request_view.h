@@ -0,0 +1,185 @@
+#pragma once
+
+#include "http.h"
+#include "http11_parser.h"
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+namespace server{
+namespace http{
+
+//常用header，解析时记录位置，查找时不需要遍历
+#define HTTP_KNOWN_HEADER_MAP(XX)                           \
+  XX(0,  HOST,              "host")                         \
+  XX(1,  CONNECTION,        "connection")                   \
+  XX(2,  CONTENT_LENGTH,    "content-length")               \
+  XX(3,  CONTENT_TYPE,      "content-type")                 \
+  XX(4,  TRANSFER_ENCODING, "transfer-encoding")            \
+  XX(5,  ACCEPT,            "accept")                       \
+  XX(6,  ACCEPT_ENCODING,   "accept-encoding")              \
+  XX(7,  USER_AGENT,        "user-agent")                   \
+  XX(8,  COOKIE,            "cookie")                       \
+  XX(9,  EXPECT,            "expect")                       \
+  XX(10, UPGRADE,           "upgrade")                      \
+  XX(11, IF_NONE_MATCH,     "if-none-match")                \
+  XX(12, RANGE,             "range")                        \
+
+enum class KnownHeader
+{
+    #define XX(num, name, string) name = num,
+    HTTP_KNOWN_HEADER_MAP(XX)
+    #undef XX
+    COUNT
+};
+
+constexpr char HeaderLower(char c){
+    return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+//大小写不敏感的FNV-1a，编译期可以算出常用header的hash
+constexpr uint32_t HeaderHash(const char *s, uint32_t h = 2166136261u){
+    return *s ? HeaderHash(s + 1, (h ^ (uint8_t)HeaderLower(*s)) * 16777619u) : h;
+}
+
+uint32_t HeaderHash(StringView s);
+
+//请求级别的内存池，reset后保留已申请的块，长连接下不会重复申请内存
+class HttpArena{
+public:
+    typedef std::shared_ptr<HttpArena> ptr;
+    HttpArena(size_t block_size = 4096);
+    ~HttpArena();
+
+    char *alloc(size_t size);
+    StringView copy(const char *data, size_t len);
+    void reset();
+
+    size_t getBlockCount() const { return m_blocks.size(); }
+
+private:
+    HttpArena(const HttpArena &) = delete;
+    HttpArena &operator=(const HttpArena &) = delete;
+
+    struct Block{
+        char *data;
+        size_t size;
+    };
+
+    size_t m_blockSize;
+    std::vector<Block> m_blocks;
+    size_t m_cur;
+    size_t m_pos;
+};
+
+//扁平的header数组，数量少时线性查找比map更快，也不需要为每个header申请节点
+class HttpHeaderList{
+public:
+    struct Header{
+        StringView name;
+        StringView value;
+        uint32_t hash;
+    };
+    typedef std::vector<Header>::const_iterator const_iterator;
+
+    HttpHeaderList();
+
+    void add(StringView name, StringView value);
+    bool get(StringView name, StringView &val) const;
+    bool get(KnownHeader h, StringView &val) const;
+    void clear();
+    void rebase(const char *from, const char *to);
+
+    size_t size() const { return m_headers.size(); }
+    const_iterator begin() const { return m_headers.begin(); }
+    const_iterator end() const { return m_headers.end(); }
+
+private:
+    std::vector<Header> m_headers;
+    int16_t m_known[(int)KnownHeader::COUNT];
+};
+
+//不拥有数据的HttpRequest，所有字段都指向arena中的原始请求
+class HttpRequestView{
+public:
+    typedef std::shared_ptr<HttpRequestView> ptr;
+    HttpRequestView();
+
+    HttpMethod getMethod() const { return m_method; }
+    uint8_t getVersion() const { return m_version; }
+    bool isClose() const { return m_close; }
+    StringView getPath() const { return m_path; }
+    StringView getQuery() const { return m_query; }
+    StringView getFragment() const { return m_fragment; }
+    StringView getBody() const { return m_body; }
+    const HttpHeaderList &getHeaders() const { return m_headers; }
+    HttpHeaderList &getHeaders() { return m_headers; }
+    HttpArena &getArena() { return m_arena; }
+
+    void setMethod(HttpMethod v) { m_method = v; }
+    void setVersion(uint8_t v) { m_version = v; }
+    void setClose(bool v) { m_close = v; }
+    void setPath(StringView v) { m_path = v; }
+    void setQuery(StringView v) { m_query = v; }
+    void setFragment(StringView v) { m_fragment = v; }
+    void setBody(StringView v) { m_body = v; }
+
+    bool getHeader(StringView key, StringView &val) const { return m_headers.get(key, val); }
+    bool getHeader(KnownHeader key, StringView &val) const { return m_headers.get(key, val); }
+    //没有Content-Length时为0，值不合法（不是纯数字、为空或者溢出）时为-1，调用者应回复400
+    int64_t getContentLength() const;
+
+    //根据版本和Connection头部确定是否为长连接
+    void init();
+    //清空所有字段，arena和header数组保留容量
+    void reset();
+    //把指向from的字段移动到to
+    void rebase(const char *from, const char *to);
+
+    //转换成普通的HttpRequest，给现有的Servlet使用
+    HttpRequest::ptr toRequest() const;
+
+private:
+    HttpMethod m_method;
+    uint8_t m_version;
+    bool m_close;
+
+    StringView m_path;
+    StringView m_query;
+    StringView m_fragment;
+    StringView m_body;
+
+    HttpHeaderList m_headers;
+    HttpArena m_arena;
+};
+
+//解析到HttpRequestView，解析过程中不产生任何std::string
+class HttpRequestViewParser{
+public:
+    typedef std::shared_ptr<HttpRequestViewParser> ptr;
+    HttpRequestViewParser(HttpRequestView &data);
+
+    //从上次解析结束的位置继续解析，不移动data，返回已解析的header总长度
+    size_t parse(const char *data, size_t len);
+    bool isFinished();
+    bool hasError();
+    //header解析完成后调用，把header拷贝到arena中，之后data可以被覆盖
+    void commit();
+    void reset();
+
+    HttpRequestView &getData() const { return m_data; }
+    void setError(int v) { m_error = v; }
+    const http_parser &getParser() const { return m_parser; }
+
+private:
+    http_parser m_parser;
+    HttpRequestView &m_data;
+    const char *m_base;
+    //1000: invalid method
+    //1001: invalid version
+    //1002: invalid field
+    int m_error;
+};
+
+}
+}
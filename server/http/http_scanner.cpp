@@ -0,0 +1,344 @@
+#include "http_scanner.h"
+#include "../config.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HTTP_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace server{
+namespace http{
+
+static server::ConfigVar<bool>::ptr g_http_parser_simd =
+    server::Config::AddData("http.parser.simd", true, "scan request headers with sse4.2/avx2 before falling back to ragel");
+
+//超过这个数量的header交给ragel
+static const size_t MAX_FIELDS = 64;
+
+enum ScanLevel
+{
+    SCAN_SCALAR = 0,
+    SCAN_SSE42 = 1,
+    SCAN_AVX2 = 2,
+};
+
+static int GetScanLevel(){
+#ifdef HTTP_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){
+        return SCAN_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")){
+        return SCAN_SSE42;
+    }
+#endif
+    return SCAN_SCALAR;
+}
+
+static const int s_level = GetScanLevel();
+
+//和http11_parser.rl中的字符集一致
+struct CharTables{
+    //token：ascii中去掉控制字符和分隔符
+    bool token[256];
+    //uri中不需要特殊处理的字符（%?#和空格需要单独处理）
+    bool uri[256];
+    //header值中允许的字符：除了\t之外的控制字符都不允许
+    bool value[256];
+};
+
+static CharTables MakeTables(){
+    CharTables t;
+    memset(&t, 0, sizeof(t));
+    const char *separators = "()<>@,;:\\\"/[]?={} \t";
+    for (int c = 33; c < 127; ++c){
+        t.token[c] = strchr(separators, c) == nullptr;
+    }
+    const char *uri = "-._~!$&'()*+,;=:@/";
+    for (int c = 0; c < 256; ++c){
+        t.uri[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+                 || (c != 0 && strchr(uri, c) != nullptr);
+        t.value[c] = c == '\t' || (c >= 32 && c != 127);
+    }
+    return t;
+}
+
+static const CharTables s_tables = MakeTables();
+
+#ifdef HTTP_SCANNER_X86
+//pcmpestri按区间查找，返回第一个落在任意区间中的字符，ranges最多8个区间，需要至少16字节可读
+__attribute__((target("sse4.2")))
+static const char *FindRangesSSE42(const char *p, const char *end, const char *ranges, int size){
+    __m128i r = _mm_loadu_si128((const __m128i *)ranges);
+    while (end - p >= 16){
+        __m128i b = _mm_loadu_si128((const __m128i *)p);
+        int idx = _mm_cmpestri(r, size, b, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (idx != 16){
+            return p + idx;
+        }
+        p += 16;
+    }
+    return p;
+}
+
+//header值一次比较32字节，找<0x20(除了\t)或者0x7f
+__attribute__((target("avx2")))
+static const char *FindValueAVX2(const char *p, const char *end){
+    const __m256i ctl = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    while (end - p >= 32){
+        __m256i b = _mm256_loadu_si256((const __m256i *)p);
+        __m256i lo = _mm256_cmpeq_epi8(_mm256_min_epu8(b, ctl), b);
+        __m256i stop = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(b, tab), lo), _mm256_cmpeq_epi8(b, del));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(stop);
+        if (mask){
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return p;
+}
+#endif
+
+//区间两两一组，用于pcmpestri，_mm_loadu_si128固定读16字节，所以数组都是16字节，不足的补0，有效长度单独传入
+static const char s_uri_ranges[16] = {'\x00', ' ', '"', '#', '%', '%', '<', '<', '>', '?', '[', '^', '`', '`', '{', '\xff'};
+static const char s_token_ranges[16] = {'\x00', ' ', '"', '"', '(', ')', ',', ',', '/', '/', ':', '@', '[', ']', '{', '\xff'};
+static const char s_value_ranges[16] = {'\x00', '\x08', '\x0a', '\x1f', '\x7f', '\x7f'};
+static const int s_value_ranges_len = 6;
+
+//跳过表中允许的字符，返回第一个不允许的字符或者end
+static const char *FindStop(const char *p, const char *end, const bool *table, const char *ranges, int size){
+#ifdef HTTP_SCANNER_X86
+    if (s_level >= SCAN_SSE42){
+        p = FindRangesSSE42(p, end, ranges, size);
+    }
+#endif
+    while (p < end && table[(unsigned char)*p]){
+        ++p;
+    }
+    return p;
+}
+
+static const char *FindValueStop(const char *p, const char *end){
+#ifdef HTTP_SCANNER_X86
+    if (s_level >= SCAN_AVX2){
+        p = FindValueAVX2(p, end);
+    }
+#endif
+    return FindStop(p, end, s_tables.value, s_value_ranges, s_value_ranges_len);
+}
+
+static bool IsHex(char c){
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+//data从p开始是否为expect，数据不够时返回0，不匹配返回-1
+static int Expect(const char *p, const char *end, const char *expect, size_t len){
+    size_t n = (size_t)(end - p) < len ? end - p : len;
+    if (memcmp(p, expect, n) != 0){
+        return -1;
+    }
+    return n == len ? 1 : 0;
+}
+
+#define SCAN_EXPECT(str) \
+    { \
+        int rt = Expect(p, end, str, sizeof(str) - 1); \
+        if (rt <= 0){ \
+            return rt; \
+        } \
+        p += sizeof(str) - 1; \
+    }
+
+struct ScanField{
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+};
+
+int HttpScanRequest(http_parser *parser, const char *data, size_t len){
+    const char *p = data;
+    const char *end = data + len;
+
+    //Method = (upper | digit){1,20}
+    while (p < end && ((*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9'))){
+        ++p;
+    }
+    if (p == end){
+        return p - data > 20 ? -1 : 0;
+    }
+    size_t method_len = p - data;
+    if (method_len == 0 || method_len > 20 || *p != ' '){
+        return -1;
+    }
+    ++p;
+
+    //只处理/开头的path，//开头的是authority
+    const char *uri = p;
+    const char *query = nullptr;
+    const char *fragment = nullptr;
+    if (p == end){
+        return 0;
+    }
+    if (*p != '/'){
+        return -1;
+    }
+    if (p + 1 < end && p[1] == '/'){
+        return -1;
+    }
+    while (true){
+        p = FindStop(p, end, s_tables.uri, s_uri_ranges, sizeof(s_uri_ranges));
+        if (p == end){
+            return 0;
+        }
+        char c = *p;
+        if (c == ' '){
+            break;
+        }
+        if (c == '?'){
+            if (!query && !fragment){
+                query = p;
+            }
+            ++p;
+        }
+        else if (c == '#'){
+            if (fragment){
+                return -1;
+            }
+            fragment = p;
+            ++p;
+        }
+        else if (c == '%'){
+            if (end - p < 3){
+                return (p + 1 == end || IsHex(p[1])) ? 0 : -1;
+            }
+            if (!IsHex(p[1]) || !IsHex(p[2])){
+                return -1;
+            }
+            p += 3;
+        }
+        else{
+            return -1;
+        }
+    }
+    const char *uri_end = p;
+    ++p;
+
+    const char *version = p;
+    SCAN_EXPECT("HTTP/1.");
+    if (p == end){
+        return 0;
+    }
+    if (*p != '0' && *p != '1'){
+        return -1;
+    }
+    ++p;
+    SCAN_EXPECT("\r\n");
+
+    ScanField fields[MAX_FIELDS];
+    size_t count = 0;
+    while (true){
+        if (p == end){
+            return 0;
+        }
+        if (*p == '\r'){
+            SCAN_EXPECT("\r\n");
+            break;
+        }
+        if (count == MAX_FIELDS){
+            return -1;
+        }
+        //field_name ":" lws* field_value CRLF，折行和名字后的空格交给ragel
+        const char *name = p;
+        //|和~是token但在pcmpestri的区间中，由FindStop中的查表继续跳过
+        p = FindStop(p, end, s_tables.token, s_token_ranges, sizeof(s_token_ranges));
+        if (p == end){
+            return 0;
+        }
+        if (*p != ':' || p == name){
+            return -1;
+        }
+        ScanField &field = fields[count++];
+        field.name = name;
+        field.name_len = p - name;
+        ++p;
+        while (p < end && (*p == ' ' || *p == '\t')){
+            ++p;
+        }
+        field.value = p;
+        p = FindValueStop(p, end);
+        if (p == end){
+            return 0;
+        }
+        field.value_len = p - field.value;
+        SCAN_EXPECT("\r\n");
+        if (p < end && (*p == ' ' || *p == '\t')){
+            return -1;
+        }
+    }
+
+    //全部检查通过后再回调，交给ragel时不会有重复的回调
+    size_t uri_len = (fragment ? fragment : uri_end) - uri;
+    if (parser->request_method){
+        parser->request_method(parser->data, data, method_len);
+    }
+    if (parser->request_path){
+        const char *path_end = query ? query : (fragment ? fragment : uri_end);
+        parser->request_path(parser->data, uri, path_end - uri);
+    }
+    if (query && parser->query_string){
+        const char *query_end = fragment ? fragment : uri_end;
+        parser->query_string(parser->data, query + 1, query_end - query - 1);
+    }
+    if (parser->request_uri){
+        parser->request_uri(parser->data, uri, uri_len);
+    }
+    if (fragment && parser->fragment){
+        parser->fragment(parser->data, fragment + 1, uri_end - fragment - 1);
+    }
+    if (parser->http_version){
+        parser->http_version(parser->data, version, 8);
+    }
+    if (parser->http_field){
+        for (size_t i = 0; i < count; ++i){
+            parser->http_field(parser->data, fields[i].name, fields[i].name_len, fields[i].value, fields[i].value_len);
+        }
+    }
+    if (parser->header_done){
+        parser->header_done(parser->data, p, end - p);
+    }
+    http_parser_set_finished(parser, p - data);
+    return p - data;
+}
+
+#undef SCAN_EXPECT
+
+size_t HttpRequestExecute(http_parser *parser, const char *data, size_t len, size_t off){
+    if (off == 0 && parser->nread == 0 && g_http_parser_simd->getVal()){
+        int rt = HttpScanRequest(parser, data, len);
+        if (rt > 0){
+            return rt;
+        }
+        if (rt == 0){
+            return 0;
+        }
+    }
+    return http_parser_execute(parser, data, len, off);
+}
+
+const char *HttpScannerName(){
+    switch (s_level){
+    case SCAN_AVX2:
+        return "avx2";
+    case SCAN_SSE42:
+        return "sse4.2";
+    default:
+        return "scalar";
+    }
+}
+
+}
+}
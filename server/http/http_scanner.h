@@ -0,0 +1,23 @@
+#pragma once
+
+#include "http11_parser.h"
+#include <stddef.h>
+
+namespace server{
+namespace http{
+
+//SIMD扫描请求头（picohttpparser的做法），一次找出请求行和每个header的边界
+//只接受常见的格式，其余的（折行、绝对URI、裸\n、不完整的数据……）都交给ragel处理
+//返回值：>0 解析完成，为header的总长度；0 数据不完整；-1 需要交给ragel
+//成功时按ragel的顺序调用parser中的回调，并把parser置为完成状态
+int HttpScanRequest(http_parser *parser, const char *data, size_t len);
+
+//ragel解析请求的入口，parser还没有开始解析时先尝试SIMD扫描（http.parser.simd）
+//数据不完整时不推进parser，下次从头重新扫描
+size_t HttpRequestExecute(http_parser *parser, const char *data, size_t len, size_t off);
+
+//当前使用的扫描指令集：avx2、sse4.2或者scalar
+const char *HttpScannerName();
+
+}
+}
@@ -1,42 +1,308 @@
 #include "http_server.h"
 #include "http_session.h"
+#include "http_parser.h"
 #include "../log.h"
+#include "../config.h"
+#include "../util.h"
+#include <string.h>
+#include <sys/socket.h>
 
 namespace server{
 namespace http{
 
 static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
 
+static server::ConfigVar<uint32_t>::ptr g_http_server_max_pipeline =
+    server::Config::AddData("http.server.max_pipeline", (uint32_t)16, "max pipelined responses coalesced into one writev");
+
+static server::ConfigVar<uint64_t>::ptr g_http_server_header_timeout =
+    server::Config::AddData("http.server.header_timeout", (uint64_t)(10 * 1000), "ms to receive the whole request header, also the wait for the first request");
+
+static server::ConfigVar<uint64_t>::ptr g_http_server_body_timeout =
+    server::Config::AddData("http.server.body_timeout", (uint64_t)(30 * 1000), "ms a single request body read may stall");
+
+static server::ConfigVar<uint64_t>::ptr g_http_server_idle_timeout =
+    server::Config::AddData("http.server.idle_timeout", (uint64_t)(15 * 1000), "ms a keep-alive connection may wait for the next request");
+
+static server::ConfigVar<uint64_t>::ptr g_http_server_request_timeout =
+    server::Config::AddData("http.server.request_timeout", (uint64_t)(5 * 60 * 1000), "ms from the first byte of a request until its response is sent, 0 disables");
+
+static server::ConfigVar<uint32_t>::ptr g_http_server_max_requests =
+    server::Config::AddData("http.server.max_requests", (uint32_t)10000, "requests served on one connection before it is closed, 0 disables");
+
+static server::ConfigVar<uint32_t>::ptr g_http_server_max_idle =
+    server::Config::AddData("http.server.max_idle", (uint32_t)10000, "idle keep-alive connections above this use busy_idle_timeout and free their buffers");
+
+static server::ConfigVar<uint64_t>::ptr g_http_server_busy_idle_timeout =
+    server::Config::AddData("http.server.busy_idle_timeout", (uint64_t)1000, "idle timeout(ms) when there are more than max_idle idle connections");
+
+static server::ConfigVar<bool>::ptr g_http_server_park_idle =
+    server::Config::AddData("http.server.park_idle", true, "park idle connections in epoll instead of holding a fiber");
+
+static server::ConfigVar<bool>::ptr g_http_server_h2c =
+    server::Config::AddData("http.server.h2c", true, "accept cleartext http/2, both prior knowledge and Upgrade: h2c");
+
 HttpServer::HttpServer(bool keepalive, IOManager *worker, IOManager *acceptWorker)
 :TcpServer(worker, acceptWorker)
-,m_isKeepalive(keepalive){
+,m_isKeepalive(keepalive)
+,m_idleCount(0){
     m_servManager.reset(new ServletManager);
 }
 
+bool HttpServer::checkRequest(const Servlet::ptr &slt, const HttpRequest::ptr &req
+                              , const HttpResponse::ptr &rsp, const HttpSession::ptr &session){
+    std::string expect;
+    if (req->hasHeader("expect", &expect) && strcasecmp(expect.c_str(), "100-continue") != 0){
+        rsp->setStatus(HttpStatus::EXPECTATION_FAILED);
+        return false;
+    }
+    //完整读取的body有大小限制，超过时不用等body读完再断开
+    if (!slt->isStreamBody() && session->getBodyLength() > (int64_t)HttpRequestParser::GetHttpRequestMaxBodysize()){
+        rsp->setStatus(HttpStatus::PAYLOAD_TOO_LARGE);
+        return false;
+    }
+    return slt->checkHeader(req, rsp, session) == 0;
+}
+
 void HttpServer::handleClient(Socket::ptr client){
     HttpSession::ptr session(new HttpSession(client));
+    serve(session, 0);
+}
+
+void HttpServer::park(const HttpSession::ptr &session, uint32_t count, uint64_t timeout_ms, bool release){
+    IOManager *iom = IOManager::GetThis();
+    int fd = session->getSocket()->getSocket();
+    if (release){
+        session->releaseBuffer();
+    }
+    //超时先置标记再取消事件，事件的回调根据标记决定关闭连接还是继续处理
+    std::shared_ptr<std::atomic<bool>> expired(new std::atomic<bool>(false));
+    Timer::ptr timer = iom->addConditionTimer(timeout_ms, [iom, fd, expired](){
+        *expired = true;
+        iom->cancelEvent(fd, IOManager::READ);
+    }, expired);
+    HttpServer::ptr self = std::static_pointer_cast<HttpServer>(shared_from_this());
+    {
+        //stop之后不再挂起，和stop中的遍历在同一把锁下，不会漏掉
+        Mutex::Lock lock(m_parkMutex);
+        if (isStop()){
+            lock.unlock();
+            timer->getManager()->cancel(timer);
+            --m_idleCount;
+            session->close();
+            return;
+        }
+        m_parked[fd] = iom;
+    }
+    int rt = iom->addEvent(fd, IOManager::READ, [self, session, count, timer, expired, fd](){
+        --self->m_idleCount;
+        timer->getManager()->cancel(timer);
+        {
+            Mutex::Lock lock(self->m_parkMutex);
+            self->m_parked.erase(fd);
+        }
+        //超时或者服务器已经停止时关闭连接
+        if (*expired || self->isStop()){
+            session->close();
+            return;
+        }
+        self->serve(session, count, true);
+    });
+    if (rt){
+        {
+            Mutex::Lock lock(m_parkMutex);
+            m_parked.erase(fd);
+        }
+        timer->getManager()->cancel(timer);
+        --m_idleCount;
+        session->close();
+    }
+}
+
+void HttpServer::stop(){
+    std::unordered_map<int, IOManager *> parked;
+    {
+        Mutex::Lock lock(m_parkMutex);
+        TcpServer::stop();
+        parked.swap(m_parked);
+    }
+    //取消事件会调度回调，回调看到isStop后关闭连接，同时释放对server和session的引用
+    for (auto& i : parked){
+        i.second->cancelEvent(i.first, IOManager::READ);
+    }
+}
+
+void HttpServer::serve(const HttpSession::ptr &session, uint32_t count, bool readable){
+    uint32_t max_requests = g_http_server_max_requests->getVal();
     do
     {
-        auto req = session->recvRequest();
-        if (!req){
-            LOG_WARN(g_logger) << "recv http request fail, errno="
-                                     << errno << " errstr=" 
-                                     << strerror(errno) << " client:" << *client;
-            //continue;
+        //第一个请求按header超时等待，之后是长连接的空闲超时
+        //空闲连接太多时缩短等待时间，并且不占用接收缓冲区
+        bool busy = ++m_idleCount > g_http_server_max_idle->getVal();
+        uint64_t idle_timeout = count == 0 ? g_http_server_header_timeout->getVal()
+                              : busy ? g_http_server_busy_idle_timeout->getVal() : g_http_server_idle_timeout->getVal();
+        if (!readable && g_http_server_park_idle->getVal() && !session->hasBufferedData()){
+            park(session, count, idle_timeout, busy);
+            return;
+        }
+        readable = false;
+        bool ok = session->waitRequest(idle_timeout, busy);
+        --m_idleCount;
+        if (!ok){
+            break;
+        }
+        //prior knowledge的h2c，连接上第一个请求是HTTP/2的连接前言
+        if (count == 0 && g_http_server_h2c->getVal() && session->hasHttp2Preface()){
+            HttpServer::ptr self = std::static_pointer_cast<HttpServer>(shared_from_this());
+            Http2Session::ptr h2(new Http2Session(session->getSocket(), session->takeBuffer()
+                                 , std::bind(&HttpServer::handleStream, self, std::placeholders::_1)));
+            h2->run();
             break;
         }
-        HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), req->isClose() || !m_isKeepalive));
-        m_servManager->handle(req, rsp, session);
-        
-        // LOG_INFO(g_logger) << std::endl << "request:" << std::endl
-        //                          << *req;
-        // LOG_INFO(g_logger) << std::endl << "response:" << std::endl
-        //                          << *rsp;
 
+        //整个请求的超时到了直接关闭socket，阻塞在读写上的servlet会立即返回错误
+        Timer::ptr timer;
+        uint64_t request_timeout = g_http_server_request_timeout->getVal();
+        if (request_timeout){
+            std::weak_ptr<HttpSession> weak_session(session);
+            timer = IOManager::GetThis()->addConditionTimer(request_timeout, [weak_session](){
+                HttpSession::ptr session = weak_session.lock();
+                if (session && !session->isUpgraded()){
+                    LOG_INFO(g_logger) << "http request timeout, shutdown " << *session->getSocket();
+                    ::shutdown(session->getSocket()->getSocket(), SHUT_RDWR);
+                }
+            }, weak_session);
+        }
+        ++count;
+        ok = handleRequest(session, max_requests && count >= max_requests);
+        if (timer){
+            timer->getManager()->cancel(timer);
+        }
+        if (!ok){
+            break;
+        }
+    } while (m_isKeepalive && !isStop());
+    session->flush();
+    session->close();
+}
+
+bool HttpServer::handleRequest(const HttpSession::ptr &session, bool last){
+    uint64_t now = server::GetCurrentMS();
+    uint64_t request_timeout = g_http_server_request_timeout->getVal();
+    uint64_t deadline = request_timeout ? now + request_timeout : 0;
+    uint64_t header_deadline = now + g_http_server_header_timeout->getVal();
+    session->setReadTimeout(-1, deadline ? std::min(deadline, header_deadline) : header_deadline);
+    auto req = session->recvRequestHeader();
+    if (!req){
+        //格式错误或者body边界不明确的请求回复400后关闭连接，不去猜测body在哪里结束
+        if (session->isBadRequest()){
+            LOG_WARN(g_logger) << "bad http request, client:" << *session->getSocket();
+            HttpResponse::ptr rsp = session->createResponse(0x11, true);
+            rsp->setStatus(HttpStatus::BAD_REQUEST);
+            session->sendResponse(rsp);
+            return false;
+        }
+        LOG_WARN(g_logger) << "recv http request fail, errno="
+                                 << errno << " errstr="
+                                 << strerror(errno) << " client:" << *session->getSocket();
+        return false;
+    }
+    if (g_http_server_h2c->getVal() && upgradeHttp2(session, req)){
+        return false;
+    }
+    //body每次读取的等待时间单独限制
+    session->setReadTimeout(g_http_server_body_timeout->getVal(), deadline);
+    Servlet::ptr slt = m_servManager->getMatchedServlet(req);
+    HttpResponse::ptr rsp = session->createResponse(req->getVersion(), req->isClose() || !m_isKeepalive || last);
+    //有body时先只凭header检查，拒绝的请求不读取body，直接回复并关闭连接
+    if (!session->isBodyDone() && !checkRequest(slt, req, rsp, session)){
+        rsp->setClose(true);
         session->sendResponse(rsp);
+        return false;
+    }
+    //流式body的servlet自己读取body，其余的先把body读完
+    if (!slt->isStreamBody() && !session->recvRequestBody(req)){
+        LOG_WARN(g_logger) << "recv http request body fail, errno="
+                                 << errno << " errstr="
+                                 << strerror(errno) << " client:" << *session->getSocket();
+        return false;
+    }
+    slt->handle(req, rsp, session);
+    //servlet没有读完的body要丢掉，否则会被当成下一个请求
+    if (!session->discardBody()){
+        rsp->setClose(true);
+    }
 
-    } while (m_isKeepalive);
-    session->close();
+    // LOG_INFO(g_logger) << std::endl << "request:" << std::endl
+    //                          << *req;
+    // LOG_INFO(g_logger) << std::endl << "response:" << std::endl
+    //                          << *rsp;
+
+    //流式响应的header和body已经由servlet发送
+    if (rsp->isStream()){
+        session->finishStream();
+        return !rsp->isClose();
+    }
+
+    //pipeline时缓冲区里还有完整的请求，先不发送，攒起来一次writev
+    bool flush = rsp->isClose() || !session->hasBufferedRequest()
+              || session->getPendingCount() + 1 >= g_http_server_max_pipeline->getVal();
+    return session->sendResponse(rsp, flush) >= 0 && !rsp->isClose();
+}
+
+bool HttpServer::upgradeHttp2(const HttpSession::ptr &session, const HttpRequest::ptr &req){
+    //带body的请求不升级，升级前要先读完body，和HTTP/1.1一样处理
+    std::string settings;
+    if (req->getVersion() != 0x11 || !session->isBodyDone() || !req->hasHeader("http2-settings", &settings)
+            || !HasToken(req->getHeaderAs<std::string>("upgrade"), "h2c")
+            || !HasToken(req->getHeaderAs<std::string>("connection"), "http2-settings")){
+        return false;
+    }
+    HttpResponse::ptr rsp(new HttpResponse(0x11, false));
+    rsp->setStatus(HttpStatus::SWITCHING_PROTOCOLS);
+    rsp->setHeader("Connection", "Upgrade");
+    rsp->setHeader("Upgrade", "h2c");
+    rsp->setStream(true);
+    rsp->setContentLength(0);
+    if (session->sendResponse(rsp) <= 0){
+        return true;
+    }
+    //升级的请求作为HTTP/2的stream 1处理，去掉升级相关的header
+    req->delHeader("upgrade");
+    req->delHeader("connection");
+    req->delHeader("http2-settings");
+    req->setVersion(0x20);
+    req->setClose(false);
+    HttpServer::ptr self = std::static_pointer_cast<HttpServer>(shared_from_this());
+    Http2Session::ptr h2(new Http2Session(session->getSocket(), session->takeBuffer()
+                         , std::bind(&HttpServer::handleStream, self, std::placeholders::_1)));
+    h2->run(req, settings);
+    return true;
+}
+
+void HttpServer::handleStream(const Http2Stream::ptr &stream){
+    const HttpRequest::ptr &req = stream->getRequest();
+    //HTTP/2的stream之间互不影响，只限制每次读取body和等待发送窗口的时间
+    stream->setReadTimeout(g_http_server_body_timeout->getVal());
+    Servlet::ptr slt = m_servManager->getMatchedServlet(req);
+    HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), false));
+    if (!stream->isBodyDone() && !checkRequest(slt, req, rsp, stream)){
+        stream->sendResponse(rsp);
+        return;
+    }
+    if (!slt->isStreamBody() && !stream->recvRequestBody(req)){
+        LOG_WARN(g_logger) << "recv http2 request body fail, errno="
+                                 << errno << " errstr="
+                                 << strerror(errno) << " client:" << *stream->getSocket();
+        return;
+    }
+    slt->handle(req, rsp, stream);
+    stream->discardBody();
+    if (rsp->isStream()){
+        stream->finishStream();
+        return;
+    }
+    stream->sendResponse(rsp);
 }
 }
 
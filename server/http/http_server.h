@@ -2,7 +2,11 @@
 
 #include "../tcp_server.h"
 #include "servlet.h"
+#include "http_session.h"
+#include "http2_session.h"
+#include <atomic>
 #include <memory>
+#include <unordered_map>
 
 namespace server{
 namespace http{
@@ -14,12 +18,37 @@ public:
     ServletManager::ptr getServletManager() const { return m_servManager; }
     void setServletManager(ServletManager::ptr v) { m_servManager = v; }
 
+    //正在等待下一个请求的长连接数，包括挂起在epoll上的
+    uint32_t getIdleCount() const { return m_idleCount; }
+
+    //除了停止accept，还会关闭挂起在epoll上的空闲连接
+    virtual void stop() override;
+
 protected:
     virtual void handleClient(Socket::ptr client) override;
 
 private:
+    //读取body之前检查请求，返回false时rsp为拒绝的响应
+    bool checkRequest(const Servlet::ptr &slt, const HttpRequest::ptr &req
+                      , const HttpResponse::ptr &rsp, const HttpSession::ptr &session);
+    //循环处理连接上的请求，count为已经处理的请求数，readable表示socket已经可读
+    //http.server.park_idle打开时，等待下一个请求前把连接挂起到epoll上并返回，不占用协程
+    void serve(const HttpSession::ptr &session, uint32_t count, bool readable = false);
+    //连接可读时在新的协程中继续serve，timeout_ms内没有数据则关闭连接
+    void park(const HttpSession::ptr &session, uint32_t count, uint64_t timeout_ms, bool release);
+    //处理连接上的一个请求，返回false时关闭连接，last为true表示达到了连接的最大请求数
+    bool handleRequest(const HttpSession::ptr &session, bool last);
+    //请求是Upgrade: h2c时回复101，之后按HTTP/2处理连接，返回false表示不是h2c升级
+    bool upgradeHttp2(const HttpSession::ptr &session, const HttpRequest::ptr &req);
+    //在独立的协程中处理HTTP/2的一个stream，和handleRequest一样交给servlet
+    void handleStream(const Http2Stream::ptr &stream);
+
     bool m_isKeepalive;
     ServletManager::ptr m_servManager;
+    std::atomic<uint32_t> m_idleCount;
+    Mutex m_parkMutex;
+    //挂起在epoll上的连接，fd -> 注册事件的IOManager
+    std::unordered_map<int, IOManager *> m_parked;
 };
 }
 
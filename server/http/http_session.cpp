@@ -1,71 +1,805 @@
 #include "http_session.h"
 #include "http_parser.h"
+#include "../config.h"
+#include "../fd_manager.h"
+#include "../util.h"
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+#include <sys/socket.h>
 
 namespace server{
 namespace http{
-HttpSession::HttpSession(Socket::ptr sock, bool owner):SocketStream(sock, owner){
+
+static server::ConfigVar<uint64_t>::ptr g_http_request_max_discard_size =
+    server::Config::AddData("http.request.max_discard_size", (uint64_t)(64 * 1024), "max unread request body drained to keep a connection alive");
+
+static const char CRLF[] = "\r\n";
+static const char LAST_CHUNK[] = "0\r\n\r\n";
+
+HttpChunkedStream::HttpChunkedStream(HttpSession *session, bool chunked, Compressor::ptr compressor)
+:m_session(session)
+,m_chunked(chunked)
+,m_closed(false)
+,m_compressor(compressor){
 
 }
 
-HttpRequest::ptr HttpSession::recvRequest(){
-    HttpRequestParser::ptr parser(new HttpRequestParser);
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
+int HttpChunkedStream::writeCompressed(){
+    //压缩后可能没有输出，不能发送空chunk
+    if (m_zbuf.empty()){
+        return 0;
+    }
+    m_iovs.clear();
+    iovec iov;
+    iov.iov_base = &m_zbuf[0];
+    iov.iov_len = m_zbuf.size();
+    m_iovs.push_back(iov);
+    return writeChunk(m_iovs, m_zbuf.size());
+}
+
+int HttpChunkedStream::writeChunk(std::vector<iovec> &iovs, size_t length){
+    if (m_closed){
+        return -1;
+    }
+    //空chunk会被当成结束块
+    if (length == 0){
+        return 0;
+    }
+    char size[24];
+    if (m_chunked){
+        int n = snprintf(size, sizeof(size), "%zx\r\n", length);
+        iovec iov;
+        iov.iov_base = size;
+        iov.iov_len = n;
+        iovs.insert(iovs.begin(), iov);
+        iov.iov_base = (void *)CRLF;
+        iov.iov_len = sizeof(CRLF) - 1;
+        iovs.push_back(iov);
+    }
+    int rt = m_session->writevFixSize(&iovs[0], iovs.size());
+    return rt <= 0 ? rt : length;
+}
 
-    std::shared_ptr<char> buff(new char[buff_size], [](char *ptr)
-                               { delete[] ptr; });
+int HttpChunkedStream::write(const void *buf, size_t length){
+    if (m_compressor){
+        if (m_closed){
+            return -1;
+        }
+        m_zbuf.clear();
+        if (!m_compressor->write(buf, length, m_zbuf, true)){
+            return -1;
+        }
+        int rt = writeCompressed();
+        return rt < 0 ? rt : length;
+    }
+    m_iovs.clear();
+    iovec iov;
+    iov.iov_base = (void *)buf;
+    iov.iov_len = length;
+    m_iovs.push_back(iov);
+    return writeChunk(m_iovs, length);
+}
+
+int HttpChunkedStream::write(ByteArray::ptr ba, size_t length){
+    m_iovs.clear();
+    length = ba->getReadBuffers(m_iovs, length);
+    int rt = 0;
+    if (m_compressor){
+        if (m_closed){
+            return -1;
+        }
+        m_zbuf.clear();
+        for (size_t i = 0; i < m_iovs.size(); ++i){
+            if (!m_compressor->write(m_iovs[i].iov_base, m_iovs[i].iov_len, m_zbuf, i + 1 == m_iovs.size())){
+                return -1;
+            }
+        }
+        rt = writeCompressed();
+        rt = rt < 0 ? rt : length;
+    }
+    else{
+        rt = writeChunk(m_iovs, length);
+    }
+    if (rt > 0){
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
+void HttpChunkedStream::close(){
+    if (m_closed){
+        return;
+    }
+    if (m_compressor){
+        m_zbuf.clear();
+        if (m_compressor->finish(m_zbuf)){
+            writeCompressed();
+        }
+    }
+    m_closed = true;
+    if (m_chunked){
+        m_session->writeFixSize(LAST_CHUNK, sizeof(LAST_CHUNK) - 1);
+    }
+}
+
+int HttpBodyStream::read(void *buf, size_t length){
+    return m_session->readBody(buf, length);
+}
+
+int HttpBodyStream::read(ByteArray::ptr ba, size_t length){
+    if (length == 0){
+        return 0;
+    }
+    std::vector<iovec> iovs;
+    ba->getWriteBuffers(iovs, length);
+    //只读第一个iovec，和readBody一样每次最多返回一段
+    int rt = m_session->readBody(iovs[0].iov_base, iovs[0].iov_len);
+    if (rt > 0){
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
+HttpSession::HttpSession(Socket::ptr sock, bool owner)
+:SocketStream(sock, owner)
+,m_bodyLeft(0)
+,m_bodyChunked(false)
+,m_bodyDone(true)
+,m_readTimeout(-1)
+,m_bufferSize(HttpRequestParser::GetHttpRequestBufferSize())
+,m_length(0)
+,m_chunkStarted(false)
+,m_continuePending(false)
+,m_badRequest(false)
+,m_acceptEncoding(ContentEncoding::IDENTITY)
+,m_readDeadline(0)
+,m_upgraded(false){
+    resetBuffer();
+}
+
+void HttpSession::resetBuffer(){
+    m_buffer.reset(new char[m_bufferSize], [](char *ptr)
+                   { delete[] ptr; });
+}
+
+void HttpSession::releaseBuffer(){
+    if (m_length == 0){
+        m_buffer.reset();
+        m_parser.reset();
+        m_response.reset();
+    }
+}
+
+void HttpSession::setReadTimeout(uint64_t timeout_ms, uint64_t deadline){
+    m_readTimeout = timeout_ms;
+    m_readDeadline = deadline;
+}
+
+bool HttpSession::applyReadTimeout(){
+    if (m_readTimeout == (uint64_t)-1 && m_readDeadline == 0){
+        return true;
+    }
+    uint64_t timeout = m_readTimeout;
+    if (m_readDeadline){
+        uint64_t now = server::GetCurrentMS();
+        if (now >= m_readDeadline){
+            errno = ETIMEDOUT;
+            return false;
+        }
+        timeout = std::min(timeout, m_readDeadline - now);
+    }
+    //直接修改FdCtx中的超时，不用每次read都调用setsockopt
+    FdCtx::ptr ctx = FdMgr::GetInstance()->get(getSocket()->getSocket());
+    if (ctx){
+        ctx->setTimeout(SO_RCVTIMEO, timeout);
+    }
+    return true;
+}
+
+int HttpSession::read(void *buf, size_t length){
+    if (!applyReadTimeout()){
+        return -1;
+    }
+    return SocketStream::read(buf, length);
+}
 
-    //recv+解析
-    char *data = buff.get();
-    int offset = 0;
+int HttpSession::read(ByteArray::ptr ba, size_t length){
+    if (!applyReadTimeout()){
+        return -1;
+    }
+    return SocketStream::read(ba, length);
+}
+
+bool HttpSession::hasHttp2Preface(){
+    static const char s_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+    static const size_t len = sizeof(s_preface) - 1;
+    while (m_length < len && memcmp(m_buffer.get(), s_preface, m_length) == 0){
+        int rt = read(m_buffer.get() + m_length, m_bufferSize - m_length);
+        if (rt <= 0){
+            return false;
+        }
+        m_length += rt;
+    }
+    return m_length >= len && memcmp(m_buffer.get(), s_preface, len) == 0;
+}
+
+bool HttpSession::waitRequest(uint64_t timeout_ms, bool release){
+    if (m_length > 0){
+        return true;
+    }
+    if (!m_buffer){
+        resetBuffer();
+    }
+    setReadTimeout(timeout_ms);
+    if (!release){
+        int rt = read(m_buffer.get(), m_bufferSize);
+        if (rt <= 0){
+            return false;
+        }
+        m_length = rt;
+        return true;
+    }
+    if (!applyReadTimeout()){
+        return false;
+    }
+    //空闲期间不占用缓冲区，有数据后再重新申请
+    releaseBuffer();
+    char c;
+    int rt = getSocket()->recv(&c, 1, MSG_PEEK);
+    resetBuffer();
+    return rt > 0;
+}
+
+//recv+解析header，上一个请求多读的数据已经在缓冲区开头
+template<class Parser>
+static bool RecvHeader(HttpSession *session, Parser &parser, char *data, size_t &length, size_t size){
     do{
-        int len = read(data + offset, buff_size - offset);
+        if (length > 0){
+            parser.parse(data, length);
+            if (parser.hasError()){
+                return false;
+            }
+            if (parser.isFinished()){
+                return true;
+            }
+            //header超过缓冲区大小
+            if (length == size){
+                return false;
+            }
+        }
+        int len = session->read(data + length, size - length);
         if (len <= 0){
-            return nullptr;
+            return false;
         }
-        len += offset;
+        length += len;
+    } while (true);
+}
+
+bool HttpSession::recvBody(char *body, size_t length){
+    //先取缓冲区里已经读到的部分
+    size_t len = length >= m_length ? m_length : length;
+    memcpy(body, m_buffer.get(), len);
+    consume(len);
+    length -= len;
+    if (length > 0){
+        if (readFixSize(body + len, length) <= 0){
+            return false;
+        }
+    }
+    return true;
+}
 
-        size_t nparse = parser->execute(data, len);
-        if (parser->hasError()){
-            return nullptr;
+void HttpSession::consume(size_t len){
+    //pipeline的后续请求移到缓冲区开头
+    memmove(m_buffer.get(), m_buffer.get() + len, m_length - len);
+    m_length -= len;
+}
+
+int HttpSession::readLine(){
+    char *data = m_buffer.get();
+    do{
+        const char *end = (const char *)memchr(data, '\n', m_length);
+        if (end){
+            return end - data + 1;
         }
-        //未解析的size（包括body）
-        offset = len - nparse;
-        if (offset == (int)buff_size){
-            return nullptr;
+        if (m_length == m_bufferSize){
+            return -1;
         }
-        
-        if (parser->isFinished())
-        {
-            break;
+        int len = read(data + m_length, m_bufferSize - m_length);
+        if (len <= 0){
+            return -1;
         }
+        m_length += len;
     } while (true);
-    int64_t length = parser->getContentLength();
-    if (length > 0){
-        std::string body;
-        body.reserve(length);
+}
 
-        if (length >= offset){
-            body.append(data, offset);
+//一行是否以CRLF结尾，n为包括\n的长度
+static bool IsCRLFLine(const char *data, int n){
+    return n >= 2 && data[n - 2] == '\r';
+}
+
+bool HttpSession::readChunkSize(){
+    //上一个chunk的数据后面必须正好是CRLF
+    if (m_chunkStarted){
+        int n = readLine();
+        if (n != 2 || m_buffer.get()[0] != '\r'){
+            return false;
+        }
+        consume(n);
+    }
+    m_chunkStarted = true;
+
+    int n = readLine();
+    if (n < 0){
+        return false;
+    }
+    const char *data = m_buffer.get();
+    uint64_t size = 0;
+    int digits = 0;
+    for (; digits < n; ++digits){
+        char c = data[digits];
+        int v;
+        if (c >= '0' && c <= '9'){
+            v = c - '0';
+        }
+        else if (c >= 'a' && c <= 'f'){
+            v = c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F'){
+            v = c - 'A' + 10;
         }
         else{
-            body.append(data, length);
+            break;
+        }
+        size = size * 16 + v;
+    }
+    //最多15位十六进制，不会溢出；数字后面只能是CRLF或者;开头的chunk扩展（忽略扩展的内容）
+    if (digits == 0 || digits > 15 || !IsCRLFLine(data, n)
+            || (digits != n - 2 && data[digits] != ';')){
+        return false;
+    }
+    consume(n);
+
+    if (size == 0){
+        //跳过trailer直到空行
+        do{
+            n = readLine();
+            if (n < 0 || !IsCRLFLine(m_buffer.get(), n)){
+                return false;
+            }
+            consume(n);
+            if (n == 2){
+                break;
+            }
+        } while (true);
+        m_bodyDone = true;
+    }
+    m_bodyLeft = size;
+    return true;
+}
+
+bool HttpSession::checkFraming(bool has_te, bool chunked, bool has_length, int64_t length){
+    //body的边界只能有一种解释，否则和前面的代理理解不一致会造成请求走私
+    if ((has_te && (!chunked || has_length)) || (has_length && length < 0)){
+        m_badRequest = true;
+        return false;
+    }
+    return true;
+}
+
+void HttpSession::startBody(uint64_t length, bool chunked){
+    m_bodyLeft = chunked ? 0 : length;
+    m_bodyChunked = chunked;
+    m_chunkStarted = false;
+    m_bodyDone = !chunked && length == 0;
+}
+
+void HttpSession::checkExpect(uint8_t version, const char *expect, size_t len){
+    //HTTP/1.0的客户端不会等待100，不用回复
+    m_continuePending = !m_bodyDone && version >= 0x11
+                     && len == 12 && strncasecmp(expect, "100-continue", 12) == 0;
+}
+
+int HttpSession::sendContinue(){
+    static const char s_continue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    m_continuePending = false;
+    if (flush() < 0){
+        return -1;
+    }
+    return writeFixSize(s_continue, sizeof(s_continue) - 1);
+}
+
+int HttpSession::readBody(void *buf, size_t length){
+    if (m_bodyDone){
+        return 0;
+    }
+    if (m_continuePending && sendContinue() <= 0){
+        return -1;
+    }
+    if (m_bodyLeft == 0){
+        if (!m_bodyChunked){
+            m_bodyDone = true;
+            return 0;
+        }
+        if (!readChunkSize()){
+            return -1;
+        }
+        if (m_bodyDone){
+            return 0;
+        }
+    }
+    size_t len = length > m_bodyLeft ? m_bodyLeft : length;
+    int rt = 0;
+    if (m_length > 0){
+        rt = len > m_length ? m_length : len;
+        memcpy(buf, m_buffer.get(), rt);
+        consume(rt);
+    }
+    else{
+        //缓冲区为空时直接读到调用者的内存，大body不经过缓冲区
+        rt = read(buf, len);
+        if (rt <= 0){
+            return -1;
+        }
+    }
+    m_bodyLeft -= rt;
+    if (m_bodyLeft == 0 && !m_bodyChunked){
+        m_bodyDone = true;
+    }
+    return rt;
+}
+
+bool HttpSession::readAllBody(std::string &body){
+    uint64_t max_size = HttpRequestParser::GetHttpRequestMaxBodysize();
+    if (!m_bodyChunked){
+        if (m_bodyLeft > max_size){
+            return false;
+        }
+        if (m_continuePending && sendContinue() <= 0){
+            return false;
+        }
+        if (m_bodyLeft > 0){
+            body.resize(m_bodyLeft);
+            if (!recvBody(&body[0], m_bodyLeft)){
+                return false;
+            }
+        }
+        m_bodyLeft = 0;
+        m_bodyDone = true;
+        return true;
+    }
+
+    size_t size = 0;
+    do{
+        if (body.size() - size < m_bufferSize){
+            body.resize(size + m_bufferSize);
+        }
+        int rt = readBody(&body[size], body.size() - size);
+        if (rt < 0){
+            return false;
+        }
+        if (rt == 0){
+            break;
+        }
+        size += rt;
+        if (size > max_size){
+            return false;
+        }
+    } while (true);
+    body.resize(size);
+    return true;
+}
+
+bool HttpSession::discardBody(){
+    //没有回复100时客户端还没有发送body，不能再等它
+    if (m_continuePending){
+        m_continuePending = false;
+        return false;
+    }
+    uint64_t left = g_http_request_max_discard_size->getVal();
+    char tmp[1024];
+    while (!m_bodyDone){
+        int rt = readBody(tmp, sizeof(tmp));
+        if (rt < 0 || (uint64_t)rt > left){
+            return false;
+        }
+        left -= rt;
+    }
+    return true;
+}
+
+//Transfer-Encoding的最后一个编码是否为chunked，chunked只能出现一次
+//其他情况无法确定请求body的结束位置，调用者按400处理
+static bool IsChunked(const char *data, size_t len){
+    bool last = false;
+    size_t pos = 0;
+    while (pos <= len){
+        const char *comma = (const char *)memchr(data + pos, ',', len - pos);
+        size_t end = comma ? comma - data : len;
+        size_t begin = pos;
+        while (begin < end && (data[begin] == ' ' || data[begin] == '\t')){
+            ++begin;
+        }
+        size_t tail = end;
+        while (tail > begin && (data[tail - 1] == ' ' || data[tail - 1] == '\t')){
+            --tail;
+        }
+        bool chunked = tail - begin == 7 && strncasecmp(data + begin, "chunked", 7) == 0;
+        if (chunked && last){
+            return false;
+        }
+        last = chunked;
+        pos = end + 1;
+    }
+    return last;
+}
+
+//查找header，不拷贝value
+static const std::string *FindHeader(const HttpRequest::ptr &req, const std::string &key){
+    auto it = req->getHeaders().find(key);
+    return it == req->getHeaders().end() ? nullptr : &it->second;
+}
+
+HttpRequest::ptr HttpSession::recvRequestHeader(){
+    static const std::string s_transfer_encoding = "transfer-encoding";
+    static const std::string s_content_length = "content-length";
+    static const std::string s_expect = "expect";
+    static const std::string s_accept_encoding = "accept-encoding";
+    if (m_parser){
+        m_parser->reset();
+    }
+    else{
+        m_parser.reset(new HttpRequestParser);
+    }
+    m_badRequest = false;
+    if (!RecvHeader(this, *m_parser, m_buffer.get(), m_length, m_bufferSize)){
+        m_badRequest = m_parser->hasError();
+        return nullptr;
+    }
+    consume(m_parser->getParser().nread);
+
+    HttpRequest::ptr req = m_parser->getData();
+    const std::string *te = FindHeader(req, s_transfer_encoding);
+    bool chunked = te && IsChunked(te->c_str(), te->size());
+    if (!checkFraming(te != nullptr, chunked, FindHeader(req, s_content_length) != nullptr
+                      , req->getHeaderContentLength())){
+        return nullptr;
+    }
+    startBody(m_parser->getContentLength(), chunked);
+    m_continuePending = false;
+    const std::string *expect = FindHeader(req, s_expect);
+    if (expect){
+        checkExpect(req->getVersion(), expect->c_str(), expect->size());
+    }
+    const std::string *accept = FindHeader(req, s_accept_encoding);
+    m_acceptEncoding = accept ? NegotiateEncoding(*accept) : ContentEncoding::IDENTITY;
+    req->init();
+    return req;
+}
+
+bool HttpSession::recvRequestBody(HttpRequest::ptr req){
+    std::string body;
+    if (!readAllBody(body)){
+        return false;
+    }
+    req->setBody(body);
+    return true;
+}
+
+HttpRequest::ptr HttpSession::recvRequest(){
+    HttpRequest::ptr req = recvRequestHeader();
+    if (!req || !recvRequestBody(req)){
+        return nullptr;
+    }
+    return req;
+}
+
+bool HttpSession::recvRequest(HttpRequestView &req){
+    req.reset();
+    HttpRequestViewParser parser(req);
+    m_badRequest = false;
+    if (!RecvHeader(this, parser, m_buffer.get(), m_length, m_bufferSize)){
+        m_badRequest = parser.hasError();
+        return false;
+    }
+    parser.commit();
+    consume(parser.getParser().nread);
+
+    StringView te;
+    StringView cl;
+    bool has_te = req.getHeader(KnownHeader::TRANSFER_ENCODING, te);
+    bool chunked = has_te && IsChunked(te.data(), te.size());
+    if (!checkFraming(has_te, chunked, req.getHeader(KnownHeader::CONTENT_LENGTH, cl)
+                      , req.getContentLength())){
+        return false;
+    }
+    startBody(req.getContentLength(), chunked);
+    StringView expect;
+    m_continuePending = false;
+    if (req.getHeader(KnownHeader::EXPECT, expect)){
+        checkExpect(req.getVersion(), expect.data(), expect.size());
+    }
+    StringView accept;
+    m_acceptEncoding = req.getHeader(KnownHeader::ACCEPT_ENCODING, accept)
+                     ? NegotiateEncoding(std::string(accept.data(), accept.size())) : ContentEncoding::IDENTITY;
+    if (!chunked){
+        uint64_t length = req.getContentLength();
+        if (length > HttpRequestParser::GetHttpRequestMaxBodysize()){
+            return false;
+        }
+        if (m_continuePending && sendContinue() <= 0){
+            return false;
         }
-        length -= offset;
         if (length > 0){
-            if (readFixSize(&body[body.size()], length) <= 0){
-                return nullptr;
+            char *body = req.getArena().alloc(length);
+            if (!recvBody(body, length)){
+                return false;
             }
+            m_bodyLeft = 0;
+            m_bodyDone = true;
+            req.setBody(StringView(body, length));
+        }
+        return true;
+    }
+    //chunked的总长度事先未知，先解码再放进arena
+    std::string body;
+    if (!readAllBody(body)){
+        return false;
+    }
+    req.setBody(req.getArena().copy(body.c_str(), body.size()));
+    return true;
+}
+
+HttpBodyStream::ptr HttpSession::getBodyStream(){
+    return HttpBodyStream::ptr(new HttpBodyStream(this));
+}
+
+bool HttpSession::hasBufferedRequest() const{
+    if (m_length == 0){
+        return false;
+    }
+    const char *data = m_buffer.get();
+    return memmem(data, m_length, "\r\n\r\n", 4) != nullptr
+        || memmem(data, m_length, "\n\n", 2) != nullptr;
+}
+
+std::string HttpSession::takeBuffer(){
+    std::string ret(m_buffer.get(), m_length);
+    m_length = 0;
+    m_upgraded = true;
+    return ret;
+}
+
+HttpResponse::ptr HttpSession::createResponse(uint8_t version, bool close){
+    //pipeline中还没有发送的响应被m_pending引用，这时重新申请
+    if (m_response && m_response.use_count() == 1){
+        m_response->reset(version, close);
+    }
+    else{
+        m_response.reset(new HttpResponse(version, close));
+    }
+    return m_response;
+}
+
+int HttpSession::sendResponse(HttpResponse::ptr rsp, bool flush){
+    //按当前请求的Accept-Encoding压缩body，预先序列化的响应和流式响应不处理
+    if (m_acceptEncoding != ContentEncoding::IDENTITY && !rsp->getRaw() && !rsp->isStream()
+            && IsCompressible(rsp, rsp->getBody().size())){
+        CompressResponse(rsp, m_acceptEncoding);
+    }
+    PendingResponse pending;
+    pending.offset = m_sendBuffer.size();
+    //预先序列化的响应不需要再序列化，发送时直接引用，只生成当前请求的版本和Date
+    if (!rsp->getRaw()){
+        rsp->serializeHeader(m_sendBuffer);
+    }
+    else{
+        m_sendBuffer.append("HTTP/");
+        m_sendBuffer.push_back((char)('0' + (rsp->getVersion() >> 4)));
+        m_sendBuffer.push_back('.');
+        m_sendBuffer.push_back((char)('0' + (rsp->getVersion() & 0x0F)));
+        StringView date = HttpDateValue();
+        m_sendBuffer.append("Date: ");
+        m_sendBuffer.append(date.data(), date.size());
+        m_sendBuffer.append("\r\n");
+    }
+    pending.length = m_sendBuffer.size() - pending.offset;
+    pending.rsp = rsp;
+    m_pending.push_back(pending);
+    if (!flush){
+        return pending.length + (rsp->getRaw() ? rsp->getRaw()->data.size() - HttpRawResponse::VERSION_LEN : rsp->getBody().size());
+    }
+    return this->flush();
+}
+
+HttpChunkedStream::ptr HttpSession::startStream(HttpResponse::ptr rsp){
+    bool chunked = rsp->getVersion() >= 0x11;
+    if (!chunked){
+        rsp->setClose(true);
+    }
+    rsp->setStream(true);
+    //长度未知的流式body边写边压缩
+    Compressor::ptr compressor;
+    if (m_acceptEncoding != ContentEncoding::IDENTITY && rsp->getContentLength() < 0 && IsCompressible(rsp, -1)){
+        compressor = Compressor::Create(m_acceptEncoding);
+        if (compressor){
+            SetContentEncoding(rsp, m_acceptEncoding);
         }
-        parser->getData()->setBody(body);
     }
-    return parser->getData();
+    //之前pipeline缓存的响应和这个响应头一起发出
+    if (sendResponse(rsp, true) <= 0){
+        return nullptr;
+    }
+    m_stream.reset(new HttpChunkedStream(this, chunked, compressor));
+    return m_stream;
+}
+
+int HttpSession::finishStream(){
+    if (!m_stream){
+        return 0;
+    }
+    m_stream->close();
+    m_stream.reset();
+    return 0;
 }
 
-int HttpSession::sendResponse(HttpResponse::ptr rsp){
-    std::stringstream ss;
-    ss << *rsp;
-    std::string data = ss.str();
-    return writeFixSize(data.c_str(), data.size());
+int64_t HttpSession::sendFile(HttpResponse::ptr rsp, int fd, uint64_t offset, uint64_t length){
+    rsp->setStream(true);
+    rsp->setContentLength(length);
+    if (sendResponse(rsp, true) <= 0){
+        return -1;
+    }
+    if (length == 0){
+        return 0;
+    }
+    return SocketStream::sendFile(fd, offset, length);
+}
+
+int HttpSession::flush(){
+    if (m_pending.empty()){
+        return 0;
+    }
+    //header和body分别作为iovec，body不做拷贝，小响应一次sendmsg就能发完
+    m_iovs.clear();
+    for (auto& i : m_pending){
+        iovec iov;
+        const HttpRawResponse::ptr &raw = i.rsp->getRaw();
+        if (raw){
+            //替换raw数据的版本，中间插入Date和当前连接的connection头
+            const char *conn = i.rsp->isClose() ? "connection: close\r\n" : "connection: keep-alive\r\n";
+            iov.iov_base = &m_sendBuffer[i.offset];
+            iov.iov_len = HttpRawResponse::VERSION_LEN;
+            m_iovs.push_back(iov);
+            iov.iov_base = (void *)(raw->data.c_str() + HttpRawResponse::VERSION_LEN);
+            iov.iov_len = raw->connOffset - HttpRawResponse::VERSION_LEN;
+            m_iovs.push_back(iov);
+            iov.iov_base = &m_sendBuffer[i.offset + HttpRawResponse::VERSION_LEN];
+            iov.iov_len = i.length - HttpRawResponse::VERSION_LEN;
+            m_iovs.push_back(iov);
+            iov.iov_base = (void *)conn;
+            iov.iov_len = strlen(conn);
+            m_iovs.push_back(iov);
+            iov.iov_base = (void *)(raw->data.c_str() + raw->connOffset);
+            iov.iov_len = raw->data.size() - raw->connOffset;
+            m_iovs.push_back(iov);
+            continue;
+        }
+        iov.iov_base = &m_sendBuffer[i.offset];
+        iov.iov_len = i.length;
+        m_iovs.push_back(iov);
+        const std::string &body = i.rsp->getBody();
+        if (!body.empty() && !i.rsp->isStream()){
+            iov.iov_base = (void *)body.c_str();
+            iov.iov_len = body.size();
+            m_iovs.push_back(iov);
+        }
+    }
+    int rt = writevFixSize(&m_iovs[0], m_iovs.size());
+    m_pending.clear();
+    //clear保留容量，下一个响应复用
+    m_sendBuffer.clear();
+    return rt;
+}
 }
 }
-}
\ No newline at end of file
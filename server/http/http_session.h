@@ -2,19 +2,179 @@
 
 #include "../socket_stream.h"
 #include "http.h"
+#include "http_parser.h"
+#include "http_request_view.h"
+#include "compress.h"
 #include <memory>
+#include <vector>
+#include <string>
 
 namespace server{
 namespace http{
+
+class HttpSession;
+
+//分块写出响应body，每次write发送一个chunk，close发送结束块
+//HTTP/1.0下直接写原始数据，由关闭连接结束body
+//有compressor时每次write的数据压缩并flush后作为一个chunk发出，返回值仍是压缩前的长度
+class HttpChunkedStream : public Stream{
+public:
+    typedef std::shared_ptr<HttpChunkedStream> ptr;
+    HttpChunkedStream(HttpSession *session, bool chunked, Compressor::ptr compressor = nullptr);
+
+    virtual int read(void *buf, size_t length) override { return -1; }
+    virtual int read(ByteArray::ptr ba, size_t length) override { return -1; }
+    virtual int write(const void *buf, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+    virtual void close() override;
+
+    bool isClosed() const { return m_closed; }
+
+private:
+    int writeChunk(std::vector<iovec> &iovs, size_t length);
+    //发送m_zbuf中压缩好的数据
+    int writeCompressed();
+
+    HttpSession *m_session;
+    bool m_chunked;
+    bool m_closed;
+    std::vector<iovec> m_iovs;
+    Compressor::ptr m_compressor;
+    std::string m_zbuf;
+};
+
+//请求body的输入流，read返回0表示body已经读完，chunked的body会自动解码
+class HttpBodyStream : public Stream{
+public:
+    typedef std::shared_ptr<HttpBodyStream> ptr;
+    HttpBodyStream(HttpSession *session) : m_session(session) {}
+
+    virtual int read(void *buf, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+    virtual int write(const void *buf, size_t length) override { return -1; }
+    virtual int write(ByteArray::ptr ba, size_t length) override { return -1; }
+    virtual void close() override {}
+
+private:
+    HttpSession *m_session;
+};
+
 class HttpSession: public SocketStream{
 public:
     typedef std::shared_ptr<HttpSession> ptr;
     HttpSession(Socket::ptr sock, bool owner = true);
 
+    //读取header和完整的body
+    //上一个请求没有被其他地方引用时复用同一个对象（以及解析器），之前返回的请求不要再保存
     HttpRequest::ptr recvRequest();
-    int sendResponse(HttpResponse::ptr rsp);
+    //只读取header，body之后通过recvRequestBody或getBodyStream读取
+    HttpRequest::ptr recvRequestHeader();
+    virtual bool recvRequestBody(HttpRequest::ptr req);
+    HttpBodyStream::ptr getBodyStream();
+    //读取当前请求的body，返回0表示读完
+    virtual int readBody(void *buf, size_t length);
+    //丢弃servlet没有读的body，超过http.request.max_discard_size返回false
+    //客户端在等100 Continue时不会发送body，这时也返回false，连接需要关闭
+    virtual bool discardBody();
+    bool isBodyDone() const { return m_bodyDone; }
+    //当前请求body的长度，chunked时为-1，只在开始读取body之前有效
+    int64_t getBodyLength() const { return m_bodyChunked ? -1 : (int64_t)m_bodyLeft; }
+    //请求带有Expect: 100-continue并且还没有回复100，第一次读取body时自动发送
+    bool isContinuePending() const { return m_continuePending; }
+    //上一次recvRequestHeader失败是因为请求本身不合法（格式错误、body边界不明确），应回复400
+    bool isBadRequest() const { return m_badRequest; }
+    //解析到复用的HttpRequestView中，header和body都放在它的arena里
+    bool recvRequest(HttpRequestView &req);
+    //flush为false时响应只缓存在session中，等下一次flush时用一次writev发出
+    virtual int sendResponse(HttpResponse::ptr rsp, bool flush = true);
+    virtual int flush();
+    //当前请求的响应对象，上一个响应已经发送并且没有被其他地方引用时复用
+    HttpResponse::ptr createResponse(uint8_t version, bool close);
+
+    //当前请求的Accept-Encoding协商出的编码，sendResponse和startStream按它压缩响应
+    ContentEncoding getAcceptEncoding() const { return m_acceptEncoding; }
+    void setAcceptEncoding(ContentEncoding v) { m_acceptEncoding = v; }
+
+    //发送响应头并返回body的输出流，rsp的body被忽略
+    virtual HttpChunkedStream::ptr startStream(HttpResponse::ptr rsp);
+    //结束当前的流式响应（servlet没有close时由HttpServer调用）
+    virtual int finishStream();
+    //发送响应头后用sendfile发送文件fd中[offset, offset+length)的内容作为body
+    virtual int64_t sendFile(HttpResponse::ptr rsp, int fd, uint64_t offset, uint64_t length);
+
+    //缓冲区中是否已经有一个完整的请求头（pipeline）
+    bool hasBufferedRequest() const;
+    size_t getPendingCount() const { return m_pending.size(); }
+    //取出缓冲区中已经读到但还没有解析的数据，协议升级后交给新的协议继续处理
+    virtual std::string takeBuffer();
+    //连接已经交给其他协议（调用过takeBuffer），不再受HTTP请求超时的限制
+    bool isUpgraded() const { return m_upgraded; }
+
+    //等待下一个请求的数据，最多等待timeout_ms，超时或者对端关闭返回false
+    //release为true时等待期间释放接收缓冲区，只用MSG_PEEK等待可读
+    bool waitRequest(uint64_t timeout_ms, bool release = false);
+    //缓冲区中是否有还没有处理的数据
+    bool hasBufferedData() const { return m_length > 0; }
+    //缓冲区为空时释放，下次waitRequest重新申请，同时释放复用的请求和响应
+    void releaseBuffer();
+    //缓冲区开头是否为HTTP/2的连接前言（prior knowledge），数据不够判断时继续读取
+    bool hasHttp2Preface();
+    //之后每次read最多等待timeout_ms，并且不超过deadline(ms，GetCurrentMS)，-1和0表示不限制
+    void setReadTimeout(uint64_t timeout_ms, uint64_t deadline = 0);
+
+    virtual int read(void *buf, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+protected:
+    //当前请求body剩余的长度，chunked时为当前chunk剩余的长度
+    uint64_t m_bodyLeft;
+    bool m_bodyChunked;
+    bool m_bodyDone;
+    uint64_t m_readTimeout;
+    HttpChunkedStream::ptr m_stream;
+
+private:
+    void resetBuffer();
+    //按m_readTimeout和m_readDeadline设置socket的读超时，deadline已经过了返回false
+    bool applyReadTimeout();
+    bool recvBody(char *body, size_t length);
+    bool readAllBody(std::string &body);
+    //检查Transfer-Encoding和Content-Length，不合法时设置m_badRequest并返回false
+    bool checkFraming(bool has_te, bool chunked, bool has_length, int64_t length);
+    void startBody(uint64_t length, bool chunked);
+    //请求是否在等待100 Continue，expect为Expect头的值
+    void checkExpect(uint8_t version, const char *expect, size_t len);
+    //发送100 Continue，之前pipeline缓存的响应先发出
+    int sendContinue();
+    //保证缓冲区开头有一整行，返回行的长度（包括\n）
+    int readLine();
+    bool readChunkSize();
+    //丢弃缓冲区开头len字节
+    void consume(size_t len);
+
+    //接收缓冲区，跨请求保留，pipeline时多读的数据留给下一个请求
+    std::shared_ptr<char> m_buffer;
+    size_t m_bufferSize;
+    size_t m_length;
+    bool m_chunkStarted;
+    bool m_continuePending;
+    bool m_badRequest;
+    ContentEncoding m_acceptEncoding;
+    uint64_t m_readDeadline;
+    bool m_upgraded;
+    //还未发送的响应，header序列化在m_sendBuffer中，body直接引用rsp
+    struct PendingResponse{
+        size_t offset;
+        size_t length;
+        HttpResponse::ptr rsp;
+    };
+    std::string m_sendBuffer;
+    std::vector<PendingResponse> m_pending;
+    std::vector<iovec> m_iovs;
+    //长连接上复用的解析器（连同其中的请求）和响应
+    HttpRequestParser::ptr m_parser;
+    HttpResponse::ptr m_response;
 };
 }
 
 }
-
@@ -0,0 +1,403 @@
+#include "proxy_servlet.h"
+#include "http_session.h"
+#include "../config.h"
+#include "../iomanager.h"
+#include "../log.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <vector>
+
+namespace server{
+namespace http{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+static server::ConfigVar<uint32_t>::ptr g_http_proxy_buffer_size =
+    server::Config::AddData("http.proxy.buffer_size", (uint32_t)(16 * 1024), "http proxy body forward buffer size");
+
+static server::ConfigVar<uint64_t>::ptr g_http_proxy_timeout =
+    server::Config::AddData("http.proxy.timeout", (uint64_t)30000, "http proxy default upstream timeout(ms)");
+
+//Connection头部中列出的名字也是逐跳的（RFC 7230 6.1），按逗号分割并去掉空白
+static std::vector<std::string> ConnectionTokens(const std::string &connection){
+    std::vector<std::string> tokens;
+    size_t pos = 0;
+    while (pos < connection.size()){
+        size_t end = connection.find(',', pos);
+        if (end == std::string::npos){
+            end = connection.size();
+        }
+        size_t b = connection.find_first_not_of(" \t", pos);
+        size_t e = connection.find_last_not_of(" \t", end - 1);
+        if (b != std::string::npos && b < end && e >= b){
+            tokens.push_back(connection.substr(b, e - b + 1));
+        }
+        pos = end + 1;
+    }
+    return tokens;
+}
+
+//逐跳的头部只对一个连接有效，不能转发
+//expect由代理自己回复100，body已经在转发时读出，上游不需要再等待
+static bool IsHopHeader(const std::string &key, const std::vector<std::string> &tokens){
+    static const char *s_hops[] = {"connection", "keep-alive", "proxy-connection", "te", "trailer"
+                                   , "transfer-encoding", "upgrade", "content-length", "expect"};
+    for (auto& i : s_hops){
+        if (strcasecmp(key.c_str(), i) == 0){
+            return true;
+        }
+    }
+    for (auto& i : tokens){
+        if (strcasecmp(key.c_str(), i.c_str()) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::string GetRemoteIp(const HttpSession::ptr &session){
+    Address::ptr addr = session->getSocket()->getRemoteAddress();
+    if (!addr){
+        return "";
+    }
+    //去掉端口和IPv6的[]
+    std::string ip = addr->toString();
+    size_t pos = ip.rfind(':');
+    if (pos != std::string::npos && (ip[0] == '[' || ip.find(':') == pos)){
+        ip.resize(pos);
+    }
+    if (!ip.empty() && ip[0] == '['){
+        ip = ip.substr(1, ip.size() - 2);
+    }
+    return ip;
+}
+
+ProxyServlet::ProxyServlet(const std::vector<std::string> &upstreams, Balance balance)
+:Servlet("ProxyServlet")
+,m_balance(balance)
+,m_next(0)
+,m_timeout(g_http_proxy_timeout->getVal()){
+    //body由ProxyServlet自己边读边转发
+    setStreamBody(true);
+    for (auto& i : upstreams){
+        Upstream::ptr up(new Upstream);
+        size_t pos = i.rfind(':');
+        if (pos != std::string::npos && i.find(']', pos) == std::string::npos){
+            up->host = i.substr(0, pos);
+            up->port = atoi(i.c_str() + pos + 1);
+        }
+        else{
+            up->host = i;
+            up->port = 80;
+        }
+        up->active = 0;
+        up->requests = 0;
+        up->errors = 0;
+        m_upstreams.push_back(up);
+    }
+}
+
+void ProxyServlet::setRequestHeader(const std::string &key, const std::string &val){
+    m_requestHeaders.push_back(std::make_pair(key, val));
+}
+
+void ProxyServlet::setResponseHeader(const std::string &key, const std::string &val){
+    m_responseHeaders.push_back(std::make_pair(key, val));
+}
+
+ProxyServlet::Upstream::ptr ProxyServlet::select(){
+    if (m_upstreams.empty()){
+        return nullptr;
+    }
+    size_t start = m_next++ % m_upstreams.size();
+    if (m_balance == Balance::ROUND_ROBIN){
+        return m_upstreams[start];
+    }
+    //从轮询的位置开始找，active相同时不会总是选第一个
+    Upstream::ptr ret = m_upstreams[start];
+    for (size_t i = 1; i < m_upstreams.size(); ++i){
+        const Upstream::ptr &up = m_upstreams[(start + i) % m_upstreams.size()];
+        if (up->active < ret->active){
+            ret = up;
+        }
+    }
+    return ret;
+}
+
+HttpRequest::ptr ProxyServlet::makeRequest(const HttpRequest::ptr &request, const HttpSession::ptr &session
+                                           , bool &has_body, bool &chunked){
+    //上游固定使用HTTP/1.1长连接
+    HttpRequest::ptr req(new HttpRequest(0x11, false));
+    req->setMethod(request->getMethod());
+    const std::string &path = request->getPath();
+    if (!m_stripPrefix.empty() && path.compare(0, m_stripPrefix.size(), m_stripPrefix) == 0){
+        std::string stripped = path.substr(m_stripPrefix.size());
+        req->setPath(stripped.empty() || stripped[0] != '/' ? "/" + stripped : stripped);
+    }
+    else{
+        req->setPath(path);
+    }
+    req->setQuery(request->getQuery());
+
+    HttpRequest::MapType headers;
+    std::vector<std::string> tokens = ConnectionTokens(request->getHeaderAs<std::string>("connection"));
+    for (auto& i : request->getHeaders()){
+        if (!IsHopHeader(i.first, tokens)){
+            headers[i.first] = i.second;
+        }
+    }
+
+    //body的长度和编码以session校验过的为准，不直接转发客户端的头部
+    has_body = !session->isBodyDone();
+    chunked = has_body && session->getBodyLength() < 0;
+    if (chunked){
+        headers["Transfer-Encoding"] = "chunked";
+    }
+    else if (has_body){
+        headers["Content-Length"] = std::to_string(session->getBodyLength());
+    }
+    else if (request->hasHeader("content-length", nullptr)){
+        headers["Content-Length"] = "0";
+    }
+
+    std::string ip = GetRemoteIp(session);
+    auto xff = headers.find("x-forwarded-for");
+    if (xff != headers.end()){
+        xff->second += ", " + ip;
+    }
+    else{
+        headers["X-Forwarded-For"] = ip;
+    }
+    for (auto& i : m_requestHeaders){
+        if (i.second.empty()){
+            headers.erase(i.first);
+        }
+        else{
+            headers[i.first] = i.second;
+        }
+    }
+    req->setHeaders(headers);
+    return req;
+}
+
+bool ProxyServlet::forwardBody(const HttpSession::ptr &session, const HttpConnection::ptr &conn, bool chunked){
+    std::vector<char> buf(g_http_proxy_buffer_size->getVal());
+    char size[24];
+    iovec iovs[3];
+    while (true){
+        int rt = session->readBody(&buf[0], buf.size());
+        if (rt < 0){
+            return false;
+        }
+        if (rt == 0){
+            break;
+        }
+        if (!chunked){
+            if (conn->writeFixSize(&buf[0], rt) <= 0){
+                return false;
+            }
+            continue;
+        }
+        iovs[0].iov_base = size;
+        iovs[0].iov_len = snprintf(size, sizeof(size), "%x\r\n", rt);
+        iovs[1].iov_base = &buf[0];
+        iovs[1].iov_len = rt;
+        iovs[2].iov_base = (void *)"\r\n";
+        iovs[2].iov_len = 2;
+        if (conn->writevFixSize(iovs, 3) <= 0){
+            return false;
+        }
+    }
+    if (chunked && conn->writeFixSize("0\r\n\r\n", 5) <= 0){
+        return false;
+    }
+    return true;
+}
+
+bool ProxyServlet::forwardResponse(const HttpRequest::ptr &request, const HttpResponse::ptr &response,
+                                   const HttpSession::ptr &session, const HttpConnection::ptr &conn,
+                                   const HttpResponse::ptr &upstream_rsp){
+    response->setStatus(upstream_rsp->getStatus());
+    response->setReason(upstream_rsp->getReason());
+    HttpResponse::MapType headers;
+    std::vector<std::string> tokens = ConnectionTokens(upstream_rsp->getHeaderAs<std::string>("connection"));
+    for (auto& i : upstream_rsp->getHeaders()){
+        if (!IsHopHeader(i.first, tokens)){
+            headers[i.first] = i.second;
+        }
+    }
+    for (auto& i : m_responseHeaders){
+        if (i.second.empty()){
+            headers.erase(i.first);
+        }
+        else{
+            headers[i.first] = i.second;
+        }
+    }
+    response->setHeaders(headers);
+
+    int64_t length = conn->getBodyLength();
+    bool head = request->getMethod() == HttpMethod::HEAD;
+    if (head || conn->isBodyDone()){
+        //HEAD的响应保留上游的content-length
+        response->setStream(true);
+        response->setContentLength(head ? std::max<int64_t>(upstream_rsp->getHeaderContentLength(), 0) : 0);
+        return session->sendResponse(response, true) > 0;
+    }
+
+    std::vector<char> buf(g_http_proxy_buffer_size->getVal());
+    if (length >= 0){
+        //长度已知，原样转发
+        response->setStream(true);
+        response->setContentLength(length);
+        if (session->sendResponse(response, true) <= 0){
+            return false;
+        }
+        while (true){
+            int rt = conn->readBody(&buf[0], buf.size());
+            if (rt < 0){
+                return false;
+            }
+            if (rt == 0){
+                return true;
+            }
+            if (session->writeFixSize(&buf[0], rt) <= 0){
+                return false;
+            }
+        }
+    }
+
+    //chunked或者以关闭连接结束的body，以chunked转发给客户端
+    HttpChunkedStream::ptr out = session->startStream(response);
+    if (!out){
+        return false;
+    }
+    while (true){
+        int rt = conn->readBody(&buf[0], buf.size());
+        if (rt < 0){
+            return false;
+        }
+        if (rt == 0){
+            break;
+        }
+        if (out->writeFixSize(&buf[0], rt) <= 0){
+            return false;
+        }
+    }
+    out->close();
+    return true;
+}
+
+int32_t ProxyServlet::handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session){
+    Upstream::ptr up = select();
+    if (!up){
+        response->setStatus(HttpStatus::BAD_GATEWAY);
+        response->setBody("no upstream");
+        return 0;
+    }
+    ++up->active;
+    ++up->requests;
+
+    bool has_body = false;
+    bool chunked = false;
+    HttpRequest::ptr req = makeRequest(request, session, has_body, chunked);
+    HttpConnectionPool::ptr pool = HttpConnectionPoolMgr::GetInstance()->getPool(up->host, up->port);
+
+    //超时后shutdown上游连接，阻塞在上面的读写都会立即返回
+    //token保存当前上游连接的fd，-2表示已经超时
+    std::shared_ptr<std::atomic<int>> timeout_token(new std::atomic<int>(-1));
+    Timer::ptr timer;
+    IOManager *iom = IOManager::GetThis();
+    if (iom && m_timeout){
+        std::weak_ptr<std::atomic<int>> weak(timeout_token);
+        timer = iom->addConditionTimer(m_timeout, [weak](){
+            std::shared_ptr<std::atomic<int>> token = weak.lock();
+            int fd = token ? token->exchange(-2) : -1;
+            if (fd >= 0){
+                ::shutdown(fd, SHUT_RDWR);
+            }
+        }, weak);
+    }
+
+    HttpConnection::ptr conn;
+    HttpResponse::ptr upstream_rsp;
+    HttpStatus error = HttpStatus::BAD_GATEWAY;
+    //没有body的请求在复用的连接失效时换新连接重试一次
+    for (int i = 0; i < 2 && !upstream_rsp; ++i){
+        conn = pool->getConnection(m_timeout);
+        if (!conn){
+            break;
+        }
+        bool reused = conn->getRequestCount() > 0;
+        int expect = -1;
+        if (!timeout_token->compare_exchange_strong(expect, conn->getSocket()->getSocket())
+            && expect == -2){
+            error = HttpStatus::GATEWAY_TIMEOUT;
+            pool->releaseConnection(conn, true);
+            conn.reset();
+            break;
+        }
+        conn->getSocket()->setRecvTimeout(m_timeout);
+        if (conn->sendRequest(req) <= 0 || (has_body && !forwardBody(session, conn, chunked))){
+            pool->releaseConnection(conn, true);
+            conn.reset();
+            if (reused && !has_body && *timeout_token != -2){
+                *timeout_token = -1;
+                continue;
+            }
+            break;
+        }
+        upstream_rsp = conn->recvResponseHeader(request->getMethod() == HttpMethod::HEAD);
+        if (!upstream_rsp){
+            if (errno == ETIMEDOUT || errno == EAGAIN || *timeout_token == -2){
+                error = HttpStatus::GATEWAY_TIMEOUT;
+            }
+            pool->releaseConnection(conn, true);
+            conn.reset();
+            if (!reused || has_body || error == HttpStatus::GATEWAY_TIMEOUT){
+                break;
+            }
+            *timeout_token = -1;
+        }
+    }
+
+    int32_t rt = 0;
+    if (!upstream_rsp){
+        ++up->errors;
+        LOG_WARN(g_logger) << "ProxyServlet " << up->host << ":" << up->port << " " << request->getPath()
+                           << " fail errno=" << errno << " errstr=" << strerror(errno);
+        response->setStatus(error);
+        response->setBody(HttpStatustoString(error));
+        //请求body可能没有读完
+        if (has_body){
+            response->setClose(true);
+        }
+    }
+    else if (!forwardResponse(request, response, session, conn, upstream_rsp)){
+        //响应头已经发出，只能关闭客户端连接
+        ++up->errors;
+        LOG_WARN(g_logger) << "ProxyServlet " << up->host << ":" << up->port << " " << request->getPath()
+                           << " forward response fail errno=" << errno;
+        response->setClose(true);
+        session->close();
+        rt = -1;
+    }
+    if (timer){
+        iom->cancel(timer);
+    }
+    //走到这里conn不为空时一定已经收到了响应头，失败的分支都已经释放了连接
+    if (conn){
+        bool close = !upstream_rsp || upstream_rsp->isClose() || !conn->isBodyDone() || *timeout_token == -2;
+        pool->releaseConnection(conn, close);
+    }
+    --up->active;
+    return rt;
+}
+
+}
+}
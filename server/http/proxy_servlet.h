@@ -0,0 +1,76 @@
+#pragma once
+
+#include "servlet.h"
+#include "http_connection.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace server{
+namespace http{
+
+//反向代理，把请求转发给一组上游服务器，连接来自HttpConnectionPoolMgr
+//请求和响应的body都是边读边转发，不会完整地缓存在内存中
+class ProxyServlet : public Servlet{
+public:
+    typedef std::shared_ptr<ProxyServlet> ptr;
+
+    enum class Balance
+    {
+        ROUND_ROBIN = 0,
+        //当前转发中的请求最少的上游
+        LEAST_CONN = 1,
+    };
+
+    struct Upstream{
+        typedef std::shared_ptr<Upstream> ptr;
+        std::string host;
+        uint16_t port;
+        //正在转发的请求数
+        std::atomic<uint32_t> active;
+        std::atomic<uint64_t> requests;
+        std::atomic<uint64_t> errors;
+    };
+
+    //upstreams为host:port的列表，端口默认80
+    ProxyServlet(const std::vector<std::string> &upstreams, Balance balance = Balance::ROUND_ROBIN);
+
+    virtual int32_t handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session) override;
+
+    //转发给上游的请求头，val为空表示删除
+    void setRequestHeader(const std::string &key, const std::string &val);
+    //返回给客户端的响应头，val为空表示删除
+    void setResponseHeader(const std::string &key, const std::string &val);
+    //上游的超时时间(ms)，从取连接开始到响应body读完，超时后关闭上游连接
+    void setTimeout(uint64_t v) { m_timeout = v; }
+    //转发时去掉path的前缀，如/api/users -> /users
+    void setStripPrefix(const std::string &v) { m_stripPrefix = v; }
+
+    const std::vector<Upstream::ptr> &getUpstreams() const { return m_upstreams; }
+
+private:
+    Upstream::ptr select();
+    //生成转发给上游的请求头，chunked为true表示客户端的body是chunked
+    HttpRequest::ptr makeRequest(const HttpRequest::ptr &request, const HttpSession::ptr &session, bool &has_body, bool &chunked);
+    //返回false表示上游出错
+    bool forwardBody(const HttpSession::ptr &session, const HttpConnection::ptr &conn, bool chunked);
+    //返回false表示响应头已经发出后上游出错，客户端连接需要关闭
+    bool forwardResponse(const HttpRequest::ptr &request, const HttpResponse::ptr &response,
+                         const HttpSession::ptr &session, const HttpConnection::ptr &conn,
+                         const HttpResponse::ptr &upstream_rsp);
+
+    std::vector<Upstream::ptr> m_upstreams;
+    Balance m_balance;
+    std::atomic<uint64_t> m_next;
+    uint64_t m_timeout;
+    std::string m_stripPrefix;
+    std::vector<std::pair<std::string, std::string>> m_requestHeaders;
+    std::vector<std::pair<std::string, std::string>> m_responseHeaders;
+};
+
+}
+}
@@ -0,0 +1,225 @@
+#include "router.h"
+#include "servlet.h"
+#include "../log.h"
+#include <stdint.h>
+#include <string.h>
+
+namespace server{
+namespace http{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+RadixRouter::Node::Node()
+:param(nullptr)
+,wildcardOrder(0)
+,servletOrder(0){
+
+}
+
+RadixRouter::Node::~Node(){
+    for (auto& i : children){
+        delete i;
+    }
+    delete param;
+}
+
+RadixRouter::RadixRouter()
+:m_root(new Node){
+
+}
+
+RadixRouter::~RadixRouter(){
+    delete m_root;
+}
+
+bool RadixRouter::IsPrefixGlob(const std::string &glob){
+    size_t pos = glob.find_first_of("*?[\\");
+    return pos == std::string::npos || (pos == glob.size() - 1 && glob[pos] == '*');
+}
+
+RadixRouter::Node *RadixRouter::insertStatic(Node *n, const std::string &s){
+    size_t off = 0;
+    while (off < s.size()){
+        size_t idx = n->indices.find(s[off]);
+        if (idx == std::string::npos){
+            Node *child = new Node;
+            child->label = s.substr(off);
+            n->indices.push_back(s[off]);
+            n->children.push_back(child);
+            return child;
+        }
+        Node *child = n->children[idx];
+        size_t common = 0;
+        while (common < child->label.size() && off + common < s.size()
+               && child->label[common] == s[off + common]){
+            ++common;
+        }
+        if (common < child->label.size()){
+            //公共前缀比子节点短，拆分出中间节点
+            Node *mid = new Node;
+            mid->label = child->label.substr(0, common);
+            child->label = child->label.substr(common);
+            mid->indices.push_back(child->label[0]);
+            mid->children.push_back(child);
+            n->children[idx] = mid;
+            child = mid;
+        }
+        n = child;
+        off += common;
+    }
+    return n;
+}
+
+bool RadixRouter::addRoute(const std::string &pattern, ServletPtr slt){
+    Node *n = m_root;
+    size_t pos = 0;
+    while (pos < pattern.size()){
+        size_t special = pattern.find_first_of(":*", pos);
+        if (special == std::string::npos){
+            n = insertStatic(n, pattern.substr(pos));
+            break;
+        }
+        if (special > pos){
+            n = insertStatic(n, pattern.substr(pos, special - pos));
+        }
+        if (pattern[special] == '*'){
+            if (n->wildcard && n->wildcard != slt){
+                LOG_WARN(g_logger) << "route " << pattern << " replaces wildcard " << n->wildcardName;
+            }
+            n->wildcard = slt;
+            n->wildcardName = pattern.substr(special + 1);
+            if (n->wildcardName.find('/') != std::string::npos){
+                LOG_ERROR(g_logger) << "route " << pattern << " wildcard must be at the end";
+                n->wildcard = nullptr;
+                return false;
+            }
+            return true;
+        }
+        size_t end = pattern.find('/', special);
+        if (end == std::string::npos){
+            end = pattern.size();
+        }
+        std::string name = pattern.substr(special + 1, end - special - 1);
+        if (!n->param){
+            n->param = new Node;
+            n->paramName = name;
+        }
+        else if (n->paramName != name){
+            LOG_WARN(g_logger) << "route " << pattern << " param :" << name
+                               << " conflicts with :" << n->paramName;
+        }
+        n = n->param;
+        pos = end;
+    }
+    n->servlet = slt;
+    return true;
+}
+
+void RadixRouter::addPrefix(const std::string &prefix, bool wildcard, ServletPtr slt, size_t order){
+    Node *n = insertStatic(m_root, prefix);
+    if (wildcard){
+        n->wildcard = slt;
+        n->wildcardName.clear();
+        n->wildcardOrder = order;
+    }
+    else{
+        n->servlet = slt;
+        n->servletOrder = order;
+    }
+}
+
+bool RadixRouter::match(const Node *n, const char *p, size_t len, Params &params, ServletPtr &slt) const{
+    if (len == 0){
+        if (n->servlet){
+            slt = n->servlet;
+            return true;
+        }
+        if (n->wildcard){
+            if (!n->wildcardName.empty()){
+                params.push_back(std::make_pair(&n->wildcardName, boost::string_view(p, 0)));
+            }
+            slt = n->wildcard;
+            return true;
+        }
+        return false;
+    }
+
+    size_t idx = n->indices.find(*p);
+    if (idx != std::string::npos){
+        const Node *child = n->children[idx];
+        size_t l = child->label.size();
+        if (len >= l && memcmp(child->label.c_str(), p, l) == 0
+            && match(child, p + l, len - l, params, slt)){
+            return true;
+        }
+    }
+
+    if (n->param){
+        const char *end = (const char *)memchr(p, '/', len);
+        size_t seg = end ? end - p : len;
+        if (seg > 0){
+            params.push_back(std::make_pair(&n->paramName, boost::string_view(p, seg)));
+            if (match(n->param, p + seg, len - seg, params, slt)){
+                return true;
+            }
+            params.pop_back();
+        }
+    }
+
+    if (n->wildcard){
+        if (!n->wildcardName.empty()){
+            params.push_back(std::make_pair(&n->wildcardName, boost::string_view(p, len)));
+        }
+        slt = n->wildcard;
+        return true;
+    }
+    return false;
+}
+
+RadixRouter::ServletPtr RadixRouter::matchFirst(const std::string &path, size_t &order) const{
+    ServletPtr slt;
+    order = SIZE_MAX;
+    const Node *n = m_root;
+    const char *p = path.c_str();
+    size_t len = path.size();
+    //沿着静态路径向下，经过的每个通配符都是一个匹配的前缀
+    while (true){
+        if (n->wildcard && n->wildcardOrder < order){
+            slt = n->wildcard;
+            order = n->wildcardOrder;
+        }
+        if (len == 0){
+            if (n->servlet && n->servletOrder < order){
+                slt = n->servlet;
+                order = n->servletOrder;
+            }
+            break;
+        }
+        size_t idx = n->indices.find(*p);
+        if (idx == std::string::npos){
+            break;
+        }
+        const Node *child = n->children[idx];
+        size_t l = child->label.size();
+        if (len < l || memcmp(child->label.c_str(), p, l) != 0){
+            break;
+        }
+        n = child;
+        p += l;
+        len -= l;
+    }
+    return slt;
+}
+
+RadixRouter::ServletPtr RadixRouter::match(const std::string &path, Params &params) const{
+    ServletPtr slt;
+    params.clear();
+    if (!match(m_root, path.c_str(), path.size(), params, slt)){
+        params.clear();
+        return nullptr;
+    }
+    return slt;
+}
+
+}
+}
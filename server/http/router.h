@@ -0,0 +1,69 @@
+#pragma once
+
+#include "http.h"
+#include <boost/utility/string_view.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace server{
+namespace http{
+
+class Servlet;
+
+//压缩前缀树路由，静态部分按字符压缩，支持:param捕获一段路径，末尾的*或*name匹配剩余路径
+//匹配优先级：静态 > :param > 通配符，与添加顺序无关
+//构建完成后只读，多线程可以同时查找
+class RadixRouter{
+public:
+    typedef std::shared_ptr<RadixRouter> ptr;
+    typedef std::shared_ptr<Servlet> ServletPtr;
+    typedef std::vector<std::pair<const std::string *, boost::string_view>> Params;
+
+    RadixRouter();
+    ~RadixRouter();
+
+    //按路由语法添加，如/user/:id/profile、/static/*path
+    bool addRoute(const std::string &pattern, ServletPtr slt);
+    //prefix按字面添加，wildcard为true时后面接一个匿名通配符，用于转换/api/*这样的glob
+    //order为添加顺序，只用于matchFirst
+    void addPrefix(const std::string &prefix, bool wildcard, ServletPtr slt, size_t order = 0);
+
+    //匹配成功时params中是捕获到的参数，指向path
+    ServletPtr match(const std::string &path, Params &params) const;
+    //只用于addPrefix添加的路由，在所有匹配的前缀中返回order最小的，和按添加顺序依次fnmatch的结果相同
+    //没有匹配时返回nullptr，order为SIZE_MAX
+    ServletPtr matchFirst(const std::string &path, size_t &order) const;
+
+    //glob只有末尾一个*并且没有其他通配符时可以转换成前缀路由
+    static bool IsPrefixGlob(const std::string &glob);
+
+private:
+    struct Node{
+        Node();
+        ~Node();
+
+        std::string label;
+        //静态子节点，indices[i]为children[i]的label首字符
+        std::string indices;
+        std::vector<Node *> children;
+        Node *param;
+        std::string paramName;
+        ServletPtr wildcard;
+        std::string wildcardName;
+        ServletPtr servlet;
+        size_t wildcardOrder;
+        size_t servletOrder;
+    };
+
+    Node *insertStatic(Node *n, const std::string &s);
+    bool match(const Node *n, const char *p, size_t len, Params &params, ServletPtr &slt) const;
+
+    RadixRouter(const RadixRouter &) = delete;
+    RadixRouter &operator=(const RadixRouter &) = delete;
+
+    Node *m_root;
+};
+
+}
+}
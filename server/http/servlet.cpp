@@ -3,7 +3,7 @@
 
 namespace server{
 namespace http{
-int32_t doDefault(http::HttpRequest::ptr request, http::HttpResponse::ptr response, http::HttpSession::ptr session){
+int32_t doDefault(const http::HttpRequest::ptr &request, const http::HttpResponse::ptr &response, const http::HttpSession::ptr &session){
     static const std::string& DEF_BODY = "<html><head><title>405 Method Not Allowed"
         "</title></head><body><center><h1>405 Method Not Allowed</h1></center>"
         "<hr><center>sewing server/1.0.0</center></body></html>";
@@ -18,48 +18,42 @@ int32_t doDefault(http::HttpRequest::ptr request, http::HttpResponse::ptr respon
 
 Servlet::Servlet(const std::string &name)
 :m_name(name)
-,m_doGet(doDefault)
-,m_doPost(doDefault)
-,m_doPut(doDefault)
-,m_doDelete(doDefault)
+,m_streamBody(false)
 ,m_default(doDefault){
 
 }
 
-int32_t Servlet::handle(http::HttpRequest::ptr request,
-                   http::HttpResponse::ptr response,
-                   http::HttpSession::ptr session)
+void Servlet::setHandler(HttpMethod method, doFunction doF){
+    if ((int)method >= 0 && method < HttpMethod::INVALID_METHOD){
+        m_handlers[(int)method] = doF;
+    }
+}
+
+int32_t Servlet::handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session)
 {
-    http::HttpMethod method = request->getMethod();
-    switch (method)
-    {
-    case HttpMethod::GET:
-        return m_doGet(request, response, session);
-        break;
-    case HttpMethod::POST:
-        return m_doPost(request, response, session);
-        break;
-    case HttpMethod::PUT:
-        return m_doPut(request, response, session);
-        break;
-    case HttpMethod::DELETE:
-        return m_doDelete(request, response, session);
-        break;
-    default:
-        return m_default(request, response, session);
-        break;
+    //直接按method下标查表
+    int idx = (int)request->getMethod();
+    if (idx >= 0 && idx < (int)HttpMethod::INVALID_METHOD && m_handlers[idx]){
+        return m_handlers[idx](request, response, session);
     }
+    return m_default(request, response, session);
+}
 
-    return -1;
+int32_t Servlet::checkHeader(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session){
+    return m_checkHeader ? m_checkHeader(request, response, session) : 0;
 }
 
 NotFoundServlet::NotFoundServlet(const std::string &name):Servlet(name){
 
 }
 
-int32_t NotFoundServlet::handle(http::HttpRequest::ptr request,
-                   http::HttpResponse::ptr response,
-                   http::HttpSession::ptr session){
+int32_t NotFoundServlet::handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session){
     static const std::string& RSP_BODY = "<html><head><title>404 Not Found"
         "</title></head><body><center><h1>404 Not Found</h1></center>"
         "<hr><center>sewing Server/1.0.0</center></body></html>";
@@ -74,23 +68,49 @@ int32_t NotFoundServlet::handle(http::HttpRequest::ptr request,
 
 ServletManager::ServletManager(){
     m_default.reset(new NotFoundServlet("Sewing server/1.0.0"));
+    RWMutexType::WriteLock lock(m_mutex);
+    rebuild();
 }
 
-int32_t ServletManager::handle(http::HttpRequest::ptr request,
-                   http::HttpResponse::ptr response,
-                   http::HttpSession::ptr session)
+int32_t ServletManager::handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session)
 {
-    auto slt = getMatchedServlet(request->getPath());
+    auto slt = getMatchedServlet(request);
     if (slt){
         slt->handle(request, response, session);
     }
     return 0;
 }
 
+void ServletManager::rebuild(){
+    std::shared_ptr<Snapshot> snapshot(new Snapshot);
+    snapshot->datas = m_datas;
+    for (auto& i : m_routes){
+        snapshot->router.addRoute(i.first, i.second);
+    }
+    for (size_t i = 0; i < m_globs.size(); ++i){
+        const std::string &glob = m_globs[i].first;
+        if (RadixRouter::IsPrefixGlob(glob)){
+            bool wildcard = !glob.empty() && glob.back() == '*';
+            snapshot->prefixGlobs.addPrefix(wildcard ? glob.substr(0, glob.size() - 1) : glob, wildcard, m_globs[i].second, i);
+        }
+        else{
+            snapshot->globs.push_back(std::make_pair(i, m_globs[i]));
+        }
+    }
+    std::atomic_store(&m_snapshot, Snapshot::ptr(snapshot));
+}
+
+ServletManager::Snapshot::ptr ServletManager::getSnapshot(){
+    return std::atomic_load(&m_snapshot);
+}
+
 Servlet::ptr ServletManager::addServlet(const std::string &uri, Servlet::ptr slt){
     RWMutexType::WriteLock lock(m_mutex);
     m_datas[uri] = slt;
-    return m_datas[uri];
+    rebuild();
+    return slt;
 }
 
 Servlet::ptr ServletManager::addGlobServlet(const std::string &uri, Servlet::ptr slt){
@@ -102,12 +122,27 @@ Servlet::ptr ServletManager::addGlobServlet(const std::string &uri, Servlet::ptr
         }
     }
     m_globs.push_back(std::make_pair(uri, slt));
+    rebuild();
+    return slt;
+}
+
+Servlet::ptr ServletManager::addRouteServlet(const std::string &uri, Servlet::ptr slt){
+    RWMutexType::WriteLock lock(m_mutex);
+    for (auto it = m_routes.begin(); it != m_routes.end(); ++it){
+        if (it->first == uri){
+            m_routes.erase(it);
+            break;
+        }
+    }
+    m_routes.push_back(std::make_pair(uri, slt));
+    rebuild();
     return slt;
 }
 
 void ServletManager::delServlet(const std::string &uri){
     RWMutexType::WriteLock lock(m_mutex);
     m_datas.erase(uri);
+    rebuild();
 }
 
 void ServletManager::delGlobServlet(const std::string &uri){
@@ -118,38 +153,71 @@ void ServletManager::delGlobServlet(const std::string &uri){
             break;
         }
     }
-    return;
+    rebuild();
+}
+
+void ServletManager::delRouteServlet(const std::string &uri){
+    RWMutexType::WriteLock lock(m_mutex);
+    for (auto it = m_routes.begin(); it != m_routes.end(); ++it){
+        if (it->first == uri){
+            m_routes.erase(it);
+            break;
+        }
+    }
+    rebuild();
 }
 
 Servlet::ptr ServletManager::getServlet(const std::string &uri){
-    RWMutexType::ReadLock lock(m_mutex);
-    auto it = m_datas.find(uri);
-    return it == m_datas.end() ? nullptr : it->second;
+    Snapshot::ptr snapshot = getSnapshot();
+    auto it = snapshot->datas.find(uri);
+    return it == snapshot->datas.end() ? nullptr : it->second;
 }
 
-Servlet::ptr ServletManager::getGlobServlet(const std::string &uri){
-    RWMutexType::ReadLock lock(m_mutex);
-    for (auto it = m_globs.begin(); it != m_globs.end(); ++it){
-        if (!fnmatch(it->first.c_str(), uri.c_str(), 0)){
-            return it->second;
+Servlet::ptr ServletManager::matchGlob(const Snapshot &snapshot, const std::string &uri) const{
+    size_t order = 0;
+    Servlet::ptr ret = snapshot.prefixGlobs.matchFirst(uri, order);
+    for (auto& i : snapshot.globs){
+        if (i.first > order){
+            break;
+        }
+        if (!fnmatch(i.second.first.c_str(), uri.c_str(), 0)){
+            return i.second.second;
         }
     }
-    return nullptr;
+    return ret;
 }
 
-Servlet::ptr ServletManager::getMatchedServlet(const std::string &uri){
-    Servlet::ptr ret = getServlet(uri);
-    if (ret)
-    {
-        return ret;
+Servlet::ptr ServletManager::getGlobServlet(const std::string &uri){
+    return matchGlob(*getSnapshot(), uri);
+}
+
+Servlet::ptr ServletManager::match(const std::string &uri, RadixRouter::Params &params){
+    Snapshot::ptr snapshot = getSnapshot();
+    auto it = snapshot->datas.find(uri);
+    if (it != snapshot->datas.end()){
+        return it->second;
     }
-    ret = getGlobServlet(uri);
-    if (ret)
-    {
+    Servlet::ptr ret = snapshot->router.match(uri, params);
+    if (ret){
         return ret;
     }
-    return m_default;
+    ret = matchGlob(*snapshot, uri);
+    return ret ? ret : m_default;
 }
 
+Servlet::ptr ServletManager::getMatchedServlet(const std::string &uri){
+    RadixRouter::Params params;
+    return match(uri, params);
+}
+
+Servlet::ptr ServletManager::getMatchedServlet(const http::HttpRequest::ptr &request){
+    RadixRouter::Params params;
+    Servlet::ptr ret = match(request->getPath(), params);
+    for (auto& i : params){
+        request->setParam(*i.first, i.second.to_string());
+    }
+    return ret;
+}
+
+}
 }
-}
\ No newline at end of file
@@ -6,44 +6,66 @@
 #include <vector>
 #include "http.h"
 #include "http_session.h"
+#include "router.h"
 #include "../macro.h"
+#include "../mutex.h"
 
 namespace server{
 namespace http{
 class Servlet{
 public:
     typedef std::shared_ptr<Servlet> ptr;
-    typedef std::function<int32_t(http::HttpRequest::ptr request, http::HttpResponse::ptr response, http::HttpSession::ptr session)> doFunction;
+    //参数都是引用，调用时不产生shared_ptr的引用计数操作，需要保存时再自行拷贝
+    typedef std::function<int32_t(const http::HttpRequest::ptr &request, const http::HttpResponse::ptr &response, const http::HttpSession::ptr &session)> doFunction;
     Servlet(const std::string &name);
     virtual ~Servlet(){};
 
-    virtual int32_t handle(http::HttpRequest::ptr request,
-                   http::HttpResponse::ptr response,
-                   http::HttpSession::ptr session);
+    virtual int32_t handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session);
 
-    void setGet(doFunction doF) { m_doGet = doF; };
-    void setPost(doFunction doF) { m_doPost = doF; };
-    void setPut(doFunction doF) { m_doPut = doF; };
-    void setDelete(doFunction doF) { m_doDelete = doF; };
+    //按method设置处理函数，覆盖HTTP_METHOD_MAP中所有的method
+    void setHandler(HttpMethod method, doFunction doF);
+    //没有设置处理函数的method使用默认函数（405）
+    void setDefault(doFunction doF) { m_default = doF; };
 
-    std::string getName() { return m_name; }
+    void setGet(doFunction doF) { setHandler(HttpMethod::GET, doF); };
+    void setPost(doFunction doF) { setHandler(HttpMethod::POST, doF); };
+    void setPut(doFunction doF) { setHandler(HttpMethod::PUT, doF); };
+    void setDelete(doFunction doF) { setHandler(HttpMethod::DELETE, doF); };
+    void setHead(doFunction doF) { setHandler(HttpMethod::HEAD, doF); };
+    void setOptions(doFunction doF) { setHandler(HttpMethod::OPTIONS, doF); };
+    void setPatch(doFunction doF) { setHandler(HttpMethod::PATCH, doF); };
+
+    const std::string &getName() const { return m_name; }
+
+    //请求有body时，在读取body之前只凭header调用，返回非0表示拒绝：response作为最终响应发出，body不再读取，连接关闭
+    //Expect: 100-continue的请求被拒绝时不会回复100，客户端不会发送body
+    virtual int32_t checkHeader(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session);
+    void setCheckHeader(doFunction doF) { m_checkHeader = doF; }
+
+    //为true时HttpServer不预先读取body，servlet通过session->getBodyStream()读取
+    void setStreamBody(bool v) { m_streamBody = v; }
+    bool isStreamBody() const { return m_streamBody; }
 
 private:
     std::string m_name;
-    doFunction m_doGet;
-    doFunction m_doPost;
-    doFunction m_doPut;
-    doFunction m_doDelete;
+    bool m_streamBody;
+    //按method下标索引，为空时使用m_default
+    doFunction m_handlers[(int)HttpMethod::INVALID_METHOD];
     doFunction m_default;
+    doFunction m_checkHeader;
 };
 
 class NotFoundServlet : public Servlet{
 public:
     typedef std::shared_ptr<NotFoundServlet> ptr;
     NotFoundServlet(const std::string &name);
-    virtual int32_t handle(http::HttpRequest::ptr request,
-                   http::HttpResponse::ptr response,
-                   http::HttpSession::ptr session) override;
+    virtual int32_t handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session) override;
 
 private:
 };
@@ -51,36 +73,65 @@ private:
 class ServletManager{
 public:
     typedef std::shared_ptr<ServletManager> ptr;
-    typedef std::function<int32_t(http::HttpRequest::ptr request, http::HttpResponse::ptr response, http::HttpSession::ptr session)> callback;
+    typedef Servlet::doFunction callback;
     typedef RWMutex RWMutexType;
 
     ServletManager();
 
-    int32_t handle(http::HttpRequest::ptr request,
-                   http::HttpResponse::ptr response,
-                   http::HttpSession::ptr session);
+    int32_t handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session);
 
     //精准匹配
     Servlet::ptr addServlet(const std::string &uri, Servlet::ptr slt);
-    //模糊匹配
+    //模糊匹配，只有末尾一个*的glob会转换成前缀路由，其余的仍然用fnmatch
     Servlet::ptr addGlobServlet(const std::string &uri, Servlet::ptr slt); 
+    //路由匹配，如/user/:id、/static/*path，捕获的参数写入request的param
+    Servlet::ptr addRouteServlet(const std::string &uri, Servlet::ptr slt);
 
     void delServlet(const std::string &uri);
     void delGlobServlet(const std::string &uri);
+    void delRouteServlet(const std::string &uri);
 
     Servlet::ptr getServlet(const std::string &uri);
     Servlet::ptr getGlobServlet(const std::string &uri);
     
     Servlet::ptr getMatchedServlet(const std::string &uri);
+    //匹配的同时把路由参数写入request
+    Servlet::ptr getMatchedServlet(const http::HttpRequest::ptr &request);
 
 private:
+    //路由表的只读快照，修改时重新构建并整体替换，查找不需要加锁
+    //匹配顺序：精准匹配 > 路由 > glob，多个glob都匹配时和原来一样取最先添加的
+    struct Snapshot{
+        typedef std::shared_ptr<const Snapshot> ptr;
+        std::unordered_map<std::string, Servlet::ptr> datas;
+        RadixRouter router;
+        //可以转换成前缀的glob，order为在m_globs中的位置
+        RadixRouter prefixGlobs;
+        //其余的glob按添加顺序保存，first为在m_globs中的位置
+        std::vector<std::pair<size_t, std::pair<std::string, Servlet::ptr>>> globs;
+    };
+
+    //调用前需要加写锁
+    void rebuild();
+    Snapshot::ptr getSnapshot();
+    //在前缀树和fnmatch列表中取最先添加的glob
+    Servlet::ptr matchGlob(const Snapshot &snapshot, const std::string &uri) const;
+    Servlet::ptr match(const std::string &uri, RadixRouter::Params &params);
+
     RWMutexType m_mutex;
     // uri -> servlet
     std::unordered_map<std::string, Servlet::ptr> m_datas;
     // uri(/sylar/*) -> servlet
     std::vector<std::pair<std::string, Servlet::ptr>> m_globs;
+    // uri(/user/:id) -> servlet
+    std::vector<std::pair<std::string, Servlet::ptr>> m_routes;
     // 默认servlet，所有路径都没匹配到时使用
     Servlet::ptr m_default;
+
+    //只通过std::atomic_load/atomic_store访问，每个manager各自一份
+    Snapshot::ptr m_snapshot;
 };
 }
 
@@ -0,0 +1,84 @@
+#include "ws_servlet.h"
+#include "../config.h"
+#include "../log.h"
+#include <string.h>
+
+namespace server{
+namespace http{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+static server::ConfigVar<uint64_t>::ptr g_ws_ping_interval =
+    server::Config::AddData("http.ws.ping_interval", (uint64_t)(30 * 1000), "websocket ping interval(ms), 0 disables keepalive");
+
+WSServlet::WSServlet(const std::string &name)
+:Servlet(name)
+,m_pingInterval(g_ws_ping_interval->getVal()){
+
+}
+
+bool WSServlet::checkUpgrade(const HttpRequest::ptr &request, const HttpResponse::ptr &response){
+    if (request->getMethod() != HttpMethod::GET
+            || !HasToken(request->getHeaderAs<std::string>("Upgrade"), "websocket")
+            || !HasToken(request->getHeaderAs<std::string>("Connection"), "upgrade")){
+        response->setStatus(HttpStatus::UPGRADE_REQUIRED);
+        response->setHeader("Upgrade", "websocket");
+        return false;
+    }
+    if (request->getHeaderAs<std::string>("Sec-WebSocket-Version") != "13"){
+        response->setStatus(HttpStatus::UPGRADE_REQUIRED);
+        response->setHeader("Sec-WebSocket-Version", "13");
+        return false;
+    }
+    if (request->getHeaderAs<std::string>("Sec-WebSocket-Key").empty()){
+        response->setStatus(HttpStatus::BAD_REQUEST);
+        return false;
+    }
+    return true;
+}
+
+int32_t WSServlet::handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session){
+    if (!checkUpgrade(request, response)){
+        return 0;
+    }
+    response->setStatus(HttpStatus::SWITCHING_PROTOCOLS);
+    response->setHeader("Upgrade", "websocket");
+    response->setHeader("Sec-WebSocket-Accept", WSAcceptKey(request->getHeaderAs<std::string>("Sec-WebSocket-Key")));
+    //响应头已经由这里发出，HttpServer之后不再处理这个连接，直接关闭
+    response->setStream(true);
+    response->setContentLength(0);
+    response->setClose(true);
+    if (session->sendResponse(response) <= 0){
+        return -1;
+    }
+
+    Socket::ptr sock = session->getSocket();
+    //空闲的连接由keepalive断开，读超时要比两个ping周期长
+    if (m_pingInterval){
+        sock->setRecvTimeout(m_pingInterval * 3);
+    }
+    WSSession::ptr ws(new WSSession(sock, false, session->takeBuffer()));
+    ws->startKeepalive(m_pingInterval);
+    if (!m_onConnect || m_onConnect(request, ws) == 0){
+        while (WSFrameMessage::ptr msg = ws->recvMessage()){
+            if (m_onMessage && m_onMessage(request, msg, ws) != 0){
+                ws->sendClose(WSSession::NORMAL);
+                break;
+            }
+        }
+    }
+    else{
+        ws->sendClose(WSSession::GOING_AWAY);
+    }
+    ws->stopKeepalive();
+    LOG_DEBUG(g_logger) << "websocket closed code=" << ws->getCloseCode() << " " << *sock;
+    if (m_onClose){
+        m_onClose(request, ws);
+    }
+    return 0;
+}
+
+}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "servlet.h"
+#include "ws_session.h"
+#include <functional>
+#include <memory>
+
+namespace server{
+namespace http{
+
+//websocket的servlet，完成握手后在当前协程中循环读取消息，返回时连接关闭
+//不是升级请求时返回426
+class WSServlet : public Servlet{
+public:
+    typedef std::shared_ptr<WSServlet> ptr;
+    //返回非0时关闭连接
+    typedef std::function<int32_t(const HttpRequest::ptr &request, const WSSession::ptr &session)> ConnectFunction;
+    typedef std::function<int32_t(const HttpRequest::ptr &request, const WSFrameMessage::ptr &msg
+                                  , const WSSession::ptr &session)> MessageFunction;
+
+    WSServlet(const std::string &name);
+
+    virtual int32_t handle(const http::HttpRequest::ptr &request,
+                   const http::HttpResponse::ptr &response,
+                   const http::HttpSession::ptr &session) override;
+
+    void setOnConnect(ConnectFunction v) { m_onConnect = v; }
+    void setOnMessage(MessageFunction v) { m_onMessage = v; }
+    //连接关闭后调用，返回值被忽略
+    void setOnClose(ConnectFunction v) { m_onClose = v; }
+    //ping的间隔(ms)，默认为http.ws.ping_interval，0表示不发送
+    void setPingInterval(uint64_t v) { m_pingInterval = v; }
+
+private:
+    //检查升级请求，失败时设置response并返回false
+    bool checkUpgrade(const HttpRequest::ptr &request, const HttpResponse::ptr &response);
+
+    ConnectFunction m_onConnect;
+    MessageFunction m_onMessage;
+    ConnectFunction m_onClose;
+    uint64_t m_pingInterval;
+};
+
+}
+}
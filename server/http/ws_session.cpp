@@ -0,0 +1,524 @@
+#include "ws_session.h"
+#include "../config.h"
+#include "../iomanager.h"
+#include "../log.h"
+#include "../util.h"
+#include <random>
+#include <string.h>
+#include <sys/socket.h>
+
+namespace server{
+namespace http{
+
+static server::Logger::ptr g_logger = LOG_GET_LOGGER("system");
+
+static server::ConfigVar<uint32_t>::ptr g_ws_max_message_size =
+    server::Config::AddData("http.ws.max_message_size", (uint32_t)(32 * 1024 * 1024), "websocket max message size after reassembly");
+
+static server::ConfigVar<uint32_t>::ptr g_ws_max_frame_size =
+    server::Config::AddData("http.ws.max_frame_size", (uint32_t)(64 * 1024), "websocket outgoing messages larger than this are fragmented");
+
+static server::ConfigVar<uint32_t>::ptr g_ws_max_send_queue =
+    server::Config::AddData("http.ws.max_send_queue", (uint32_t)(16 * 1024 * 1024), "websocket max bytes queued per connection before it is dropped");
+
+static const char *s_ws_guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+std::string WSAcceptKey(const std::string &key){
+    std::string v = key + s_ws_guid;
+    std::string sha1 = Sha1Sum(v.c_str(), v.size());
+    return Base64Encode(sha1.c_str(), sha1.size());
+}
+
+static void RandomBytes(unsigned char *buf, size_t len){
+    static thread_local std::mt19937 s_rand(std::random_device{}() ^ (uint32_t)GetThreadId());
+    for (size_t i = 0; i < len; ++i){
+        buf[i] = (unsigned char)s_rand();
+    }
+}
+
+//按8字节异或，掩码从每帧payload的第0个字节开始循环
+static void Mask(char *data, size_t len, const unsigned char *key){
+    unsigned char kb[8] = {key[0], key[1], key[2], key[3], key[0], key[1], key[2], key[3]};
+    uint64_t k;
+    memcpy(&k, kb, 8);
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8){
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        v ^= k;
+        memcpy(data + i, &v, 8);
+    }
+    for (; i < len; ++i){
+        data[i] ^= key[i & 3];
+    }
+}
+
+WSSession::WSSession(Socket::ptr sock, bool client, const std::string &buffered, bool owner)
+:SocketStream(sock, owner)
+,m_client(client)
+,m_buffered(buffered)
+,m_bufferedOffset(0)
+,m_queueBytes(0)
+,m_sending(false)
+,m_closeSent(false)
+,m_error(false)
+,m_lastRecv(GetCurrentMS())
+,m_closeCode(ABNORMAL){
+
+}
+
+WSSession::~WSSession(){
+    stopKeepalive();
+}
+
+std::pair<HttpResult::ptr, WSSession::ptr> WSSession::Connect(const std::string &url
+                                   , uint64_t timeout_ms
+                                   , const std::map<std::string, std::string> &headers){
+    Uri::ptr uri = Uri::Create(url);
+    if (!uri){
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::INVALID_URL, nullptr, "invalid url: " + url), nullptr);
+    }
+    Address::ptr addr = uri->createAddress();
+    if (!addr){
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::INVALID_HOST, nullptr, "invalid host: " + uri->getHost()), nullptr);
+    }
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    if (!sock){
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::CREATE_SOCKET_ERROR
+                        , nullptr, "create socket fail: " + addr->toString() + " errno=" + std::to_string(errno)
+                            + " errstr=" + std::string(strerror(errno))), nullptr);
+    }
+    if (!sock->connect(addr, timeout_ms)){
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::CONNECT_FAIL, nullptr, "connect fail: " + addr->toString()), nullptr);
+    }
+    sock->setRecvTimeout(timeout_ms);
+
+    unsigned char nonce[16];
+    RandomBytes(nonce, sizeof(nonce));
+    std::string key = Base64Encode(nonce, sizeof(nonce));
+    HttpRequest::ptr req(new HttpRequest(0x11, false));
+    req->setPath(uri->getPath());
+    req->setQuery(uri->getQuery());
+    bool has_host = false;
+    for (auto& i : headers){
+        if (!has_host && strcasecmp(i.first.c_str(), "host") == 0){
+            has_host = !i.second.empty();
+        }
+        req->setHeader(i.first, i.second);
+    }
+    if (!has_host){
+        req->setHeader("Host", uri->getHost());
+    }
+    req->setHeader("Upgrade", "websocket");
+    req->setHeader("Sec-WebSocket-Key", key);
+    req->setHeader("Sec-WebSocket-Version", "13");
+
+    //握手只用到HttpConnection的收发，socket之后归WSSession所有
+    HttpConnection::ptr conn(new HttpConnection(sock, false));
+    if (conn->sendRequest(req) <= 0){
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::SEND_SOCKET_ERROR, nullptr, "send upgrade request fail errno=" + std::to_string(errno)), nullptr);
+    }
+    HttpResponse::ptr rsp = conn->recvResponseHeader(true);
+    if (!rsp){
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT, nullptr, "recv upgrade response timeout: " + addr->toString() +
+                                            " timeout_ms:" + std::to_string(timeout_ms)), nullptr);
+    }
+    if (rsp->getStatus() != HttpStatus::SWITCHING_PROTOCOLS
+            || rsp->getHeaderAs<std::string>("Sec-WebSocket-Accept") != WSAcceptKey(key)){
+        sock->close();
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::UPGRADE_FAIL, rsp, "websocket upgrade fail, status="
+                                            + std::to_string((int)rsp->getStatus())), nullptr);
+    }
+    //连接建立后读不再超时，由keepalive检测对端是否存活
+    sock->setRecvTimeout(-1);
+    WSSession::ptr ws(new WSSession(sock, true, conn->takeBuffer(), true));
+    return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok"), ws);
+}
+
+int WSSession::read(void *buf, size_t length){
+    if (m_bufferedOffset < m_buffered.size()){
+        size_t len = std::min(length, m_buffered.size() - m_bufferedOffset);
+        memcpy(buf, m_buffered.c_str() + m_bufferedOffset, len);
+        m_bufferedOffset += len;
+        if (m_bufferedOffset == m_buffered.size()){
+            std::string().swap(m_buffered);
+            m_bufferedOffset = 0;
+        }
+        return len;
+    }
+    return SocketStream::read(buf, length);
+}
+
+bool WSSession::recvFrameHead(FrameHead &head){
+    unsigned char buf[8];
+    if (readFixSize(buf, 2) <= 0){
+        return false;
+    }
+    m_lastRecv = GetCurrentMS();
+    //没有协商扩展，RSV必须为0
+    if (buf[0] & 0x70){
+        fail(PROTOCOL_ERROR);
+        return false;
+    }
+    head.fin = buf[0] & 0x80;
+    head.opcode = buf[0] & 0x0F;
+    head.masked = buf[1] & 0x80;
+    //客户端发出的帧必须有掩码，服务端发出的帧不能有
+    if (head.masked == m_client){
+        fail(PROTOCOL_ERROR);
+        return false;
+    }
+    head.length = buf[1] & 0x7F;
+    if (head.length == 126){
+        if (readFixSize(buf, 2) <= 0){
+            return false;
+        }
+        head.length = (buf[0] << 8) | buf[1];
+    }
+    else if (head.length == 127){
+        if (readFixSize(buf, 8) <= 0){
+            return false;
+        }
+        //64位长度的最高位必须为0
+        if (buf[0] & 0x80){
+            fail(PROTOCOL_ERROR);
+            return false;
+        }
+        head.length = 0;
+        for (int i = 0; i < 8; ++i){
+            head.length = (head.length << 8) | buf[i];
+        }
+    }
+    //单帧超过消息上限时不用等读payload再拒绝
+    if (head.length > g_ws_max_message_size->getVal()){
+        fail(TOO_BIG);
+        return false;
+    }
+    if (head.masked && readFixSize(head.mask, 4) <= 0){
+        return false;
+    }
+    return true;
+}
+
+//关闭帧中可以出现的关闭码：1000-1003、1007-1014是协议定义的，3000-4999留给库和应用
+static bool IsValidCloseCode(uint16_t code){
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014)
+           || (code >= 3000 && code <= 4999);
+}
+
+//TEXT消息和关闭原因必须是合法的UTF-8，拒绝过长编码、代理对和超过U+10FFFF的码点
+static bool IsValidUtf8(const char *data, size_t len){
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + len;
+    while (p < end){
+        unsigned char c = *p;
+        if (c < 0x80){
+            ++p;
+            continue;
+        }
+        size_t n;
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF){
+            n = 1;
+        }
+        else if (c >= 0xE0 && c <= 0xEF){
+            n = 2;
+            if (c == 0xE0){
+                lo = 0xA0;
+            }
+            else if (c == 0xED){
+                hi = 0x9F;
+            }
+        }
+        else if (c >= 0xF0 && c <= 0xF4){
+            n = 3;
+            if (c == 0xF0){
+                lo = 0x90;
+            }
+            else if (c == 0xF4){
+                hi = 0x8F;
+            }
+        }
+        else{
+            return false;
+        }
+        if ((size_t)(end - p) <= n || p[1] < lo || p[1] > hi){
+            return false;
+        }
+        for (size_t i = 2; i <= n; ++i){
+            if ((p[i] & 0xC0) != 0x80){
+                return false;
+            }
+        }
+        p += n + 1;
+    }
+    return true;
+}
+
+bool WSSession::recvPayload(const FrameHead &head, std::string &data){
+    size_t offset = data.size();
+    if (head.length == 0){
+        return true;
+    }
+    data.resize(offset + head.length);
+    if (readFixSize(&data[offset], head.length) <= 0){
+        return false;
+    }
+    if (head.masked){
+        Mask(&data[offset], head.length, head.mask);
+    }
+    return true;
+}
+
+WSFrameMessage::ptr WSSession::recvMessage(){
+    uint64_t max_size = g_ws_max_message_size->getVal();
+    WSFrameMessage::ptr msg;
+    FrameHead head;
+    while (recvFrameHead(head)){
+        if (head.opcode & 0x08){
+            //控制帧可以插在分片之间，本身不能分片，长度不超过125
+            if (!head.fin || head.length > 125){
+                fail(PROTOCOL_ERROR);
+                return nullptr;
+            }
+            std::string data;
+            if (!recvPayload(head, data)){
+                return nullptr;
+            }
+            if (head.opcode == WSFrameMessage::PING){
+                std::string frame;
+                appendFrame(frame, WSFrameMessage::PONG, true, data.c_str(), data.size());
+                enqueue(frame, data.size());
+                continue;
+            }
+            if (head.opcode == WSFrameMessage::PONG){
+                continue;
+            }
+            if (head.opcode == WSFrameMessage::CLOSE){
+                uint16_t code = data.size() >= 2 ? ((uint8_t)data[0] << 8) | (uint8_t)data[1] : NO_STATUS;
+                //只有1字节的payload、不能出现在帧中的关闭码和非UTF-8的原因都是协议错误，不原样回复
+                if (data.size() == 1 || (data.size() >= 2 && !IsValidCloseCode(code))
+                    || (data.size() > 2 && !IsValidUtf8(data.c_str() + 2, data.size() - 2))){
+                    fail(PROTOCOL_ERROR);
+                    return nullptr;
+                }
+                m_closeCode = code;
+                m_closeReason = data.size() > 2 ? data.substr(2) : "";
+                //回复关闭帧，已经发过时什么也不做
+                sendClose(m_closeCode == NO_STATUS ? (uint16_t)NORMAL : m_closeCode);
+                return nullptr;
+            }
+            fail(PROTOCOL_ERROR);
+            return nullptr;
+        }
+        if (head.opcode == WSFrameMessage::CONTINUE){
+            if (!msg){
+                fail(PROTOCOL_ERROR);
+                return nullptr;
+            }
+        }
+        else{
+            //上一条消息的分片还没有结束
+            if (msg || (head.opcode != WSFrameMessage::TEXT_FRAME && head.opcode != WSFrameMessage::BIN_FRAME)){
+                fail(PROTOCOL_ERROR);
+                return nullptr;
+            }
+            msg.reset(new WSFrameMessage(head.opcode));
+        }
+        //已有的数据不会超过max_size，用减法避免相加溢出
+        if (head.length > max_size - msg->getData().size()){
+            fail(TOO_BIG);
+            return nullptr;
+        }
+        if (!recvPayload(head, msg->getData())){
+            return nullptr;
+        }
+        if (head.fin){
+            if (msg->getOpcode() == WSFrameMessage::TEXT_FRAME
+                && !IsValidUtf8(msg->getData().c_str(), msg->getData().size())){
+                fail(INVALID_PAYLOAD);
+                return nullptr;
+            }
+            return msg;
+        }
+    }
+    return nullptr;
+}
+
+void WSSession::appendFrame(std::string &buf, int opcode, bool fin, const char *data, size_t len){
+    buf.push_back((char)((fin ? 0x80 : 0) | opcode));
+    unsigned char masked = m_client ? 0x80 : 0;
+    if (len < 126){
+        buf.push_back((char)(masked | len));
+    }
+    else if (len <= 0xFFFF){
+        buf.push_back((char)(masked | 126));
+        buf.push_back((char)(len >> 8));
+        buf.push_back((char)len);
+    }
+    else{
+        buf.push_back((char)(masked | 127));
+        for (int i = 7; i >= 0; --i){
+            buf.push_back((char)((uint64_t)len >> (i * 8)));
+        }
+    }
+    if (!m_client){
+        buf.append(data, len);
+        return;
+    }
+    unsigned char key[4];
+    RandomBytes(key, 4);
+    buf.append((const char *)key, 4);
+    size_t offset = buf.size();
+    buf.append(data, len);
+    Mask(&buf[offset], len, key);
+}
+
+int WSSession::sendMessage(WSFrameMessage::ptr msg){
+    return sendMessage(msg->getData(), msg->getOpcode());
+}
+
+int WSSession::sendMessage(const std::string &data, int opcode){
+    size_t frame_size = g_ws_max_frame_size->getVal();
+    if (frame_size == 0){
+        frame_size = data.size();
+    }
+    std::string frames;
+    frames.reserve(data.size() + 14 * (data.size() / (frame_size ? frame_size : 1) + 1));
+    size_t offset = 0;
+    do{
+        size_t len = std::min(frame_size, data.size() - offset);
+        appendFrame(frames, offset == 0 ? opcode : WSFrameMessage::CONTINUE
+                    , offset + len == data.size(), data.c_str() + offset, len);
+        offset += len;
+    } while (offset < data.size());
+    return enqueue(frames, data.size());
+}
+
+int WSSession::ping(const std::string &data){
+    std::string frame;
+    size_t len = std::min(data.size(), (size_t)125);
+    appendFrame(frame, WSFrameMessage::PING, true, data.c_str(), len);
+    return enqueue(frame, len);
+}
+
+int WSSession::sendClose(uint16_t code, const std::string &reason){
+    std::string payload;
+    payload.push_back((char)(code >> 8));
+    payload.push_back((char)code);
+    payload.append(reason, 0, 123);
+    std::string frame;
+    appendFrame(frame, WSFrameMessage::CLOSE, true, payload.c_str(), payload.size());
+    return enqueue(frame, payload.size(), true);
+}
+
+int WSSession::enqueue(std::string &frames, size_t length, bool close){
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_error || m_closeSent){
+            return -1;
+        }
+        if (m_queueBytes + frames.size() > g_ws_max_send_queue->getVal()){
+            //对端读得太慢，断开而不是无限制地缓存
+            m_error = true;
+            lock.unlock();
+            LOG_WARN(g_logger) << "websocket send queue overflow, queued=" << m_queueBytes
+                               << " fd=" << getSocket()->getSocket();
+            shutdown();
+            return -1;
+        }
+        m_closeSent = close;
+        m_queueBytes += frames.size();
+        m_queue.push_back(std::move(frames));
+        //其他协程正在发送，会把这些帧一起发出
+        if (m_sending){
+            return length;
+        }
+        m_sending = true;
+    }
+
+    std::vector<std::string> sending;
+    std::vector<iovec> iovs;
+    while (true){
+        size_t bytes = 0;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_queue.empty() || m_error){
+                m_sending = false;
+                return m_error ? -1 : length;
+            }
+            sending.clear();
+            while (!m_queue.empty()){
+                sending.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+        }
+        iovs.clear();
+        for (auto& i : sending){
+            iovec iov;
+            iov.iov_base = (void *)i.c_str();
+            iov.iov_len = i.size();
+            iovs.push_back(iov);
+            bytes += i.size();
+        }
+        int rt = writevFixSize(&iovs[0], iovs.size());
+        MutexType::Lock lock(m_mutex);
+        m_queueBytes -= bytes;
+        if (rt <= 0){
+            m_error = true;
+            m_queue.clear();
+            m_queueBytes = 0;
+            m_sending = false;
+            return -1;
+        }
+    }
+}
+
+void WSSession::fail(uint16_t code){
+    LOG_DEBUG(g_logger) << "websocket fail code=" << code << " fd=" << getSocket()->getSocket();
+    sendClose(code);
+    shutdown();
+}
+
+void WSSession::shutdown(){
+    //唤醒阻塞在读写上的协程，socket由所有者关闭
+    Socket::ptr sock = getSocket();
+    if (sock && sock->isValid()){
+        ::shutdown(sock->getSocket(), SHUT_RDWR);
+    }
+}
+
+void WSSession::startKeepalive(uint64_t interval_ms){
+    IOManager *iom = IOManager::GetThis();
+    if (interval_ms == 0 || !iom){
+        return;
+    }
+    stopKeepalive();
+    MutexType::Lock lock(m_mutex);
+    m_keepaliveTimer = iom->addConditionTimer(interval_ms, std::bind(&WSSession::onKeepalive, this, interval_ms)
+                                              , std::weak_ptr<WSSession>(shared_from_this()), true);
+}
+
+void WSSession::stopKeepalive(){
+    Timer::ptr timer;
+    {
+        MutexType::Lock lock(m_mutex);
+        timer.swap(m_keepaliveTimer);
+    }
+    if (timer){
+        timer->getManager()->cancel(timer);
+    }
+}
+
+void WSSession::onKeepalive(uint64_t interval_ms){
+    if (GetCurrentMS() - m_lastRecv > interval_ms * 2){
+        LOG_INFO(g_logger) << "websocket keepalive timeout fd=" << getSocket()->getSocket();
+        stopKeepalive();
+        shutdown();
+        return;
+    }
+    ping();
+}
+
+}
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "../socket_stream.h"
+#include "../mutex.h"
+#include "../timer.h"
+#include "http_connection.h"
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace server{
+namespace http{
+
+//Sec-WebSocket-Key对应的Sec-WebSocket-Accept
+std::string WSAcceptKey(const std::string &key);
+
+//websocket的一条完整消息，分片的数据帧已经拼接好
+class WSFrameMessage{
+public:
+    typedef std::shared_ptr<WSFrameMessage> ptr;
+
+    enum OPCODE
+    {
+        CONTINUE = 0,
+        TEXT_FRAME = 1,
+        BIN_FRAME = 2,
+        CLOSE = 8,
+        PING = 9,
+        PONG = 0xA,
+    };
+
+    WSFrameMessage(int opcode = TEXT_FRAME, const std::string &data = "")
+        :m_opcode(opcode), m_data(data){}
+
+    int getOpcode() const { return m_opcode; }
+    void setOpcode(int v) { m_opcode = v; }
+    const std::string &getData() const { return m_data; }
+    std::string &getData() { return m_data; }
+    void setData(const std::string &v) { m_data = v; }
+
+private:
+    int m_opcode;
+    std::string m_data;
+};
+
+//握手完成后的websocket连接，服务端和客户端共用
+//读只能在一个协程中进行，写可以在任意协程中调用：帧先放入发送队列，由当前没有在发送的调用者依次写出
+class WSSession : public SocketStream, public std::enable_shared_from_this<WSSession>{
+public:
+    typedef std::shared_ptr<WSSession> ptr;
+    typedef Mutex MutexType;
+
+    //关闭码
+    enum CloseCode
+    {
+        NORMAL = 1000,
+        GOING_AWAY = 1001,
+        PROTOCOL_ERROR = 1002,
+        UNSUPPORTED_DATA = 1003,
+        NO_STATUS = 1005,
+        ABNORMAL = 1006,
+        INVALID_PAYLOAD = 1007,
+        TOO_BIG = 1009,
+    };
+
+    //client为true时发出的帧要加掩码，收到的帧不能有掩码，服务端相反
+    //buffered为握手时多读的数据，会在socket之前被读取
+    WSSession(Socket::ptr sock, bool client, const std::string &buffered = "", bool owner = false);
+    ~WSSession();
+
+    //客户端握手，成功时HttpResult为OK，response为101响应
+    static std::pair<HttpResult::ptr, WSSession::ptr> Connect(const std::string &url
+                                   , uint64_t timeout_ms
+                                   , const std::map<std::string, std::string> &headers = {});
+
+    //读取下一条数据消息，ping/pong/close在内部处理，返回nullptr表示连接已经关闭或者出错
+    WSFrameMessage::ptr recvMessage();
+
+    //返回放入发送队列的字节数，连接已关闭或者发送队列超过http.ws.max_send_queue返回-1
+    //超过http.ws.max_frame_size的消息拆成多个分片发送
+    int sendMessage(WSFrameMessage::ptr msg);
+    int sendMessage(const std::string &data, int opcode = WSFrameMessage::TEXT_FRAME);
+    int ping(const std::string &data = "");
+    //发送关闭帧，之后不能再发送，对端回复关闭帧后recvMessage返回nullptr
+    int sendClose(uint16_t code = NORMAL, const std::string &reason = "");
+
+    //每interval_ms发送一次ping，超过两个周期没有收到任何数据就断开连接，0表示不检测
+    void startKeepalive(uint64_t interval_ms);
+    void stopKeepalive();
+
+    //对端发来的关闭码，没有收到关闭帧时为ABNORMAL
+    uint16_t getCloseCode() const { return m_closeCode; }
+    const std::string &getCloseReason() const { return m_closeReason; }
+    bool isClient() const { return m_client; }
+    uint64_t getLastRecvTime() const { return m_lastRecv; }
+
+    //先返回握手时多读的数据
+    virtual int read(void *buf, size_t length) override;
+
+private:
+    struct FrameHead{
+        bool fin;
+        int opcode;
+        uint64_t length;
+        bool masked;
+        unsigned char mask[4];
+    };
+
+    bool recvFrameHead(FrameHead &head);
+    bool recvPayload(const FrameHead &head, std::string &data);
+    //把一帧追加到buf，client时对数据加掩码
+    void appendFrame(std::string &buf, int opcode, bool fin, const char *data, size_t len);
+    //frames中的帧作为一个整体放入发送队列，中间不会插入其他帧，close为true表示这是关闭帧
+    int enqueue(std::string &frames, size_t length, bool close = false);
+    //协议错误时发送关闭帧并断开
+    void fail(uint16_t code);
+    void onKeepalive(uint64_t interval_ms);
+    void shutdown();
+
+    bool m_client;
+    std::string m_buffered;
+    size_t m_bufferedOffset;
+
+    MutexType m_mutex;
+    std::deque<std::string> m_queue;
+    size_t m_queueBytes;
+    bool m_sending;
+    bool m_closeSent;
+    bool m_error;
+
+    std::atomic<uint64_t> m_lastRecv;
+    uint16_t m_closeCode;
+    std::string m_closeReason;
+    Timer::ptr m_keepaliveTimer;
+};
+
+}
+}
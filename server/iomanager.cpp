@@ -312,6 +312,10 @@ void IOManager::idle(){
                 next_timeout = MAX_TIMEOUT;
             }
 
+            //执行满frequency个任务后进入idle只是为了处理一次IO事件，队列中还有任务时不能阻塞
+            if (hasPendingTasks()){
+                next_timeout = 0;
+            }
             rt = epoll_wait(m_epfd, events, 64, (int)next_timeout);
             //LOG_INFO(g_logger) << "epoll_wait rt=" << rt;
             if (rt < 0 && errno == EINTR){
@@ -341,8 +345,9 @@ void IOManager::idle(){
 
             FdContext *fd_ctx = (FdContext*)event.data.ptr;
             FdContext::MutexType::Lock lock(fd_ctx->mutex);
+            //出错时只唤醒已经注册的事件，否则会触发没有注册的事件
             if (event.events & (EPOLLERR | EPOLLHUP)){
-                event.events |= EPOLLIN | EPOLLOUT;
+                event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
             }
             int real_event = NONE;
             if (event.events & EPOLLIN){
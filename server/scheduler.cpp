@@ -226,6 +226,11 @@ Scheduler *Scheduler::GetThis(){
     return t_scheduler;
 }
 
+bool Scheduler::hasPendingTasks(){
+    MutexType::Lock lock(m_mutex);
+    return !fiberQueue.empty();
+}
+
 //通知各线程退出idle
 void Scheduler::tickle(){
     LOG_INFO(g_logger) << "tickle";
@@ -93,6 +93,8 @@ protected:
     virtual bool stopping();
 
     bool hasIdleThreads() { return wait_threads > 0; };
+    //队列中是否还有等待执行的任务
+    bool hasPendingTasks();
 
 private:
     std::vector<FiberAndCb> fiberQueue; //Fiber队列
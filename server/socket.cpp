@@ -2,6 +2,7 @@
 
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 
 namespace server{
 
@@ -14,6 +15,9 @@ Socket::ptr Socket::CreateTCP(server::Address::ptr address){
 
 Socket::ptr Socket::CreateUDP(server::Address::ptr address){
     Socket::ptr sock(new Socket(address->getFamily(), UDP, 0));
+    //UDP不需要connect，创建后就可以sendTo/recvFrom
+    sock->newSock();
+    sock->m_isConnected = true;
     return sock;
 }
 
@@ -24,6 +28,8 @@ Socket::ptr Socket::CreateTCPSocket(){
 
 Socket::ptr Socket::CreateUDPSocket(){
     Socket::ptr sock(new Socket(IPv4, UDP, 0));
+    sock->newSock();
+    sock->m_isConnected = true;
     return sock;
 }
 
@@ -34,6 +40,8 @@ Socket::ptr Socket::CreateTCPSocket6(){
 
 Socket::ptr Socket::CreateUDPSocket6(){
     Socket::ptr sock(new Socket(IPv6, UDP, 0));
+    sock->newSock();
+    sock->m_isConnected = true;
     return sock;
 }
 
@@ -237,6 +245,13 @@ int Socket::send(const iovec *buffers, size_t length, int flags){
     return -1;
 }
     
+int Socket::sendFile(int fd, off_t *offset, size_t count){
+    if (isConnected()){
+        return ::sendfile(m_sock, fd, offset, count);
+    }
+    return -1;
+}
+
 int Socket::sendTo(const void *buffer, size_t length, const Address::ptr to, int flags){
     if (isConnected()){
         return ::sendto(m_sock, buffer, length, flags, to->getAddr(), to->getAddrLen());
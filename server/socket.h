@@ -72,6 +72,8 @@ public:
 
     int send(const void *buffer, size_t length, int flags = 0);
     int send(const iovec *buffers, size_t length, int flags = 0);
+    //用sendfile把文件fd中从offset开始的count字节发送出去，offset会被更新
+    int sendFile(int fd, off_t *offset, size_t count);
     int sendTo(const void *buffer, size_t length, const Address::ptr to, int flags = 0);
     int sendTo(const iovec *buffers, size_t length, const Address::ptr to, int flags = 0);
 
@@ -53,6 +53,54 @@ int SocketStream::write(ByteArray::ptr ba, size_t length){
     return rt;
 }
 
+int SocketStream::writev(const iovec *iovs, size_t count){
+    if (!isConnected()){
+        return -1;
+    }
+    return m_socket->send(iovs, count);
+}
+
+int SocketStream::writevFixSize(iovec *iovs, size_t count){
+    size_t total = 0;
+    while (count > 0){
+        int len = writev(iovs, count);
+        if (len <= 0){
+            return len;
+        }
+        total += len;
+        //跳过已经发送完的iovec，调整发送了一半的iovec
+        size_t left = len;
+        while (count > 0 && left >= iovs->iov_len){
+            left -= iovs->iov_len;
+            ++iovs;
+            --count;
+        }
+        if (count > 0){
+            iovs->iov_base = (char *)iovs->iov_base + left;
+            iovs->iov_len -= left;
+        }
+    }
+    return total;
+}
+
+int64_t SocketStream::sendFile(int fd, uint64_t offset, uint64_t length){
+    if (!isConnected()){
+        return -1;
+    }
+    off_t off = offset;
+    uint64_t left = length;
+    while (left > 0){
+        //单次最多发送1G，保证返回值不溢出int
+        size_t count = left > (1u << 30) ? (1u << 30) : left;
+        int rt = m_socket->sendFile(fd, &off, count);
+        if (rt <= 0){
+            return rt;
+        }
+        left -= rt;
+    }
+    return length;
+}
+
 void SocketStream::close(){
     if (m_socket){
         m_socket->close();
@@ -18,6 +18,13 @@ public:
     virtual int write(ByteArray::ptr ba, size_t length) override;
     virtual void close() override;
 
+    //一次sendmsg发送多个iovec，返回实际发送的字节数
+    int writev(const iovec *iovs, size_t count);
+    //循环发送直到iovs全部发完，会修改iovs的内容
+    virtual int writevFixSize(iovec *iovs, size_t count);
+    //用sendfile发送文件fd中[offset, offset+length)的内容，发完返回length
+    int64_t sendFile(int fd, uint64_t offset, uint64_t length);
+
     Socket::ptr getSocket() const { return m_socket; }
     bool isConnected() const { return m_socket && m_socket->isConnected(); }
 
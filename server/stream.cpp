@@ -5,7 +5,7 @@ int Stream::readFixSize(void *buf, size_t length){
     size_t offset = 0;
     size_t left = length;
     while (left > 0){
-        size_t len = read((char *)buf + offset, left);
+        int len = read((char *)buf + offset, left);
         if (len <= 0){
             return len;
         }
@@ -18,7 +18,7 @@ int Stream::readFixSize(void *buf, size_t length){
 int Stream::readFixSize(ByteArray::ptr ba, size_t length){
     size_t left = length;
     while (left > 0){
-        size_t len = read(ba, left);
+        int len = read(ba, left);
         if (len <= 0){
             return len;
         }
@@ -31,7 +31,7 @@ int Stream::writeFixSize(const void *buffer, size_t length){
     size_t offset = 0;
     size_t left = length;
     while (left > 0){
-        size_t len = write((const char*)buffer + offset, left);
+        int len = write((const char*)buffer + offset, left);
         if (len <= 0){
             return len;
         }
@@ -44,7 +44,7 @@ int Stream::writeFixSize(const void *buffer, size_t length){
 int Stream::writeFixSize(ByteArray::ptr ba, size_t length){
     size_t left = length;
     while (left > 0){
-        size_t len = write(ba, left);
+        int len = write(ba, left);
         if (len <= 0){
             return len;
         }
@@ -31,8 +31,8 @@ protected:
 
 private:
     std::vector<Socket::ptr> m_socks;
-    IOManager::ptr m_worker;
-    IOManager::ptr m_acceptWorker;
+    IOManager *m_worker;
+    IOManager *m_acceptWorker;
     uint64_t m_recvTimeout;
     std::string m_name;
     bool m_isStop;
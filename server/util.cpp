@@ -1,6 +1,7 @@
 #include "util.h"
 #include "fiber.h"
 #include <sys/time.h>
+#include <string.h>
 
 namespace server{
 
@@ -23,4 +24,151 @@ uint64_t GetCurrentUS(){
     gettimeofday(&tv, NULL);
     return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
 }
+
+std::string Base64Encode(const void *data, size_t len){
+    static const char *table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const unsigned char *src = (const unsigned char *)data;
+    std::string ret;
+    ret.reserve((len + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3){
+        uint32_t v = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+        ret.push_back(table[(v >> 18) & 0x3F]);
+        ret.push_back(table[(v >> 12) & 0x3F]);
+        ret.push_back(table[(v >> 6) & 0x3F]);
+        ret.push_back(table[v & 0x3F]);
+    }
+    if (i < len){
+        uint32_t v = src[i] << 16;
+        if (i + 1 < len){
+            v |= src[i + 1] << 8;
+        }
+        ret.push_back(table[(v >> 18) & 0x3F]);
+        ret.push_back(table[(v >> 12) & 0x3F]);
+        ret.push_back(i + 1 < len ? table[(v >> 6) & 0x3F] : '=');
+        ret.push_back('=');
+    }
+    return ret;
+}
+
+bool Base64Decode(const std::string &src, std::string &out){
+    out.clear();
+    out.reserve(src.size() / 4 * 3 + 2);
+    uint32_t v = 0;
+    int bits = 0;
+    size_t i = 0;
+    for (; i < src.size() && src[i] != '='; ++i){
+        char c = src[i];
+        int d = 0;
+        if (c >= 'A' && c <= 'Z'){
+            d = c - 'A';
+        }
+        else if (c >= 'a' && c <= 'z'){
+            d = c - 'a' + 26;
+        }
+        else if (c >= '0' && c <= '9'){
+            d = c - '0' + 52;
+        }
+        else if (c == '+' || c == '-'){
+            d = 62;
+        }
+        else if (c == '/' || c == '_'){
+            d = 63;
+        }
+        else{
+            return false;
+        }
+        v = (v << 6) | d;
+        bits += 6;
+        if (bits >= 8){
+            bits -= 8;
+            out.push_back((char)(v >> bits));
+        }
+    }
+    //剩余的不足8位必须是0，之后只能是填充
+    if (bits >= 6 || (v & ((1u << bits) - 1))){
+        return false;
+    }
+    for (; i < src.size(); ++i){
+        if (src[i] != '='){
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline uint32_t Rol(uint32_t v, int n){
+    return (v << n) | (v >> (32 - n));
+}
+
+static void Sha1Block(uint32_t *h, const unsigned char *block){
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i){
+        w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i){
+        w[i] = Rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i){
+        uint32_t f, k;
+        if (i < 20){
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40){
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60){
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else{
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t t = Rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = Rol(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+std::string Sha1Sum(const void *data, size_t len){
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    const unsigned char *src = (const unsigned char *)data;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64){
+        Sha1Block(h, src + i);
+    }
+    //最后不足一块的数据加上0x80、补0和64位的长度(bit)
+    unsigned char tail[128] = {0};
+    size_t left = len - i;
+    memcpy(tail, src + i, left);
+    tail[left] = 0x80;
+    size_t tail_len = left + 1 + 8 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int j = 0; j < 8; ++j){
+        tail[tail_len - 1 - j] = (unsigned char)(bits >> (j * 8));
+    }
+    for (size_t j = 0; j < tail_len; j += 64){
+        Sha1Block(h, tail + j);
+    }
+    std::string ret(20, '\0');
+    for (int j = 0; j < 5; ++j){
+        ret[j * 4] = (char)(h[j] >> 24);
+        ret[j * 4 + 1] = (char)(h[j] >> 16);
+        ret[j * 4 + 2] = (char)(h[j] >> 8);
+        ret[j * 4 + 3] = (char)h[j];
+    }
+    return ret;
+}
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <string>
 #include <zconf.h>
 #include <sys/syscall.h>
 
@@ -14,6 +15,14 @@ uint64_t GetCurrentMS();
 
 uint64_t GetCurrentUS();
 
+//标准的base64编码（带=填充）
+std::string Base64Encode(const void *data, size_t len);
+//同时接受标准和url安全的字母表，填充可以省略，不合法时返回false
+bool Base64Decode(const std::string &src, std::string &out);
+
+//SHA-1摘要，返回20字节的原始数据
+std::string Sha1Sum(const void *data, size_t len);
+
 class MallocStackAllocator{
 public:
     static void* Alloc(size_t size){
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../server/log.h"
+#include <iostream>
+#include <stdlib.h>
+
+//测试中的检查，失败时记录日志后abort，进程以非0退出，跑测试时不会被当成通过
+#define CHECK(x)                                        \
+    do{                                                 \
+        if (!(x)){                                      \
+            LOG_ERROR(LOG_ROOT()) << "CHECK FAIL: " #x; \
+            std::cout.flush();                          \
+            abort();                                    \
+        }                                               \
+    }while (0)
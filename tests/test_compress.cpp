@@ -0,0 +1,302 @@
+#include "../server/http/http_server.h"
+#include "../server/http/http_connection.h"
+#include "../server/http/cache_servlet.h"
+#include "../server/http/file_servlet.h"
+#include "../server/http/compress.h"
+#include "../server/config.h"
+#include "../server/iomanager.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <algorithm>
+#include <fstream>
+#include <unistd.h>
+#include <zlib.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static const std::string URL = "http://127.0.0.1:8070";
+
+//gzip和zlib格式都可以解压
+static std::string Inflate(const std::string &data){
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 32) != Z_OK){
+        return "";
+    }
+    std::string out;
+    char buf[16384];
+    zs.next_in = (Bytef *)data.c_str();
+    zs.avail_in = data.size();
+    int rt = Z_OK;
+    while (rt == Z_OK){
+        zs.next_out = (Bytef *)buf;
+        zs.avail_out = sizeof(buf);
+        rt = inflate(&zs, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - zs.avail_out);
+    }
+    inflateEnd(&zs);
+    return rt == Z_STREAM_END ? out : "";
+}
+
+//类似真实的页面，有重复也有变化
+static std::string MakeText(size_t size){
+    std::string text;
+    int i = 0;
+    while (text.size() < size){
+        text += "<div class=\"item\" id=\"item-" + std::to_string(i) + "\">value " + std::to_string(i * 7919 % 1000) + "</div>\n";
+        ++i;
+    }
+    text.resize(size);
+    return text;
+}
+
+static server::http::HttpResult::ptr Get(const std::string &path, const std::string &accept
+                                         , std::map<std::string, std::string> headers = {}){
+    if (!accept.empty()){
+        headers["Accept-Encoding"] = accept;
+    }
+    return server::http::HttpConnection::DoGet(URL + path, 1000, headers);
+}
+
+//发送原始请求，读到对端关闭为止，返回小写方便比较
+static std::string RawRequest(const std::string &req){
+    server::Address::ptr addr = server::Address::LookupAnyIPAddress("127.0.0.1:8070");
+    server::Socket::ptr sock = server::Socket::CreateTCP(addr);
+    sock->connect(addr);
+    sock->setRecvTimeout(1000);
+    sock->send(req.c_str(), req.size());
+    std::string buf;
+    char tmp[4096];
+    int rt = 0;
+    while ((rt = sock->recv(tmp, sizeof(tmp))) > 0){
+        buf.append(tmp, rt);
+    }
+    std::transform(buf.begin(), buf.end(), buf.begin(), ::tolower);
+    return buf;
+}
+
+//HEAD请求没有body，直接读原始响应头
+static std::string Head(const std::string &path, const std::string &accept){
+    std::string req = "HEAD " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n";
+    if (!accept.empty()){
+        req += "Accept-Encoding: " + accept + "\r\n";
+    }
+    return RawRequest(req + "\r\n");
+}
+
+static std::string Encoding(const server::http::HttpResult::ptr &r){
+    return r->response ? r->response->getHeaderAs<std::string>("Content-Encoding") : "";
+}
+
+void test_negotiate(){
+    using server::http::ContentEncoding;
+    using server::http::NegotiateEncoding;
+    CHECK(NegotiateEncoding("") == ContentEncoding::IDENTITY);
+    CHECK(NegotiateEncoding("gzip, deflate, br") == ContentEncoding::GZIP);
+    CHECK(NegotiateEncoding("deflate") == ContentEncoding::DEFLATE);
+    CHECK(NegotiateEncoding("gzip;q=0.5, deflate;q=0.8") == ContentEncoding::DEFLATE);
+    CHECK(NegotiateEncoding("gzip;q=0, deflate;q=0") == ContentEncoding::IDENTITY);
+    CHECK(NegotiateEncoding("*") == ContentEncoding::GZIP);
+    CHECK(NegotiateEncoding("*;q=0, identity") == ContentEncoding::IDENTITY);
+    CHECK(NegotiateEncoding("br, *;q=0.1") == ContentEncoding::GZIP);
+    CHECK(NegotiateEncoding("X-GZIP") == ContentEncoding::GZIP);
+
+    CHECK(server::http::IsCompressibleType("text/html; charset=utf-8"));
+    CHECK(server::http::IsCompressibleType("Application/JSON"));
+    CHECK(!server::http::IsCompressibleType("image/png"));
+    CHECK(!server::http::IsCompressibleType("text/htmlx"));
+
+    //流式压缩的每次flush都可以单独解压
+    std::string text = MakeText(100000);
+    auto compressor = server::http::Compressor::Create(ContentEncoding::GZIP);
+    std::string out;
+    for (size_t i = 0; i < text.size(); i += 10000){
+        compressor->write(text.c_str() + i, 10000, out, true);
+    }
+    compressor->finish(out);
+    CHECK(Inflate(out) == text);
+    std::string once;
+    CHECK(server::http::Compress(ContentEncoding::DEFLATE, text.c_str(), text.size(), once) && Inflate(once) == text);
+}
+
+void run(){
+    test_negotiate();
+
+    server::http::HttpServer::ptr server(new server::http::HttpServer(true));
+    while (!server->bind(server::Address::LookupAnyIPAddress("127.0.0.1:8070"))){
+        sleep(1);
+    }
+    server->start();
+    auto mgr = server->getServletManager();
+
+    static const std::string TEXT = MakeText(64 * 1024);
+    //路径为/text、/text/small、/text/png
+    auto text = mgr->addGlobServlet("/text*", server::http::Servlet::ptr(new server::http::Servlet("text")));
+    text->setGet([](const server::http::HttpRequest::ptr &req,
+                    const server::http::HttpResponse::ptr &rsp,
+                    const server::http::HttpSession::ptr &session){
+        rsp->setHeader("Content-Type", req->getPath() == "/text/png" ? "image/png" : "text/html");
+        rsp->setBody(req->getPath() == "/text/small" ? TEXT.substr(0, 100) : TEXT);
+        return 0;
+    });
+    auto stream = mgr->addServlet("/stream", server::http::Servlet::ptr(new server::http::Servlet("stream")));
+    stream->setGet([](const server::http::HttpRequest::ptr &req,
+                      const server::http::HttpResponse::ptr &rsp,
+                      const server::http::HttpSession::ptr &session){
+        rsp->setHeader("Content-Type", "application/json");
+        auto out = session->startStream(rsp);
+        for (size_t i = 0; i < TEXT.size(); i += 4096){
+            out->write(TEXT.c_str() + i, std::min((size_t)4096, TEXT.size() - i));
+        }
+        out->close();
+        return 0;
+    });
+    static int s_count = 0;
+    auto inner = server::http::Servlet::ptr(new server::http::Servlet("inner"));
+    inner->setGet([](const server::http::HttpRequest::ptr &req,
+                     const server::http::HttpResponse::ptr &rsp,
+                     const server::http::HttpSession::ptr &session){
+        ++s_count;
+        rsp->setHeader("Content-Type", "text/plain");
+        rsp->setBody(TEXT);
+        return 0;
+    });
+    server::http::CacheServlet::ptr cache(new server::http::CacheServlet(inner, 10000));
+    mgr->addServlet("/cached", cache);
+    {
+        std::ofstream ofs("/tmp/test_compress.html");
+        ofs << TEXT;
+    }
+    {
+        std::ofstream ofs("/tmp/test_compress.png");
+        ofs << TEXT;
+    }
+    mgr->addGlobServlet("/static/*", server::http::FileServlet::ptr(new server::http::FileServlet("/tmp", "/static")));
+
+    //协商
+    auto r = Get("/text", "gzip, deflate");
+    CHECK(Encoding(r) == "gzip" && Inflate(r->response->getBody()) == TEXT);
+    CHECK(r->response->getHeaderAs<std::string>("Vary") == "Accept-Encoding");
+    r = Get("/text", "deflate");
+    CHECK(Encoding(r) == "deflate" && Inflate(r->response->getBody()) == TEXT);
+    r = Get("/text", "");
+    CHECK(Encoding(r).empty() && r->response->getBody() == TEXT);
+    //小于http.gzip.min_size和不在类型列表中的不压缩
+    r = Get("/text/small", "gzip");
+    CHECK(Encoding(r).empty() && r->response->getBody().size() == 100);
+    r = Get("/text/png", "gzip");
+    CHECK(Encoding(r).empty() && r->response->getBody() == TEXT);
+
+    //流式响应边写边压缩
+    r = Get("/stream", "gzip");
+    CHECK(Encoding(r) == "gzip" && Inflate(r->response->getBody()) == TEXT);
+    r = Get("/stream", "");
+    CHECK(Encoding(r).empty() && r->response->getBody() == TEXT);
+
+    //缓存的响应每种编码只压缩一次
+    r = Get("/cached", "gzip");
+    CHECK(Encoding(r) == "gzip" && Inflate(r->response->getBody()) == TEXT);
+    uint64_t bytes = cache->getCacheBytes();
+    r = Get("/cached", "gzip");
+    CHECK(Encoding(r) == "gzip" && Inflate(r->response->getBody()) == TEXT);
+    CHECK(cache->getCacheBytes() == bytes);
+    r = Get("/cached", "");
+    CHECK(Encoding(r).empty() && r->response->getBody() == TEXT);
+    CHECK(r->response->getHeaderAs<std::string>("Vary") == "Accept-Encoding");
+    r = Get("/cached", "deflate");
+    CHECK(Encoding(r) == "deflate" && Inflate(r->response->getBody()) == TEXT);
+    CHECK(s_count == 1 && cache->getCacheBytes() > bytes);
+    //缓存的响应使用当前请求的版本和当前的Date
+    std::string raw = RawRequest("GET /cached HTTP/1.0\r\nHost: 127.0.0.1\r\n\r\n");
+    CHECK(raw.compare(0, 17, "http/1.0 200 ok\r\n") == 0);
+    CHECK(raw.find("\r\ndate: ") != std::string::npos && raw.find("\r\ndate: ", raw.find("\r\ndate: ") + 1) == std::string::npos);
+    CHECK(raw.find("connection: close\r\n") != std::string::npos);
+    CHECK(s_count == 1);
+    raw = RawRequest("GET /cached HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+    CHECK(raw.compare(0, 17, "http/1.1 200 ok\r\n") == 0 && raw.find("\r\ndate: ") != std::string::npos);
+    CHECK(raw.size() > TEXT.size() && raw.find("content-length: " + std::to_string(TEXT.size()) + "\r\n") != std::string::npos);
+    CHECK(s_count == 1);
+    //过期的entry即使不再被访问，也会在之后的请求中删除
+    server::http::CacheServlet::ptr short_cache(new server::http::CacheServlet(inner, 500));
+    mgr->addGlobServlet("/short/*", short_cache);
+    Get("/short/a", "");
+    Get("/short/b", "");
+    CHECK(short_cache->getCacheCount() == 2);
+    usleep(600 * 1000);
+    Get("/short/c", "");
+    CHECK(short_cache->getCacheCount() == 1);
+
+    //静态文件
+    r = Get("/static/test_compress.html", "gzip");
+    CHECK(Encoding(r) == "gzip" && Inflate(r->response->getBody()) == TEXT);
+    std::string etag = r->response->getHeaderAs<std::string>("ETag");
+    CHECK(etag.find("-gzip\"") != std::string::npos);
+    r = Get("/static/test_compress.html", "gzip", {{"If-None-Match", etag}});
+    CHECK(r->response && r->response->getStatus() == server::http::HttpStatus::NOT_MODIFIED);
+    r = Get("/static/test_compress.html", "");
+    CHECK(Encoding(r).empty() && r->response->getBody() == TEXT);
+    CHECK(r->response->getHeaderAs<std::string>("ETag") != etag);
+    CHECK(r->response->getHeaderAs<std::string>("Vary") == "Accept-Encoding");
+    //Range按原始内容计算
+    r = Get("/static/test_compress.html", "gzip", {{"Range", "bytes=0-99"}});
+    CHECK(Encoding(r).empty() && r->response->getBody() == TEXT.substr(0, 100));
+    r = Get("/static/test_compress.png", "gzip");
+    CHECK(Encoding(r).empty() && r->response->getBody() == TEXT);
+    //HEAD不触发压缩：没有缓存的压缩版本时按原始内容回复，缓存之后回复压缩后的长度
+    std::string head = Head("/static/test_compress.html", "deflate");
+    CHECK(head.find("content-length: " + std::to_string(TEXT.size()) + "\r\n") != std::string::npos);
+    CHECK(head.find("content-encoding") == std::string::npos);
+    r = Get("/static/test_compress.html", "deflate");
+    CHECK(Encoding(r) == "deflate");
+    head = Head("/static/test_compress.html", "deflate");
+    CHECK(head.find("content-length: " + std::to_string(r->response->getBody().size()) + "\r\n") != std::string::npos);
+    CHECK(head.find("content-encoding: deflate\r\n") != std::string::npos);
+
+    //缓存满时淘汰最久没有访问的文件：a、b、a、c之后淘汰b
+    server::Config::Lookup<uint32_t>("http.file.cache_size")->setVal(2);
+    server::Config::Lookup<uint32_t>("http.file.check_interval")->setVal(100000);
+    mgr->addGlobServlet("/lru/*", server::http::FileServlet::ptr(new server::http::FileServlet("/tmp", "/lru")));
+    for (auto name : {"a", "b", "a", "c"}){
+        std::ofstream(std::string("/tmp/test_compress_lru_") + name + ".txt") << name;
+        r = Get(std::string("/lru/test_compress_lru_") + name + ".txt", "");
+        CHECK(r->response && r->response->getBody() == name);
+        usleep(2000);
+    }
+    for (auto name : {"a", "b", "c"}){
+        unlink((std::string("/tmp/test_compress_lru_") + name + ".txt").c_str());
+    }
+    r = Get("/lru/test_compress_lru_a.txt", "");
+    CHECK(r->response && r->response->getStatus() == server::http::HttpStatus::OK && r->response->getBody() == "a");
+    r = Get("/lru/test_compress_lru_b.txt", "");
+    CHECK(r->response && r->response->getStatus() == server::http::HttpStatus::NOT_FOUND);
+    r = Get("/lru/test_compress_lru_c.txt", "");
+    CHECK(r->response && r->response->getStatus() == server::http::HttpStatus::OK && r->response->getBody() == "c");
+
+    //带宽和耗时
+    const int ROUNDS = 2000;
+    const char *paths[] = {"/static/test_compress.html", "/cached", "/text"};
+    for (auto path : paths){
+        for (auto accept : {"", "gzip"}){
+            uint64_t wire = 0;
+            uint64_t start = server::GetCurrentUS();
+            for (int i = 0; i < ROUNDS; ++i){
+                auto rsp = Get(path, accept);
+                if (!rsp->response){
+                    break;
+                }
+                wire += rsp->response->getBody().size();
+            }
+            uint64_t us = server::GetCurrentUS() - start;
+            LOG_INFO(g_logger) << path << " accept=" << (*accept ? accept : "identity")
+                               << " body_bytes=" << wire / ROUNDS << " qps=" << ROUNDS * 1000000.0 / us;
+        }
+    }
+    LOG_INFO(g_logger) << "test_compress done";
+}
+
+int main(int argc, char **argv){
+    server::IOManager iom(2);
+    iom.scheduler(run);
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include "../server/config.h"
+#include "../server/dns.h"
+#include "../server/iomanager.h"
+#include "../server/log.h"
+#include "../server/socket.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <fstream>
+#include <string.h>
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static int s_queries = 0;
+
+//本地的DNS桩服务器：a.test返回两个A记录，ttl.test的TTL为1s，v6.test只有AAAA，其他返回NXDOMAIN
+void stub_server(server::Socket::ptr sock){
+    uint8_t buf[512];
+    while (true){
+        server::Address::ptr from(new server::IPv4Address);
+        int rt = sock->recvFrom(buf, sizeof(buf), from);
+        if (rt <= 12){
+            sock->close();
+            break;
+        }
+        ++s_queries;
+        //解析QNAME
+        std::string name;
+        size_t pos = 12;
+        while (pos < (size_t)rt && buf[pos]){
+            if (!name.empty()){
+                name.push_back('.');
+            }
+            name.append((char *)buf + pos + 1, buf[pos]);
+            pos += buf[pos] + 1;
+        }
+        pos += 1;
+        uint16_t qtype = (buf[pos] << 8) | buf[pos + 1];
+        pos += 4;
+
+        std::string rsp((char *)buf, pos);
+        rsp[2] = (char)0x81;
+        rsp[3] = (char)0x80;
+        std::vector<std::string> rdatas;
+        uint32_t ttl = 60;
+        if (name == "a.test" && qtype == 1){
+            rdatas.push_back(std::string("\x0a\x00\x00\x01", 4));
+            rdatas.push_back(std::string("\x0a\x00\x00\x02", 4));
+        }
+        else if (name == "ttl.test" && qtype == 1){
+            rdatas.push_back(std::string("\x0a\x00\x00\x03", 4));
+            ttl = 1;
+        }
+        else if (name == "v6.test" && qtype == 28){
+            rdatas.push_back(std::string("\xfd\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x01", 16));
+        }
+        else if (name != "v6.test"){
+            rsp[3] = (char)0x83;
+        }
+        rsp[7] = (char)rdatas.size();
+        for (auto& i : rdatas){
+            //压缩指针指向问题中的域名
+            rsp.append("\xc0\x0c", 2);
+            rsp.push_back(0);
+            rsp.push_back((char)qtype);
+            rsp.append("\x00\x01", 2);
+            rsp.push_back(0);
+            rsp.push_back(0);
+            rsp.push_back(0);
+            rsp.push_back((char)ttl);
+            rsp.push_back(0);
+            rsp.push_back((char)i.size());
+            rsp.append(i);
+        }
+        sock->sendTo(rsp.c_str(), rsp.size(), from);
+    }
+}
+
+void run(server::Socket::ptr sock){
+    server::DnsResolver::ptr resolver(new server::DnsResolver);
+    resolver->setServers({sock->getLocalAddress()});
+
+    std::vector<server::IPAddress::ptr> addrs;
+    CHECK(resolver->resolve("a.test", addrs) && addrs.size() == 2);
+    CHECK(addrs.size() && addrs[0]->toString() == "10.0.0.1:0");
+    int queries = s_queries;
+    addrs.clear();
+    CHECK(resolver->resolve("A.TEST.", addrs) && addrs.size() == 2);
+    CHECK(s_queries == queries);
+
+    addrs.clear();
+    CHECK(resolver->resolve("v6.test", addrs) && addrs.size() == 1);
+    CHECK(addrs.size() && addrs[0]->getFamily() == AF_INET6);
+    addrs.clear();
+    CHECK(!resolver->resolve("v6.test", addrs, AF_INET));
+
+    //负缓存
+    addrs.clear();
+    queries = s_queries;
+    CHECK(!resolver->resolve("none.test", addrs));
+    CHECK(!resolver->resolve("none.test", addrs));
+    CHECK(s_queries == queries + 1);
+
+    //TTL过期后重新查询
+    addrs.clear();
+    CHECK(resolver->resolve("ttl.test", addrs));
+    queries = s_queries;
+    sleep(2);
+    CHECK(resolver->resolve("ttl.test", addrs));
+    CHECK(s_queries == queries + 1);
+
+    //hosts文件优先
+    {
+        std::ofstream ofs("/tmp/test_dns_hosts");
+        ofs << "# comment\n10.9.9.9 a.test alias.test\n::1 alias.test\n";
+    }
+    CHECK(resolver->loadHosts("/tmp/test_dns_hosts"));
+    addrs.clear();
+    CHECK(resolver->resolve("alias.test", addrs) && addrs.size() == 2);
+    addrs.clear();
+    CHECK(resolver->resolve("a.test", addrs, AF_INET) && addrs.size() == 1 && addrs[0]->toString() == "10.9.9.9:0");
+    addrs.clear();
+    CHECK(resolver->resolve("127.0.0.1", addrs) && addrs.size() == 1);
+
+    //服务器没有应答
+    server::DnsResolver::ptr dead(new server::DnsResolver);
+    dead->setServers({server::IPAddress::Create("127.0.0.1", 1)});
+    addrs.clear();
+    uint64_t start = server::GetCurrentMS();
+    CHECK(!dead->resolve("dead.test", addrs));
+    LOG_INFO(g_logger) << "dead server used " << server::GetCurrentMS() - start << "ms";
+    //服务器没有应答时退回到getaddrinfo，结果同样缓存，不会每次都等超时
+    dead->loadHosts("/dev/null");
+    addrs.clear();
+    CHECK(dead->resolve("localhost", addrs) && !addrs.empty());
+    addrs.clear();
+    start = server::GetCurrentMS();
+    CHECK(dead->resolve("localhost", addrs) && !addrs.empty());
+    CHECK(server::GetCurrentMS() - start < 100);
+
+    LOG_INFO(g_logger) << "cache size=" << resolver->getCacheSize();
+
+    //缓存数量有上限，满了先删过期的，再删最快过期的
+    server::Config::Lookup<uint32_t>("dns.cache_size")->setVal(2);
+    server::DnsResolver::ptr small(new server::DnsResolver);
+    small->setServers({sock->getLocalAddress()});
+    small->loadHosts("/dev/null");
+    for (auto name : {"a.test", "v6.test", "none.test", "ttl.test"}){
+        addrs.clear();
+        small->resolve(name, addrs);
+        CHECK(small->getCacheSize() <= 2);
+    }
+    addrs.clear();
+    queries = s_queries;
+    CHECK(small->resolve("ttl.test", addrs));
+    CHECK(s_queries == queries);
+    server::Config::Lookup<uint32_t>("dns.cache_size")->setVal(4096);
+
+    //NXDOMAIN不退回到getaddrinfo，之后命中负缓存
+    server::DnsResolverMgr::GetInstance()->setServers({sock->getLocalAddress()});
+    server::DnsResolverMgr::GetInstance()->loadHosts("/dev/null");
+    queries = s_queries;
+    CHECK(!server::Address::LookupAnyIPAddress("none.test:80"));
+    CHECK(!server::Address::LookupAnyIPAddress("none.test:80"));
+    CHECK(s_queries == queries + 1);
+
+    //DNS服务器没有应答时Address::Lookup退回到getaddrinfo
+    server::DnsResolverMgr::GetInstance()->setServers({server::IPAddress::Create("127.0.0.1", 1)});
+    server::DnsResolverMgr::GetInstance()->loadHosts("/dev/null");
+    server::Address::ptr fallback = server::Address::LookupAnyIPAddress("localhost:80");
+    CHECK(fallback && fallback->toString().find(":80") != std::string::npos);
+    server::DnsResolverMgr::GetInstance()->setServers({});
+    server::DnsResolverMgr::GetInstance()->loadHosts("/etc/hosts");
+
+    //通过Address::Lookup走默认的解析器
+    server::Address::ptr addr = server::Address::LookupAnyIPAddress("localhost:80");
+    LOG_INFO(g_logger) << "localhost:80 -> " << (addr ? addr->toString() : "null");
+
+    LOG_INFO(g_logger) << "test_dns done";
+    //发一个空包让桩服务器退出
+    server::Socket::ptr quit = server::Socket::CreateUDP(sock->getLocalAddress());
+    quit->sendTo("", 0, sock->getLocalAddress());
+}
+
+void start(){
+    //socket需要在IOManager中创建，否则没有被hook
+    server::Socket::ptr sock = server::Socket::CreateUDP(server::IPAddress::Create("127.0.0.1"));
+    if (!sock->bind(server::IPAddress::Create("127.0.0.1", 5353))){
+        return;
+    }
+    server::IOManager::GetThis()->scheduler(std::bind(stub_server, sock));
+    server::IOManager::GetThis()->scheduler(std::bind(run, sock));
+}
+
+int main(int argc, char **argv){
+    server::IOManager iom(1);
+    iom.scheduler(start);
+    return 0;
+}
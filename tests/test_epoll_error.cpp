@@ -0,0 +1,61 @@
+#include "../server/server.h"
+#include "../server/iomanager.h"
+#include "../server/hook.h"
+#include "test_check.h"
+#include <atomic>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static std::atomic<int> s_reads(0);
+
+//对端关闭时epoll返回EPOLLIN|EPOLLHUP，只注册了READ的fd不能再去触发WRITE
+void test_hup(){
+    for (int i = 0; i < 100; ++i){
+        int fds[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        int fd = fds[0];
+        server::IOManager::GetThis()->addEvent(fd, server::IOManager::READ, [fd](){
+            char c;
+            CHECK(read(fd, &c, 1) == 0);
+            close(fd);
+            ++s_reads;
+        });
+        close(fds[1]);
+    }
+}
+
+//只注册了WRITE，连接出错时同样只唤醒WRITE
+void test_err(){
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    //填满发送缓冲区，保证WRITE是在对端关闭后才被唤醒
+    char buf[4096] = {0};
+    while (write(fds[0], buf, sizeof(buf)) > 0);
+    int fd = fds[0];
+    server::IOManager::GetThis()->addEvent(fd, server::IOManager::WRITE, [fd](){
+        CHECK(write(fd, "x", 1) == -1);
+        close(fd);
+        ++s_reads;
+    });
+    close(fds[1]);
+}
+
+int main(){
+    signal(SIGPIPE, SIG_IGN);
+    {
+        server::IOManager iom(2, false);
+        iom.scheduler(test_hup);
+        iom.scheduler(test_err);
+        //主线程不在调度器里，直接调用原始的sleep
+        usleep_f(1000 * 1000);
+        CHECK(s_reads == 101);
+        LOG_INFO(g_logger) << "test_epoll_error done";
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include "../server/http/http_server.h"
+#include "../server/http/http_connection.h"
+#include "../server/http/http_parser.h"
+#include "../server/config.h"
+#include "../server/iomanager.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static server::Address::ptr s_addr;
+
+static server::Socket::ptr Connect(){
+    server::Socket::ptr sock = server::Socket::CreateTCP(s_addr);
+    sock->connect(s_addr);
+    sock->setRecvTimeout(1000);
+    return sock;
+}
+
+static void Send(server::Socket::ptr sock, const std::string &data){
+    sock->send(data.c_str(), data.size());
+}
+
+//读到一个完整的响应头为止，带content-length时把body也读完
+static std::string Recv(server::Socket::ptr sock){
+    std::string buf;
+    char tmp[4096];
+    size_t body = std::string::npos;
+    while (true){
+        size_t pos = buf.find("\r\n\r\n");
+        if (pos != std::string::npos){
+            if (body == std::string::npos){
+                size_t cl = buf.find("content-length: ");
+                body = cl != std::string::npos && cl < pos ? atoi(buf.c_str() + cl + 16) : 0;
+            }
+            if (buf.size() >= pos + 4 + body){
+                return buf;
+            }
+        }
+        int rt = sock->recv(tmp, sizeof(tmp));
+        if (rt <= 0){
+            return buf;
+        }
+        buf.append(tmp, rt);
+    }
+}
+
+static std::string Header(const std::string &path, uint64_t length, const std::string &expect = "100-continue"
+                          , const std::string &extra = ""){
+    return "POST " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: " + std::to_string(length)
+           + "\r\nExpect: " + expect + "\r\n" + extra + "\r\n";
+}
+
+void run(){
+    s_addr = server::Address::LookupAnyIPAddress("127.0.0.1:8060");
+    server::http::HttpServer::ptr server(new server::http::HttpServer(true));
+    while (!server->bind(s_addr)){
+        sleep(1);
+    }
+    server->start();
+    auto mgr = server->getServletManager();
+
+    //没有token的上传只凭header就拒绝
+    auto upload = mgr->addServlet("/upload", server::http::Servlet::ptr(new server::http::Servlet("upload")));
+    upload->setCheckHeader([](const server::http::HttpRequest::ptr &req,
+                              const server::http::HttpResponse::ptr &rsp,
+                              const server::http::HttpSession::ptr &session){
+        if (req->getHeaderAs<std::string>("X-Token") != "ok"){
+            rsp->setStatus(server::http::HttpStatus::UNAUTHORIZED);
+            return 1;
+        }
+        return 0;
+    });
+    upload->setPost([](const server::http::HttpRequest::ptr &req,
+                       const server::http::HttpResponse::ptr &rsp,
+                       const server::http::HttpSession::ptr &session){
+        rsp->setBody(std::to_string(req->getBody().size()));
+        return 0;
+    });
+    //不读body直接回复
+    auto ignore = mgr->addServlet("/ignore", server::http::Servlet::ptr(new server::http::Servlet("ignore")));
+    ignore->setStreamBody(true);
+    ignore->setPost([](const server::http::HttpRequest::ptr &req,
+                       const server::http::HttpResponse::ptr &rsp,
+                       const server::http::HttpSession::ptr &session){
+        rsp->setStatus(server::http::HttpStatus::FORBIDDEN);
+        return 0;
+    });
+
+    //通过检查后先收到100再发送body，连接可以继续使用
+    auto sock = Connect();
+    Send(sock, Header("/upload", 1000, "100-continue", "X-Token: ok\r\n"));
+    std::string rsp = Recv(sock);
+    CHECK(rsp == "HTTP/1.1 100 Continue\r\n\r\n");
+    Send(sock, std::string(1000, 'x'));
+    rsp = Recv(sock);
+    CHECK(rsp.find("HTTP/1.1 200") == 0 && rsp.find("\r\n\r\n1000") != std::string::npos);
+    Send(sock, Header("/upload", 10, "100-continue", "X-Token: ok\r\n"));
+    CHECK(Recv(sock) == "HTTP/1.1 100 Continue\r\n\r\n");
+    Send(sock, std::string(10, 'x'));
+    CHECK(Recv(sock).find("\r\n\r\n10") != std::string::npos);
+
+    //被拒绝时不回复100，直接返回最终响应并关闭连接
+    sock = Connect();
+    uint64_t start = server::GetCurrentUS();
+    Send(sock, Header("/upload", 32 * 1024 * 1024));
+    rsp = Recv(sock);
+    CHECK(rsp.find("HTTP/1.1 401") == 0 && rsp.find("connection: close") != std::string::npos);
+    CHECK(Recv(sock).empty());
+    LOG_INFO(g_logger) << "reject 32MB upload in " << server::GetCurrentUS() - start << "us";
+
+    //超过http.request.max_body_size
+    sock = Connect();
+    Send(sock, Header("/upload", server::http::HttpRequestParser::GetHttpRequestMaxBodysize() + 1, "100-continue", "X-Token: ok\r\n"));
+    CHECK(Recv(sock).find("HTTP/1.1 413") == 0);
+
+    //不认识的expect
+    sock = Connect();
+    Send(sock, Header("/upload", 10, "something-else", "X-Token: ok\r\n"));
+    CHECK(Recv(sock).find("HTTP/1.1 417") == 0);
+
+    //servlet没有读body，也就没有100
+    sock = Connect();
+    Send(sock, Header("/ignore", 1000));
+    rsp = Recv(sock);
+    CHECK(rsp.find("HTTP/1.1 403") == 0 && rsp.find("connection: close") != std::string::npos);
+
+    //客户端跳过100，得到最终的响应
+    auto r = server::http::HttpConnection::DoPost("http://127.0.0.1:8060/upload", 1000
+                                                  , {{"Expect", "100-continue"}, {"X-Token", "ok"}}, std::string(5000, 'y'));
+    CHECK(r->response && r->response->getStatus() == server::http::HttpStatus::OK && r->response->getBody() == "5000");
+    LOG_INFO(g_logger) << "test_expect done";
+}
+
+int main(int argc, char **argv){
+    server::IOManager iom(2);
+    iom.scheduler(run);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include "../server/server.h"
+#include "../server/fd_manager.h"
+#include "test_check.h"
+#include <vector>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+//这些fd并不存在，FdCtx只是初始化失败，不影响管理逻辑
+static const int THREADS = 8;
+static const int PER_THREAD = 2000;
+
+void test_bounds(){
+    server::FdManager mgr;
+    //初始容量是64，越界的fd不能读写到vector外
+    CHECK(!mgr.get(64));
+    CHECK(!mgr.get(100000));
+    CHECK(!mgr.get(-1, true));
+    mgr.del(64);
+    mgr.del(100000);
+
+    server::FdCtx::ptr ctx = mgr.add(64);
+    CHECK(ctx && mgr.get(64) == ctx);
+    mgr.del(64);
+    CHECK(!mgr.get(64));
+}
+
+void test_concurrent(){
+    server::FdManager mgr;
+    std::vector<server::Thread::ptr> thrs;
+    for (int t = 0; t < THREADS; ++t){
+        //交错的fd让每个线程都会触发扩容
+        thrs.push_back(server::Thread::ptr(new server::Thread("fd_" + std::to_string(t), [&mgr, t](){
+            for (int i = 0; i < PER_THREAD; ++i){
+                int fd = i * THREADS + t;
+                server::FdCtx::ptr ctx = mgr.get(fd, true);
+                CHECK(ctx && mgr.get(fd) == ctx);
+            }
+        })));
+    }
+    for (auto &i : thrs){
+        i->join();
+    }
+    for (int fd = 0; fd < THREADS * PER_THREAD; ++fd){
+        CHECK(mgr.get(fd));
+    }
+}
+
+int main(){
+    test_bounds();
+    test_concurrent();
+    LOG_INFO(g_logger) << "test_fd_manager done";
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include "../server/server.h"
+#include "../server/iomanager.h"
+#include "../server/hook.h"
+#include "test_check.h"
+#include <atomic>
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static const int FIBERS = 16;
+static const int ROUNDS = 20000;
+static std::atomic<int> s_rounds(0);
+
+//先把自己放回队列再YieldToHold，其他线程会在swapOut完成前就取到这个协程
+void run(){
+    for (int i = 0; i < ROUNDS; ++i){
+        server::Scheduler::GetThis()->scheduler(server::Fiber::GetThis());
+        server::Fiber::YieldToHold();
+        ++s_rounds;
+    }
+}
+
+int main(){
+    {
+        server::IOManager iom(4, false);
+        for (int i = 0; i < FIBERS; ++i){
+            iom.scheduler(run);
+        }
+        uint64_t start = server::GetCurrentMS();
+        while (s_rounds < FIBERS * ROUNDS && server::GetCurrentMS() - start < 30000){
+            usleep_f(10000);
+        }
+        CHECK(s_rounds == FIBERS * ROUNDS);
+        LOG_INFO(g_logger) << "test_fiber_hold done";
+    }
+    return 0;
+}
@@ -1,5 +1,8 @@
 #include "../server/http/http.h"
 #include "../server/log.h"
+#include "test_check.h"
+
+static server::Logger::ptr g_logger = LOG_ROOT();
 
 void test_request(){
     server::http::HttpRequest::ptr req(new server::http::HttpRequest);
@@ -19,8 +22,31 @@ void test_response(){
     req->dump(std::cout) << std::endl;
 }
 
+void test_method(){
+    using server::http::HttpMethod;
+#define XX(num, method, string) \
+    CHECK(server::http::ParseHttpMethod(#string, sizeof(#string) - 1) == HttpMethod::method); \
+    CHECK(server::http::StringtoHttpMethod(#string) == HttpMethod::method);
+    HTTP_METHOD_MAP(XX)
+#undef XX
+    CHECK(server::http::ParseHttpMethod("GETX", 3) == HttpMethod::GET);
+    CHECK(server::http::ParseHttpMethod("GETX", 4) == HttpMethod::INVALID_METHOD);
+    CHECK(server::http::ParseHttpMethod("get", 3) == HttpMethod::INVALID_METHOD);
+    CHECK(server::http::ParseHttpMethod("UNSUBSCRIBE", 10) == HttpMethod::INVALID_METHOD);
+    CHECK(server::http::ParseHttpMethod("UNSUBSCRIBEX", 12) == HttpMethod::INVALID_METHOD);
+    CHECK(server::http::ParseHttpMethod("", 0) == HttpMethod::INVALID_METHOD);
+    CHECK(server::http::CharstoHttpMethod("POST /a HTTP/1.1") == HttpMethod::POST);
+    CHECK(server::http::CharstoHttpMethod("XXX") == HttpMethod::INVALID_METHOD);
+
+    CHECK(server::http::ParseHttpVersion("HTTP/1.1", 8) == 0x11);
+    CHECK(server::http::ParseHttpVersion("HTTP/1.0", 8) == 0x10);
+    CHECK(server::http::ParseHttpVersion("HTTP/1.", 7) == 0);
+    CHECK(server::http::ParseHttpVersion("HTTP/2.0", 8) == 0);
+}
+
 int main(){
     test_request();
     test_response();
+    test_method();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,439 @@
+#include "../server/http/http_server.h"
+#include "../server/http/hpack.h"
+#include "../server/config.h"
+#include "../server/iomanager.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <map>
+#include <string.h>
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static std::string Unhex(const std::string &hex){
+    std::string out;
+    for (size_t i = 0; i + 1 < hex.size(); ){
+        if (hex[i] == ' '){
+            ++i;
+            continue;
+        }
+        out.push_back((char)strtol(hex.substr(i, 2).c_str(), nullptr, 16));
+        i += 2;
+    }
+    return out;
+}
+
+static std::string Hex(const std::string &data){
+    static const char *digits = "0123456789abcdef";
+    std::string out;
+    for (unsigned char c : data){
+        out.push_back(digits[c >> 4]);
+        out.push_back(digits[c & 0xF]);
+    }
+    return out;
+}
+
+//RFC 7541 附录C.4，同一个连接上连续的三个请求（huffman编码）
+void test_hpack(){
+    server::http::HPackDecoder decoder;
+    std::vector<server::http::HPackHeader> headers;
+    std::string block = Unhex("8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff");
+    CHECK(decoder.decode(block.c_str(), block.size(), headers));
+    CHECK(headers.size() == 4 && headers[0].name == ":method" && headers[0].value == "GET"
+          && headers[3].name == ":authority" && headers[3].value == "www.example.com");
+    CHECK(decoder.getTable().getSize() == 57);
+
+    block = Unhex("8286 84be 5886 a8eb 1064 9cbf");
+    headers.clear();
+    CHECK(decoder.decode(block.c_str(), block.size(), headers));
+    CHECK(headers.size() == 5 && headers[3].value == "www.example.com"
+          && headers[4].name == "cache-control" && headers[4].value == "no-cache");
+    CHECK(decoder.getTable().getSize() == 110);
+
+    block = Unhex("8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf");
+    headers.clear();
+    CHECK(decoder.decode(block.c_str(), block.size(), headers));
+    CHECK(headers.size() == 5 && headers[1].value == "https" && headers[2].value == "/index.html"
+          && headers[4].name == "custom-key" && headers[4].value == "custom-value");
+    CHECK(decoder.getTable().getSize() == 164 && decoder.getTable().getCount() == 3);
+
+    //编码器的输出和RFC一致
+    server::http::HPackEncoder encoder;
+    std::string out;
+    encoder.begin(out);
+    encoder.encode(":method", "GET", out);
+    encoder.encode(":scheme", "http", out);
+    encoder.encode(":path", "/", out);
+    encoder.encode(":authority", "www.example.com", out);
+    CHECK(Hex(out) == "828684418cf1e3c2e5f23a6ba0ab90f4ff");
+
+    //不合法的输入：index越界，huffman中的EOS
+    block = Unhex("be");
+    server::http::HPackDecoder bad;
+    CHECK(!bad.decode(block.c_str(), block.size(), headers));
+    block = Unhex("0085 ffff ffff ff00");
+    CHECK(!bad.decode(block.c_str(), block.size(), headers));
+
+    std::string text = "text/html; charset=utf-8 \x01\xff 中文";
+    std::string huff;
+    server::http::HuffmanEncode(text.c_str(), text.size(), huff);
+    std::string decoded;
+    CHECK(huff.size() == server::http::HuffmanEncodedLength(text.c_str(), text.size()));
+    CHECK(server::http::HuffmanDecode(huff.c_str(), huff.size(), decoded) && decoded == text);
+
+    std::string settings;
+    CHECK(server::Base64Decode("AAMAAABkAAQCAAAAAAIAAAAA", settings) && settings.size() == 18);
+    CHECK(server::Base64Decode("-_8", settings) && settings == "\xfb\xff");
+    CHECK(!server::Base64Decode("AAM*", settings));
+}
+
+static server::Address::ptr s_addr;
+
+struct Frame{
+    uint8_t type;
+    uint8_t flags;
+    uint32_t stream;
+    std::string payload;
+};
+
+//只实现测试需要的部分，收到的DATA立即归还窗口
+class Client{
+public:
+    Client(bool preface = true){
+        m_sock = server::Socket::CreateTCP(s_addr);
+        m_sock->connect(s_addr);
+        m_sock->setRecvTimeout(3000);
+        if (preface){
+            start();
+        }
+    }
+
+    void start(){
+        std::string settings;
+        //初始窗口1MB
+        settings.append("\x00\x04\x00\x10\x00\x00", 6);
+        send("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + frame(4, 0, 0, settings));
+    }
+
+    static std::string frame(uint8_t type, uint8_t flags, uint32_t stream, const std::string &payload){
+        std::string out;
+        out.push_back((char)(payload.size() >> 16));
+        out.push_back((char)(payload.size() >> 8));
+        out.push_back((char)payload.size());
+        out.push_back((char)type);
+        out.push_back((char)flags);
+        for (int i = 3; i >= 0; --i){
+            out.push_back((char)(stream >> (i * 8)));
+        }
+        return out + payload;
+    }
+
+    void send(const std::string &data){
+        m_sock->send(data.c_str(), data.size());
+    }
+
+    void request(uint32_t id, const std::string &method, const std::string &path, bool end
+                 , const std::vector<std::pair<std::string, std::string>> &extra = {}){
+        std::string block;
+        m_encoder.begin(block);
+        m_encoder.encode(":method", method, block);
+        m_encoder.encode(":scheme", "http", block);
+        m_encoder.encode(":path", path, block);
+        m_encoder.encode(":authority", "127.0.0.1", block);
+        for (auto& i : extra){
+            m_encoder.encode(i.first, i.second, block);
+        }
+        send(frame(1, 0x4 | (end ? 0x1 : 0), id, block));
+    }
+
+    //按服务端的窗口发送body
+    bool sendBody(uint32_t id, const std::string &body){
+        size_t offset = 0;
+        while (offset < body.size()){
+            int64_t window = std::min(m_window, m_streamWindow[id]);
+            if (window <= 0){
+                if (!readFrame()){
+                    return false;
+                }
+                continue;
+            }
+            size_t len = std::min((size_t)std::min<int64_t>(window, 16384), body.size() - offset);
+            bool end = offset + len == body.size();
+            send(frame(0, end ? 1 : 0, id, body.substr(offset, len)));
+            m_window -= len;
+            m_streamWindow[id] -= len;
+            offset += len;
+        }
+        return true;
+    }
+
+    //读取一个帧并处理，返回false表示连接关闭
+    bool readFrame(Frame *out = nullptr){
+        char head[9];
+        if (!readFull(head, 9)){
+            return false;
+        }
+        Frame f;
+        uint32_t len = ((uint8_t)head[0] << 16) | ((uint8_t)head[1] << 8) | (uint8_t)head[2];
+        f.type = head[3];
+        f.flags = head[4];
+        f.stream = (((uint8_t)head[5] << 24) | ((uint8_t)head[6] << 16) | ((uint8_t)head[7] << 8) | (uint8_t)head[8]) & 0x7FFFFFFF;
+        f.payload.resize(len);
+        if (len && !readFull(&f.payload[0], len)){
+            return false;
+        }
+        const uint8_t *p = (const uint8_t *)f.payload.c_str();
+        if (f.type == 4 && !(f.flags & 1)){
+            for (size_t i = 0; i + 6 <= len; i += 6){
+                uint16_t id = (p[i] << 8) | p[i + 1];
+                uint32_t v = (p[i + 2] << 24) | (p[i + 3] << 16) | (p[i + 4] << 8) | p[i + 5];
+                m_settings[id] = v;
+                if (id == 4){
+                    m_initialWindow = v;
+                }
+            }
+            send(frame(4, 1, 0, ""));
+        }
+        else if (f.type == 8){
+            uint32_t v = ((p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]) & 0x7FFFFFFF;
+            if (f.stream == 0){
+                m_window += v;
+            }
+            else{
+                m_streamWindow[f.stream] += v;
+            }
+        }
+        else if (f.type == 0 && len){
+            std::string inc;
+            for (int i = 3; i >= 0; --i){
+                inc.push_back((char)(len >> (i * 8)));
+            }
+            send(frame(8, 0, 0, inc) + frame(8, 0, f.stream, inc));
+            m_responses[f.stream].body += f.payload;
+        }
+        else if (f.type == 1){
+            std::vector<server::http::HPackHeader> headers;
+            m_decoder.decode(f.payload.c_str(), f.payload.size(), headers);
+            for (auto& h : headers){
+                m_responses[f.stream].headers[h.name] = h.value;
+            }
+        }
+        else if (f.type == 3){
+            m_responses[f.stream].reset = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+            m_responses[f.stream].done = true;
+        }
+        if ((f.type == 0 || f.type == 1) && (f.flags & 1)){
+            m_responses[f.stream].done = true;
+            m_order.push_back(f.stream);
+        }
+        if (out){
+            *out = f;
+        }
+        return true;
+    }
+
+    //读到stream结束（END_STREAM或者RST_STREAM）
+    bool wait(uint32_t id){
+        while (!m_responses[id].done){
+            if (!readFrame()){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool readFull(char *buf, size_t len){
+        while (len > 0){
+            int rt = m_sock->recv(buf, len);
+            if (rt <= 0){
+                return false;
+            }
+            buf += rt;
+            len -= rt;
+        }
+        return true;
+    }
+
+    struct Response{
+        std::map<std::string, std::string> headers;
+        std::string body;
+        bool done = false;
+        uint32_t reset = 0xFFFFFFFF;
+    };
+
+    server::Socket::ptr m_sock;
+    server::http::HPackEncoder m_encoder;
+    server::http::HPackDecoder m_decoder;
+    std::map<uint16_t, uint32_t> m_settings;
+    std::map<uint32_t, Response> m_responses;
+    std::map<uint32_t, int64_t> m_streamWindow;
+    std::vector<uint32_t> m_order;
+    int64_t m_window = 65535;
+    uint32_t m_initialWindow = 65535;
+
+    int64_t &streamWindow(uint32_t id){
+        auto it = m_streamWindow.find(id);
+        if (it == m_streamWindow.end()){
+            it = m_streamWindow.insert(std::make_pair(id, (int64_t)m_initialWindow)).first;
+        }
+        return it->second;
+    }
+};
+
+static void Add(server::http::ServletManager::ptr mgr, const std::string &path, server::http::Servlet::doFunction cb){
+    server::http::Servlet::ptr slt(new server::http::Servlet(path));
+    slt->setDefault(cb);
+    mgr->addServlet(path, slt);
+}
+
+void run(){
+    s_addr = server::Address::LookupAnyIPAddress("127.0.0.1:8100");
+    server::http::HttpServer::ptr server(new server::http::HttpServer(true));
+    while (!server->bind(s_addr)){
+        sleep(1);
+    }
+    server->start();
+    auto mgr = server->getServletManager();
+    Add(mgr, "/hello", [](const server::http::HttpRequest::ptr &req,
+                                 const server::http::HttpResponse::ptr &rsp,
+                                 const server::http::HttpSession::ptr &session){
+        rsp->setHeader("Content-Type", "text/plain");
+        rsp->setHeader("X-Query", req->getQuery());
+        rsp->setBody("hello " + req->getHeaderAs<std::string>("host") + " " + req->getCookieAs<std::string>("b"));
+        return 0;
+    });
+    Add(mgr, "/slow", [](const server::http::HttpRequest::ptr &req,
+                                const server::http::HttpResponse::ptr &rsp,
+                                const server::http::HttpSession::ptr &session){
+        usleep(300 * 1000);
+        rsp->setBody("slow");
+        return 0;
+    });
+    Add(mgr, "/echo", [](const server::http::HttpRequest::ptr &req,
+                                const server::http::HttpResponse::ptr &rsp,
+                                const server::http::HttpSession::ptr &session){
+        rsp->setBody(req->getBody());
+        return 0;
+    });
+    Add(mgr, "/big", [](const server::http::HttpRequest::ptr &req,
+                               const server::http::HttpResponse::ptr &rsp,
+                               const server::http::HttpSession::ptr &session){
+        rsp->setBody(std::string(300 * 1024, 'b'));
+        return 0;
+    });
+    Add(mgr, "/stream", [](const server::http::HttpRequest::ptr &req,
+                                  const server::http::HttpResponse::ptr &rsp,
+                                  const server::http::HttpSession::ptr &session){
+        auto out = session->startStream(rsp);
+        for (int i = 0; out && i < 3; ++i){
+            out->write("part", 4);
+        }
+        return 0;
+    });
+
+    //prior knowledge
+    Client c;
+    c.request(1, "GET", "/hello?x=1", true, {{"cookie", "a=1"}, {"cookie", "b=2"}});
+    CHECK(c.wait(1));
+    CHECK(c.m_settings[3] == 100 && c.m_settings[2] == 0);
+    CHECK(c.m_responses[1].headers[":status"] == "200");
+    CHECK(c.m_responses[1].headers["content-length"] == "17");
+    CHECK(c.m_responses[1].headers["x-query"] == "x=1");
+    CHECK(!c.m_responses[1].headers["date"].empty());
+    CHECK(c.m_responses[1].body == "hello 127.0.0.1 2");
+
+    //多路复用：慢的请求不阻塞之后的请求
+    uint64_t start = server::GetCurrentMS();
+    c.request(3, "GET", "/slow", true);
+    c.request(5, "GET", "/hello", true);
+    CHECK(c.wait(3) && c.wait(5));
+    CHECK(c.m_order.size() == 3 && c.m_order[1] == 5 && c.m_order[2] == 3);
+    LOG_INFO(g_logger) << "multiplexed slow+fast in " << server::GetCurrentMS() - start << "ms";
+
+    //body超过服务端的窗口，需要等WINDOW_UPDATE
+    std::string body(1024 * 1024 + 7, 'x');
+    for (size_t i = 0; i < body.size(); i += 4096){
+        body[i] = 'a' + i % 26;
+    }
+    c.request(7, "POST", "/echo", false, {{"content-length", std::to_string(body.size())}});
+    c.streamWindow(7);
+    CHECK(c.sendBody(7, body));
+    CHECK(c.wait(7));
+    CHECK(c.m_responses[7].body == body);
+
+    //流式响应和HEAD
+    c.request(9, "GET", "/stream", true);
+    CHECK(c.wait(9) && c.m_responses[9].body == "partpartpart");
+    c.request(11, "HEAD", "/big", true);
+    CHECK(c.wait(11) && c.m_responses[11].body.empty() && c.m_responses[11].headers["content-length"] == "307200");
+
+    //不合法的请求只重置这个stream，大写的header名和content-length不一致
+    c.request(13, "GET", "/hello", true, {{"X-Upper", "1"}});
+    CHECK(c.wait(13) && c.m_responses[13].reset == 1);
+    c.request(15, "POST", "/echo", false, {{"content-length", "10"}});
+    c.send(Client::frame(0, 1, 15, "abc"));
+    CHECK(c.wait(15) && c.m_responses[15].reset == 1);
+    c.request(17, "GET", "/hello", true);
+    CHECK(c.wait(17) && c.m_responses[17].body == "hello 127.0.0.1 ");
+
+    //PING
+    c.send(Client::frame(6, 0, 0, "12345678"));
+    Frame f;
+    while (c.readFrame(&f) && f.type != 6){
+    }
+    CHECK(f.type == 6 && f.flags == 1 && f.payload == "12345678");
+
+    //超过max_concurrent_streams的stream被拒绝
+    server::Config::Lookup<uint32_t>("http.h2.max_concurrent_streams")->setVal(2);
+    Client c2;
+    c2.request(1, "GET", "/slow", true);
+    c2.request(3, "GET", "/slow", true);
+    c2.request(5, "GET", "/slow", true);
+    CHECK(c2.wait(5) && c2.m_responses[5].reset == 7);
+    CHECK(c2.wait(1) && c2.wait(3) && c2.m_responses[3].body == "slow");
+    server::Config::Lookup<uint32_t>("http.h2.max_concurrent_streams")->setVal(100);
+
+    //连接错误：第一个帧不是SETTINGS
+    Client c3(false);
+    c3.send(std::string("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n") + Client::frame(6, 0, 0, "12345678"));
+    bool goaway = false;
+    while (c3.readFrame(&f)){
+        goaway = goaway || f.type == 7;
+    }
+    CHECK(goaway);
+
+    //Upgrade: h2c，升级的请求作为stream 1
+    Client c4(false);
+    c4.send("GET /hello HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: Upgrade, HTTP2-Settings\r\n"
+            "Upgrade: h2c\r\nHTTP2-Settings: AAMAAABkAAQAEAAA\r\n\r\n");
+    //101之后紧跟着服务端的SETTINGS，逐字节读到响应头结束
+    std::string line;
+    char ch = 0;
+    while (line.size() < 4 || line.compare(line.size() - 4, 4, "\r\n\r\n") != 0){
+        if (!c4.readFull(&ch, 1)){
+            break;
+        }
+        line.push_back(ch);
+    }
+    CHECK(line.find("HTTP/1.1 101") == 0 && line.find("h2c\r\n") != std::string::npos);
+    c4.start();
+    CHECK(c4.wait(1) && c4.m_responses[1].body == "hello 127.0.0.1 ");
+    c4.request(3, "GET", "/big", true);
+    CHECK(c4.wait(3) && c4.m_responses[3].body.size() == 300 * 1024);
+
+    //HTTP/1.1不受影响
+    Client c5(false);
+    c5.send("GET /hello HTTP/1.1\r\nHost: h1\r\n\r\n");
+    char buf[100] = {0};
+    int rt = c5.m_sock->recv(buf, sizeof(buf) - 1);
+    CHECK(rt > 0 && strncmp(buf, "HTTP/1.1 200", 12) == 0);
+    LOG_INFO(g_logger) << "test_http2 done";
+}
+
+int main(int argc, char **argv){
+    test_hpack();
+    server::IOManager iom(2);
+    iom.scheduler(run);
+    return 0;
+}
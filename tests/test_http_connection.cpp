@@ -1,6 +1,11 @@
 #include "../server/http/http_connection.h"
+#include "../server/http/http_fanout.h"
 #include "../server/log.h"
 #include "../server/iomanager.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <atomic>
+#include <unistd.h>
 
 static server::Logger::ptr g_logger = LOG_ROOT();
 
@@ -48,8 +53,81 @@ void run(){
                              << " rsp=" << (r->response ? r->response->toString() : "");
 }
 
+//需要先启动test_http_server
+void test_pool(){
+    for (int i = 0; i < 10; ++i){
+        auto r = server::http::HttpConnection::DoGet("http://127.0.0.1:8020/server/xx", 300);
+        LOG_INFO(g_logger) << "result=" << r->result << " error=" << r->error
+                           << " status=" << (r->response ? (int)r->response->getStatus() : 0);
+    }
+    auto pool = server::http::HttpConnectionPoolMgr::GetInstance()->getPool("127.0.0.1", 8020);
+    LOG_INFO(g_logger) << "pool create_count=" << pool->getCreateCount()
+                       << " idle_count=" << pool->getIdleCount();
+}
+
+void test_fanout(){
+    //三个请求并发，总耗时接近最慢的一个
+    server::http::HttpFanout::ptr fanout(new server::http::HttpFanout(1000));
+    fanout->setCallback([](size_t index, server::http::HttpResult::ptr result){
+        LOG_INFO(g_logger) << "fanout request " << index << " done result=" << result->result;
+    });
+    uint64_t start = server::GetCurrentMS();
+    fanout->addGet("http://127.0.0.1:8020/server/sleep/300", 1000);
+    fanout->addGet("http://127.0.0.1:8020/server/sleep/200", 1000);
+    fanout->addGet("http://127.0.0.1:8020/server/sleep/100", 1000);
+    size_t ok = fanout->waitAll();
+    LOG_INFO(g_logger) << "waitAll ok=" << ok << " used=" << server::GetCurrentMS() - start << "ms";
+
+    //单个请求超时
+    fanout.reset(new server::http::HttpFanout(1000));
+    start = server::GetCurrentMS();
+    fanout->addGet("http://127.0.0.1:8020/server/sleep/500", 100);
+    fanout->addGet("http://127.0.0.1:8020/server/sleep/50", 1000);
+    int index = fanout->waitAny();
+    LOG_INFO(g_logger) << "waitAny index=" << index << " used=" << server::GetCurrentMS() - start << "ms";
+
+    //整体超时，2个里有1个成功
+    fanout.reset(new server::http::HttpFanout(250));
+    start = server::GetCurrentMS();
+    fanout->addGet("http://127.0.0.1:8020/server/sleep/100", 1000);
+    fanout->addGet("http://127.0.0.1:8020/server/sleep/150", 1000);
+    fanout->addGet("http://127.0.0.1:8020/server/sleep/800", 1000);
+    ok = fanout->waitQuorum(2);
+    LOG_INFO(g_logger) << "waitQuorum(2) ok=" << ok << " used=" << server::GetCurrentMS() - start << "ms";
+    fanout.reset(new server::http::HttpFanout(250));
+    start = server::GetCurrentMS();
+    fanout->addGet("http://127.0.0.1:8020/server/sleep/100", 1000);
+    fanout->addGet("http://127.0.0.1:8020/server/sleep/800", 1000);
+    ok = fanout->waitAll();
+    LOG_INFO(g_logger) << "deadline waitAll ok=" << ok << " used=" << server::GetCurrentMS() - start << "ms"
+                       << " result[1]=" << fanout->getResult(1)->error;
+}
+
+//整体超时的时候回调还在执行，wait要等回调结束才返回
+void test_fanout_callback(){
+    static std::atomic<int> s_running(0);
+    static std::atomic<int> s_calls(0);
+    server::http::HttpFanout::ptr fanout(new server::http::HttpFanout(100));
+    fanout->setCallback([](size_t index, server::http::HttpResult::ptr result){
+        ++s_running;
+        usleep(300 * 1000);
+        ++s_calls;
+        --s_running;
+    });
+    uint64_t start = server::GetCurrentMS();
+    //端口没有监听，连接马上失败
+    fanout->addGet("http://127.0.0.1:1/", 1000);
+    fanout->waitAll();
+    CHECK(s_running == 0 && s_calls == 1);
+    CHECK(server::GetCurrentMS() - start >= 250);
+    LOG_INFO(g_logger) << "test_fanout_callback done used=" << server::GetCurrentMS() - start << "ms";
+}
+
 int main(){
     server::IOManager iom(2);
+    iom.scheduler(test_fanout_callback);
+    iom.scheduler(test_pool);
+    iom.scheduler(test_fanout);
     iom.scheduler(run);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "../server/http/http.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+void test_cast(){
+    int i = 0;
+    CHECK(server::http::castAs(std::string("1024"), i) && i == 1024);
+    CHECK(server::http::castAs(std::string("-2147483648"), i) && i == INT32_MIN);
+    CHECK(server::http::castAs(std::string("+7"), i) && i == 7);
+    CHECK(!server::http::castAs(std::string("2147483648"), i, -1) && i == -1);
+    CHECK(!server::http::castAs(std::string(""), i, -1) && i == -1);
+    CHECK(!server::http::castAs(std::string("-"), i, -1) && i == -1);
+    CHECK(!server::http::castAs(std::string(" 1"), i, -1) && i == -1);
+    CHECK(!server::http::castAs(std::string("1 "), i, -1) && i == -1);
+    CHECK(!server::http::castAs(std::string("12abc"), i, -1) && i == -1);
+
+    uint64_t u = 0;
+    CHECK(server::http::castAs(std::string("18446744073709551615"), u) && u == UINT64_MAX);
+    CHECK(!server::http::castAs(std::string("18446744073709551616"), u, (uint64_t)1) && u == 1);
+    //lexical_cast会把-1转换成UINT64_MAX
+    CHECK(!server::http::castAs(std::string("-1"), u, (uint64_t)1) && u == 1);
+
+    int16_t i16 = 0;
+    CHECK(server::http::castAs(std::string("-32768"), i16) && i16 == -32768);
+    CHECK(!server::http::castAs(std::string("32768"), i16, (int16_t)3) && i16 == 3);
+    //int8_t和lexical_cast一样按字符处理
+    int8_t i8 = 0;
+    CHECK(server::http::castAs(std::string("A"), i8) && i8 == 'A');
+
+    double d = 0;
+    CHECK(server::http::castAs(std::string("0.5"), d) && d == 0.5);
+    CHECK(server::http::castAs(std::string("-1e3"), d) && d == -1000);
+    CHECK(!server::http::castAs(std::string("0.5x"), d, 2.0) && d == 2.0);
+    CHECK(!server::http::castAs(std::string(" 0.5"), d, 2.0) && d == 2.0);
+    CHECK(!server::http::castAs(std::string("1e999"), d, 2.0) && d == 2.0);
+
+    bool b = false;
+    CHECK(server::http::castAs(std::string("1"), b) && b);
+    CHECK(!server::http::castAs(std::string("yes"), b, false) && !b);
+
+    server::http::HttpRequest::MapType m;
+    m["id"] = "42";
+    m["bad"] = "x";
+    CHECK(server::http::getAs(m, "id", 0) == 42);
+    CHECK(server::http::getAs(m, "bad", 9) == 9);
+    std::string s;
+    CHECK(server::http::checkGetAs(m, "bad", s) && s == "x");
+}
+
+void test_hot_header(){
+    server::http::HttpRequest::ptr req(new server::http::HttpRequest);
+    CHECK(req->getHeaderContentLength() == -1);
+    CHECK(req->getConnectionHeader() == server::http::ConnectionHeader::NONE);
+    req->setHeader("Content-Length", "27");
+    req->setHeader("Connection", "Keep-Alive");
+    CHECK(req->getHeaderContentLength() == 27);
+    CHECK(req->getConnectionHeader() == server::http::ConnectionHeader::KEEP_ALIVE);
+    req->setHeader("content-length", "abc");
+    CHECK(req->getHeaderContentLength() == -1);
+    req->setHeader("content-length", "-5");
+    CHECK(req->getHeaderContentLength() == -1);
+    //Content-Length只接受数字：不带符号，不能为空，不能溢出
+    req->setHeader("content-length", "+5");
+    CHECK(req->getHeaderContentLength() == -1);
+    req->setHeader("content-length", "");
+    CHECK(req->getHeaderContentLength() == -1);
+    req->setHeader("content-length", "9223372036854775808");
+    CHECK(req->getHeaderContentLength() == -1);
+    req->setHeader("content-length", "9223372036854775807");
+    CHECK(req->getHeaderContentLength() == INT64_MAX);
+    req->setHeader("content-length", "007");
+    CHECK(req->getHeaderContentLength() == 7);
+    req->delHeader("CONNECTION");
+    CHECK(req->getConnectionHeader() == server::http::ConnectionHeader::NONE);
+
+    //HTTP/1.1默认长连接，connection: close时关闭
+    req->setHeader("Connection", "close");
+    req->init();
+    CHECK(req->isClose());
+    req->setHeader("Connection", "Upgrade");
+    CHECK(req->getConnectionHeader() == server::http::ConnectionHeader::OTHER);
+    req->init();
+    CHECK(!req->isClose());
+
+    server::http::HttpRequest::MapType headers;
+    headers["CONTENT-LENGTH"] = "100";
+    headers["connection"] = "close";
+    req->setHeaders(headers);
+    CHECK(req->getHeaderContentLength() == 100);
+    CHECK(req->getConnectionHeader() == server::http::ConnectionHeader::CLOSE);
+
+    server::http::HttpResponse::ptr rsp(new server::http::HttpResponse);
+    rsp->setHeader("Content-Length", "1048576");
+    CHECK(rsp->getHeaderContentLength() == 1048576);
+    rsp->delHeader("content-length");
+    CHECK(rsp->getHeaderContentLength() == -1);
+    rsp->setHeaders(headers);
+    CHECK(rsp->getHeaderContentLength() == 100);
+    CHECK(rsp->getConnectionHeader() == server::http::ConnectionHeader::CLOSE);
+}
+
+//以前的做法：每次都用lexical_cast，不合法时抛异常
+template<class T>
+static T LexicalGetAs(const std::string &str, const T &def){
+    try{
+        return boost::lexical_cast<T>(str);
+    }
+    catch(...){
+    }
+    return def;
+}
+
+void bench(){
+    const int N = 1000000;
+    const std::string good = "1048576";
+    const std::string bad = "1048576x";
+    int64_t sum = 0;
+
+    uint64_t start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        sum += LexicalGetAs<int64_t>(good, 0);
+    }
+    uint64_t us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "lexical_cast valid: ns/op=" << us * 1000.0 / N;
+
+    start = server::GetCurrentUS();
+    for (int i = 0; i < N / 10; ++i){
+        sum += LexicalGetAs<int64_t>(bad, 0);
+    }
+    us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "lexical_cast invalid: ns/op=" << us * 10000.0 / N;
+
+    for (int k = 0; k < 2; ++k){
+        const std::string &str = k == 0 ? good : bad;
+        start = server::GetCurrentUS();
+        for (int i = 0; i < N; ++i){
+            int64_t v = 0;
+            server::http::castAs(str, v, (int64_t)0);
+            sum += v;
+        }
+        us = server::GetCurrentUS() - start;
+        LOG_INFO(g_logger) << "castAs " << (k == 0 ? "valid" : "invalid") << ": ns/op=" << us * 1000.0 / N;
+    }
+
+    //每次读取content-length
+    server::http::HttpRequest req;
+    req.setHeader("Content-Length", good);
+    start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        sum += req.getHeaderAs<int64_t>("content-length");
+    }
+    us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "getHeaderAs content-length: ns/op=" << us * 1000.0 / N;
+
+    start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        sum += req.getHeaderContentLength();
+    }
+    us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "cached content-length: ns/op=" << us * 1000.0 / N << " sum=" << sum;
+}
+
+int main(){
+    test_cast();
+    test_hot_header();
+    bench();
+    LOG_INFO(g_logger) << "test_http_getas done";
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include "../server/http/http.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+void test_query(){
+    server::http::HttpRequest::ptr req(new server::http::HttpRequest);
+    req->setQuery("id=1024&name=%E4%BD%A0%E5%A5%BD&q=a+b%2Bc&flag&empty=&id=2&a%20b=1");
+    CHECK(req->getParamAs<int>("id") == 1024);
+    CHECK(req->getParamAs<std::string>("name") == "你好");
+    CHECK(req->getParamAs<std::string>("q") == "a b+c");
+    CHECK(req->getParamAs<std::string>("NAME") == "你好");
+    std::string val = "x";
+    CHECK(req->hasParam("flag", &val) && val.empty());
+    CHECK(req->hasParam("empty", &val) && val.empty());
+    CHECK(req->getParamAs<int>("a b") == 1);
+    CHECK(!req->hasParam("none", nullptr));
+    CHECK(req->getParamAs<int>("none", 7) == 7);
+    CHECK(req->getParamAs<int>("name", -1) == -1);
+
+    //setParam（路由参数）优先
+    req->setParam("id", "42");
+    CHECK(req->getParamAs<int>("id") == 42);
+    auto& all = req->getParames();
+    CHECK(all.size() == 6 && all.at("id") == "42" && all.at("q") == "a b+c");
+    req->delParam("id");
+    CHECK(!req->hasParam("id", nullptr));
+
+    //重新设置query后重新解析
+    req->setQuery("x=1");
+    CHECK(req->getParamAs<int>("x") == 1 && !req->hasParam("q", nullptr));
+}
+
+void test_form(){
+    server::http::HttpRequest::ptr req(new server::http::HttpRequest);
+    req->setMethod(server::http::HttpMethod::POST);
+    req->setQuery("page=2");
+    req->setBody("user=alice&msg=hello+world%21");
+    //没有content-type时body不作为参数
+    CHECK(!req->hasParam("user", nullptr));
+    req->setHeader("Content-Type", "application/x-www-form-urlencoded; charset=utf-8");
+    CHECK(req->getParamAs<std::string>("user") == "alice");
+    CHECK(req->getParamAs<std::string>("msg") == "hello world!");
+    CHECK(req->getParamAs<int>("page") == 2);
+}
+
+void test_cookie(){
+    server::http::HttpRequest::ptr req(new server::http::HttpRequest);
+    req->setHeader("Cookie", "session=4f3c2a1b; theme=dark;  quoted=\"a b\" ; enc=a%3Bb+c;;flag");
+    CHECK(req->getCookieAs<std::string>("session") == "4f3c2a1b");
+    CHECK(req->getCookieAs<std::string>("theme") == "dark");
+    CHECK(req->getCookieAs<std::string>("quoted") == "a b");
+    //cookie中的+不是空格
+    CHECK(req->getCookieAs<std::string>("enc") == "a;b+c");
+    CHECK(req->hasCookie("flag", nullptr));
+    CHECK(req->getCookies().size() == 5);
+    req->setHeader("Cookie", "a=1");
+    CHECK(req->getCookieAs<int>("a") == 1 && !req->hasCookie("session", nullptr));
+}
+
+//以前的做法：收到请求后把query全部解码到map中
+static void EagerParse(server::http::HttpRequest::MapType &m, const std::string &query){
+    size_t pos = 0;
+    while (pos < query.size()){
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos){
+            end = query.size();
+        }
+        size_t eq = query.find('=', pos);
+        if (eq < end){
+            m[server::http::UrlDecode(query.c_str() + pos, eq - pos)] = server::http::UrlDecode(query.c_str() + eq + 1, end - eq - 1);
+        }
+        pos = end + 1;
+    }
+}
+
+void bench(){
+    const int N = 200000;
+    const std::string query = "utm_source=newsletter&utm_medium=email&utm_campaign=spring%20sale&id=1024"
+                              "&fields=name,email,avatar&lang=zh-CN&ts=1700000000&sig=4f3c2a1b9e8d7c6b";
+    server::http::HttpRequest req;
+    req.setQuery(query);
+
+    uint64_t start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        server::http::HttpRequest::MapType m;
+        EagerParse(m, query);
+    }
+    uint64_t us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "eager decode all: ns/request=" << us * 1000.0 / N;
+
+    int sum = 0;
+    start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        req.setQuery(query);
+        sum += req.getParamAs<int>("id");
+    }
+    us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "lazy one param: ns/request=" << us * 1000.0 / N << " sum=" << sum;
+
+    start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        req.setQuery(query);
+    }
+    us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "no param access: ns/request=" << us * 1000.0 / N;
+}
+
+int main(){
+    test_query();
+    test_form();
+    test_cookie();
+    bench();
+    LOG_INFO(g_logger) << "test_http_param done";
+    return 0;
+}
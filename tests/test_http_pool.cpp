@@ -0,0 +1,171 @@
+#include "../server/http/http_server.h"
+#include "../server/http/http_parser.h"
+#include "../server/config.h"
+#include "../server/iomanager.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+//统计整个进程的operator new次数
+static std::atomic<uint64_t> s_allocs(0);
+
+void *operator new(size_t size){
+    ++s_allocs;
+    void *p = malloc(size ? size : 1);
+    if (!p){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept{
+    free(p);
+}
+
+void test_reset(){
+    server::http::HttpRequest::ptr req(new server::http::HttpRequest);
+    req->setMethod(server::http::HttpMethod::POST);
+    req->setPath("/a/very/long/path/that/does/not/fit/in/sso");
+    req->setQuery("id=1&name=x");
+    req->setBody(std::string(1000, 'b'));
+    req->setHeader("Content-Length", "1000");
+    req->setHeader("Connection", "close");
+    req->setHeader("Cookie", "a=1");
+    req->setParam("route", "1");
+    CHECK(req->getParamAs<int>("id") == 1 && req->getCookieAs<int>("a") == 1);
+    size_t capacity = req->getBody().capacity();
+
+    req->reset(0x10, false);
+    CHECK(req->getMethod() == server::http::HttpMethod::GET && req->getVersion() == 0x10 && !req->isClose());
+    CHECK(req->getPath() == "/" && req->getQuery().empty() && req->getBody().empty());
+    CHECK(req->getBody().capacity() == capacity);
+    CHECK(req->getHeaders().empty() && req->getHeaderContentLength() == -1);
+    CHECK(req->getConnectionHeader() == server::http::ConnectionHeader::NONE);
+    CHECK(!req->hasParam("id", nullptr) && !req->hasParam("route", nullptr) && !req->hasCookie("a", nullptr));
+    req->setQuery("id=2");
+    CHECK(req->getParamAs<int>("id") == 2);
+
+    server::http::HttpResponse::ptr rsp(new server::http::HttpResponse);
+    rsp->setStatus(server::http::HttpStatus::NOT_FOUND);
+    rsp->setStream(true);
+    rsp->setContentLength(10);
+    rsp->setHeader("Content-Type", "text/plain");
+    //大的body不保留容量
+    rsp->setBody(std::string(1024 * 1024, 'x'));
+    rsp->reset(0x11, true);
+    CHECK(rsp->getStatus() == server::http::HttpStatus::OK && !rsp->isStream() && rsp->getContentLength() == -1);
+    CHECK(rsp->getHeaders().empty() && rsp->getBody().capacity() < 1024 * 1024 && rsp->isClose());
+
+    //释放的节点被下一次分配复用
+    void *p = server::http::NodePoolAllocate(96);
+    server::http::NodePoolDeallocate(p, 96);
+    CHECK(server::http::NodePoolAllocate(90) == p);
+    server::http::NodePoolDeallocate(p, 90);
+}
+
+void test_parser(){
+    server::http::HttpRequestParser parser;
+    std::string data = "GET /x?a=1 HTTP/1.1\r\nHost: h\r\nContent-Length: 3\r\n\r\n";
+    parser.parse(data.c_str(), data.size());
+    CHECK(parser.isFinished() && parser.getContentLength() == 3);
+    server::http::HttpRequest *first = parser.getData().get();
+
+    //没有其他引用时复用同一个请求对象，上一个请求的状态被清掉
+    parser.reset();
+    data = "POST /y HTTP/1.0\r\nConnection: keep-alive\r\n\r\n";
+    parser.parse(data.c_str(), data.size());
+    CHECK(parser.isFinished() && !parser.hasError() && parser.getData().get() == first);
+    CHECK(parser.getData()->getPath() == "/y" && parser.getData()->getQuery().empty());
+    CHECK(parser.getContentLength() == 0 && !parser.getData()->hasHeader("host", nullptr));
+
+    //还被引用时重新申请
+    server::http::HttpRequest::ptr hold = parser.getData();
+    parser.reset();
+    CHECK(parser.getData() != hold && hold->getPath() == "/y");
+}
+
+static server::Address::ptr s_addr;
+static std::atomic<void *> s_lastRequest(nullptr);
+static std::atomic<void *> s_lastResponse(nullptr);
+static std::atomic<uint32_t> s_reused(0);
+
+//长连接上发送count个请求，返回成功的个数
+static int Requests(const server::Socket::ptr &sock, int count){
+    static const char request[] = "GET /ping?id=42 HTTP/1.1\r\nHost: 127.0.0.1:8110\r\n"
+                                  "User-Agent: Mozilla/5.0 (X11; Linux x86_64) keep-alive benchmark\r\n"
+                                  "Accept: text/html,application/xhtml+xml;q=0.9,*/*;q=0.8\r\n"
+                                  "Accept-Encoding: gzip, deflate, br\r\nConnection: keep-alive\r\n\r\n";
+    char buf[4096];
+    for (int i = 0; i < count; ++i){
+        if (sock->send(request, sizeof(request) - 1) <= 0){
+            return i;
+        }
+        size_t len = 0;
+        while (len < 4 || memcmp(buf + len - 4, "pong", 4) != 0){
+            int rt = sock->recv(buf + len, sizeof(buf) - len);
+            if (rt <= 0){
+                return i;
+            }
+            len += rt;
+        }
+    }
+    return count;
+}
+
+void run(){
+    //空闲连接挂起到epoll和请求超时的定时器属于IOManager，这里只统计HTTP层
+    server::Config::Lookup<bool>("http.server.park_idle")->setVal(false);
+    server::Config::Lookup<uint64_t>("http.server.request_timeout")->setVal(0);
+    server::Config::Lookup<uint32_t>("http.server.max_requests")->setVal(0);
+
+    s_addr = server::Address::LookupAnyIPAddress("127.0.0.1:8110");
+    server::http::HttpServer::ptr server(new server::http::HttpServer(true));
+    while (!server->bind(s_addr)){
+        sleep(1);
+    }
+    server->start();
+    server::http::Servlet::ptr slt(new server::http::Servlet("ping"));
+    slt->setGet([](const server::http::HttpRequest::ptr &req,
+                   const server::http::HttpResponse::ptr &rsp,
+                   const server::http::HttpSession::ptr &session){
+        if (s_lastRequest == req.get() && s_lastResponse == rsp.get()){
+            ++s_reused;
+        }
+        s_lastRequest = req.get();
+        s_lastResponse = rsp.get();
+        rsp->setHeader("Content-Type", "text/plain");
+        rsp->setBody(req->getParamAs<int>("id") == 42 ? "pong" : "fail");
+        return 0;
+    });
+    server->getServletManager()->addServlet("/ping", slt);
+
+    server::Socket::ptr sock = server::Socket::CreateTCP(s_addr);
+    CHECK(sock->connect(s_addr));
+    sock->setRecvTimeout(3000);
+    CHECK(Requests(sock, 1000) == 1000);
+    CHECK(s_reused == 999);
+
+    const int N = 20000;
+    uint64_t allocs = s_allocs;
+    uint64_t start = server::GetCurrentUS();
+    CHECK(Requests(sock, N) == N);
+    uint64_t us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "keep-alive: allocs/request=" << (s_allocs - allocs) * 1.0 / N
+                       << " us/request=" << us * 1.0 / N << " reused=" << s_reused;
+    LOG_INFO(g_logger) << "test_http_pool done";
+}
+
+int main(int argc, char **argv){
+    test_reset();
+    test_parser();
+    server::IOManager iom(2);
+    iom.scheduler(run);
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "../server/http/http_parser.h"
+#include "../server/http/http_request_view.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+//统计堆分配次数
+static std::atomic<uint64_t> s_allocs = {0};
+
+void *operator new(size_t size){
+    ++s_allocs;
+    void *p = malloc(size);
+    if (!p){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept{
+    free(p);
+}
+
+const char test_request_data[] = "GET /api/v1/users/1024?fields=name,email&lang=zh HTTP/1.1\r\n"
+                                 "Host: www.example.com\r\n"
+                                 "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36\r\n"
+                                 "Accept: application/json\r\n"
+                                 "Accept-Encoding: gzip, deflate\r\n"
+                                 "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+                                 "Cookie: session=4f3c2a1b; theme=dark\r\n"
+                                 "Connection: keep-alive\r\n"
+                                 "X-Request-Id: 7d9f0c2e-1b3a-4c5d-8e6f-0a1b2c3d4e5f\r\n\r\n";
+
+static const int N = 100000;
+
+void test_view(){
+    server::http::HttpRequestView req;
+    server::http::HttpRequestViewParser parser(req);
+    std::string tmp = test_request_data;
+    parser.parse(&tmp[0], tmp.size());
+    parser.commit();
+    server::http::StringView host, conn;
+    req.getHeader(server::http::KnownHeader::HOST, host);
+    req.getHeader("CONNECTION", conn);
+    LOG_INFO(g_logger) << "finished=" << parser.isFinished() << " error=" << parser.hasError()
+                       << " method=" << server::http::HttpMethodtoString(req.getMethod())
+                       << " path=" << req.getPath() << " query=" << req.getQuery()
+                       << " host=" << host << " connection=" << conn
+                       << " close=" << req.isClose() << " headers=" << req.getHeaders().size();
+    LOG_INFO(g_logger) << "\n" << req.toRequest()->toString();
+}
+
+static int64_t ContentLength(const std::string &headers){
+    server::http::HttpRequestView req;
+    server::http::HttpRequestViewParser parser(req);
+    std::string tmp = "POST / HTTP/1.1\r\nHost: a\r\n" + headers + "\r\n";
+    parser.parse(&tmp[0], tmp.size());
+    parser.commit();
+    return req.getContentLength();
+}
+
+static bool HasError(const std::string &headers){
+    server::http::HttpRequestView req;
+    server::http::HttpRequestViewParser parser(req);
+    std::string tmp = "POST / HTTP/1.1\r\nHost: a\r\n" + headers + "\r\n";
+    parser.parse(&tmp[0], tmp.size());
+    return parser.hasError();
+}
+
+//没有Content-Length为0，不是纯数字或者溢出时为-1，由调用者回复400
+void test_content_length(){
+    CHECK(ContentLength("") == 0);
+    CHECK(ContentLength("Content-Length: 0\r\n") == 0);
+    CHECK(ContentLength("Content-Length: 1024\r\n") == 1024);
+    CHECK(ContentLength("Content-Length: abc\r\n") == -1);
+    CHECK(ContentLength("Content-Length: +5\r\n") == -1);
+    CHECK(ContentLength("Content-Length: 5a\r\n") == -1);
+    CHECK(ContentLength("Content-Length:\r\n") == -1);
+    CHECK(ContentLength("Content-Length: 99999999999999999999\r\n") == -1);
+    //重复的Content-Length值相同时接受，不同时拒绝
+    CHECK(!HasError("Content-Length: 5\r\ncontent-length: 5\r\n"));
+    CHECK(ContentLength("Content-Length: 5\r\ncontent-length: 5\r\n") == 5);
+    CHECK(HasError("Content-Length: 5\r\ncontent-length: 6\r\n"));
+    CHECK(HasError("Content-Length: 5\r\nX-A: b\r\nCONTENT-LENGTH: 05\r\n"));
+}
+
+void bench_parser(){
+    std::string tmp = test_request_data;
+
+    uint64_t allocs = s_allocs;
+    uint64_t start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        server::http::HttpRequestParser parser;
+        std::string buf = tmp;
+        parser.execute(&buf[0], buf.size());
+    }
+    uint64_t us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "HttpRequestParser: allocs/request=" << (double)(s_allocs - allocs) / N
+                       << " ns/request=" << us * 1000.0 / N;
+
+    server::http::HttpRequestView req;
+    server::http::HttpRequestViewParser parser(req);
+    //先跑一次让arena和header数组申请好内存
+    parser.parse(&tmp[0], tmp.size());
+    parser.commit();
+
+    allocs = s_allocs;
+    start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        req.reset();
+        parser.reset();
+        parser.parse(&tmp[0], tmp.size());
+        parser.commit();
+    }
+    us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "HttpRequestViewParser: allocs/request=" << (double)(s_allocs - allocs) / N
+                       << " ns/request=" << us * 1000.0 / N;
+}
+
+int main(){
+    test_view();
+    test_content_length();
+    bench_parser();
+    return 0;
+}
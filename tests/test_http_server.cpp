@@ -1,5 +1,7 @@
 #include "../server/http/http_server.h"
 #include "../server/http/servlet.h"
+#include "../server/http/file_servlet.h"
+#include "../server/http/cache_servlet.h"
 
 static server::Logger::ptr g_logger = LOG_ROOT();
 
@@ -35,6 +37,67 @@ void run(){
         rsp->setHeader("connection", "keep-alive");
         return 0; });
 
+    auto stream_servlet = SerManager->addServlet("/server/stream", server::http::Servlet::ptr(new server::http::Servlet("stream")));
+    stream_servlet->setGet([](server::http::HttpRequest::ptr req,
+                              server::http::HttpResponse::ptr rsp,
+                              server::http::HttpSession::ptr session)
+                           {
+        rsp->setHeader("Content-Type", "text/plain");
+        auto out = session->startStream(rsp);
+        if (!out){
+            return -1;
+        }
+        for (int i = 0; i < 5; ++i){
+            std::string line = "line " + std::to_string(i) + "\n";
+            out->writeFixSize(line.c_str(), line.size());
+        }
+        out->close();
+        return 0; });
+
+    auto upload_servlet = SerManager->addServlet("/server/upload", server::http::Servlet::ptr(new server::http::Servlet("upload")));
+    upload_servlet->setStreamBody(true);
+    upload_servlet->setPost([](server::http::HttpRequest::ptr req,
+                               server::http::HttpResponse::ptr rsp,
+                               server::http::HttpSession::ptr session)
+                            {
+        auto in = session->getBodyStream();
+        char buf[4096];
+        uint64_t total = 0;
+        int rt = 0;
+        while ((rt = in->read(buf, sizeof(buf))) > 0){
+            total += rt;
+        }
+        rsp->setBody(rt < 0 ? "read body error" : "received " + std::to_string(total) + " bytes");
+        return 0; });
+
+    //静态文件：/static/a.txt -> /tmp/a.txt
+    SerManager->addGlobServlet("/static/*", server::http::FileServlet::ptr(new server::http::FileServlet("/tmp", "/static")));
+
+    //缓存1秒，并发的miss只会调用一次内部servlet
+    auto slow_servlet = server::http::Servlet::ptr(new server::http::Servlet("slow"));
+    slow_servlet->setGet([](server::http::HttpRequest::ptr req,
+                            server::http::HttpResponse::ptr rsp,
+                            server::http::HttpSession::ptr session)
+                         {
+        static std::atomic<int> s_count = {0};
+        usleep(100 * 1000);
+        rsp->setHeader("Content-Type", "text/plain");
+        rsp->setBody("computed " + std::to_string(++s_count) + " times\n");
+        return 0; });
+    SerManager->addServlet("/server/cached", server::http::CacheServlet::ptr(new server::http::CacheServlet(slow_servlet, 1000)));
+
+    //延迟指定的毫秒数后返回，用于测试客户端的并发和超时
+    auto sleep_servlet = server::http::Servlet::ptr(new server::http::Servlet("sleep"));
+    sleep_servlet->setGet([](const server::http::HttpRequest::ptr &req,
+                             const server::http::HttpResponse::ptr &rsp,
+                             const server::http::HttpSession::ptr &session)
+                          {
+        int ms = req->getParamAs<int>("ms");
+        usleep(ms * 1000);
+        rsp->setBody("slept " + std::to_string(ms) + "ms");
+        return 0; });
+    SerManager->addRouteServlet("/server/sleep/:ms", sleep_servlet);
+
     server->start();
 }
 
@@ -0,0 +1,93 @@
+#include "../server/http/http_server.h"
+#include "../server/iomanager.h"
+#include "../server/log.h"
+#include "test_check.h"
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static server::Address::ptr s_addr;
+
+//新连接上发送data，读到对端关闭或者超时为止
+static std::string Request(const std::string &data){
+    server::Socket::ptr sock = server::Socket::CreateTCP(s_addr);
+    sock->connect(s_addr);
+    sock->setRecvTimeout(1000);
+    sock->send(data.c_str(), data.size());
+    std::string buf;
+    char tmp[4096];
+    while (true){
+        int rt = sock->recv(tmp, sizeof(tmp));
+        if (rt <= 0){
+            return buf;
+        }
+        buf.append(tmp, rt);
+    }
+}
+
+static std::string Post(const std::string &headers, const std::string &body){
+    return Request("POST /echo HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n" + headers + "\r\n" + body);
+}
+
+static bool IsStatus(const std::string &rsp, int status){
+    return rsp.find("HTTP/1.1 " + std::to_string(status) + " ") == 0;
+}
+
+//响应只有一个，被拒绝的请求后面的数据不会被当成新的请求
+static bool IsOnly(const std::string &rsp, int status){
+    return IsStatus(rsp, status) && rsp.find("HTTP/1.1", 1) == std::string::npos;
+}
+
+void run(){
+    s_addr = server::Address::LookupAnyIPAddress("127.0.0.1:8111");
+    server::http::HttpServer::ptr server(new server::http::HttpServer(true));
+    while (!server->bind(s_addr)){
+        sleep(1);
+    }
+    server->start();
+    auto echo = server->getServletManager()->addServlet("/echo", server::http::Servlet::ptr(new server::http::Servlet("echo")));
+    echo->setPost([](const server::http::HttpRequest::ptr &req,
+                     const server::http::HttpResponse::ptr &rsp,
+                     const server::http::HttpSession::ptr &session){
+        rsp->setBody("[" + req->getBody() + "]");
+        return 0;
+    });
+
+    //合法的chunked，chunk扩展被忽略，trailer被跳过
+    std::string rsp = Post("Transfer-Encoding: chunked\r\n", "5\r\nhello\r\n0\r\n\r\n");
+    CHECK(IsStatus(rsp, 200) && rsp.find("[hello]") != std::string::npos);
+    rsp = Post("Transfer-Encoding: gzip ,  Chunked \r\n", "3;ext=\"v\"\r\nabc\r\n2\r\nde\r\n0\r\nX-Trailer: 1\r\n\r\n");
+    CHECK(IsStatus(rsp, 200) && rsp.find("[abcde]") != std::string::npos);
+
+    //Content-Length和Transfer-Encoding同时出现
+    CHECK(IsOnly(Post("Content-Length: 5\r\nTransfer-Encoding: chunked\r\n", "0\r\n\r\nGET /echo HTTP/1.1\r\n\r\n"), 400));
+    //chunked不是最后一个编码，或者只是子串、出现了两次
+    CHECK(IsOnly(Post("Transfer-Encoding: chunked, gzip\r\n", "0\r\n\r\n"), 400));
+    CHECK(IsOnly(Post("Transfer-Encoding: gzip, chunkedx\r\n", "0\r\n\r\n"), 400));
+    CHECK(IsOnly(Post("Transfer-Encoding: chunked, chunked\r\n", "0\r\n\r\n"), 400));
+    CHECK(IsOnly(Post("Transfer-Encoding: identity\r\n", "hello"), 400));
+    //Content-Length不合法、重复且不一致
+    CHECK(IsOnly(Post("Content-Length: abc\r\n", "hello"), 400));
+    CHECK(IsOnly(Post("Content-Length: 99999999999999999999999\r\n", "hello"), 400));
+    CHECK(IsOnly(Post("Content-Length: +5\r\n", "hello"), 400));
+    CHECK(IsOnly(Post("Content-Length: 0x5\r\n", "hello"), 400));
+    CHECK(IsOnly(Post("Content-Length:\r\n", "hello"), 400));
+    CHECK(IsOnly(Post("Content-Length: 5\r\nContent-Length: 6\r\n", "hello!"), 400));
+    rsp = Post("Content-Length: 5\r\nContent-Length: 5\r\n", "hello");
+    CHECK(IsStatus(rsp, 200) && rsp.find("[hello]") != std::string::npos);
+
+    //chunk大小后面有多余的字符、没有CRLF、超过15位，chunk数据后面不是CRLF：直接关闭，不回复
+    CHECK(Post("Transfer-Encoding: chunked\r\n", "5x\r\nhello\r\n0\r\n\r\n").empty());
+    CHECK(Post("Transfer-Encoding: chunked\r\n", "5 \r\nhello\r\n0\r\n\r\n").empty());
+    CHECK(Post("Transfer-Encoding: chunked\r\n", "5\nhello\r\n0\r\n\r\n").empty());
+    CHECK(Post("Transfer-Encoding: chunked\r\n", "0000000000000005\r\nhello\r\n0\r\n\r\n").empty());
+    CHECK(Post("Transfer-Encoding: chunked\r\n", "5\r\nhelloXX\r\n0\r\n\r\n").empty());
+    CHECK(Post("Transfer-Encoding: chunked\r\n", "5\r\nhello\n0\r\n\r\n").empty());
+    LOG_INFO(g_logger) << "test_http_smuggling done";
+}
+
+int main(int argc, char **argv){
+    server::IOManager iom(2);
+    iom.scheduler(run);
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include "../server/server.h"
+#include "../server/iomanager.h"
+#include "../server/hook.h"
+#include "test_check.h"
+#include <atomic>
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static const int TASKS = 100;
+static std::atomic<int> s_done(0);
+
+//在工作线程忙的时候投递任务，不会tickle，只能靠idle里的epoll_wait返回后再取任务
+void produce(){
+    for (int i = 0; i < TASKS; ++i){
+        server::IOManager::GetThis()->scheduler([](){
+            ++s_done;
+        });
+    }
+}
+
+int main(){
+    uint64_t start = server::GetCurrentMS();
+    {
+        server::IOManager iom(1, false);
+        iom.scheduler(produce);
+        //每执行frequency个任务进一次idle，阻塞时每次最多要等3s
+        while (s_done < TASKS && server::GetCurrentMS() - start < 10000){
+            usleep_f(1000);
+        }
+        uint64_t ms = server::GetCurrentMS() - start;
+        CHECK(s_done == TASKS);
+        CHECK(ms < 1000);
+        LOG_INFO(g_logger) << "test_idle_poll: " << TASKS << " tasks in " << ms << "ms";
+        LOG_INFO(g_logger) << "test_idle_poll done";
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include "../server/http/http_server.h"
+#include "../server/config.h"
+#include "../server/fiber.h"
+#include "../server/iomanager.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <fstream>
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static server::Address::ptr s_addr;
+static const std::string GET = "GET /hello HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+static server::Socket::ptr Connect(){
+    server::Socket::ptr sock = server::Socket::CreateTCP(s_addr);
+    sock->connect(s_addr);
+    sock->setRecvTimeout(5000);
+    return sock;
+}
+
+//读取count个响应（body为ok）
+static bool Recv(server::Socket::ptr sock, int count = 1){
+    static const std::string END = "\r\n\r\nok";
+    std::string buf;
+    char tmp[4096];
+    size_t pos = 0;
+    while (count > 0){
+        size_t end = buf.find(END, pos);
+        if (end != std::string::npos){
+            pos = end + END.size();
+            --count;
+            continue;
+        }
+        int rt = sock->recv(tmp, sizeof(tmp));
+        if (rt <= 0){
+            return false;
+        }
+        buf.append(tmp, rt);
+    }
+    return true;
+}
+
+//进程的常驻内存(KB)
+static uint64_t GetRss(){
+    std::ifstream ifs("/proc/self/statm");
+    uint64_t size = 0, rss = 0;
+    ifs >> size >> rss;
+    return rss * getpagesize() / 1024;
+}
+
+//建立count个长连接，每个连接完成一个请求后保持空闲
+static void OpenIdle(std::vector<server::Socket::ptr> &socks, int count, const std::string &name){
+    uint64_t fibers = server::Fiber::TotalFibers();
+    uint64_t rss = GetRss();
+    int ok = 0;
+    for (int i = 0; i < count; ++i){
+        auto sock = Connect();
+        sock->send(GET.c_str(), GET.size());
+        if (Recv(sock)){
+            ++ok;
+        }
+        socks.push_back(sock);
+    }
+    CHECK(ok == count);
+    usleep(100 * 1000);
+    LOG_INFO(g_logger) << name << " idle=" << count << " fibers+=" << (int64_t)(server::Fiber::TotalFibers() - fibers)
+                       << " rss+=" << (int64_t)(GetRss() - rss) << "KB";
+}
+
+static double Bench(){
+    const int ROUNDS = 5000;
+    auto sock = Connect();
+    uint64_t start = server::GetCurrentUS();
+    for (int i = 0; i < ROUNDS; ++i){
+        sock->send(GET.c_str(), GET.size());
+        if (!Recv(sock)){
+            return 0;
+        }
+    }
+    return ROUNDS * 1000000.0 / (server::GetCurrentUS() - start);
+}
+
+void run(){
+    s_addr = server::Address::LookupAnyIPAddress("127.0.0.1:8090");
+    server::http::HttpServer::ptr server(new server::http::HttpServer(true));
+    while (!server->bind(s_addr)){
+        sleep(1);
+    }
+    server->start();
+    auto hello = server->getServletManager()->addServlet("/hello", server::http::Servlet::ptr(new server::http::Servlet("hello")));
+    hello->setGet([](const server::http::HttpRequest::ptr &req,
+                     const server::http::HttpResponse::ptr &rsp,
+                     const server::http::HttpSession::ptr &session){
+        rsp->setBody("ok");
+        return 0;
+    });
+    auto park = server::Config::Lookup<bool>("http.server.park_idle");
+    const int COUNT = 2000;
+
+    //挂起的连接不占用协程，之后仍然可以继续处理请求
+    park->setVal(true);
+    std::vector<server::Socket::ptr> parked;
+    uint64_t fibers = server::Fiber::TotalFibers();
+    OpenIdle(parked, COUNT, "park");
+    CHECK(server::Fiber::TotalFibers() < fibers + 10);
+    CHECK(server->getIdleCount() == COUNT);
+    int ok = 0;
+    for (auto& i : parked){
+        i->send(GET.c_str(), GET.size());
+        if (Recv(i)){
+            ++ok;
+        }
+    }
+    CHECK(ok == COUNT);
+    //pipeline的请求在缓冲区中，不会挂起
+    std::string three = GET + GET + GET;
+    parked[0]->send(three.c_str(), three.size());
+    CHECK(Recv(parked[0], 3));
+    LOG_INFO(g_logger) << "park qps=" << Bench();
+
+    //不挂起时每个空闲连接占一个协程
+    park->setVal(false);
+    std::vector<server::Socket::ptr> held;
+    fibers = server::Fiber::TotalFibers();
+    OpenIdle(held, COUNT, "hold");
+    CHECK(server::Fiber::TotalFibers() > fibers + COUNT / 2);
+    LOG_INFO(g_logger) << "hold qps=" << Bench();
+
+    parked.clear();
+    held.clear();
+    usleep(200 * 1000);
+    CHECK(server->getIdleCount() == 0);
+
+    //stop时关闭挂起的连接，客户端读到EOF
+    server::http::HttpServer::ptr stopped(new server::http::HttpServer(true));
+    stopped->setServletManager(server->getServletManager());
+    s_addr = server::Address::LookupAnyIPAddress("127.0.0.1:8112");
+    while (!stopped->bind(s_addr)){
+        sleep(1);
+    }
+    stopped->start();
+    park->setVal(true);
+    parked.clear();
+    OpenIdle(parked, 10, "stop");
+    CHECK(stopped->getIdleCount() == 10);
+    stopped->stop();
+    int closed = 0;
+    char c;
+    for (auto& i : parked){
+        if (i->recv(&c, 1) == 0){
+            ++closed;
+        }
+    }
+    CHECK(closed == 10);
+    CHECK(stopped->getIdleCount() == 0);
+    LOG_INFO(g_logger) << "test_park_idle done";
+}
+
+int main(int argc, char **argv){
+    server::IOManager iom(2);
+    iom.scheduler(run);
+    return 0;
+}
@@ -0,0 +1,241 @@
+#include "../server/http/http_server.h"
+#include "../server/http/http_connection.h"
+#include "../server/http/proxy_servlet.h"
+#include "../server/http/servlet.h"
+#include "../server/iomanager.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <algorithm>
+#include <atomic>
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static const int CONCURRENCY = 16;
+static const int REQUESTS = 500;
+
+static server::http::HttpServer::ptr StartServer(const std::string &addr){
+    server::http::HttpServer::ptr server(new server::http::HttpServer(true));
+    while (!server->bind(server::Address::LookupAnyIPAddress(addr))){
+        sleep(1);
+    }
+    server->start();
+    return server;
+}
+
+//上游：/hello返回自己的名字，/big返回chunked的大body，/echo统计请求body的长度，/slow延迟500ms
+static server::http::HttpServer::ptr StartUpstream(const std::string &addr, const std::string &name){
+    server::http::HttpServer::ptr server = StartServer(addr);
+    auto mgr = server->getServletManager();
+    auto hello = mgr->addServlet("/hello", server::http::Servlet::ptr(new server::http::Servlet("hello")));
+    hello->setGet([name](const server::http::HttpRequest::ptr &req,
+                         const server::http::HttpResponse::ptr &rsp,
+                         const server::http::HttpSession::ptr &session){
+        rsp->setHeader("X-Upstream", name);
+        rsp->setHeader("X-Seen-Forwarded-For", req->getHeaderAs<std::string>("X-Forwarded-For"));
+        rsp->setHeader("X-Seen-Private", req->getHeaderAs<std::string>("X-Private"));
+        rsp->setBody("hello from " + name);
+        return 0;
+    });
+    auto big = mgr->addServlet("/big", server::http::Servlet::ptr(new server::http::Servlet("big")));
+    big->setGet([](const server::http::HttpRequest::ptr &req,
+                   const server::http::HttpResponse::ptr &rsp,
+                   const server::http::HttpSession::ptr &session){
+        auto out = session->startStream(rsp);
+        std::string block(64 * 1024, 'x');
+        for (int i = 0; i < 16; ++i){
+            out->writeFixSize(block.c_str(), block.size());
+        }
+        out->close();
+        return 0;
+    });
+    auto echo = mgr->addServlet("/echo", server::http::Servlet::ptr(new server::http::Servlet("echo")));
+    echo->setStreamBody(true);
+    echo->setPost([](const server::http::HttpRequest::ptr &req,
+                     const server::http::HttpResponse::ptr &rsp,
+                     const server::http::HttpSession::ptr &session){
+        char buf[4096];
+        uint64_t total = 0;
+        int rt = 0;
+        while ((rt = session->readBody(buf, sizeof(buf))) > 0){
+            total += rt;
+        }
+        rsp->setHeader("X-Seen-Length", req->getHeaderAs<std::string>("Content-Length"));
+        rsp->setHeader("X-Seen-TE", req->getHeaderAs<std::string>("Transfer-Encoding"));
+        rsp->setBody(std::to_string(total));
+        return 0;
+    });
+    auto slow = mgr->addServlet("/slow", server::http::Servlet::ptr(new server::http::Servlet("slow")));
+    slow->setGet([](const server::http::HttpRequest::ptr &req,
+                    const server::http::HttpResponse::ptr &rsp,
+                    const server::http::HttpSession::ptr &session){
+        usleep(500 * 1000);
+        rsp->setBody("slow");
+        return 0;
+    });
+    return server;
+}
+
+//原始的上游，每个请求都回复在Connection中列出了X-Hop的响应
+static void RawUpstream(server::Socket::ptr sock){
+    while (true){
+        server::Socket::ptr client = sock->accept();
+        if (!client){
+            break;
+        }
+        server::IOManager::GetThis()->scheduler([client](){
+            static const std::string rsp = "HTTP/1.1 200 OK\r\nConnection: keep-alive, X-Hop\r\nX-Hop: 1\r\n"
+                                           "X-End: 1\r\nContent-Length: 2\r\n\r\nok";
+            std::string buf;
+            char tmp[4096];
+            int rt = 0;
+            while ((rt = client->recv(tmp, sizeof(tmp))) > 0){
+                buf.append(tmp, rt);
+                while (buf.find("\r\n\r\n") != std::string::npos){
+                    buf.erase(0, buf.find("\r\n\r\n") + 4);
+                    client->send(rsp.c_str(), rsp.size());
+                }
+            }
+            client->close();
+        });
+    }
+}
+
+//发送原始请求，读到对端关闭为止，返回小写方便比较
+static std::string RawRequest(const std::string &addr, const std::string &data){
+    server::Address::ptr address = server::Address::LookupAnyIPAddress(addr);
+    server::Socket::ptr sock = server::Socket::CreateTCP(address);
+    sock->connect(address);
+    sock->setRecvTimeout(2000);
+    sock->send(data.c_str(), data.size());
+    std::string buf;
+    char tmp[4096];
+    int rt = 0;
+    while ((rt = sock->recv(tmp, sizeof(tmp))) > 0){
+        buf.append(tmp, rt);
+    }
+    std::transform(buf.begin(), buf.end(), buf.begin(), ::tolower);
+    return buf;
+}
+
+static double Bench(const std::string &url){
+    std::atomic<int> done = {0};
+    std::atomic<int> fail = {0};
+    server::Fiber::ptr self = server::Fiber::GetThis();
+    server::Scheduler *scheduler = server::Scheduler::GetThis();
+    uint64_t start = server::GetCurrentUS();
+    for (int i = 0; i < CONCURRENCY; ++i){
+        server::IOManager::GetThis()->scheduler([&, url](){
+            for (int n = 0; n < REQUESTS; ++n){
+                auto r = server::http::HttpConnection::DoGet(url, 1000);
+                if (!r->response || r->response->getStatus() != server::http::HttpStatus::OK){
+                    ++fail;
+                }
+            }
+            if (++done == CONCURRENCY){
+                scheduler->scheduler(self);
+            }
+        });
+    }
+    server::Fiber::YieldToHold();
+    uint64_t us = server::GetCurrentUS() - start;
+    double qps = CONCURRENCY * REQUESTS * 1000000.0 / us;
+    LOG_INFO(g_logger) << url << " qps=" << qps << " avg_us=" << (double)us * CONCURRENCY / (CONCURRENCY * REQUESTS)
+                       << " fail=" << fail;
+    return qps;
+}
+
+void run(){
+    auto up1 = StartUpstream("127.0.0.1:8030", "up1");
+    auto up2 = StartUpstream("127.0.0.1:8031", "up2");
+
+    auto rr_server = StartServer("127.0.0.1:8040");
+    server::http::ProxyServlet::ptr rr(new server::http::ProxyServlet({"127.0.0.1:8030", "127.0.0.1:8031"}));
+    rr->setRequestHeader("X-Proxy", "sewing");
+    rr->setResponseHeader("Server", "sewing-proxy");
+    rr_server->getServletManager()->addGlobServlet("/*", rr);
+
+    auto lc_server = StartServer("127.0.0.1:8041");
+    server::http::ProxyServlet::ptr lc(new server::http::ProxyServlet({"127.0.0.1:8030", "127.0.0.1:8031"}
+                                        , server::http::ProxyServlet::Balance::LEAST_CONN));
+    lc->setTimeout(200);
+    lc->setStripPrefix("/api");
+    lc_server->getServletManager()->addGlobServlet("/api/*", lc);
+
+    //轮询
+    auto r1 = server::http::HttpConnection::DoGet("http://127.0.0.1:8040/hello", 1000);
+    auto r2 = server::http::HttpConnection::DoGet("http://127.0.0.1:8040/hello", 1000);
+    CHECK(r1->response && r2->response);
+    if (r1->response && r2->response){
+        CHECK(r1->response->getHeaderAs<std::string>("X-Upstream") != r2->response->getHeaderAs<std::string>("X-Upstream"));
+        CHECK(r1->response->getHeaderAs<std::string>("Server") == "sewing-proxy");
+        CHECK(r1->response->getHeaderAs<std::string>("X-Seen-Forwarded-For") == "127.0.0.1");
+    }
+
+    //chunked的响应流式转发
+    auto big = server::http::HttpConnection::DoGet("http://127.0.0.1:8040/big", 1000);
+    CHECK(big->response && big->response->getBody().size() == 16 * 64 * 1024);
+
+    //请求body流式转发
+    std::string body(3 * 1024 * 1024, 'b');
+    auto echo = server::http::HttpConnection::DoPost("http://127.0.0.1:8040/echo", 3000, {}, body);
+    CHECK(echo->response && echo->response->getBody() == std::to_string(body.size()));
+
+    //Connection中列出的头部是逐跳的，两个方向都不转发
+    std::string raw = RawRequest("127.0.0.1:8040", "GET /hello HTTP/1.1\r\nHost: a\r\nConnection: close, X-Private\r\n"
+                     "X-Private: secret\r\n\r\n");
+    CHECK(raw.find("x-upstream: ") != std::string::npos);
+    CHECK(raw.find("x-seen-private: \r\n") != std::string::npos || raw.find("x-seen-private") == std::string::npos);
+    CHECK(raw.find("secret") == std::string::npos);
+
+    server::Address::ptr raw_addr = server::Address::LookupAnyIPAddress("127.0.0.1:8112");
+    server::Socket::ptr raw_sock = server::Socket::CreateTCP(raw_addr);
+    CHECK(raw_sock->bind(raw_addr) && raw_sock->listen());
+    server::IOManager::GetThis()->scheduler(std::bind(RawUpstream, raw_sock));
+    auto hop_server = StartServer("127.0.0.1:8113");
+    hop_server->getServletManager()->addGlobServlet("/*", server::http::ProxyServlet::ptr(
+                                                       new server::http::ProxyServlet({"127.0.0.1:8112"})));
+    raw = RawRequest("127.0.0.1:8113", "GET /hop HTTP/1.1\r\nHost: a\r\nConnection: close\r\n\r\n");
+    CHECK(raw.find("x-end: 1\r\n") != std::string::npos);
+    CHECK(raw.find("x-hop") == std::string::npos);
+
+    //转发给上游的body边界按session校验后的结果重新生成
+    raw = RawRequest("127.0.0.1:8040", "POST /echo HTTP/1.1\r\nHost: a\r\nConnection: close\r\n"
+                                 "Content-Length: 005\r\n\r\nhello");
+    CHECK(raw.find("x-seen-length: 5\r\n") != std::string::npos);
+    CHECK(raw.size() > 1 && raw.substr(raw.size() - 1) == "5");
+    raw = RawRequest("127.0.0.1:8040", "POST /echo HTTP/1.1\r\nHost: a\r\nConnection: close\r\n"
+                     "Transfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n3\r\nabc\r\n0\r\n\r\n");
+    CHECK(raw.find("x-seen-te: chunked\r\n") != std::string::npos);
+    CHECK(raw.size() > 1 && raw.substr(raw.size() - 1) == "8");
+
+    //去掉前缀和上游超时
+    auto strip = server::http::HttpConnection::DoGet("http://127.0.0.1:8041/api/hello", 1000);
+    CHECK(strip->response && strip->response->getStatus() == server::http::HttpStatus::OK);
+    uint64_t start = server::GetCurrentMS();
+    auto slow = server::http::HttpConnection::DoGet("http://127.0.0.1:8041/api/slow", 2000);
+    CHECK(slow->response && slow->response->getStatus() == server::http::HttpStatus::GATEWAY_TIMEOUT);
+    LOG_INFO(g_logger) << "upstream timeout used " << server::GetCurrentMS() - start << "ms";
+
+    //上游不可用
+    auto down_server = StartServer("127.0.0.1:8042");
+    down_server->getServletManager()->addGlobServlet("/*", server::http::ProxyServlet::ptr(
+                                                        new server::http::ProxyServlet({"127.0.0.1:8039"})));
+    auto down = server::http::HttpConnection::DoGet("http://127.0.0.1:8042/hello", 1000);
+    CHECK(down->response && down->response->getStatus() == server::http::HttpStatus::BAD_GATEWAY);
+
+    double direct = Bench("http://127.0.0.1:8030/hello");
+    double proxied = Bench("http://127.0.0.1:8040/hello");
+    LOG_INFO(g_logger) << "proxy qps ratio=" << proxied / direct;
+    for (auto& i : rr->getUpstreams()){
+        LOG_INFO(g_logger) << i->host << ":" << i->port << " requests=" << i->requests << " errors=" << i->errors;
+    }
+    LOG_INFO(g_logger) << "test_proxy done";
+}
+
+int main(int argc, char **argv){
+    server::IOManager iom(4);
+    iom.scheduler(run);
+    return 0;
+}
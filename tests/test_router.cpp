@@ -0,0 +1,123 @@
+#include "../server/http/servlet.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <fnmatch.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static const int N = 1000000;
+static const int ROUTES = 300;
+
+void test_match(){
+    server::http::ServletManager::ptr mgr(new server::http::ServletManager);
+    mgr->addServlet("/", server::http::Servlet::ptr(new server::http::Servlet("index")));
+    mgr->addRouteServlet("/user/:id", server::http::Servlet::ptr(new server::http::Servlet("user")));
+    mgr->addRouteServlet("/user/:id/posts/:post", server::http::Servlet::ptr(new server::http::Servlet("post")));
+    mgr->addRouteServlet("/user/admin", server::http::Servlet::ptr(new server::http::Servlet("admin")));
+    mgr->addRouteServlet("/static/*path", server::http::Servlet::ptr(new server::http::Servlet("static")));
+    mgr->addGlobServlet("/server/*", server::http::Servlet::ptr(new server::http::Servlet("glob")));
+    mgr->addGlobServlet("/img/*.png", server::http::Servlet::ptr(new server::http::Servlet("fnmatch")));
+
+    const char *paths[] = {"/", "/user/42", "/user/admin", "/user/42/posts/7", "/user/42/posts",
+                           "/static/css/a.css", "/server/xx/yy", "/img/a.png", "/none"};
+    for (auto p : paths){
+        server::http::HttpRequest::ptr req(new server::http::HttpRequest);
+        req->setPath(p);
+        auto slt = mgr->getMatchedServlet(req);
+        std::stringstream ss;
+        for (auto& i : req->getParames()){
+            ss << " " << i.first << "=" << i.second;
+        }
+        LOG_INFO(g_logger) << p << " -> " << slt->getName() << ss.str();
+    }
+}
+
+static std::string Name(const server::http::ServletManager::ptr &mgr, const std::string &path){
+    return mgr->getMatchedServlet(path)->getName();
+}
+
+//多个glob都匹配时取最先添加的，和原来依次fnmatch的顺序一致，不管是否转换成了前缀树
+void test_glob_order(){
+    server::http::ServletManager::ptr mgr(new server::http::ServletManager);
+    mgr->addGlobServlet("/a/*", server::http::Servlet::ptr(new server::http::Servlet("a")));
+    mgr->addGlobServlet("/a/b/*", server::http::Servlet::ptr(new server::http::Servlet("ab")));
+    mgr->addGlobServlet("/*.css", server::http::Servlet::ptr(new server::http::Servlet("css")));
+    mgr->addGlobServlet("/c/d", server::http::Servlet::ptr(new server::http::Servlet("cd")));
+    mgr->addGlobServlet("/c/*", server::http::Servlet::ptr(new server::http::Servlet("c")));
+    mgr->addServlet("/a/b/exact", server::http::Servlet::ptr(new server::http::Servlet("exact")));
+    CHECK(Name(mgr, "/a/b/c") == "a");
+    CHECK(Name(mgr, "/a/x.css") == "a");
+    CHECK(Name(mgr, "/x/y.css") == "css");
+    CHECK(Name(mgr, "/c/d") == "cd");
+    CHECK(Name(mgr, "/c/d/e") == "c");
+    CHECK(Name(mgr, "/c/x.css") == "css");
+    //精准匹配优先于glob
+    CHECK(Name(mgr, "/a/b/exact") == "exact");
+    //重新添加的glob排到最后
+    mgr->addGlobServlet("/a/*", server::http::Servlet::ptr(new server::http::Servlet("a2")));
+    CHECK(Name(mgr, "/a/b/c") == "ab");
+    CHECK(Name(mgr, "/a/c") == "a2");
+    CHECK(mgr->getGlobServlet("/a/b/c")->getName() == "ab");
+    mgr->delGlobServlet("/a/b/*");
+    CHECK(Name(mgr, "/a/b/c") == "a2");
+}
+
+//同一个线程交替使用多个manager，各自的快照互不影响
+void test_multi_manager(){
+    server::http::ServletManager::ptr m1(new server::http::ServletManager);
+    server::http::ServletManager::ptr m2(new server::http::ServletManager);
+    m1->addServlet("/x", server::http::Servlet::ptr(new server::http::Servlet("m1")));
+    m2->addServlet("/x", server::http::Servlet::ptr(new server::http::Servlet("m2")));
+    for (int i = 0; i < 3; ++i){
+        CHECK(Name(m1, "/x") == "m1");
+        CHECK(Name(m2, "/x") == "m2");
+    }
+    m1->addServlet("/y", server::http::Servlet::ptr(new server::http::Servlet("m1y")));
+    CHECK(Name(m1, "/y") == "m1y");
+    CHECK(Name(m2, "/y") != "m1y");
+    CHECK(Name(m2, "/x") == "m2");
+}
+
+void bench_match(){
+    server::http::ServletManager::ptr mgr(new server::http::ServletManager);
+    std::vector<std::string> globs;
+    for (int i = 0; i < ROUTES; ++i){
+        globs.push_back("/api/v1/module" + std::to_string(i) + "/*");
+        mgr->addGlobServlet(globs.back(), server::http::Servlet::ptr(new server::http::Servlet("m" + std::to_string(i))));
+    }
+    std::string path = "/api/v1/module" + std::to_string(ROUTES - 1) + "/users/1024";
+
+    //原来的实现：依次fnmatch
+    uint64_t start = server::GetCurrentUS();
+    size_t found = 0;
+    for (int i = 0; i < N / 100; ++i){
+        for (auto& g : globs){
+            if (!fnmatch(g.c_str(), path.c_str(), 0)){
+                ++found;
+                break;
+            }
+        }
+    }
+    uint64_t us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "fnmatch scan: ns/lookup=" << us * 1000.0 / (N / 100) << " found=" << found;
+
+    start = server::GetCurrentUS();
+    found = 0;
+    for (int i = 0; i < N; ++i){
+        if (mgr->getMatchedServlet(path)){
+            ++found;
+        }
+    }
+    us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "radix router: ns/lookup=" << us * 1000.0 / N << " found=" << found;
+}
+
+int main(){
+    test_match();
+    test_glob_order();
+    test_multi_manager();
+    bench_match();
+    LOG_INFO(g_logger) << "test_router done";
+    return 0;
+}
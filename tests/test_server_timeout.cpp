@@ -0,0 +1,162 @@
+#include "../server/http/http_server.h"
+#include "../server/config.h"
+#include "../server/iomanager.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static server::Address::ptr s_addr;
+
+static server::Socket::ptr Connect(){
+    server::Socket::ptr sock = server::Socket::CreateTCP(s_addr);
+    sock->connect(s_addr);
+    sock->setRecvTimeout(5000);
+    return sock;
+}
+
+static void Send(server::Socket::ptr sock, const std::string &data){
+    sock->send(data.c_str(), data.size());
+}
+
+//读到一个完整的响应（没有body），连接关闭时返回空
+static std::string Recv(server::Socket::ptr sock){
+    std::string buf;
+    char tmp[4096];
+    while (buf.find("\r\n\r\n") == std::string::npos){
+        int rt = sock->recv(tmp, sizeof(tmp));
+        if (rt <= 0){
+            return "";
+        }
+        buf.append(tmp, rt);
+    }
+    return buf;
+}
+
+//等待服务端关闭连接，返回等待的时间(ms)
+static uint64_t WaitClose(server::Socket::ptr sock){
+    uint64_t start = server::GetCurrentMS();
+    char tmp[4096];
+    while (sock->recv(tmp, sizeof(tmp)) > 0){
+    }
+    return server::GetCurrentMS() - start;
+}
+
+static const std::string GET = "GET /hello HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+template<class T>
+static void SetConfig(const std::string &name, T v){
+    server::Config::Lookup<T>(name)->setVal(v);
+}
+
+void run(){
+    SetConfig<uint64_t>("http.server.header_timeout", 300);
+    SetConfig<uint64_t>("http.server.body_timeout", 300);
+    SetConfig<uint64_t>("http.server.idle_timeout", 600);
+    SetConfig<uint64_t>("http.server.request_timeout", 1500);
+    SetConfig<uint64_t>("http.server.busy_idle_timeout", 100);
+    SetConfig<uint32_t>("http.server.max_requests", 3);
+
+    s_addr = server::Address::LookupAnyIPAddress("127.0.0.1:8080");
+    server::http::HttpServer::ptr server(new server::http::HttpServer(true));
+    while (!server->bind(s_addr)){
+        sleep(1);
+    }
+    server->start();
+    auto mgr = server->getServletManager();
+    auto hello = mgr->addServlet("/hello", server::http::Servlet::ptr(new server::http::Servlet("hello")));
+    hello->setGet([](const server::http::HttpRequest::ptr &req,
+                  const server::http::HttpResponse::ptr &rsp,
+                  const server::http::HttpSession::ptr &session){
+        return 0;
+    });
+    auto slow = mgr->addServlet("/slow", server::http::Servlet::ptr(new server::http::Servlet("slow")));
+    slow->setGet([](const server::http::HttpRequest::ptr &req,
+                  const server::http::HttpResponse::ptr &rsp,
+                  const server::http::HttpSession::ptr &session){
+        sleep(3);
+        return 0;
+    });
+
+    //连上之后不发请求，按header超时断开
+    auto sock = Connect();
+    uint64_t ms = WaitClose(sock);
+    CHECK(ms >= 250 && ms < 500);
+    LOG_INFO(g_logger) << "no request closed after " << ms << "ms";
+
+    //长连接空闲超时和header超时分开计算
+    sock = Connect();
+    Send(sock, GET);
+    CHECK(Recv(sock).find("HTTP/1.1 200") == 0);
+    ms = WaitClose(sock);
+    CHECK(ms >= 550 && ms < 900);
+    LOG_INFO(g_logger) << "idle closed after " << ms << "ms";
+
+    //header一直在慢慢发送，每次read都没有超时，整个header的期限到了就断开
+    sock = Connect();
+    Send(sock, "GET /hello HTTP/1.1\r\n");
+    server::IOManager::GetThis()->scheduler([sock](){
+        for (int i = 0; i < 20; ++i){
+            usleep(50 * 1000);
+            Send(sock, "X");
+        }
+    });
+    ms = WaitClose(sock);
+    CHECK(ms >= 250 && ms < 600);
+    LOG_INFO(g_logger) << "slow header closed after " << ms << "ms";
+
+    //body停顿超过body_timeout
+    sock = Connect();
+    Send(sock, "POST /hello HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 100\r\n\r\n0123456789");
+    ms = WaitClose(sock);
+    CHECK(ms >= 250 && ms < 600);
+    LOG_INFO(g_logger) << "body stall closed after " << ms << "ms";
+
+    //整个请求超过request_timeout
+    sock = Connect();
+    Send(sock, "GET /slow HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ms = WaitClose(sock);
+    CHECK(ms >= 1400 && ms < 2500);
+    LOG_INFO(g_logger) << "slow servlet closed after " << ms << "ms";
+
+    //每个连接最多3个请求，第3个响应带connection: close
+    sock = Connect();
+    for (int i = 0; i < 3; ++i){
+        Send(sock, GET);
+        std::string rsp = Recv(sock);
+        CHECK(rsp.find("HTTP/1.1 200") == 0);
+        CHECK((rsp.find("connection: close") != std::string::npos) == (i == 2));
+    }
+    CHECK(WaitClose(sock) < 100);
+
+    //空闲连接超过max_idle时使用busy_idle_timeout
+    std::vector<server::Socket::ptr> socks;
+    for (int i = 0; i < 10; ++i){
+        socks.push_back(Connect());
+        Send(socks.back(), GET);
+        CHECK(Recv(socks.back()).find("HTTP/1.1 200") == 0);
+    }
+    usleep(50 * 1000);
+    CHECK(server->getIdleCount() == 10);
+    SetConfig<uint32_t>("http.server.max_idle", 5);
+    auto busy = Connect();
+    Send(busy, GET);
+    CHECK(Recv(busy).find("HTTP/1.1 200") == 0);
+    ms = WaitClose(busy);
+    CHECK(ms < 300);
+    LOG_INFO(g_logger) << "busy idle closed after " << ms << "ms";
+    for (auto& i : socks){
+        WaitClose(i);
+    }
+    usleep(100 * 1000);
+    CHECK(server->getIdleCount() == 0);
+    LOG_INFO(g_logger) << "test_server_timeout done";
+}
+
+int main(int argc, char **argv){
+    server::IOManager iom(2);
+    iom.scheduler(run);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "../server/http/servlet.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+//统计堆分配次数
+static std::atomic<uint64_t> s_allocs = {0};
+
+void *operator new(size_t size){
+    ++s_allocs;
+    void *p = malloc(size);
+    if (!p){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept{
+    free(p);
+}
+
+static const int N = 5000000;
+
+//原来的调用方式：shared_ptr按值传递，经过switch和std::function两层
+class LegacyServlet{
+public:
+    typedef std::function<int32_t(server::http::HttpRequest::ptr, server::http::HttpResponse::ptr, server::http::HttpSession::ptr)> doFunction;
+
+    int32_t handle(server::http::HttpRequest::ptr request,
+                   server::http::HttpResponse::ptr response,
+                   server::http::HttpSession::ptr session){
+        switch (request->getMethod())
+        {
+        case server::http::HttpMethod::GET:
+            return m_doGet(request, response, session);
+        case server::http::HttpMethod::POST:
+            return m_doPost(request, response, session);
+        default:
+            return m_default(request, response, session);
+        }
+    }
+
+    doFunction m_doGet;
+    doFunction m_doPost;
+    doFunction m_default;
+};
+
+static int32_t LegacyManagerHandle(LegacyServlet &slt,
+                                   server::http::HttpRequest::ptr request,
+                                   server::http::HttpResponse::ptr response,
+                                   server::http::HttpSession::ptr session){
+    return slt.handle(request, response, session);
+}
+
+int main(){
+    server::http::HttpRequest::ptr req(new server::http::HttpRequest);
+    server::http::HttpResponse::ptr rsp(new server::http::HttpResponse);
+    server::http::HttpSession::ptr session;
+    req->setPath("/api/users");
+    volatile int sink = 0;
+
+    LegacyServlet legacy;
+    legacy.m_doGet = [&](server::http::HttpRequest::ptr, server::http::HttpResponse::ptr, server::http::HttpSession::ptr){
+        return ++sink;
+    };
+    legacy.m_doPost = legacy.m_doGet;
+    legacy.m_default = legacy.m_doGet;
+
+    uint64_t allocs = s_allocs;
+    uint64_t start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        LegacyManagerHandle(legacy, req, rsp, session);
+    }
+    uint64_t us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "legacy dispatch: ns/request=" << us * 1000.0 / N
+                       << " allocs/request=" << (double)(s_allocs - allocs) / N;
+
+    server::http::ServletManager::ptr mgr(new server::http::ServletManager);
+    server::http::Servlet::ptr slt(new server::http::Servlet("api"));
+    auto fun = [&](const server::http::HttpRequest::ptr &, const server::http::HttpResponse::ptr &, const server::http::HttpSession::ptr &){
+        return ++sink;
+    };
+    slt->setGet(fun);
+    slt->setPost(fun);
+    slt->setHandler(server::http::HttpMethod::PROPFIND, fun);
+    mgr->addServlet("/api/users", slt);
+
+    allocs = s_allocs;
+    start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        slt->handle(req, rsp, session);
+    }
+    us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "table dispatch: ns/request=" << us * 1000.0 / N
+                       << " allocs/request=" << (double)(s_allocs - allocs) / N;
+
+    allocs = s_allocs;
+    start = server::GetCurrentUS();
+    for (int i = 0; i < N; ++i){
+        mgr->handle(req, rsp, session);
+    }
+    us = server::GetCurrentUS() - start;
+    LOG_INFO(g_logger) << "ServletManager::handle (match + dispatch): ns/request=" << us * 1000.0 / N
+                       << " allocs/request=" << (double)(s_allocs - allocs) / N;
+    return 0;
+}
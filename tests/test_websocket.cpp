@@ -0,0 +1,219 @@
+#include "../server/http/http_server.h"
+#include "../server/http/http_connection.h"
+#include "../server/http/ws_servlet.h"
+#include "../server/iomanager.h"
+#include "../server/log.h"
+#include "../server/util.h"
+#include "test_check.h"
+#include <atomic>
+#include <unistd.h>
+
+static server::Logger::ptr g_logger = LOG_ROOT();
+
+static const std::string URL = "ws://127.0.0.1:8050";
+
+static server::http::WSSession::ptr Connect(const std::string &path){
+    auto r = server::http::WSSession::Connect(URL + path, 1000);
+    if (!r.second){
+        LOG_ERROR(g_logger) << "connect " << path << " fail: " << r.first->error;
+    }
+    return r.second;
+}
+
+void run(){
+    server::http::HttpServer::ptr server(new server::http::HttpServer(true));
+    while (!server->bind(server::Address::LookupAnyIPAddress("127.0.0.1:8050"))){
+        sleep(1);
+    }
+    server->start();
+    auto mgr = server->getServletManager();
+
+    //原样返回
+    server::http::WSServlet::ptr echo(new server::http::WSServlet("echo"));
+    echo->setOnMessage([](const server::http::HttpRequest::ptr &req, const server::http::WSFrameMessage::ptr &msg
+                          , const server::http::WSSession::ptr &ws){
+        if (msg->getData() == "bye"){
+            return 1;
+        }
+        ws->sendMessage(msg);
+        return 0;
+    });
+    mgr->addServlet("/echo", echo);
+
+    //连接后由另一个协程推送
+    server::http::WSServlet::ptr push(new server::http::WSServlet("push"));
+    push->setOnConnect([](const server::http::HttpRequest::ptr &req, const server::http::WSSession::ptr &ws){
+        server::IOManager::GetThis()->scheduler([ws](){
+            for (int i = 0; i < 100; ++i){
+                ws->sendMessage(std::to_string(i));
+            }
+            ws->sendClose(server::http::WSSession::NORMAL, "done");
+        });
+        return 0;
+    });
+    mgr->addServlet("/push", push);
+
+    //ping间隔很短，用来测试keepalive
+    server::http::WSServlet::ptr alive(new server::http::WSServlet("alive"));
+    alive->setPingInterval(100);
+    alive->setOnMessage([](const server::http::HttpRequest::ptr &req, const server::http::WSFrameMessage::ptr &msg
+                           , const server::http::WSSession::ptr &ws){
+        ws->sendMessage(msg);
+        return 0;
+    });
+    mgr->addServlet("/alive", alive);
+
+    //普通请求不能升级
+    auto plain = server::http::HttpConnection::DoGet("http://127.0.0.1:8050/echo", 1000);
+    CHECK(plain->response && plain->response->getStatus() == server::http::HttpStatus::UPGRADE_REQUIRED);
+
+    //文本和分片的大消息
+    auto ws = Connect("/echo");
+    CHECK(ws);
+    if (ws){
+        ws->sendMessage("hello");
+        auto msg = ws->recvMessage();
+        CHECK(msg && msg->getOpcode() == server::http::WSFrameMessage::TEXT_FRAME && msg->getData() == "hello");
+        std::string big(1024 * 1024 + 7, 0);
+        for (size_t i = 0; i < big.size(); ++i){
+            big[i] = (char)(i * 31);
+        }
+        ws->sendMessage(big, server::http::WSFrameMessage::BIN_FRAME);
+        msg = ws->recvMessage();
+        CHECK(msg && msg->getOpcode() == server::http::WSFrameMessage::BIN_FRAME && msg->getData() == big);
+
+        //多个协程同时发送，消息不能交错
+        const int FIBERS = 8;
+        const int COUNT = 100;
+        for (int f = 0; f < FIBERS; ++f){
+            server::IOManager::GetThis()->scheduler([ws, f](){
+                for (int i = 0; i < COUNT; ++i){
+                    ws->sendMessage(std::string(1000 + f, 'a' + f));
+                }
+            });
+        }
+        int ok = 0;
+        for (int i = 0; i < FIBERS * COUNT; ++i){
+            msg = ws->recvMessage();
+            if (!msg){
+                break;
+            }
+            size_t f = msg->getData().size() - 1000;
+            if (f < FIBERS && msg->getData() == std::string(1000 + f, 'a' + f)){
+                ++ok;
+            }
+        }
+        CHECK(ok == FIBERS * COUNT);
+
+        //服务端主动关闭
+        ws->sendMessage("bye");
+        CHECK(!ws->recvMessage() && ws->getCloseCode() == server::http::WSSession::NORMAL);
+    }
+
+    //64位长度的最高位被置位，或者单帧超过http.ws.max_message_size，读payload之前就拒绝
+    const char *heads[] = {"\x82\xff\xff\xff\xff\xff\xff\xff\xff\xfb", "\x82\xff\x7f\xff\xff\xff\xff\xff\xff\xff"};
+    const uint16_t codes[] = {server::http::WSSession::PROTOCOL_ERROR, server::http::WSSession::TOO_BIG};
+    for (int i = 0; i < 2; ++i){
+        ws = Connect("/echo");
+        CHECK(ws);
+        if (ws){
+            //先发一个没有结束的分片，再发长度异常的帧
+            std::string frame("\x02\x85\x00\x00\x00\x00hello", 11);
+            frame.append(heads[i], 10);
+            frame.append(4, '\0');
+            ws->writeFixSize(frame.c_str(), frame.size());
+            CHECK(!ws->recvMessage() && ws->getCloseCode() == codes[i]);
+        }
+    }
+
+    //关闭码和TEXT消息的校验，非法的关闭码不会被原样回复
+    struct BadFrame{
+        std::string frame;
+        uint16_t code;
+    };
+    const BadFrame frames[] = {
+        {std::string("\x88\x82\x00\x00\x00\x00\x03\xed", 8), server::http::WSSession::PROTOCOL_ERROR},
+        {std::string("\x88\x82\x00\x00\x00\x00\x03\xf7", 8), server::http::WSSession::PROTOCOL_ERROR},
+        {std::string("\x88\x82\x00\x00\x00\x00\x03\xe7", 8), server::http::WSSession::PROTOCOL_ERROR},
+        {std::string("\x88\x81\x00\x00\x00\x00\x03", 7), server::http::WSSession::PROTOCOL_ERROR},
+        {std::string("\x88\x84\x00\x00\x00\x00\x03\xe8\xc3\x28", 10), server::http::WSSession::PROTOCOL_ERROR},
+        {std::string("\x88\x82\x00\x00\x00\x00\x0b\xb8", 8), 3000},
+        {std::string("\x81\x82\x00\x00\x00\x00\xc3\x28", 8), server::http::WSSession::INVALID_PAYLOAD},
+        {std::string("\x81\x83\x00\x00\x00\x00\xed\xa0\x80", 9), server::http::WSSession::INVALID_PAYLOAD},
+        //分片中间断开的多字节字符在消息完整后仍然合法
+        {std::string("\x01\x81\x00\x00\x00\x00\xc3\x80\x81\x00\x00\x00\x00\xa9"
+                     "\x88\x82\x00\x00\x00\x00\x03\xe8", 22), server::http::WSSession::NORMAL},
+    };
+    for (auto& i : frames){
+        ws = Connect("/echo");
+        CHECK(ws);
+        if (ws){
+            ws->writeFixSize(i.frame.c_str(), i.frame.size());
+            while (ws->recvMessage()){
+            }
+            CHECK(ws->getCloseCode() == i.code);
+        }
+    }
+
+    //推送
+    ws = Connect("/push");
+    CHECK(ws);
+    if (ws){
+        int n = 0;
+        while (auto msg = ws->recvMessage()){
+            CHECK(msg->getData() == std::to_string(n));
+            ++n;
+        }
+        CHECK(n == 100 && ws->getCloseCode() == server::http::WSSession::NORMAL && ws->getCloseReason() == "done");
+    }
+
+    //一直在读的客户端会自动回复pong，连接保持
+    ws = Connect("/alive");
+    CHECK(ws);
+    if (ws){
+        server::IOManager::GetThis()->scheduler([ws](){
+            usleep(500 * 1000);
+            ws->sendMessage("still here");
+        });
+        auto msg = ws->recvMessage();
+        CHECK(msg && msg->getData() == "still here");
+        ws->sendClose();
+        CHECK(!ws->recvMessage());
+    }
+    //不读的客户端收不到ping，也就不回复pong，超过两个周期后被断开
+    ws = Connect("/alive");
+    CHECK(ws);
+    if (ws){
+        uint64_t start = server::GetCurrentMS();
+        usleep(500 * 1000);
+        while (ws->recvMessage()){
+        }
+        CHECK(ws->getCloseCode() == server::http::WSSession::ABNORMAL);
+        LOG_INFO(g_logger) << "keepalive drop after " << server::GetCurrentMS() - start << "ms";
+    }
+
+    //往返的延迟
+    ws = Connect("/echo");
+    if (ws){
+        const int ROUNDS = 10000;
+        std::string data(64, 'x');
+        uint64_t start = server::GetCurrentUS();
+        for (int i = 0; i < ROUNDS; ++i){
+            ws->sendMessage(data);
+            if (!ws->recvMessage()){
+                break;
+            }
+        }
+        uint64_t us = server::GetCurrentUS() - start;
+        LOG_INFO(g_logger) << "echo rounds=" << ROUNDS << " avg_us=" << (double)us / ROUNDS
+                           << " qps=" << ROUNDS * 1000000.0 / us;
+        ws->sendClose();
+    }
+    LOG_INFO(g_logger) << "test_websocket done";
+}
+
+int main(int argc, char **argv){
+    server::IOManager iom(2);
+    iom.scheduler(run);
+    return 0;
+}